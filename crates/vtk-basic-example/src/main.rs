@@ -13,6 +13,8 @@ fn main() {
         let fragment_shader = device.create_shader(fragment_shader_bytes);
 
         loop {
+            // Render only when the compositor will show the frame.
+            window.wait_for_frame(None);
             window.render();
         }
     });
@@ -0,0 +1,22 @@
+fn main() {
+    let crate_dir = std::env::var("CARGO_MANIFEST_DIR").unwrap();
+    let out_dir = std::env::var("OUT_DIR").unwrap();
+
+    let mut out_path = std::path::PathBuf::from(&out_dir);
+    out_path.push("shaders");
+
+    std::fs::create_dir_all(&out_path).unwrap();
+
+    for shader in ["bench.vert", "bench.frag", "draw.vert"] {
+        let in_file = format!("{}/shaders/{}", crate_dir, shader);
+        let out_file = format!("{}/{}.spv", out_path.display(), shader);
+        println!("cargo:rerun-if-changed={}", in_file);
+
+        let status = std::process::Command::new("glslc")
+            .args(["--target-env=vulkan1.3", "-o", &out_file, &in_file])
+            .status()
+            .expect("Couldn't launch glslc");
+
+        assert!(status.success(), "Failed running glslc to compile shaders");
+    }
+}
@@ -0,0 +1,8 @@
+#version 450
+
+layout (location = 0) in vec4 fragColor;
+layout (location = 0) out vec4 uFragColor;
+
+void main() {
+   uFragColor = fragColor;
+}
@@ -0,0 +1,14 @@
+#version 450
+
+layout (set = 0, binding = 0) uniform DrawUniforms {
+    mat4 model_view_projection;
+    vec4 color;
+} draw;
+
+layout (location = 0) in vec3 pos;
+layout (location = 0) out vec4 fragColor;
+
+void main() {
+   gl_Position = draw.model_view_projection * vec4(pos, 1.0);
+   fragColor = draw.color;
+}
@@ -0,0 +1,115 @@
+//! Minimal JSON values, enough to write benchmark results without pulling in dependencies.
+
+use std::fmt::{self, Write};
+
+pub enum Json {
+    Null,
+    Bool(bool),
+    Number(f64),
+    String(String),
+    Array(Vec<Json>),
+    Object(Vec<(&'static str, Json)>),
+}
+
+impl Json {
+    pub fn object<const N: usize>(fields: [(&'static str, Json); N]) -> Self {
+        Json::Object(fields.into())
+    }
+
+    fn write(&self, out: &mut impl Write, indent: usize) -> fmt::Result {
+        match self {
+            Json::Null => out.write_str("null"),
+            Json::Bool(value) => write!(out, "{value}"),
+            // JSON has no representation of infinities or NaN.
+            Json::Number(value) if !value.is_finite() => out.write_str("null"),
+            Json::Number(value) => write!(out, "{value}"),
+            Json::String(value) => write_string(out, value),
+            Json::Array(values) if values.is_empty() => out.write_str("[]"),
+            Json::Array(values) => {
+                out.write_str("[\n")?;
+                for (i, value) in values.iter().enumerate() {
+                    write!(out, "{:1$}", "", indent + 2)?;
+                    value.write(out, indent + 2)?;
+                    out.write_str(if i + 1 < values.len() { ",\n" } else { "\n" })?;
+                }
+                write!(out, "{:1$}]", "", indent)
+            }
+            Json::Object(fields) if fields.is_empty() => out.write_str("{}"),
+            Json::Object(fields) => {
+                out.write_str("{\n")?;
+                for (i, (name, value)) in fields.iter().enumerate() {
+                    write!(out, "{:1$}", "", indent + 2)?;
+                    write_string(out, name)?;
+                    out.write_str(": ")?;
+                    value.write(out, indent + 2)?;
+                    out.write_str(if i + 1 < fields.len() { ",\n" } else { "\n" })?;
+                }
+                write!(out, "{:1$}}}", "", indent)
+            }
+        }
+    }
+}
+
+fn write_string(out: &mut impl Write, value: &str) -> fmt::Result {
+    out.write_char('"')?;
+    for c in value.chars() {
+        match c {
+            '"' => out.write_str("\\\"")?,
+            '\\' => out.write_str("\\\\")?,
+            '\n' => out.write_str("\\n")?,
+            '\r' => out.write_str("\\r")?,
+            '\t' => out.write_str("\\t")?,
+            c if u32::from(c) < 0x20 => write!(out, "\\u{:04x}", u32::from(c))?,
+            c => out.write_char(c)?,
+        }
+    }
+    out.write_char('"')
+}
+
+impl fmt::Display for Json {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        self.write(f, 0)
+    }
+}
+
+impl From<f64> for Json {
+    fn from(value: f64) -> Self {
+        Json::Number(value)
+    }
+}
+
+impl From<u64> for Json {
+    fn from(value: u64) -> Self {
+        Json::Number(value as f64)
+    }
+}
+
+impl From<u32> for Json {
+    fn from(value: u32) -> Self {
+        Json::Number(f64::from(value))
+    }
+}
+
+impl From<usize> for Json {
+    fn from(value: usize) -> Self {
+        Json::Number(value as f64)
+    }
+}
+
+impl From<&str> for Json {
+    fn from(value: &str) -> Self {
+        Json::String(value.to_string())
+    }
+}
+
+impl From<String> for Json {
+    fn from(value: String) -> Self {
+        Json::String(value)
+    }
+}
+
+impl<T: Into<Json>> From<Option<T>> for Json {
+    fn from(value: Option<T>) -> Self {
+        value.map_or(Json::Null, Into::into)
+    }
+}
@@ -0,0 +1,459 @@
+//! Benchmarks of the vtk hot paths, rendering headless so that they run on any Linux machine -
+//! including CI machines using the lavapipe software rasterizer. Results are written as JSON, so
+//! that regressions can be tracked over time.
+//!
+//! Headless rendering needs `VK_EXT_headless_surface`, which vtk only uses on Linux - elsewhere the
+//! benchmarks are built but not run.
+#![cfg_attr(not(target_os = "linux"), allow(dead_code, unused_imports))]
+
+mod json;
+
+use json::Json;
+use std::time::{Duration, Instant, SystemTime};
+use vtk::{
+    VtkDevice, VtkFrame, VtkFramePhase, VtkGraphicsPipelineDesc, VtkPresentMode, VtkRecorder,
+    VtkVertexAttribute, VtkVertexFormat, VtkWindow,
+};
+
+/// Bumped when the structure of the results changes incompatibly.
+const SCHEMA_VERSION: u32 = 1;
+
+struct Options {
+    /// Frames rendered per measured configuration.
+    frames: usize,
+    output: Option<std::path::PathBuf>,
+}
+
+impl Options {
+    fn parse() -> Self {
+        let mut options = Options {
+            frames: 600,
+            output: None,
+        };
+        let mut args = std::env::args().skip(1);
+        while let Some(arg) = args.next() {
+            match arg.as_str() {
+                "--frames" => {
+                    options.frames = args
+                        .next()
+                        .and_then(|value| value.parse().ok())
+                        .filter(|&frames| frames > 0)
+                        .unwrap_or_else(|| usage("--frames needs a positive number"));
+                }
+                "--output" => {
+                    options.output = Some(
+                        args.next()
+                            .unwrap_or_else(|| usage("--output needs a file name"))
+                            .into(),
+                    );
+                }
+                "--help" | "-h" => usage(""),
+                _ => usage(&format!("unknown argument '{arg}'")),
+            }
+        }
+        options
+    }
+}
+
+fn usage(error: &str) -> ! {
+    if !error.is_empty() {
+        eprintln!("vtk-bench: {error}");
+    }
+    eprintln!("usage: vtk-bench [--frames <count>] [--output <file.json>]");
+    std::process::exit(if error.is_empty() { 0 } else { 2 })
+}
+
+fn millis(duration: Duration) -> Json {
+    Json::Number(duration.as_secs_f64() * 1000.0)
+}
+
+/// Distribution statistics of the samples, in milliseconds.
+fn distribution(samples: &mut [Duration]) -> Json {
+    if samples.is_empty() {
+        return Json::Null;
+    }
+    samples.sort_unstable();
+    // Nearest rank percentiles.
+    let percentile = |p: usize| samples[(samples.len() * p).div_ceil(100).max(1) - 1];
+    let total: Duration = samples.iter().sum();
+    Json::object([
+        ("min_ms", millis(samples[0])),
+        ("avg_ms", millis(total / samples.len() as u32)),
+        ("p50_ms", millis(percentile(50))),
+        ("p90_ms", millis(percentile(90))),
+        ("p99_ms", millis(percentile(99))),
+        ("max_ms", millis(samples[samples.len() - 1])),
+    ])
+}
+
+fn present_mode_name(present_mode: VtkPresentMode) -> &'static str {
+    match present_mode {
+        VtkPresentMode::Fifo => "fifo",
+        VtkPresentMode::FifoRelaxed => "fifo_relaxed",
+        VtkPresentMode::Mailbox => "mailbox",
+        VtkPresentMode::Immediate => "immediate",
+    }
+}
+
+fn phase_name(phase: VtkFramePhase) -> &'static str {
+    match phase {
+        VtkFramePhase::FenceWait => "fence_wait",
+        VtkFramePhase::Acquire => "acquire",
+        VtkFramePhase::Reset => "reset",
+        VtkFramePhase::Record => "record",
+        VtkFramePhase::Submit => "submit",
+        VtkFramePhase::Present => "present",
+        VtkFramePhase::Recreate => "recreate",
+    }
+}
+
+/// Timings of rendered frames.
+struct FrameSamples {
+    frame_times: Vec<Duration>,
+    gpu_times: Vec<Duration>,
+    elapsed: Duration,
+}
+
+/// Render frames, timing each from beginning to ending it and collecting the GPU time of the
+/// frames. `prepare` is called with each frame before it is ended.
+fn render_frames(
+    window: &mut VtkWindow,
+    frames: usize,
+    mut prepare: impl FnMut(&VtkFrame),
+) -> FrameSamples {
+    let mut samples = FrameSamples {
+        frame_times: Vec::with_capacity(frames),
+        gpu_times: Vec::with_capacity(frames),
+        elapsed: Duration::ZERO,
+    };
+    let mut last_gpu_frame = 0;
+    let start = Instant::now();
+    for _ in 0..frames {
+        let frame_start = Instant::now();
+        let frame = window.begin_frame();
+        prepare(&frame);
+        frame.end();
+        samples.frame_times.push(frame_start.elapsed());
+
+        if let Some(timings) = window.gpu_frame_timings() {
+            if timings.frame_number != last_gpu_frame {
+                last_gpu_frame = timings.frame_number;
+                samples.gpu_times.push(timings.gpu_time());
+            }
+        }
+    }
+    samples.elapsed = start.elapsed();
+    samples
+}
+
+fn render_results(window: &VtkWindow, mut samples: FrameSamples) -> Vec<(&'static str, Json)> {
+    let frame_stats = window.frame_stats();
+    let phases = VtkFramePhase::ALL
+        .iter()
+        .map(|&phase| {
+            let stats = frame_stats.phase(phase);
+            (
+                phase_name(phase),
+                Json::object([
+                    ("avg_ms", millis(stats.avg)),
+                    ("p50_ms", millis(stats.p50)),
+                    ("p99_ms", millis(stats.p99)),
+                ]),
+            )
+        })
+        .collect();
+    vec![
+        ("frames", samples.frame_times.len().into()),
+        (
+            "fps",
+            (samples.frame_times.len() as f64 / samples.elapsed.as_secs_f64()).into(),
+        ),
+        ("frame_time", distribution(&mut samples.frame_times)),
+        ("cpu_phases", Json::Object(phases)),
+        ("gpu_time", distribution(&mut samples.gpu_times)),
+    ]
+}
+
+/// Frame rate and frame times for each present mode and number of frames in flight.
+fn bench_render(window: &mut VtkWindow, options: &Options) -> Json {
+    let mut results = Vec::new();
+    for present_mode in [
+        VtkPresentMode::Fifo,
+        VtkPresentMode::Mailbox,
+        VtkPresentMode::Immediate,
+    ] {
+        for frames_in_flight in 1..=3 {
+            window.set_frames_in_flight(frames_in_flight);
+            let config = window.configure_swap_chain(present_mode, 0);
+            // Warm up, and flush timings of earlier configurations out of the frame statistics.
+            render_frames(window, vtk::VTK_FRAME_TIMING_HISTORY as usize, |_| {});
+            let samples = render_frames(window, options.frames, |_| {});
+
+            let mut result = vec![
+                ("present_mode", present_mode_name(present_mode).into()),
+                (
+                    "actual_present_mode",
+                    present_mode_name(config.present_mode).into(),
+                ),
+                (
+                    "present_mode_supported",
+                    Json::Bool(config.present_mode == present_mode),
+                ),
+                ("frames_in_flight", frames_in_flight.into()),
+                ("swap_chain_images", config.image_count.into()),
+            ];
+            result.extend(render_results(window, samples));
+            results.push(Json::Object(result));
+        }
+    }
+    window.set_frames_in_flight(vtk::VTK_DEFAULT_FRAMES_IN_FLIGHT);
+    window.configure_swap_chain(VtkPresentMode::Fifo, 0);
+    Json::Array(results)
+}
+
+/// Latency of recreating the swap chain, alternating between present modes.
+fn bench_swap_chain_recreation(window: &mut VtkWindow) -> Json {
+    const ITERATIONS: usize = 100;
+    let mut latencies = Vec::with_capacity(ITERATIONS);
+    for i in 0..ITERATIONS {
+        let present_mode = if i % 2 == 0 {
+            VtkPresentMode::Immediate
+        } else {
+            VtkPresentMode::Fifo
+        };
+        let start = Instant::now();
+        window.configure_swap_chain(present_mode, 0);
+        latencies.push(start.elapsed());
+        // Let retired swap chains be destroyed as frames finish, as they would be in practice.
+        window.render();
+    }
+    Json::object([
+        ("iterations", ITERATIONS.into()),
+        ("latency", distribution(&mut latencies)),
+    ])
+}
+
+/// Throughput of shader module creation.
+fn bench_shader_creation(device: &VtkDevice) -> Json {
+    const ITERATIONS: usize = 1000;
+    let shaders: [&[u8]; 2] = [
+        include_bytes!(concat!(env!("OUT_DIR"), "/shaders/bench.vert.spv")),
+        include_bytes!(concat!(env!("OUT_DIR"), "/shaders/bench.frag.spv")),
+    ];
+    let mut durations = Vec::with_capacity(ITERATIONS);
+    let start = Instant::now();
+    for i in 0..ITERATIONS {
+        let shader_start = Instant::now();
+        let shader = device.create_shader(shaders[i % shaders.len()]);
+        durations.push(shader_start.elapsed());
+        device.destroy_shader(shader);
+    }
+    let elapsed = start.elapsed();
+    Json::object([
+        ("shaders", ITERATIONS.into()),
+        (
+            "shaders_per_second",
+            (ITERATIONS as f64 / elapsed.as_secs_f64()).into(),
+        ),
+        ("creation_time", distribution(&mut durations)),
+    ])
+}
+
+/// Frame times when writing the vertices and uniforms of many draws per frame to the frame data
+/// ring buffer, which is the per-draw CPU cost vtk imposes.
+fn bench_dynamic_draw_data(window: &mut VtkWindow, options: &Options) -> Json {
+    #[derive(Copy, Clone)]
+    struct DrawUniforms {
+        _model_view_projection: [f32; 16],
+        _color: [f32; 4],
+    }
+
+    let mut results = Vec::new();
+    for draws in [100, 1000, 4000] {
+        let samples = render_frames(window, options.frames, |frame| {
+            for draw in 0..draws {
+                let vertices = frame.allocate_frame_slice::<[f32; 3]>(3);
+                let x = draw as f32 / draws as f32;
+                vertices.data[0].write([x, 0.0, 0.0]);
+                vertices.data[1].write([x, 1.0, 0.0]);
+                vertices.data[2].write([x + 0.01, 0.0, 0.0]);
+
+                let uniforms = frame.allocate_frame_slice::<DrawUniforms>(1);
+                let mut model_view_projection = [0.0; 16];
+                model_view_projection[0] = 1.0;
+                model_view_projection[5] = 1.0;
+                model_view_projection[10] = 1.0;
+                model_view_projection[15] = 1.0;
+                uniforms.data[0].write(DrawUniforms {
+                    _model_view_projection: model_view_projection,
+                    _color: [x, 1.0 - x, 0.5, 1.0],
+                });
+            }
+        });
+        let draws_per_second =
+            (draws * samples.frame_times.len()) as f64 / samples.elapsed.as_secs_f64();
+        let mut result = vec![
+            ("draws_per_frame", draws.into()),
+            ("draws_per_second", draws_per_second.into()),
+        ];
+        result.extend(render_results(window, samples));
+        results.push(Json::Object(result));
+    }
+    Json::Array(results)
+}
+
+/// Frame times when recording tens of thousands of draws per frame, split across a growing number
+/// of threads recording with a recorder each.
+fn bench_parallel_recording(window: &mut VtkWindow, device: &VtkDevice, options: &Options) -> Json {
+    const DRAWS: usize = 20000;
+    #[derive(Copy, Clone)]
+    #[repr(C)]
+    struct DrawConstants {
+        model_view_projection: [f32; 16],
+        color: [f32; 4],
+    }
+
+    let vertex_shader = device.create_shader(include_bytes!(concat!(
+        env!("OUT_DIR"),
+        "/shaders/draw.vert.spv"
+    )));
+    let fragment_shader = device.create_shader(include_bytes!(concat!(
+        env!("OUT_DIR"),
+        "/shaders/bench.frag.spv"
+    )));
+    let pipeline = window.create_graphics_pipeline(&VtkGraphicsPipelineDesc {
+        vertex_shader: &vertex_shader,
+        fragment_shader: &fragment_shader,
+        vertex_stride: std::mem::size_of::<[f32; 3]>() as u32,
+        vertex_attributes: &[VtkVertexAttribute {
+            format: VtkVertexFormat::Float3,
+            offset: 0,
+        }],
+        push_constant_size: std::mem::size_of::<DrawConstants>() as u32,
+    });
+    let draws: Vec<DrawConstants> = (0..DRAWS)
+        .map(|draw| {
+            let x = draw as f32 / DRAWS as f32;
+            let mut model_view_projection = [0.0; 16];
+            model_view_projection[0] = 0.01;
+            model_view_projection[5] = 0.01;
+            model_view_projection[10] = 1.0;
+            model_view_projection[12] = 2.0 * x - 1.0;
+            model_view_projection[15] = 1.0;
+            DrawConstants {
+                model_view_projection,
+                color: [x, 1.0 - x, 0.5, 1.0],
+            }
+        })
+        .collect();
+
+    let max_threads = std::thread::available_parallelism().map_or(1, |threads| threads.get());
+    let mut results = Vec::new();
+    let mut thread_count = 1;
+    while thread_count <= max_threads.min(8) {
+        let mut recorders: Vec<VtkRecorder> = (0..thread_count)
+            .map(|_| window.create_recorder())
+            .collect();
+        let mut record_times = Vec::with_capacity(options.frames);
+        let samples = render_frames(window, options.frames, |frame| {
+            let triangle = frame.allocate_frame_slice::<[f32; 3]>(3);
+            triangle.data[0].write([0.0, 0.0, 0.0]);
+            triangle.data[1].write([1.0, 0.0, 0.0]);
+            triangle.data[2].write([0.0, 1.0, 0.0]);
+            let vertices = triangle.binding();
+
+            let start = Instant::now();
+            frame.record_parallel(&mut recorders, &draws, |commands, draws| {
+                commands.bind_pipeline(&pipeline);
+                commands.bind_vertex_buffer(vertices);
+                for draw in draws {
+                    // DrawConstants is plain old data without padding.
+                    let constants = unsafe {
+                        std::slice::from_raw_parts(
+                            (draw as *const DrawConstants).cast::<u8>(),
+                            std::mem::size_of::<DrawConstants>(),
+                        )
+                    };
+                    commands.push_constants(&pipeline, constants);
+                    commands.draw(0..3, 0..1);
+                }
+            });
+            record_times.push(start.elapsed());
+        });
+        drop(recorders);
+
+        let mut result = vec![
+            ("threads", thread_count.into()),
+            ("draws_per_frame", DRAWS.into()),
+            ("record_time", distribution(&mut record_times)),
+        ];
+        result.extend(render_results(window, samples));
+        results.push(Json::Object(result));
+        thread_count *= 2;
+    }
+
+    window.destroy_graphics_pipeline(pipeline);
+    device.destroy_shader(vertex_shader);
+    device.destroy_shader(fragment_shader);
+    Json::Array(results)
+}
+
+#[cfg(not(target_os = "linux"))]
+fn main() {
+    eprintln!("vtk-bench: unsupported on this platform, as it renders headless which needs Linux");
+    std::process::exit(1);
+}
+
+#[cfg(target_os = "linux")]
+fn main() {
+    let options = Options::parse();
+
+    let start = Instant::now();
+    let mut context = vtk::VtkContext::new_headless();
+    let context_time = start.elapsed();
+    let start = Instant::now();
+    let mut device = context.create_device();
+    let device_time = start.elapsed();
+    let start = Instant::now();
+    let mut window = context.create_window(&mut device);
+    let window_time = start.elapsed();
+    eprintln!("vtk-bench: benchmarking {}", device.name());
+
+    let init = Json::object([
+        ("context_ms", millis(context_time)),
+        ("device_ms", millis(device_time)),
+        ("window_ms", millis(window_time)),
+    ]);
+    let render = bench_render(&mut window, &options);
+    let swap_chain_recreation = bench_swap_chain_recreation(&mut window);
+    let shader_creation = bench_shader_creation(&device);
+    let dynamic_draw_data = bench_dynamic_draw_data(&mut window, &options);
+    let parallel_recording = bench_parallel_recording(&mut window, &device, &options);
+
+    let unix_time = SystemTime::now()
+        .duration_since(SystemTime::UNIX_EPOCH)
+        .map_or(0, |duration| duration.as_secs());
+    let results = Json::object([
+        ("schema_version", SCHEMA_VERSION.into()),
+        ("unix_time", unix_time.into()),
+        ("device", device.name().into()),
+        ("dynamic_rendering", Json::Bool(device.dynamic_rendering())),
+        ("frames_per_configuration", options.frames.into()),
+        ("init", init),
+        ("render", render),
+        ("swap_chain_recreation", swap_chain_recreation),
+        ("shader_creation", shader_creation),
+        ("dynamic_draw_data", dynamic_draw_data),
+        ("parallel_recording", parallel_recording),
+    ]);
+
+    match &options.output {
+        Some(path) => {
+            if let Err(error) = std::fs::write(path, format!("{results}\n")) {
+                eprintln!("vtk-bench: could not write {}: {error}", path.display());
+                std::process::exit(1);
+            }
+        }
+        None => println!("{results}"),
+    }
+}
@@ -165,26 +165,42 @@ fn main() {
 
         build_c_file(&mut cc, "native/vtk_wayland.c");
         build_c_file(&mut cc, "native/vtk_wayland_keyboard.c");
+        build_c_file(&mut cc, "native/vtk_wayland_pointer.c");
+        build_c_file(&mut cc, "native/vtk_wayland_presentation.c");
+        build_c_file(&mut cc, "native/vtk_headless.c");
+        build_c_file(&mut cc, "native/vtk_event_loop.c");
+        build_c_file(&mut cc, "native/vtk_input.c");
 
         // See https://wayland-book.com/xdg-shell-basics/example-code.html
-        let generated_wayland_c = format!("{out_dir}/xdg-shell-client-protocol.c");
-        assert!(Command::new("sh")
-            .args([
-                "-c",
-                &format!("wayland-scanner private-code < /usr/share/wayland-protocols/stable/xdg-shell/xdg-shell.xml > {generated_wayland_c}")
-            ])
-            .status()
-            .unwrap()
-            .success());
-        assert!(Command::new("sh")
-            .args([
-                "-c",
-                &format!("wayland-scanner client-header < /usr/share/wayland-protocols/stable/xdg-shell/xdg-shell.xml > {generated_headers_dir}/xdg-shell-client-protocol.h")
-            ])
-            .status()
-            .unwrap()
-            .success());
-        cc.file(generated_wayland_c);
+        for protocol in [
+            "stable/xdg-shell/xdg-shell",
+            "stable/presentation-time/presentation-time",
+            "stable/viewporter/viewporter",
+            "staging/fractional-scale/fractional-scale-v1",
+            "unstable/relative-pointer/relative-pointer-unstable-v1",
+            "unstable/pointer-constraints/pointer-constraints-unstable-v1",
+        ] {
+            let protocol_xml = format!("/usr/share/wayland-protocols/{protocol}.xml");
+            let protocol_name = protocol.rsplit('/').next().unwrap();
+            let generated_wayland_c = format!("{out_dir}/{protocol_name}-client-protocol.c");
+            assert!(Command::new("sh")
+                .args([
+                    "-c",
+                    &format!("wayland-scanner private-code < {protocol_xml} > {generated_wayland_c}")
+                ])
+                .status()
+                .unwrap()
+                .success());
+            assert!(Command::new("sh")
+                .args([
+                    "-c",
+                    &format!("wayland-scanner client-header < {protocol_xml} > {generated_headers_dir}/{protocol_name}-client-protocol.h")
+                ])
+                .status()
+                .unwrap()
+                .success());
+            cc.file(generated_wayland_c);
+        }
     }
 
     #[cfg(feature = "validation")]
@@ -198,6 +214,17 @@ fn main() {
 
     build_c_file(&mut cc, "native/vulkan_wrapper.c");
     build_c_file(&mut cc, "native/vtk_cffi.c");
+    build_c_file(&mut cc, "native/vtk_device_select.c");
+    build_c_file(&mut cc, "native/vtk_pipeline_cache.c");
+    build_c_file(&mut cc, "native/vtk_memory.c");
+    build_c_file(&mut cc, "native/vtk_upload.c");
+    build_c_file(&mut cc, "native/vtk_compute.c");
+    build_c_file(&mut cc, "native/vtk_frame_data.c");
+    build_c_file(&mut cc, "native/vtk_gpu_timer.c");
+    build_c_file(&mut cc, "native/vtk_history.c");
+    build_c_file(&mut cc, "native/vtk_frame_stats.c");
+    build_c_file(&mut cc, "native/vtk_graphics.c");
+    build_c_file(&mut cc, "native/vtk_recorder.c");
     build_c_file(&mut cc, "native/vtk_vulkan_setup.c");
 
     // TODO: Make sanitize a feature or depend on build profile?
@@ -1,13 +1,84 @@
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "vtk_array.h"
 #include "vtk_cffi.h"
 #include "vtk_internal.h"
 #include "vtk_log.h"
+#include "vtk_platform.h"
 #include "vulkan_wrapper.h"
 
+static struct VtkQueueNative *vtk_queue_init(struct VtkDeviceNative *vtk_device, uint32_t family_idx,
+                                             uint32_t queue_idx) {
+  struct VtkQueueNative *queue = (struct VtkQueueNative *)malloc(sizeof(struct VtkQueueNative));
+  queue->family_idx = family_idx;
+  vkGetDeviceQueue(vtk_device->vk_device, family_idx, queue_idx, &queue->vk_queue);
+  pthread_mutex_init(&queue->submit_mutex, NULL);
+
+  VkSemaphoreTypeCreateInfo vk_semaphore_type_create_info = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+      .pNext = NULL,
+      .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+      .initialValue = 0,
+  };
+  VkSemaphoreCreateInfo vk_semaphore_create_info = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+      .pNext = &vk_semaphore_type_create_info,
+      .flags = 0,
+  };
+  CALL_VK(vkCreateSemaphore(vtk_device->vk_device, &vk_semaphore_create_info, NULL, &queue->vk_timeline_semaphore))
+  queue->timeline_value = 0;
+  return queue;
+}
+
+void vtk_queue_submit(struct VtkQueueNative *queue, uint32_t submit_count, VkSubmitInfo const *submits, VkFence fence) {
+  pthread_mutex_lock(&queue->submit_mutex);
+  CALL_VK(vkQueueSubmit(queue->vk_queue, submit_count, submits, fence))
+  pthread_mutex_unlock(&queue->submit_mutex);
+}
+
+uint64_t vtk_queue_submit_timeline(struct VtkQueueNative *queue, VkSubmitInfo const *submit, uint64_t *signal_value,
+                                   VkFence fence) {
+  pthread_mutex_lock(&queue->submit_mutex);
+  uint64_t ticket = ++queue->timeline_value;
+  *signal_value = ticket;
+  CALL_VK(vkQueueSubmit(queue->vk_queue, 1, submit, fence))
+  pthread_mutex_unlock(&queue->submit_mutex);
+  return ticket;
+}
+
+bool vtk_queue_ticket_complete(struct VtkDeviceNative *vtk_device, struct VtkQueueNative *queue, uint64_t ticket) {
+  uint64_t completed_ticket;
+  CALL_VK(vkGetSemaphoreCounterValue(vtk_device->vk_device, queue->vk_timeline_semaphore, &completed_ticket))
+  return completed_ticket >= ticket;
+}
+
+void vtk_queue_wait_for_ticket(struct VtkDeviceNative *vtk_device, struct VtkQueueNative *queue, uint64_t ticket) {
+  VkSemaphoreWaitInfo vk_semaphore_wait_info = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+      .pNext = NULL,
+      .flags = 0,
+      .semaphoreCount = 1,
+      .pSemaphores = &queue->vk_timeline_semaphore,
+      .pValues = &ticket,
+  };
+  CALL_VK(vkWaitSemaphores(vtk_device->vk_device, &vk_semaphore_wait_info, UINT64_MAX))
+}
+
+VkResult vtk_queue_present(struct VtkQueueNative *queue, VkPresentInfoKHR const *present_info) {
+  pthread_mutex_lock(&queue->submit_mutex);
+  VkResult result = vkQueuePresentKHR(queue->vk_queue, present_info);
+  pthread_mutex_unlock(&queue->submit_mutex);
+  return result;
+}
+
 struct VtkDeviceNative *vtk_device_init(struct VtkContextNative *vtk_context) {
+  return vtk_device_init_with_selector(vtk_context, NULL);
+}
+
+struct VtkDeviceNative *vtk_device_init_with_selector(struct VtkContextNative *vtk_context,
+                                                      char const *device_selector) {
   struct VtkDeviceNative *device = (struct VtkDeviceNative *)malloc(sizeof(struct VtkDeviceNative));
   device->vtk_context = vtk_context;
 
@@ -36,6 +107,37 @@ struct VtkDeviceNative *vtk_device_init(struct VtkContextNative *vtk_context) {
 #endif
   };
 
+#ifdef VTK_PLATFORM_WAYLAND
+  // Headless contexts create headless surfaces instead of Wayland ones.
+  if (vtk_context->headless) {
+    instance_extensions[VTK_ARRAY_SIZE(instance_extensions) - 1] = "VK_EXT_headless_surface";
+  }
+#endif
+
+  // Surface maintenance lets devices with VK_EXT_swapchain_maintenance1 tell when presents are done, see
+  // vtk_destroy_retired_swap_chains().
+  char const *enabled_instance_extensions[VTK_ARRAY_SIZE(instance_extensions) + 2];
+  uint32_t instance_extension_count = 0;
+  for (uint32_t i = 0; i < VTK_ARRAY_SIZE(instance_extensions); i++) {
+    enabled_instance_extensions[instance_extension_count++] = instance_extensions[i];
+  }
+  uint32_t available_instance_extension_count = 0;
+  CALL_VK(vkEnumerateInstanceExtensionProperties(NULL, &available_instance_extension_count, NULL))
+  VkExtensionProperties *available_instance_extensions =
+      VTK_ARRAY_ALLOC(VkExtensionProperties, available_instance_extension_count);
+  CALL_VK(vkEnumerateInstanceExtensionProperties(NULL, &available_instance_extension_count,
+                                                 available_instance_extensions))
+  bool surface_maintenance1 =
+      vtk_has_extension(available_instance_extensions, available_instance_extension_count,
+                        "VK_KHR_get_surface_capabilities2") &&
+      vtk_has_extension(available_instance_extensions, available_instance_extension_count,
+                        "VK_EXT_surface_maintenance1");
+  free(available_instance_extensions);
+  if (surface_maintenance1) {
+    enabled_instance_extensions[instance_extension_count++] = "VK_KHR_get_surface_capabilities2";
+    enabled_instance_extensions[instance_extension_count++] = "VK_EXT_surface_maintenance1";
+  }
+
   char const *enabledLayerNames[] = {
 #ifdef VTK_VULKAN_VALIDATION
       "VK_LAYER_KHRONOS_validation"
@@ -48,8 +150,8 @@ struct VtkDeviceNative *vtk_device_init(struct VtkContextNative *vtk_context) {
       .pApplicationInfo = &app_info,
       .enabledLayerCount = VTK_ARRAY_SIZE(enabledLayerNames),
       .ppEnabledLayerNames = enabledLayerNames,
-      .enabledExtensionCount = VTK_ARRAY_SIZE(instance_extensions),
-      .ppEnabledExtensionNames = instance_extensions,
+      .enabledExtensionCount = instance_extension_count,
+      .ppEnabledExtensionNames = enabled_instance_extensions,
 #if defined(__APPLE__) && !defined(VTK_NO_VULKAN_LOADING)
       // Necessary to load MoltenVK through the vulkan loader:
       .flags = VK_INSTANCE_CREATE_ENUMERATE_PORTABILITY_BIT_KHR,
@@ -61,111 +163,167 @@ struct VtkDeviceNative *vtk_device_init(struct VtkContextNative *vtk_context) {
   CALL_VK(vkCreateInstance(&instance_create_info, NULL, &device->vk_instance));
   LOGI("AFter vkCreateInstance");
 
-  uint32_t gpu_count = 0;
-  CALL_VK(vkEnumeratePhysicalDevices(device->vk_instance, &gpu_count, NULL));
-
-  LOGI("Number of gpus: %d", gpu_count);
-  VkPhysicalDevice gpus[gpu_count];
-  CALL_VK(vkEnumeratePhysicalDevices(device->vk_instance, &gpu_count, gpus));
-  for (int i = 0; i < gpu_count; i++) {
-    VkPhysicalDevice gpu = gpus[i];
-    VkPhysicalDeviceProperties properties;
-    vkGetPhysicalDeviceProperties(gpu, &properties);
-    switch (properties.deviceType) {
-    default:
-      continue;
-    case VK_PHYSICAL_DEVICE_TYPE_OTHER:
-      LOGI("gpu %d: Type other", i);
-      break;
-    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
-      LOGI("gpu %d: Type integrated", i);
-      break;
-    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
-      LOGI("gpu %d: Type discrete", i);
-      break;
-    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
-      LOGI("gpu %d: Type virtual", i);
-      break;
-    case VK_PHYSICAL_DEVICE_TYPE_CPU:
-      LOGI("gpu %d: Type cpu", i);
+  vtk_select_physical_device(device, device_selector);
+
+  // Use a transfer-only queue family for uploads if there is one, as those are typically backed by DMA engines that
+  // run in parallel with rendering. Otherwise uploads share the graphics queue.
+  uint32_t queue_family_count;
+  vkGetPhysicalDeviceQueueFamilyProperties(device->vk_physical_device, &queue_family_count, NULL);
+  VkQueueFamilyProperties *queue_family_properties = VTK_ARRAY_ALLOC(VkQueueFamilyProperties, queue_family_count);
+  vkGetPhysicalDeviceQueueFamilyProperties(device->vk_physical_device, &queue_family_count, queue_family_properties);
+  device->transfer_queue_family_idx = device->graphics_queue_family_idx;
+  for (uint32_t i = 0; i < queue_family_count; i++) {
+    VkQueueFlags flags = queue_family_properties[i].queueFlags;
+    if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+      device->transfer_queue_family_idx = i;
       break;
     }
   }
+  bool dedicated_transfer_queue = device->transfer_queue_family_idx != device->graphics_queue_family_idx;
 
-  // Select the first device:
-  device->vk_physical_device = gpus[0];
-
-  uint32_t queueFamilyCount;
-  vkGetPhysicalDeviceQueueFamilyProperties(device->vk_physical_device, &queueFamilyCount, NULL);
-  LOGI("Device queue family count: %d", queueFamilyCount);
-  assert(queueFamilyCount);
-  VkQueueFamilyProperties *queueFamilyProperties = VTK_ARRAY_ALLOC(VkQueueFamilyProperties, queueFamilyCount);
-  vkGetPhysicalDeviceQueueFamilyProperties(device->vk_physical_device, &queueFamilyCount, queueFamilyProperties);
-  uint32_t queue_family_idx;
-  /*
-  for (queue_family_idx = 0; queue_family_idx < queueFamilyCount; queue_family_idx++) {
-      uint32_t flags = queueFamilyProperties[queue_family_idx].queueFlags;
-      LOGI("Queue family: %d", queue_family_idx);
-      if (flags & VK_QUEUE_GRAPHICS_BIT) LOGI("  - VK_QUEUE_GRAPHICS_BIT");
-      if (flags & VK_QUEUE_COMPUTE_BIT) LOGI("  - VK_QUEUE_COMPUTE_BIT");
-      if (flags & VK_QUEUE_TRANSFER_BIT) LOGI("  - VK_QUEUE_TRANSFER_BIT");
-  }
-  */
-  for (queue_family_idx = 0; queue_family_idx < queueFamilyCount; queue_family_idx++) {
-    if (queueFamilyProperties[queue_family_idx].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+  // Compute work runs concurrently with rendering on a compute-only family if there is one, or else on a second
+  // queue of the graphics family, which still lets the driver overlap it with graphics work on most hardware.
+  device->compute_queue_family_idx = device->graphics_queue_family_idx;
+  for (uint32_t i = 0; i < queue_family_count; i++) {
+    VkQueueFlags flags = queue_family_properties[i].queueFlags;
+    if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT)) {
+      device->compute_queue_family_idx = i;
       break;
     }
   }
-  free(queueFamilyProperties);
-  assert(queue_family_idx < queueFamilyCount);
-  device->graphics_queue_family_idx = queue_family_idx;
+  bool dedicated_compute_family = device->compute_queue_family_idx != device->graphics_queue_family_idx;
+  bool second_graphics_queue =
+      !dedicated_compute_family && queue_family_properties[device->graphics_queue_family_idx].queueCount > 1;
+  free(queue_family_properties);
+  LOGI("Graphics queue family: %d, compute queue family: %d%s, transfer queue family: %d",
+       device->graphics_queue_family_idx, device->compute_queue_family_idx,
+       second_graphics_queue ? " (second queue)" : "", device->transfer_queue_family_idx);
 
-  float priorities[] = {1.0f};
+  float priorities[] = {1.0f, 1.0f};
 
-  VkDeviceQueueCreateInfo queueCreateInfo = {
-      .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-      .pNext = NULL,
-      .flags = 0,
-      .queueFamilyIndex = queue_family_idx,
-      .queueCount = 1,
-      .pQueuePriorities = priorities,
-  };
+  VkDeviceQueueCreateInfo queue_create_infos[3];
+  uint32_t queue_create_info_count = 0;
+  uint32_t queue_families[] = {device->graphics_queue_family_idx, device->compute_queue_family_idx,
+                               device->transfer_queue_family_idx};
+  for (uint32_t i = 0; i < VTK_ARRAY_SIZE(queue_families); i++) {
+    if (i > 0 && queue_families[i] == device->graphics_queue_family_idx) {
+      continue;
+    }
+    queue_create_infos[queue_create_info_count++] = (VkDeviceQueueCreateInfo){
+        .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .queueFamilyIndex = queue_families[i],
+        .queueCount = (uint32_t)(i == 0 && second_graphics_queue ? 2 : 1),
+        .pQueuePriorities = priorities,
+    };
+  }
 
-  char const *device_extensions[] = {
-      "VK_KHR_swapchain",
+  char const *device_extensions[4] = {"VK_KHR_swapchain"};
+  uint32_t device_extension_count = 1;
 #ifdef __APPLE__
-      "VK_KHR_portability_subset",
+  device_extensions[device_extension_count++] = "VK_KHR_portability_subset";
 #endif
+
+  // Dynamic rendering spares windows their render pass and framebuffers, see vtk_record_command_buffer(). Devices
+  // without it keep using render passes.
+  VkPhysicalDeviceProperties vk_physical_device_properties;
+  vkGetPhysicalDeviceProperties(device->vk_physical_device, &vk_physical_device_properties);
+  VkPhysicalDeviceVulkan13Features vk_supported_13_features = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES,
+      .pNext = NULL,
+  };
+  VkPhysicalDeviceFeatures2 vk_supported_features = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+      .pNext = &vk_supported_13_features,
+  };
+  device->dynamic_rendering = false;
+  if (VK_API_VERSION_MINOR(vk_physical_device_properties.apiVersion) >= 3) {
+    vkGetPhysicalDeviceFeatures2(device->vk_physical_device, &vk_supported_features);
+    device->dynamic_rendering = vk_supported_13_features.dynamicRendering == VK_TRUE;
+  }
+  // Unlike dynamic rendering, extended dynamic state has no feature to enable on Vulkan 1.3.
+  device->extended_dynamic_state = VK_API_VERSION_MINOR(vk_physical_device_properties.apiVersion) >= 3;
+  LOGI("Rendering with %s", device->dynamic_rendering ? "dynamic rendering" : "render passes");
+
+  uint32_t extension_count = 0;
+  CALL_VK(vkEnumerateDeviceExtensionProperties(device->vk_physical_device, NULL, &extension_count, NULL))
+  VkExtensionProperties *extensions = VTK_ARRAY_ALLOC(VkExtensionProperties, extension_count);
+  CALL_VK(vkEnumerateDeviceExtensionProperties(device->vk_physical_device, NULL, &extension_count, extensions))
+
+  // Pipeline creation feedback tells pipeline cache hits from misses, see vtk_pipeline_cache.c. Vulkan 1.2 devices,
+  // which device selection accepts, only have it as an extension.
+  device->pipeline_creation_feedback = VK_API_VERSION_MINOR(vk_physical_device_properties.apiVersion) >= 3;
+  if (!device->pipeline_creation_feedback &&
+      vtk_has_extension(extensions, extension_count, "VK_EXT_pipeline_creation_feedback")) {
+    device_extensions[device_extension_count++] = "VK_EXT_pipeline_creation_feedback";
+    device->pipeline_creation_feedback = true;
+  }
+
+  // Present fences tell when retired swap chains are no longer used by the presentation engine.
+  VkPhysicalDeviceSwapchainMaintenance1FeaturesEXT vk_swapchain_maintenance1_features = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_EXT,
+      .pNext = NULL,
+      .swapchainMaintenance1 = VK_FALSE,
+  };
+  if (surface_maintenance1 && vtk_has_extension(extensions, extension_count, "VK_EXT_swapchain_maintenance1")) {
+    VkPhysicalDeviceFeatures2 vk_maintenance_features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+        .pNext = &vk_swapchain_maintenance1_features,
+    };
+    vkGetPhysicalDeviceFeatures2(device->vk_physical_device, &vk_maintenance_features);
+  }
+  device->swapchain_maintenance1 = vk_swapchain_maintenance1_features.swapchainMaintenance1 == VK_TRUE;
+  if (device->swapchain_maintenance1) {
+    device_extensions[device_extension_count++] = "VK_EXT_swapchain_maintenance1";
+  }
+  free(extensions);
+
+  VkPhysicalDeviceVulkan13Features vk_vulkan_13_features = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES,
+      .pNext = NULL,
+      .dynamicRendering = VK_TRUE,
+  };
+
+  void *vk_enabled_features = device->dynamic_rendering ? &vk_vulkan_13_features : NULL;
+  if (device->swapchain_maintenance1) {
+    vk_swapchain_maintenance1_features.pNext = vk_enabled_features;
+    vk_enabled_features = &vk_swapchain_maintenance1_features;
+  }
+
+  // Timeline semaphores track upload completion, see vtk_upload.c.
+  VkPhysicalDeviceVulkan12Features vk_vulkan_12_features = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+      .pNext = vk_enabled_features,
+      .timelineSemaphore = VK_TRUE,
   };
 
   VkDeviceCreateInfo deviceCreateInfo = {
       .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-      .pNext = NULL,
-      .queueCreateInfoCount = 1,
-      .pQueueCreateInfos = &queueCreateInfo,
+      .pNext = &vk_vulkan_12_features,
+      .queueCreateInfoCount = queue_create_info_count,
+      .pQueueCreateInfos = queue_create_infos,
       .enabledLayerCount = 0,
       .ppEnabledLayerNames = NULL,
-      .enabledExtensionCount = VTK_ARRAY_SIZE(device_extensions),
+      .enabledExtensionCount = device_extension_count,
       .ppEnabledExtensionNames = device_extensions,
       .pEnabledFeatures = NULL,
   };
 
   CALL_VK(vkCreateDevice(device->vk_physical_device, &deviceCreateInfo, NULL, &device->vk_device));
-  vkGetDeviceQueue(device->vk_device, device->graphics_queue_family_idx, 0, &device->vk_queue);
+  device->graphics_queue = vtk_queue_init(device, device->graphics_queue_family_idx, 0);
+  device->transfer_queue =
+      dedicated_transfer_queue ? vtk_queue_init(device, device->transfer_queue_family_idx, 0) : device->graphics_queue;
+  if (dedicated_compute_family || second_graphics_queue) {
+    device->compute_queue = vtk_queue_init(device, device->compute_queue_family_idx, second_graphics_queue ? 1 : 0);
+  } else {
+    device->compute_queue = device->graphics_queue;
+  }
 
-  VkCommandPoolCreateInfo vk_command_pool_create_info = {
-      .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-      .pNext = NULL,
-      // There are two possible flags for command pools:
-      // - VK_COMMAND_POOL_CREATE_TRANSIENT_BIT: Hint that command buffers are rerecorded
-      //    with new commands very often (may change memory allocation behavior).
-      // - VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT: Allow command buffers to be
-      //   rerecorded individually, without this flag they all have to be reset together.
-      .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
-      .queueFamilyIndex = device->graphics_queue_family_idx,
-  };
-  CALL_VK(vkCreateCommandPool(device->vk_device, &vk_command_pool_create_info, NULL, &device->vk_command_pool));
-  // TODO: Cleanup with VkDestroyCommandPool
+  vtk_pipeline_cache_init(device);
+  vtk_memory_init(device);
+  vtk_uploader_init(device);
+  vtk_compute_init(device);
 
   return device;
 }
@@ -173,6 +331,16 @@ struct VtkDeviceNative *vtk_device_init(struct VtkContextNative *vtk_context) {
 __attribute__((visibility("default"))) struct VtkWindowNative *vtk_window_init(struct VtkDeviceNative *vtk_device) {
   struct VtkWindowNative *vtk_window = (struct VtkWindowNative *)malloc(sizeof(struct VtkWindowNative));
   vtk_window->vtk_device = vtk_device;
+  vtk_window->frames_in_flight = VTK_DEFAULT_FRAMES_IN_FLIGHT;
+  vtk_window->frame_number = 0;
+  vtk_window->upload_wait_ticket = 0;
+  vtk_window->compute_wait_ticket = 0;
+  vtk_window->frame_ticket = 0;
+  vtk_window->frame_timing_history = (struct VtkHistoryNative){0};
+  vtk_window->frame_begun = false;
+  vtk_window->num_retired_swap_chains = 0;
+  vtk_window->requested_present_mode = VK_PRESENT_MODE_FIFO_KHR;
+  vtk_window->requested_swap_chain_images = 0;
   vtk_window_init_platform(vtk_window);
   return vtk_window;
 }
@@ -190,3 +358,7 @@ VkShaderModule vtk_device_create_shader(struct VtkDeviceNative *vtk_device, uint
   CALL_VK(vkCreateShaderModule(vk_device, &vk_shader_module_create_info, NULL, &result));
   return result;
 }
+
+void vtk_device_destroy_shader(struct VtkDeviceNative *vtk_device, VkShaderModule shader) {
+  vkDestroyShaderModule(vtk_device->vk_device, shader, NULL);
+}
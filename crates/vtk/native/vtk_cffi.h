@@ -18,9 +18,47 @@ typedef void VtkViewController;
 extern "C" {
 #endif
 
+struct VtkComputeNative;
+struct VtkComputePipelineNative;
 struct VtkDeviceNative;
+struct VtkGpuTimerNative;
+struct VtkGraphicsPipelineNative;
+struct VtkMemoryAllocatorNative;
+struct VtkMemoryBlockNative;
+struct VtkQueueNative;
+struct VtkRecorderNative;
+struct VtkRecordingNative;
+struct VtkUploaderNative;
 struct VtkWindowNative;
 
+/** Upper bound on the number of frames that may be in flight (recorded but not yet finished by the GPU). */
+#define VTK_MAX_FRAMES_IN_FLIGHT 4
+/** The number of frames in flight used by a newly created window. */
+#define VTK_DEFAULT_FRAMES_IN_FLIGHT 2
+/** Upper bound on the number of replaced swap chains waiting for their last frames to finish. */
+#define VTK_MAX_RETIRED_SWAP_CHAINS 8
+/** Size of the buffer holding the name of the physical device, including the null terminator. */
+#define VTK_DEVICE_NAME_SIZE 256
+/** Upper bound on the number of storage buffers bound to a compute pipeline. */
+#define VTK_MAX_COMPUTE_STORAGE_BUFFERS 8
+/** Upper bound on the size of the push constants of a compute pipeline. */
+#define VTK_MAX_COMPUTE_PUSH_CONSTANT_SIZE 128
+/** Upper bound on the GPU timer scopes of a frame, including its own two. Further scopes are not timed. */
+#define VTK_MAX_GPU_TIMER_SCOPES 32
+/** Upper bound on the number of vertex attributes of a graphics pipeline. */
+#define VTK_MAX_VERTEX_ATTRIBUTES 8
+/** Upper bound on the size of the push constants of a graphics pipeline. */
+#define VTK_MAX_GRAPHICS_PUSH_CONSTANT_SIZE 128
+#define VTK_FRAME_TIMING_HISTORY 256
+/** Capacity of the ring of input events of a context, a power of two. */
+#define VTK_INPUT_QUEUE_CAPACITY 256
+/** Bits of pointer buttons in input events: bit n is the Linux button code BTN_LEFT + n. */
+#define VTK_POINTER_BUTTON_LEFT 1
+#define VTK_POINTER_BUTTON_RIGHT 2
+#define VTK_POINTER_BUTTON_MIDDLE 4
+#define VTK_POINTER_BUTTON_SIDE 8
+#define VTK_POINTER_BUTTON_EXTRA 16
+
 #ifdef __ANDROID__
 // TODO
 #elif defined __linux__
@@ -36,6 +74,89 @@ struct xdg_wm_base;
 struct xkb_context;
 struct xkb_keymap;
 struct xkb_state;
+struct VtkFramePacingNative;
+struct VtkEventLoopNative;
+struct VtkKeyboardNative;
+struct VtkPointerNative;
+struct VtkPresentationFeedbackNative;
+struct wp_fractional_scale_manager_v1;
+struct wp_fractional_scale_v1;
+struct wp_presentation;
+struct wp_viewport;
+struct wp_viewporter;
+struct zwp_locked_pointer_v1;
+struct zwp_pointer_constraints_v1;
+struct zwp_relative_pointer_manager_v1;
+
+enum VtkInputEventKindNative {
+  VTK_INPUT_EVENT_KEY_PRESSED,
+  VTK_INPUT_EVENT_KEY_RELEASED,
+  // A held key repeated, at the rate and delay configured by the compositor.
+  VTK_INPUT_EVENT_KEY_REPEATED,
+  // The keyboard focus entered a window of the context, with the keys already held.
+  VTK_INPUT_EVENT_KEYBOARD_ENTERED,
+  VTK_INPUT_EVENT_KEYBOARD_LEFT,
+  // The pointer entered a window of the context at x, y.
+  VTK_INPUT_EVENT_POINTER_ENTERED,
+  VTK_INPUT_EVENT_POINTER_LEFT,
+  // The pointer moved, scrolled or had buttons pressed or released - all events of one wl_pointer.frame, but for
+  // entering and leaving which are events of their own.
+  VTK_INPUT_EVENT_POINTER,
+};
+
+// An input event received from the compositor, see vtk_context_drain_input().
+struct VtkInputEventNative {
+  enum VtkInputEventKindNative kind;
+  // When the event was received, from CLOCK_MONOTONIC.
+  uint64_t time_ns;
+  // The Key bits of the key pressed or released, or of the keys held when entering.
+  uint64_t keys;
+  // Pointer events: the position of the pointer in surface coordinates.
+  float x;
+  float y;
+  // Pointer events: the unaccelerated motion of the frame with zwp_relative_pointer_v1, also while the pointer is
+  // locked and its position does not change.
+  float dx;
+  float dy;
+  // Pointer events: the amount scrolled in the frame, in surface coordinates.
+  float scroll_x;
+  float scroll_y;
+  // Pointer events: the VTK_POINTER_BUTTON_* bits of the buttons pressed and released in the frame.
+  uint32_t buttons_pressed;
+  uint32_t buttons_released;
+};
+
+#define VTK_PRESENTATION_HISTORY 128
+// Flags of presented frames, those of wp_presentation_feedback.
+// The presentation was synchronized to the vertical blank of the output, so the sequence counts vblanks.
+#define VTK_PRESENTATION_VSYNC 1
+// The timestamp comes from the display hardware rather than being sampled by the compositor.
+#define VTK_PRESENTATION_HW_CLOCK 2
+#define VTK_PRESENTATION_HW_COMPLETION 4
+// The buffer of the frame was scanned out directly, without composition.
+#define VTK_PRESENTATION_ZERO_COPY 8
+
+// When a frame of a window turned into light, reported by the compositor through wp_presentation.
+struct VtkPresentationNative {
+  // The number of the frame, as in struct VtkFrameTimingNative.
+  uint64_t frame_number;
+  // When the frame was shown, from CLOCK_MONOTONIC. 0 if the frame was discarded without being shown.
+  uint64_t presented_ns;
+  // The refresh interval of the output, 0 if it is variable or unknown.
+  uint32_t refresh_ns;
+  uint32_t flags;
+  // The vblank counter of the output at presentation, only with VTK_PRESENTATION_VSYNC.
+  uint64_t sequence;
+  // The vblanks since the previously presented frame which showed no new frame of the window.
+  uint32_t missed_vblanks;
+};
+
+// Totals of the presentation records of a window.
+struct VtkPresentationStatsNative {
+  uint64_t presented_count;
+  uint64_t discarded_count;
+  uint64_t missed_vblanks;
+};
 #endif
 
 struct VtkContextNative {
@@ -45,6 +166,8 @@ struct VtkContextNative {
 #elif defined __ANDROID__
   // TODO:
 #elif defined __linux__
+  // Whether the context has no Wayland connection, windows rendering to headless surfaces instead.
+  _Bool headless;
   /** <div rustbindgen private> */
   struct wl_display *wayland_display;
   /** <div rustbindgen private> */
@@ -56,31 +179,238 @@ struct VtkContextNative {
   struct wl_seat *wayland_seat;
   struct wl_keyboard *wayland_keyboard;
   struct wl_pointer *wayland_pointer;
+  /** Null if the compositor does not support relative pointer motion. <div rustbindgen private> */
+  struct zwp_relative_pointer_manager_v1 *wayland_relative_pointer_manager;
+  /** Null if the compositor does not support locking the pointer. <div rustbindgen private> */
+  struct zwp_pointer_constraints_v1 *wayland_pointer_constraints;
+  /** Null if the compositor does not report presentation times. <div rustbindgen private> */
+  struct wp_presentation *wayland_presentation;
+  /** The clock of presentation times, see vtk_window_copy_presentations(). <div rustbindgen private> */
+  uint32_t wayland_presentation_clock;
+  /** Null if the compositor cannot scale surfaces, see vtk_window_set_render_scale(). <div rustbindgen private> */
+  struct wp_viewporter *wayland_viewporter;
+  /** Null if the compositor only has integer output scales. <div rustbindgen private> */
+  struct wp_fractional_scale_manager_v1 *wayland_fractional_scale_manager;
+  /** Outputs and their integer scales, for compositors without preferred buffer scales. <div rustbindgen private> */
+  struct VtkWaylandOutputNative *wayland_outputs;
+  /** The pointer events of the current frame, created with the pointer. <div rustbindgen private> */
+  struct VtkPointerNative *wayland_pointer_state;
   struct xkb_context *wayland_xkb_context;
   struct xkb_state *wayland_xkb_state;
   struct xkb_keymap *wayland_xkb_keymap;
+  /** Cached keymaps and key tables, created with the first keymap. <div rustbindgen private> */
+  struct VtkKeyboardNative *wayland_keyboard_state;
+  /** Ring of input events from the event loop thread to the thread draining them. <div rustbindgen private> */
+  struct VtkInputEventNative input_events[VTK_INPUT_QUEUE_CAPACITY];
+  /** The number of events written to the ring so far, updated atomically. <div rustbindgen private> */
+  uint64_t input_write_count;
+  /** The number of events drained from the ring so far, updated atomically. <div rustbindgen private> */
+  uint64_t input_read_count;
+  /** The number of events dropped since the ring was full. <div rustbindgen private> */
+  uint64_t input_dropped_count;
+  /** The Key bits of the keys held, updated atomically. <div rustbindgen private> */
+  uint64_t input_held_keys;
+  /** The VTK_POINTER_BUTTON_* bits of the pointer buttons held, updated atomically. <div rustbindgen private> */
+  uint32_t input_held_buttons;
+  /** Whether the ring has its consumer, see VtkContext::input_queue(). <div rustbindgen private> */
+  _Bool input_queue_taken;
+  /** The epoll loop run by vtk_context_run(). <div rustbindgen private> */
+  struct VtkEventLoopNative *event_loop;
 #endif
 };
 
+// Statistics on pipeline creation, to compare cold starts with starts using a persisted pipeline cache.
+struct VtkPipelineCacheStatsNative {
+  // The number of bytes of pipeline cache data loaded from disk, 0 if there was no usable cache file.
+  size_t loaded_bytes;
+  uint32_t pipelines_created;
+  // Whether the device has pipeline creation feedback (Vulkan 1.3 or VK_EXT_pipeline_creation_feedback). Without it
+  // cache hits and misses are unknown and left at 0.
+  _Bool creation_feedback;
+  // Pipelines found in the cache and pipelines that had to be compiled, as reported by the driver. Drivers not
+  // reporting feedback for a pipeline count it towards neither.
+  uint32_t cache_hits;
+  uint32_t cache_misses;
+  // Total time spent creating pipelines.
+  uint64_t creation_nanoseconds;
+};
+
+// A range of device memory bound to a resource, either sub-allocated from a larger block or a dedicated allocation.
+struct VtkMemoryAllocationNative {
+  VkDeviceMemory vk_memory;
+  uint64_t offset;
+  uint64_t size;
+  // The mapped memory of the allocation if it is host visible, otherwise null.
+  void *mapped;
+  /** The block sub-allocated from, null for dedicated allocations. <div rustbindgen private> */
+  struct VtkMemoryBlockNative *block;
+  /** <div rustbindgen private> */
+  uint32_t order;
+};
+
+// Statistics on device memory, to keep an eye on fragmentation and the number of driver allocations.
+struct VtkMemoryStatsNative {
+  // The number of device memory blocks sub-allocated from.
+  uint32_t block_count;
+  // The number of resources with memory of their own.
+  uint32_t dedicated_allocation_count;
+  // Bytes of device memory allocated from the driver, for blocks and dedicated allocations.
+  uint64_t allocated_bytes;
+  // The number of live allocations, sub-allocated or dedicated.
+  uint32_t allocation_count;
+  // Bytes in use by live allocations, including padding to the sub-allocation granularity.
+  uint64_t used_bytes;
+};
+
 struct VtkDeviceNative {
   struct VtkContextNative *vtk_context;
 
   _Bool initialized;
   VkInstance vk_instance;
   VkPhysicalDevice vk_physical_device;
+  // The null-terminated name of vk_physical_device.
+  char physical_device_name[VTK_DEVICE_NAME_SIZE];
   VkDevice vk_device;
+  // Whether windows render with dynamic rendering (core in Vulkan 1.3), without render pass and framebuffers.
+  _Bool dynamic_rendering;
+  // Whether cull mode, front face and primitive topology are dynamic state of graphics pipelines (core in Vulkan 1.3).
+  _Bool extended_dynamic_state;
+  /** Whether pipeline creation feedback is enabled (core in Vulkan 1.3). <div rustbindgen private> */
+  _Bool pipeline_creation_feedback;
+  /** Whether presents signal fences when done, with VK_EXT_swapchain_maintenance1. <div rustbindgen private> */
+  _Bool swapchain_maintenance1;
   uint32_t graphics_queue_family_idx;
+  /** <div rustbindgen private> */
+  struct VtkQueueNative *graphics_queue;
+  // A queue from a transfer-only family if the device has one, otherwise the same as graphics_queue.
+  uint32_t transfer_queue_family_idx;
+  /** <div rustbindgen private> */
+  struct VtkQueueNative *transfer_queue;
+  /** <div rustbindgen private> */
+  struct VtkMemoryAllocatorNative *memory_allocator;
+  /** Guarded by the allocator mutex, read with vtk_device_memory_stats(). <div rustbindgen private> */
+  struct VtkMemoryStatsNative memory_stats;
+  /** Staging uploads on the transfer queue. <div rustbindgen private> */
+  struct VtkUploaderNative *uploader;
+  // A queue from a compute-only family if the device has one, otherwise a second queue of the graphics family if
+  // there is one, otherwise the same as graphics_queue.
+  uint32_t compute_queue_family_idx;
+  /** <div rustbindgen private> */
+  struct VtkQueueNative *compute_queue;
+  /** Dispatches on the compute queue. <div rustbindgen private> */
+  struct VtkComputeNative *compute;
+
+  // Used for all pipeline creation, loaded from and saved to pipeline_cache_path.
+  VkPipelineCache vk_pipeline_cache;
+  /** Null if the pipeline cache is not persisted. <div rustbindgen private> */
+  char *pipeline_cache_path;
+  /** Statistics and saving of the cache, see vtk_pipeline_cache.c. <div rustbindgen private> */
+  struct VtkPipelineCacheNative *pipeline_cache;
+};
+
+// Per-frame resources, used round-robin so that the CPU can record a frame while the GPU renders earlier ones.
+struct VtkFrameNative {
+  // Signalled when the GPU has finished executing the frame, so its resources may be reused.
+  VkFence vk_fence;
+  // Signalled by the presentation engine when the acquired swap chain image is ready to be rendered to.
+  VkSemaphore vk_image_available_semaphore;
+  // Transient pool of the command buffers of the frame, reset as a whole when the frame resources are reused.
   VkCommandPool vk_command_pool;
-  VkQueue vk_queue;
+  VkCommandBuffer vk_command_buffer;
+  // Secondary command buffer of the draws recorded between vtk_window_begin_frame() and vtk_window_end_frame().
+  VkCommandBuffer vk_draw_command_buffer;
+  // The number of the frame last submitted using these resources, or 0 if none has been.
+  uint64_t frame_number;
+  /** The frame data ring position up to which the frame uses data. <div rustbindgen private> */
+  uint64_t frame_data_end;
+  /** Signalled when the latest present of the frame is done, with swapchain_maintenance1. <div rustbindgen private> */
+  VkFence vk_present_fence;
+};
+
+// The GPU time taken by a named scope of the commands of a frame.
+struct VtkGpuScopeTimingNative {
+  // Null-terminated, static string.
+  char const *name;
+  // The number of scopes enclosing this one.
+  uint32_t depth;
+  // Nanoseconds from the start of the first scope of the frame to the start of this one.
+  double start_ns;
+  double duration_ns;
+};
+
+// GPU timings of the scopes of a frame: the frame, its surface render pass, and then those of its command lists in the
+// order they were begun.
+struct VtkGpuFrameTimingsNative {
+  // The number of the frame timed, 0 if no frame has been timed yet.
+  uint64_t frame_number;
+  uint32_t scope_count;
+  struct VtkGpuScopeTimingNative scopes[VTK_MAX_GPU_TIMER_SCOPES];
+};
+
+// Phases of rendering a frame with vtk_window_begin_frame() and vtk_window_end_frame(), timed on the CPU.
+enum VtkFramePhaseNative {
+  // Waiting for the frame which last used the frame resources to finish on the GPU.
+  VTK_FRAME_PHASE_FENCE_WAIT,
+  // Acquiring a swap chain image, which blocks on vertical blank when presenting with FIFO.
+  VTK_FRAME_PHASE_ACQUIRE,
+  // Resetting the fence and command pool of the frame.
+  VTK_FRAME_PHASE_RESET,
+  // Recording the frame, including the draws recorded by the application between beginning and ending the frame.
+  VTK_FRAME_PHASE_RECORD,
+  VTK_FRAME_PHASE_SUBMIT,
+  VTK_FRAME_PHASE_PRESENT,
+  // Recreating the swap chain when it is out of date or the window has been resized.
+  VTK_FRAME_PHASE_RECREATE,
+  VTK_FRAME_PHASE_COUNT,
+};
+
+// CPU timings of rendering a frame, from CLOCK_MONOTONIC.
+struct VtkFrameTimingNative {
+  // The number of the frame submitted, 0 if none was because the swap chain was out of date.
+  uint64_t frame_number;
+  uint64_t phase_ns[VTK_FRAME_PHASE_COUNT];
+  uint64_t total_ns;
+};
+
+// The counts of entries written to a ring of recent records, updated atomically, see vtk_history.c.
+struct VtkHistoryNative {
+  // Entries the writer has begun writing.
+  uint64_t claimed_count;
+  // Entries written completely, which readers copy.
+  uint64_t published_count;
+};
 
-  // One big vertex buffer, consisting of vertex_buffer_size bytes.
-  VkBuffer vk_vertex_buffer;
-  // The mapped host coherent pointer to the vertex buffer.
-  void *vertex_buffer_ptr;
-  // The number of bytes in vk_vertex_buffer.
-  uint32_t vertex_buffer_size;
-  // The device memory backing the vertex buffer.
-  VkDeviceMemory vk_vertex_buffer_device_memory;
+// A vertex attribute of a graphics pipeline, read from the interleaved vertices of the vertex buffer.
+struct VtkVertexAttributeNative {
+  enum VkFormat format;
+  // Byte offset of the attribute within a vertex.
+  uint32_t offset;
+};
+
+// Faces culled by graphics pipelines, set with vtk_command_set_cull_mode().
+enum VtkCullModeNative {
+  VTK_CULL_MODE_NONE,
+  VTK_CULL_MODE_FRONT,
+  VTK_CULL_MODE_BACK,
+};
+
+// Primitives drawn by graphics pipelines, set with vtk_command_set_primitive_topology().
+enum VtkPrimitiveTopologyNative {
+  VTK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+  VTK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP,
+};
+
+// A swap chain which has been replaced by a newer one, kept alive until the frames using it have finished.
+struct VtkRetiredSwapChainNative {
+  VkSwapchainKHR vk_swapchain;
+  uint8_t num_images;
+  VkImage *vk_images;
+  VkImageView *vk_image_views;
+  // Null with dynamic rendering.
+  VkFramebuffer *vk_framebuffers;
+  VkSemaphore *vk_render_finished_semaphores;
+  // The number of the last frame which may use the swap chain.
+  uint64_t last_frame_number;
 };
 
 struct VtkWindowNative {
@@ -90,21 +420,81 @@ struct VtkWindowNative {
   enum VkFormat vk_surface_format;
   VkColorSpaceKHR vk_color_space;
 
+  // Null with dynamic rendering.
   VkRenderPass vk_surface_render_pass;
-  VkPipelineLayout vk_pipeline_layout;
-  VkPipeline vk_pipeline;
+
+  // The swap chain configuration asked for by the application, applied when the swap chain is (re)created.
+  VkPresentModeKHR requested_present_mode;
+  // The requested number of swap chain images, or 0 to use the minimum supported by the surface.
+  uint32_t requested_swap_chain_images;
+  // The present mode actually in use, which may differ from the requested one if that is not supported.
+  VkPresentModeKHR vk_present_mode;
 
   uint8_t num_swap_chain_images;
   VkSwapchainKHR vk_swapchain;
   VkImage *vk_swap_chain_images;
   VkImageView *vk_swap_chain_images_views;
   struct VkExtent2D vk_extent_2d;
+  // Null with dynamic rendering.
   VkFramebuffer *vk_swap_chain_framebuffers;
+  // Signalled when rendering to a swap chain image is done, waited on before presenting it. There is one per image
+  // rather than per frame, as no fence tells when a present has consumed its semaphore - only acquiring the image again
+  // does.
+  VkSemaphore *vk_render_finished_semaphores;
 
-  VkCommandBuffer *vk_command_buffers;
-  uint32_t command_buffer_len;
-  VkSemaphore vk_semaphore;
-  VkFence vk_fence;
+  // The number of entries in use in frames, between 1 and VTK_MAX_FRAMES_IN_FLIGHT.
+  uint32_t frames_in_flight;
+  // Index into frames of the frame to be rendered next.
+  uint32_t current_frame_idx;
+  struct VtkFrameNative frames[VTK_MAX_FRAMES_IN_FLIGHT];
+  // The number of frames submitted so far.
+  uint64_t frame_number;
+  // Frames wait for uploads up to this ticket to complete before reading vertex input or running shaders.
+  uint64_t upload_wait_ticket;
+  // Frames wait for compute dispatches up to this ticket to complete before reading vertex input or running shaders.
+  uint64_t compute_wait_ticket;
+  // The graphics queue ticket signalled when the latest submitted frame has finished rendering.
+  uint64_t frame_ticket;
+
+  /** Images acquired from the current swap chain, which tell when presents are done. <div rustbindgen private> */
+  uint64_t swap_chain_acquire_count;
+  // Replaced swap chains whose resources may still be in use by frames in flight or pending presents.
+  uint32_t num_retired_swap_chains;
+  struct VtkRetiredSwapChainNative retired_swap_chains[VTK_MAX_RETIRED_SWAP_CHAINS];
+
+  // Persistently mapped ring buffer for dynamic data written every frame, see vtk_window_allocate_frame_data().
+  VkBuffer vk_frame_data_buffer;
+  /** <div rustbindgen private> */
+  struct VtkMemoryAllocationNative frame_data_allocation;
+  /** <div rustbindgen private> */
+  uint8_t *frame_data_ptr;
+  /** <div rustbindgen private> */
+  uint64_t frame_data_size;
+  /** Alignment of every frame data allocation. <div rustbindgen private> */
+  uint64_t frame_data_alignment;
+  /** Ever increasing ring positions, the range between tail and head being in use. <div rustbindgen private> */
+  uint64_t frame_data_head;
+  /** <div rustbindgen private> */
+  uint64_t frame_data_tail;
+
+  /** Timestamp queries of the frames, null if unsupported. <div rustbindgen private> */
+  struct VtkGpuTimerNative *gpu_timer;
+  // GPU timings of the latest frame to have finished rendering, read back without waiting on the GPU.
+  struct VtkGpuFrameTimingsNative gpu_frame_timings;
+
+  /** Ring of CPU timings of recent frames, see vtk_window_copy_frame_timings(). <div rustbindgen private> */
+  struct VtkFrameTimingNative frame_timings[VTK_FRAME_TIMING_HISTORY];
+  /** The number of timings written to the ring so far. <div rustbindgen private> */
+  struct VtkHistoryNative frame_timing_history;
+  /** Whether a frame has been begun and not yet ended. <div rustbindgen private> */
+  _Bool frame_begun;
+  /** Timings of the frame being rendered, and the start of its current phase. <div rustbindgen private> */
+  struct VtkFrameTimingNative frame_timing;
+  /** <div rustbindgen private> */
+  uint64_t frame_lap_start;
+
+  /** Secondary command buffers finished by recorders, executed by the next frame. <div rustbindgen private> */
+  struct VtkRecordingNative *recording;
 
 #ifdef __APPLE__
   /** Platform-specific data. <div rustbindgen private> */
@@ -116,24 +506,290 @@ struct VtkWindowNative {
   struct wl_surface *wayland_surface;
   struct xdg_surface *wayland_shell_surface;
   struct xdg_toplevel_listener *wayland_toplevel_listener;
+  // The logical size of the surface, in surface coordinates.
   struct VkExtent2D wayland_size_requested_by_compositor;
+  /** <div rustbindgen private> */
+  struct wp_viewport *wayland_viewport;
+  /** <div rustbindgen private> */
+  struct wp_fractional_scale_v1 *wayland_fractional_scale;
+  /** The logical size the viewport scales the swap chain images to. <div rustbindgen private> */
+  struct VkExtent2D wayland_viewport_size;
+  // The scale from logical to physical pixels preferred by the compositor, in 120ths, updated atomically. Integer
+  // scales are used when the compositor has no fractional ones.
+  /** Read with vtk_window_surface_scale(). <div rustbindgen private> */
+  uint32_t wayland_scale_120;
+  // The size of the swap chain images relative to the physical pixel size, see vtk_window_set_render_scale().
+  float render_scale;
+  /** Frame callbacks of the surface, see vtk_window_wait_for_frame(). <div rustbindgen private> */
+  struct VtkFramePacingNative *wayland_frame_pacing;
+  /** The lock of the pointer to the surface, see vtk_window_set_pointer_locked(). <div rustbindgen private> */
+  struct zwp_locked_pointer_v1 *wayland_locked_pointer;
+  /** Presentation feedback of frames, see vtk_window_copy_presentations(). <div rustbindgen private> */
+  struct VtkPresentationFeedbackNative *wayland_presentation_feedback;
 #endif
 };
 
 /** Null-terminated, static string. <div rustbindgen private> */
 VkShaderModule vtk_device_create_shader(struct VtkDeviceNative *vtk_device, uint8_t const *bytes, size_t size);
 
+void vtk_device_destroy_shader(struct VtkDeviceNative *vtk_device, VkShaderModule shader);
+
 struct VtkContextNative *vtk_context_init();
 
-// Run the event loop.
+#if defined __linux__ && !defined __ANDROID__
+// Create a context without a display server connection, whose windows render to VK_EXT_headless_surface swap chains
+// that are never displayed. vtk_context_init() does the same if the VTK_HEADLESS environment variable is set, or if
+// no Wayland compositor can be connected to.
+struct VtkContextNative *vtk_context_init_headless(void);
+
+// Run a task on the thread running the event loop of the context, as soon as possible. May be called from any thread.
+void vtk_context_post_task(struct VtkContextNative *vtk_context, void (*task)(void *user_data), void *user_data);
+
+// Run a task on the thread running the event loop after delay_ns nanoseconds, and then every interval_ns nanoseconds
+// unless that is 0. Returns the id to cancel the task with. Once the task will not run again, destroy is called with
+// the user data on the loop thread, unless it is null. May be called from any thread.
+uint64_t vtk_context_schedule_task(struct VtkContextNative *vtk_context, uint64_t delay_ns, uint64_t interval_ns,
+                                   void (*task)(void *user_data), void (*destroy)(void *user_data), void *user_data);
+
+// Cancel a scheduled task. It may still be running on the loop thread when this returns. May be called from any thread.
+void vtk_context_cancel_task(struct VtkContextNative *vtk_context, uint64_t timer_id);
+
+// Make vtk_context_run() return, once it has finished handling the current events. May be called from any thread.
+void vtk_context_quit(struct VtkContextNative *vtk_context);
+
+// Copy the oldest input events not yet drained to events, at most max_count, returning how many were. Never blocks.
+// Must only be called from one thread at a time, as the ring has a single consumer.
+uint32_t vtk_context_drain_input(struct VtkContextNative *vtk_context, struct VtkInputEventNative *events,
+                                 uint32_t max_count);
+
+// The Key bits of the keys held, including keys whose events were dropped or are not yet drained.
+uint64_t vtk_context_held_keys(struct VtkContextNative *vtk_context);
+
+// The VTK_POINTER_BUTTON_* bits of the pointer buttons held, like vtk_context_held_keys().
+uint32_t vtk_context_held_buttons(struct VtkContextNative *vtk_context);
+
+// Lock the pointer in place while it is over the window, or release it. A locked pointer only reports relative motion,
+// for camera controls. Does nothing if the compositor does not support zwp_pointer_constraints_v1. May be called from
+// any thread, the lock is changed on the thread running the event loop.
+void vtk_window_set_pointer_locked(struct VtkWindowNative *vtk_window, _Bool locked);
+
+// Render the window at render_scale times its size in physical pixels, from the next frame on. The compositor scales
+// the frames to the window, so below 1 trades sharpness for fill rate - and 1 renders at the exact physical pixel size
+// on outputs with fractional scales. Without wp_viewporter support the window renders at its logical size instead.
+void vtk_window_set_render_scale(struct VtkWindowNative *vtk_window, float render_scale);
+
+// The scale from logical to physical pixels preferred by the compositor, like 1.5 on an output scaled to 150%. May be
+// called from any thread while the event loop updates it.
+float vtk_window_surface_scale(struct VtkWindowNative *vtk_window);
+
+// Copy the presentation records of up to max_count of the most recently presented or discarded frames to
+// presentations, oldest first, and return the number copied. Frames are reported some time after they were rendered,
+// and none are if the compositor does not support wp_presentation - or the window is headless. Does not lock, so it
+// may be called from any thread.
+uint32_t vtk_window_copy_presentations(struct VtkWindowNative *vtk_window, struct VtkPresentationNative *presentations,
+                                       uint32_t max_count);
+
+// The totals of all frames of the window reported so far.
+struct VtkPresentationStatsNative vtk_window_presentation_stats(struct VtkWindowNative *vtk_window);
+
+// The number of input events dropped because the ring was full, as no thread drained it in time.
+uint64_t vtk_context_dropped_input_events(struct VtkContextNative *vtk_context);
+#endif
+
+// Run the event loop. On Linux it runs until vtk_context_quit() is called, also for headless contexts.
 void vtk_context_run(struct VtkContextNative *context);
 
+// Wait until the compositor wants a new frame of the window, for at most timeout_ns nanoseconds - UINT64_MAX waits
+// indefinitely. Returns false if the wait timed out. Rendering a frame only after waiting paces rendering to the
+// compositor, which wants no frames at all while the window is hidden. Windows not presented to a compositor, like
+// headless ones, and all windows on macOS are paced by presentation alone and never wait.
+_Bool vtk_window_wait_for_frame(struct VtkWindowNative *vtk_window, uint64_t timeout_ns);
+
 struct VtkDeviceNative *vtk_device_init(struct VtkContextNative *vtk_context);
 
+// Create a device, using the physical device matching device_selector if not null. The selector is either an index
+// into the enumerated physical devices, or a case insensitive part of the device name. Without a selector the
+// VTK_DEVICE environment variable is used in the same way, and without that the highest scoring device is chosen.
+struct VtkDeviceNative *vtk_device_init_with_selector(struct VtkContextNative *vtk_context,
+                                                      char const *device_selector);
+
 struct VtkWindowNative *vtk_window_init(struct VtkDeviceNative *vtk_device);
 
+// Begin recording the next frame: wait for the frame which last used its frame resources to finish, reset their
+// command pool, and begin a secondary command buffer for draws in the surface render pass. The draws execute before
+// those of recorders. Frame data allocated and command buffers recorded until vtk_window_end_frame() belong to the
+// frame.
+VkCommandBuffer vtk_window_begin_frame(struct VtkWindowNative *vtk_window);
+
+// Finish recording the frame, and render and present it. If the swap chain turns out to be out of date, it is
+// recreated and the frame is dropped along with the command buffers recorded for it.
+void vtk_window_end_frame(struct VtkWindowNative *vtk_window);
+
+// Render a frame without draws of its own, the same as vtk_window_begin_frame() and vtk_window_end_frame().
 void vtk_render_frame(struct VtkWindowNative *vtk_window);
 
+// Create a buffer, usable as a destination for uploads in addition to the given VkBufferUsageFlags. It is shared
+// concurrently between the graphics, compute and transfer queue families, so no ownership transfers are needed.
+// Its memory is sub-allocated into allocation - device local, or host visible, coherent and mapped if host_visible.
+VkBuffer vtk_device_create_buffer(struct VtkDeviceNative *vtk_device, uint64_t size, uint32_t usage,
+                                  _Bool host_visible, struct VtkMemoryAllocationNative *allocation);
+
+void vtk_device_destroy_buffer(struct VtkDeviceNative *vtk_device, VkBuffer buffer,
+                               struct VtkMemoryAllocationNative *allocation);
+
+// Statistics on the device memory of the device. May be called from any thread.
+struct VtkMemoryStatsNative vtk_device_memory_stats(struct VtkDeviceNative *vtk_device);
+
+// Copy data to a device local buffer through a staging buffer on the transfer queue, without waiting for the copy to
+// finish. Returns a ticket, the value the upload timeline semaphore reaches when the copy has completed. This may
+// be called from any thread.
+uint64_t vtk_device_upload_buffer(struct VtkDeviceNative *vtk_device, VkBuffer buffer, uint64_t offset,
+                                  uint8_t const *data, size_t size);
+
+// Copy tightly packed texels to mip level 0 and array layer 0 of a color image on the transfer queue, leaving it in
+// VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL. As with buffers the image must be shared concurrently between the
+// graphics and transfer queue families if they differ. Returns a ticket as vtk_device_upload_buffer().
+uint64_t vtk_device_upload_image(struct VtkDeviceNative *vtk_device, VkImage image, uint32_t width, uint32_t height,
+                                 uint32_t texel_size, uint8_t const *data);
+
+_Bool vtk_device_upload_complete(struct VtkDeviceNative *vtk_device, uint64_t ticket);
+
+// Block until the upload with the given ticket has completed.
+void vtk_device_wait_for_upload(struct VtkDeviceNative *vtk_device, uint64_t ticket);
+
+// Make frames rendered from now on wait on the GPU for the upload with the given ticket, without blocking the CPU.
+void vtk_window_wait_for_upload(struct VtkWindowNative *vtk_window, uint64_t ticket);
+
+// Create a compute pipeline running the main function of the shader module. The pipeline reads and writes
+// storage_buffer_count storage buffers, at bindings 0 and up of descriptor set 0, and takes push_constant_size bytes
+// of push constants.
+struct VtkComputePipelineNative *vtk_device_create_compute_pipeline(struct VtkDeviceNative *vtk_device,
+                                                                    VkShaderModule shader_module,
+                                                                    uint32_t storage_buffer_count,
+                                                                    uint32_t push_constant_size);
+
+void vtk_device_destroy_compute_pipeline(struct VtkDeviceNative *vtk_device,
+                                         struct VtkComputePipelineNative *pipeline);
+
+// Dispatch a compute pipeline on the compute queue, without waiting for it to finish. The buffers are bound in order
+// to the storage buffer bindings of the pipeline. Before running, the dispatch waits on the GPU for the frame with
+// frame_ticket to finish rendering and for the upload with upload_ticket to complete, if non-zero. Returns a ticket
+// of the compute queue which frames can wait on. This may be called from any thread.
+uint64_t vtk_device_dispatch_compute(struct VtkDeviceNative *vtk_device, struct VtkComputePipelineNative *pipeline,
+                                     VkBuffer const *buffers, uint8_t const *push_constants, uint32_t group_count_x,
+                                     uint32_t group_count_y, uint32_t group_count_z, uint64_t frame_ticket,
+                                     uint64_t upload_ticket);
+
+_Bool vtk_device_compute_complete(struct VtkDeviceNative *vtk_device, uint64_t ticket);
+
+// Block until the dispatch with the given ticket has completed.
+void vtk_device_wait_for_compute(struct VtkDeviceNative *vtk_device, uint64_t ticket);
+
+// Make frames rendered from now on wait on the GPU for the dispatch with the given ticket, without blocking the CPU.
+void vtk_window_wait_for_compute(struct VtkWindowNative *vtk_window, uint64_t ticket);
+
+// Allocate size bytes of dynamic data - vertices, indices, uniforms - for the next frame to be rendered, from the
+// ring buffer vk_frame_data_buffer. The allocation starts at *offset in the buffer, aligned to at least alignment and
+// to what uniform and storage buffer bindings require. The returned host coherent pointer may be written to until the
+// frame is rendered, and the space is reused once the GPU has finished the frame. Blocks for frames in flight if the
+// ring is full, and returns null if the allocations of the frame alone would not fit.
+void *vtk_window_allocate_frame_data(struct VtkWindowNative *vtk_window, uint64_t size, uint64_t alignment,
+                                     uint64_t *offset);
+
+// Copy the CPU timings of up to max_count of the most recent frames to timings, oldest first, and return the number
+// copied. Does not lock, so it may be called from any thread while the window renders.
+uint32_t vtk_window_copy_frame_timings(struct VtkWindowNative *vtk_window, struct VtkFrameTimingNative *timings,
+                                       uint32_t max_count);
+
+// Write the pipeline cache to disk. On Linux this is done by the event loop of the context once no pipelines missing
+// from the cache have been created for a second, elsewhere only when this is called.
+void vtk_device_save_pipeline_cache(struct VtkDeviceNative *vtk_device);
+
+// Statistics on pipeline creation since the device was created. May be called from any thread.
+struct VtkPipelineCacheStatsNative vtk_device_pipeline_cache_stats(struct VtkDeviceNative *vtk_device);
+
+// Change the number of frames that may be in flight. Waits for the GPU to finish all frames in flight.
+void vtk_window_set_frames_in_flight(struct VtkWindowNative *vtk_window, uint32_t frames_in_flight);
+
+// Request a present mode and swap chain image count, and recreate the swap chain with them. Unsupported present
+// modes fall back to a supported one, and the image count is clamped to what the surface supports - the values
+// actually used are available in vk_present_mode and num_swap_chain_images afterwards.
+void vtk_window_configure_swap_chain(struct VtkWindowNative *vtk_window, VkPresentModeKHR present_mode,
+                                     uint32_t image_count);
+
+// Create a graphics pipeline drawing triangles to the surface of the window, with the main functions of the shader
+// modules. The vertex attributes, at locations 0 and up, are read from a single vertex buffer of vertex_stride bytes
+// per vertex. The pipeline takes push_constant_size bytes of push constants, in both stages. Viewport and scissor are
+// dynamic, set to the whole window by vtk_recorder_begin(), so the pipeline survives resizes and may draw in any window
+// with the same surface format. So are cull mode, front face and topology if the device has extended_dynamic_state,
+// defaulting to no culling of counter-clockwise triangle lists - the fixed state otherwise.
+struct VtkGraphicsPipelineNative *vtk_window_create_graphics_pipeline(
+    struct VtkWindowNative *vtk_window, VkShaderModule vertex_shader, VkShaderModule fragment_shader,
+    uint32_t vertex_stride, uint32_t vertex_attribute_count, struct VtkVertexAttributeNative const *vertex_attributes,
+    uint32_t push_constant_size);
+
+void vtk_window_destroy_graphics_pipeline(struct VtkWindowNative *vtk_window,
+                                          struct VtkGraphicsPipelineNative *pipeline);
+
+// Create a recorder of draw commands for the window. A recorder may only be used by one thread at a time, so parallel
+// recording takes a recorder per thread - typically created once per worker and kept.
+struct VtkRecorderNative *vtk_window_create_recorder(struct VtkWindowNative *vtk_window);
+
+// Destroy a recorder. The window frees it once the frames which may use its command buffers have finished, so this
+// never blocks and may be called from any thread.
+void vtk_window_destroy_recorder(struct VtkWindowNative *vtk_window, struct VtkRecorderNative *recorder);
+
+// Begin a secondary command buffer drawing in the surface render pass of the next frame to be rendered, with viewport
+// and scissor covering the window. Several command buffers of a recorder may be recorded at once. Must only be called
+// between vtk_window_begin_frame() and vtk_window_end_frame(), and the command buffer finished before the frame ends.
+VkCommandBuffer vtk_recorder_begin(struct VtkRecorderNative *recorder);
+
+// Finish a command buffer begun with vtk_recorder_begin(), queueing it for the next frame. The command buffers of a
+// frame execute sorted by order, and those of equal order in the order they were finished.
+void vtk_recorder_end(struct VtkRecorderNative *recorder, VkCommandBuffer vk_command_buffer, uint32_t order);
+
+// Commands recorded into the command buffers of recorders.
+void vtk_command_bind_graphics_pipeline(VkCommandBuffer vk_command_buffer,
+                                        struct VtkGraphicsPipelineNative const *pipeline);
+
+// Bind the vertex buffer read by the vertex attributes of graphics pipelines.
+void vtk_command_bind_vertex_buffer(VkCommandBuffer vk_command_buffer, VkBuffer buffer, uint64_t offset);
+
+// Bind an index buffer of 32-bit indices.
+void vtk_command_bind_index_buffer(VkCommandBuffer vk_command_buffer, VkBuffer buffer, uint64_t offset);
+
+// Set the first size bytes of the push constants of the pipeline.
+void vtk_command_push_constants(VkCommandBuffer vk_command_buffer, struct VtkGraphicsPipelineNative const *pipeline,
+                                uint8_t const *data, uint32_t size);
+
+// Set the viewport, in pixels from the top left corner of the window.
+void vtk_command_set_viewport(VkCommandBuffer vk_command_buffer, float x, float y, float width, float height);
+
+// Set the scissor rectangle, in pixels from the top left corner of the window.
+void vtk_command_set_scissor(VkCommandBuffer vk_command_buffer, int32_t x, int32_t y, uint32_t width, uint32_t height);
+
+// Set the faces culled, front faces winding clockwise if front_clockwise. The device must have extended_dynamic_state.
+void vtk_command_set_cull_mode(VkCommandBuffer vk_command_buffer, enum VtkCullModeNative cull_mode,
+                               _Bool front_clockwise);
+
+// Set the primitive topology. The device must have extended_dynamic_state.
+void vtk_command_set_primitive_topology(VkCommandBuffer vk_command_buffer, enum VtkPrimitiveTopologyNative topology);
+
+void vtk_command_draw(VkCommandBuffer vk_command_buffer, uint32_t vertex_count, uint32_t instance_count,
+                      uint32_t first_vertex, uint32_t first_instance);
+
+void vtk_command_draw_indexed(VkCommandBuffer vk_command_buffer, uint32_t index_count, uint32_t instance_count,
+                              uint32_t first_index, int32_t vertex_offset, uint32_t first_instance);
+
+// Begin timing a named scope of the following commands of a command buffer of the frame being recorded, nested depth
+// scopes deep within the command buffer. name must be a static string. Returns the scope to pass to
+// vtk_command_end_gpu_scope() in the same command buffer, UINT32_MAX if it is not timed - because the device lacks
+// timestamps, or the frame already has VTK_MAX_GPU_TIMER_SCOPES. Reported by the gpu_frame_timings of the window.
+uint32_t vtk_command_begin_gpu_scope(struct VtkWindowNative *vtk_window, VkCommandBuffer vk_command_buffer,
+                                     char const *name, uint32_t depth);
+
+void vtk_command_end_gpu_scope(struct VtkWindowNative *vtk_window, VkCommandBuffer vk_command_buffer, uint32_t scope);
+
 #ifdef __cplusplus
 }
 #endif
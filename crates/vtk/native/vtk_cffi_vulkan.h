@@ -2,7 +2,9 @@
 
 typedef unsigned char uint8_t;
 typedef unsigned long size_t;
+typedef int int32_t;
 typedef unsigned int uint32_t;
+typedef unsigned long long uint64_t;
 
 typedef void *VkBuffer;
 typedef void *VkDevice;
@@ -374,3 +376,15 @@ typedef enum VkColorSpaceKHR {
   // Provided by VK_EXT_swapchain_colorspace
   VK_COLOR_SPACE_DCI_P3_LINEAR_EXT = VK_COLOR_SPACE_DISPLAY_P3_LINEAR_EXT,
 } VkColorSpaceKHR;
+
+// Provided by VK_KHR_surface
+typedef enum VkPresentModeKHR {
+  VK_PRESENT_MODE_IMMEDIATE_KHR = 0,
+  VK_PRESENT_MODE_MAILBOX_KHR = 1,
+  VK_PRESENT_MODE_FIFO_KHR = 2,
+  VK_PRESENT_MODE_FIFO_RELAXED_KHR = 3,
+  // Provided by VK_KHR_shared_presentable_image
+  VK_PRESENT_MODE_SHARED_DEMAND_REFRESH_KHR = 1000111000,
+  // Provided by VK_KHR_shared_presentable_image
+  VK_PRESENT_MODE_SHARED_CONTINUOUS_REFRESH_KHR = 1000111001,
+} VkPresentModeKHR;
@@ -0,0 +1,293 @@
+// Compute dispatches on the compute queue, overlapping with rendering on the graphics queue. Dependencies between
+// the queues are expressed with the timeline semaphores of the queues: dispatches may wait for frames and uploads,
+// and frames may wait for dispatches.
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vtk_array.h"
+#include "vtk_cffi.h"
+#include "vtk_internal.h"
+#include "vtk_log.h"
+#include "vulkan_wrapper.h"
+
+// Maximum number of dispatches in flight.
+#define VTK_MAX_PENDING_DISPATCHES 16
+
+struct VtkComputePipelineNative {
+  VkDescriptorSetLayout vk_descriptor_set_layout;
+  VkPipelineLayout vk_pipeline_layout;
+  VkPipeline vk_pipeline;
+  uint32_t storage_buffer_count;
+  uint32_t push_constant_size;
+};
+
+struct VtkPendingDispatch {
+  VkCommandBuffer vk_command_buffer;
+  // Holds the descriptor set of the dispatch, reset when the slot is reused.
+  VkDescriptorPool vk_descriptor_pool;
+  // The compute queue ticket signalled when the dispatch has completed.
+  uint64_t ticket;
+};
+
+struct VtkComputeNative {
+  // Dispatches may be made from any thread.
+  pthread_mutex_t mutex;
+  VkCommandPool vk_command_pool;
+
+  // Ring of pending dispatches in submission order.
+  struct VtkPendingDispatch pending[VTK_MAX_PENDING_DISPATCHES];
+  uint32_t pending_start;
+  uint32_t pending_count;
+};
+
+void vtk_compute_init(struct VtkDeviceNative *vtk_device) {
+  VkDevice vk_device = vtk_device->vk_device;
+  struct VtkComputeNative *compute = (struct VtkComputeNative *)calloc(1, sizeof(struct VtkComputeNative));
+  pthread_mutex_init(&compute->mutex, NULL);
+
+  VkCommandPoolCreateInfo vk_command_pool_create_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+      .pNext = NULL,
+      .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+      .queueFamilyIndex = vtk_device->compute_queue_family_idx,
+  };
+  CALL_VK(vkCreateCommandPool(vk_device, &vk_command_pool_create_info, NULL, &compute->vk_command_pool))
+
+  VkCommandBuffer vk_command_buffers[VTK_MAX_PENDING_DISPATCHES];
+  VkCommandBufferAllocateInfo vk_command_buffers_allocate_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+      .pNext = NULL,
+      .commandPool = compute->vk_command_pool,
+      .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+      .commandBufferCount = VTK_MAX_PENDING_DISPATCHES,
+  };
+  CALL_VK(vkAllocateCommandBuffers(vk_device, &vk_command_buffers_allocate_info, vk_command_buffers))
+
+  VkDescriptorPoolSize vk_descriptor_pool_size = {
+      .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+      .descriptorCount = VTK_MAX_COMPUTE_STORAGE_BUFFERS,
+  };
+  VkDescriptorPoolCreateInfo vk_descriptor_pool_create_info = {
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+      .pNext = NULL,
+      .flags = 0,
+      .maxSets = 1,
+      .poolSizeCount = 1,
+      .pPoolSizes = &vk_descriptor_pool_size,
+  };
+  for (uint32_t i = 0; i < VTK_MAX_PENDING_DISPATCHES; i++) {
+    compute->pending[i].vk_command_buffer = vk_command_buffers[i];
+    CALL_VK(vkCreateDescriptorPool(vk_device, &vk_descriptor_pool_create_info, NULL,
+                                   &compute->pending[i].vk_descriptor_pool))
+  }
+
+  vtk_device->compute = compute;
+}
+
+struct VtkComputePipelineNative *vtk_device_create_compute_pipeline(struct VtkDeviceNative *vtk_device,
+                                                                    VkShaderModule shader_module,
+                                                                    uint32_t storage_buffer_count,
+                                                                    uint32_t push_constant_size) {
+  assert(storage_buffer_count <= VTK_MAX_COMPUTE_STORAGE_BUFFERS);
+  assert(push_constant_size <= VTK_MAX_COMPUTE_PUSH_CONSTANT_SIZE && push_constant_size % 4 == 0);
+  VkDevice vk_device = vtk_device->vk_device;
+  struct VtkComputePipelineNative *pipeline =
+      (struct VtkComputePipelineNative *)malloc(sizeof(struct VtkComputePipelineNative));
+  pipeline->storage_buffer_count = storage_buffer_count;
+  pipeline->push_constant_size = push_constant_size;
+
+  VkDescriptorSetLayoutBinding vk_bindings[VTK_MAX_COMPUTE_STORAGE_BUFFERS];
+  for (uint32_t i = 0; i < storage_buffer_count; i++) {
+    vk_bindings[i] = (VkDescriptorSetLayoutBinding){
+        .binding = i,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = 1,
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .pImmutableSamplers = NULL,
+    };
+  }
+  VkDescriptorSetLayoutCreateInfo vk_descriptor_set_layout_create_info = {
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+      .pNext = NULL,
+      .flags = 0,
+      .bindingCount = storage_buffer_count,
+      .pBindings = vk_bindings,
+  };
+  CALL_VK(vkCreateDescriptorSetLayout(vk_device, &vk_descriptor_set_layout_create_info, NULL,
+                                      &pipeline->vk_descriptor_set_layout))
+
+  VkPushConstantRange vk_push_constant_range = {
+      .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+      .offset = 0,
+      .size = push_constant_size,
+  };
+  VkPipelineLayoutCreateInfo vk_pipeline_layout_create_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+      .pNext = NULL,
+      .flags = 0,
+      .setLayoutCount = 1,
+      .pSetLayouts = &pipeline->vk_descriptor_set_layout,
+      .pushConstantRangeCount = push_constant_size > 0 ? 1 : 0,
+      .pPushConstantRanges = &vk_push_constant_range,
+  };
+  CALL_VK(vkCreatePipelineLayout(vk_device, &vk_pipeline_layout_create_info, NULL, &pipeline->vk_pipeline_layout))
+
+  VkComputePipelineCreateInfo vk_compute_pipeline_create_info = {
+      .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+      .pNext = NULL,
+      .flags = 0,
+      .stage =
+          {
+              .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+              .pNext = NULL,
+              .flags = 0,
+              .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+              .module = shader_module,
+              .pName = "main",
+              .pSpecializationInfo = NULL,
+          },
+      .layout = pipeline->vk_pipeline_layout,
+      .basePipelineHandle = VK_NULL_HANDLE,
+      .basePipelineIndex = -1,
+  };
+  vtk_pipeline_cache_create_compute_pipeline(vtk_device, &vk_compute_pipeline_create_info, &pipeline->vk_pipeline);
+  return pipeline;
+}
+
+void vtk_device_destroy_compute_pipeline(struct VtkDeviceNative *vtk_device,
+                                         struct VtkComputePipelineNative *pipeline) {
+  VkDevice vk_device = vtk_device->vk_device;
+  vkDestroyPipeline(vk_device, pipeline->vk_pipeline, NULL);
+  vkDestroyPipelineLayout(vk_device, pipeline->vk_pipeline_layout, NULL);
+  vkDestroyDescriptorSetLayout(vk_device, pipeline->vk_descriptor_set_layout, NULL);
+  free(pipeline);
+}
+
+// Retire completed dispatches, blocking until the oldest one has completed if all slots are in use.
+static void vtk_compute_retire(struct VtkDeviceNative *vtk_device) {
+  struct VtkComputeNative *compute = vtk_device->compute;
+  if (compute->pending_count == VTK_MAX_PENDING_DISPATCHES) {
+    vtk_queue_wait_for_ticket(vtk_device, vtk_device->compute_queue, compute->pending[compute->pending_start].ticket);
+  }
+  while (compute->pending_count > 0 && vtk_queue_ticket_complete(vtk_device, vtk_device->compute_queue,
+                                                                 compute->pending[compute->pending_start].ticket)) {
+    compute->pending_start = (compute->pending_start + 1) % VTK_MAX_PENDING_DISPATCHES;
+    compute->pending_count--;
+  }
+}
+
+uint64_t vtk_device_dispatch_compute(struct VtkDeviceNative *vtk_device, struct VtkComputePipelineNative *pipeline,
+                                     VkBuffer const *buffers, uint8_t const *push_constants, uint32_t group_count_x,
+                                     uint32_t group_count_y, uint32_t group_count_z, uint64_t frame_ticket,
+                                     uint64_t upload_ticket) {
+  VkDevice vk_device = vtk_device->vk_device;
+  struct VtkComputeNative *compute = vtk_device->compute;
+  pthread_mutex_lock(&compute->mutex);
+
+  vtk_compute_retire(vtk_device);
+  struct VtkPendingDispatch *dispatch =
+      &compute->pending[(compute->pending_start + compute->pending_count) % VTK_MAX_PENDING_DISPATCHES];
+
+  CALL_VK(vkResetDescriptorPool(vk_device, dispatch->vk_descriptor_pool, 0))
+  VkDescriptorSet vk_descriptor_set;
+  VkDescriptorSetAllocateInfo vk_descriptor_set_allocate_info = {
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+      .pNext = NULL,
+      .descriptorPool = dispatch->vk_descriptor_pool,
+      .descriptorSetCount = 1,
+      .pSetLayouts = &pipeline->vk_descriptor_set_layout,
+  };
+  CALL_VK(vkAllocateDescriptorSets(vk_device, &vk_descriptor_set_allocate_info, &vk_descriptor_set))
+  VkDescriptorBufferInfo vk_buffer_infos[VTK_MAX_COMPUTE_STORAGE_BUFFERS];
+  VkWriteDescriptorSet vk_writes[VTK_MAX_COMPUTE_STORAGE_BUFFERS];
+  for (uint32_t i = 0; i < pipeline->storage_buffer_count; i++) {
+    vk_buffer_infos[i] = (VkDescriptorBufferInfo){.buffer = buffers[i], .offset = 0, .range = VK_WHOLE_SIZE};
+    vk_writes[i] = (VkWriteDescriptorSet){
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .pNext = NULL,
+        .dstSet = vk_descriptor_set,
+        .dstBinding = i,
+        .dstArrayElement = 0,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pImageInfo = NULL,
+        .pBufferInfo = &vk_buffer_infos[i],
+        .pTexelBufferView = NULL,
+    };
+  }
+  vkUpdateDescriptorSets(vk_device, pipeline->storage_buffer_count, vk_writes, 0, NULL);
+
+  CALL_VK(vkResetCommandBuffer(dispatch->vk_command_buffer, 0))
+  VkCommandBufferBeginInfo vk_command_buffer_begin_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+      .pNext = NULL,
+      .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+      .pInheritanceInfo = NULL,
+  };
+  CALL_VK(vkBeginCommandBuffer(dispatch->vk_command_buffer, &vk_command_buffer_begin_info))
+  vkCmdBindPipeline(dispatch->vk_command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->vk_pipeline);
+  vkCmdBindDescriptorSets(dispatch->vk_command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->vk_pipeline_layout, 0,
+                          1, &vk_descriptor_set, 0, NULL);
+  if (pipeline->push_constant_size > 0) {
+    vkCmdPushConstants(dispatch->vk_command_buffer, pipeline->vk_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                       pipeline->push_constant_size, push_constants);
+  }
+  vkCmdDispatch(dispatch->vk_command_buffer, group_count_x, group_count_y, group_count_z);
+  CALL_VK(vkEndCommandBuffer(dispatch->vk_command_buffer))
+
+  // Waiting on the timeline semaphores makes writes of the frame or upload visible to the compute shader.
+  VkSemaphore vk_wait_semaphores[2];
+  uint64_t wait_semaphore_values[2];
+  VkPipelineStageFlags vk_wait_stages[2];
+  uint32_t wait_semaphore_count = 0;
+  if (frame_ticket > 0) {
+    vk_wait_semaphores[wait_semaphore_count] = vtk_device->graphics_queue->vk_timeline_semaphore;
+    wait_semaphore_values[wait_semaphore_count] = frame_ticket;
+    vk_wait_stages[wait_semaphore_count++] = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+  }
+  if (upload_ticket > 0) {
+    vk_wait_semaphores[wait_semaphore_count] = vtk_uploader_semaphore(vtk_device);
+    wait_semaphore_values[wait_semaphore_count] = upload_ticket;
+    vk_wait_stages[wait_semaphore_count++] = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+  }
+  VkTimelineSemaphoreSubmitInfo vk_timeline_submit_info = {
+      .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+      .pNext = NULL,
+      .waitSemaphoreValueCount = wait_semaphore_count,
+      .pWaitSemaphoreValues = wait_semaphore_values,
+      .signalSemaphoreValueCount = 1,
+      .pSignalSemaphoreValues = &dispatch->ticket,
+  };
+  VkSubmitInfo submit_info = {
+      .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+      .pNext = &vk_timeline_submit_info,
+      .waitSemaphoreCount = wait_semaphore_count,
+      .pWaitSemaphores = vk_wait_semaphores,
+      .pWaitDstStageMask = vk_wait_stages,
+      .commandBufferCount = 1,
+      .pCommandBuffers = &dispatch->vk_command_buffer,
+      .signalSemaphoreCount = 1,
+      .pSignalSemaphores = &vtk_device->compute_queue->vk_timeline_semaphore,
+  };
+  uint64_t ticket = vtk_queue_submit_timeline(vtk_device->compute_queue, &submit_info, &dispatch->ticket,
+                                              VK_NULL_HANDLE);
+  compute->pending_count++;
+
+  pthread_mutex_unlock(&compute->mutex);
+  return ticket;
+}
+
+_Bool vtk_device_compute_complete(struct VtkDeviceNative *vtk_device, uint64_t ticket) {
+  return vtk_queue_ticket_complete(vtk_device, vtk_device->compute_queue, ticket);
+}
+
+void vtk_device_wait_for_compute(struct VtkDeviceNative *vtk_device, uint64_t ticket) {
+  vtk_queue_wait_for_ticket(vtk_device, vtk_device->compute_queue, ticket);
+}
+
+void vtk_window_wait_for_compute(struct VtkWindowNative *vtk_window, uint64_t ticket) {
+  if (ticket > vtk_window->compute_wait_ticket) {
+    vtk_window->compute_wait_ticket = ticket;
+  }
+}
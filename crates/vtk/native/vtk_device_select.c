@@ -0,0 +1,325 @@
+// Selection of the physical device to use, by scoring the available ones unless overridden by the application or
+// the VTK_DEVICE environment variable.
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "vtk_array.h"
+#include "vtk_cffi.h"
+#include "vtk_internal.h"
+#include "vtk_log.h"
+#include "vtk_platform.h"
+#include "vulkan_wrapper.h"
+
+// Device extensions without which a device cannot be used.
+static char const *vtk_required_device_extensions[] = {
+    "VK_KHR_swapchain",
+};
+
+// Score of each step up in device type - from CPU implementations, to other and virtual devices, to integrated and
+// then discrete GPUs. Larger than all other bonuses together, so that the device type always comes first.
+#define VTK_DEVICE_TYPE_SCORE 10000
+#define VTK_VULKAN_13_SCORE 500
+#define VTK_DYNAMIC_RENDERING_SCORE 200
+#define VTK_SYNCHRONIZATION2_SCORE 100
+#define VTK_COMPUTE_QUEUE_SCORE 150
+#define VTK_TRANSFER_QUEUE_SCORE 150
+#define VTK_DEVICE_LOCAL_GIB_SCORE 10
+#define VTK_MAX_SCORED_DEVICE_LOCAL_GIB 64
+
+_Static_assert(VTK_DEVICE_TYPE_SCORE > VTK_VULKAN_13_SCORE + VTK_DYNAMIC_RENDERING_SCORE + VTK_SYNCHRONIZATION2_SCORE +
+                                           VTK_COMPUTE_QUEUE_SCORE + VTK_TRANSFER_QUEUE_SCORE +
+                                           VTK_DEVICE_LOCAL_GIB_SCORE * VTK_MAX_SCORED_DEVICE_LOCAL_GIB,
+               "the device type must outweigh all other bonuses");
+
+struct VtkDeviceCandidate {
+  VkPhysicalDevice vk_physical_device;
+  VkPhysicalDeviceProperties properties;
+  // Negative if the device cannot be used.
+  int64_t score;
+  uint32_t graphics_queue_family_idx;
+  // Human readable explanation of the score.
+  char reason[512];
+};
+
+static void vtk_append_reason(struct VtkDeviceCandidate *candidate, char const *format, ...) {
+  size_t used = strlen(candidate->reason);
+  if (used + 2 >= sizeof(candidate->reason)) {
+    return;
+  }
+  if (used > 0) {
+    strcpy(candidate->reason + used, ", ");
+    used += 2;
+  }
+  va_list args;
+  va_start(args, format);
+  vsnprintf(candidate->reason + used, sizeof(candidate->reason) - used, format, args);
+  va_end(args);
+}
+
+static bool vtk_queue_family_can_present(struct VtkContextNative *vtk_context, VkPhysicalDevice vk_physical_device,
+                                         uint32_t queue_family_idx) {
+#ifdef VTK_PLATFORM_WAYLAND
+  if (vtk_context->headless) {
+    // Headless surfaces can be presented to from any queue family supporting graphics.
+    return true;
+  }
+  return vkGetPhysicalDeviceWaylandPresentationSupportKHR(vk_physical_device, queue_family_idx,
+                                                          vtk_context->wayland_display);
+#else
+  // Presentation support can only be queried for an existing surface on other platforms.
+  return true;
+#endif
+}
+
+bool vtk_has_extension(VkExtensionProperties const *extensions, uint32_t extension_count, char const *name) {
+  for (uint32_t i = 0; i < extension_count; i++) {
+    if (strcmp(extensions[i].extensionName, name) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void vtk_score_device(struct VtkContextNative *vtk_context, struct VtkDeviceCandidate *candidate) {
+  VkPhysicalDevice gpu = candidate->vk_physical_device;
+  candidate->score = 0;
+  candidate->reason[0] = '\0';
+
+  switch (candidate->properties.deviceType) {
+  case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+    candidate->score += 4 * VTK_DEVICE_TYPE_SCORE;
+    vtk_append_reason(candidate, "discrete GPU");
+    break;
+  case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+    candidate->score += 3 * VTK_DEVICE_TYPE_SCORE;
+    vtk_append_reason(candidate, "integrated GPU");
+    break;
+  case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+    candidate->score += 2 * VTK_DEVICE_TYPE_SCORE;
+    vtk_append_reason(candidate, "virtual GPU");
+    break;
+  case VK_PHYSICAL_DEVICE_TYPE_CPU:
+    vtk_append_reason(candidate, "CPU implementation");
+    break;
+  default:
+    candidate->score += VTK_DEVICE_TYPE_SCORE;
+    vtk_append_reason(candidate, "other device type");
+    break;
+  }
+
+  uint32_t api_version = candidate->properties.apiVersion;
+  if (VK_API_VERSION_MAJOR(api_version) == 1 && VK_API_VERSION_MINOR(api_version) < 1) {
+    candidate->score = -1;
+    vtk_append_reason(candidate, "only Vulkan 1.0");
+    return;
+  }
+  if (VK_API_VERSION_MINOR(api_version) >= 3) {
+    candidate->score += VTK_VULKAN_13_SCORE;
+    vtk_append_reason(candidate, "Vulkan 1.3");
+  }
+
+  uint32_t extension_count = 0;
+  CALL_VK(vkEnumerateDeviceExtensionProperties(gpu, NULL, &extension_count, NULL))
+  VkExtensionProperties *extensions = VTK_ARRAY_ALLOC(VkExtensionProperties, extension_count);
+  CALL_VK(vkEnumerateDeviceExtensionProperties(gpu, NULL, &extension_count, extensions))
+  for (uint32_t i = 0; i < VTK_ARRAY_SIZE(vtk_required_device_extensions); i++) {
+    if (!vtk_has_extension(extensions, extension_count, vtk_required_device_extensions[i])) {
+      candidate->score = -1;
+      vtk_append_reason(candidate, "missing %s", vtk_required_device_extensions[i]);
+    }
+  }
+  free(extensions);
+  if (candidate->score < 0) {
+    return;
+  }
+
+  VkPhysicalDeviceVulkan13Features vulkan_13_features = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES,
+      .pNext = NULL,
+  };
+  VkPhysicalDeviceVulkan12Features vulkan_12_features = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+      .pNext = VK_API_VERSION_MINOR(api_version) >= 3 ? &vulkan_13_features : NULL,
+  };
+  VkPhysicalDeviceFeatures2 features = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+      .pNext = VK_API_VERSION_MINOR(api_version) >= 2 ? &vulkan_12_features : NULL,
+  };
+  vkGetPhysicalDeviceFeatures2(gpu, &features);
+  if (!vulkan_12_features.timelineSemaphore) {
+    candidate->score = -1;
+    vtk_append_reason(candidate, "no timeline semaphores");
+    return;
+  }
+  if (vulkan_13_features.dynamicRendering) {
+    candidate->score += VTK_DYNAMIC_RENDERING_SCORE;
+    vtk_append_reason(candidate, "dynamic rendering");
+  }
+  if (vulkan_13_features.synchronization2) {
+    candidate->score += VTK_SYNCHRONIZATION2_SCORE;
+    vtk_append_reason(candidate, "synchronization2");
+  }
+
+  uint32_t queue_family_count = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(gpu, &queue_family_count, NULL);
+  VkQueueFamilyProperties *queue_families = VTK_ARRAY_ALLOC(VkQueueFamilyProperties, queue_family_count);
+  vkGetPhysicalDeviceQueueFamilyProperties(gpu, &queue_family_count, queue_families);
+  candidate->graphics_queue_family_idx = UINT32_MAX;
+  bool has_compute_family = false;
+  bool has_transfer_family = false;
+  for (uint32_t i = 0; i < queue_family_count; i++) {
+    VkQueueFlags flags = queue_families[i].queueFlags;
+    if ((flags & VK_QUEUE_GRAPHICS_BIT) && candidate->graphics_queue_family_idx == UINT32_MAX &&
+        vtk_queue_family_can_present(vtk_context, gpu, i)) {
+      candidate->graphics_queue_family_idx = i;
+    } else if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT)) {
+      has_compute_family = true;
+    } else if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+      has_transfer_family = true;
+    }
+  }
+  free(queue_families);
+  if (candidate->graphics_queue_family_idx == UINT32_MAX) {
+    candidate->score = -1;
+    vtk_append_reason(candidate, "no graphics queue able to present");
+    return;
+  }
+  if (has_compute_family) {
+    candidate->score += VTK_COMPUTE_QUEUE_SCORE;
+    vtk_append_reason(candidate, "async compute queue");
+  }
+  if (has_transfer_family) {
+    candidate->score += VTK_TRANSFER_QUEUE_SCORE;
+    vtk_append_reason(candidate, "dedicated transfer queue");
+  }
+
+  VkPhysicalDeviceMemoryProperties memory_properties;
+  vkGetPhysicalDeviceMemoryProperties(gpu, &memory_properties);
+  VkDeviceSize device_local_bytes = 0;
+  for (uint32_t i = 0; i < memory_properties.memoryHeapCount; i++) {
+    if (memory_properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT &&
+        memory_properties.memoryHeaps[i].size > device_local_bytes) {
+      device_local_bytes = memory_properties.memoryHeaps[i].size;
+    }
+  }
+  // Capped so that memory size never outweighs the device type.
+  uint64_t device_local_gib = device_local_bytes >> 30;
+  if (device_local_gib > VTK_MAX_SCORED_DEVICE_LOCAL_GIB) {
+    device_local_gib = VTK_MAX_SCORED_DEVICE_LOCAL_GIB;
+  }
+  candidate->score += VTK_DEVICE_LOCAL_GIB_SCORE * (int64_t)device_local_gib;
+  vtk_append_reason(candidate, "%llu MiB device local memory", (unsigned long long)(device_local_bytes >> 20));
+}
+
+// Whether the device is the one asked for by a VTK_DEVICE style selector: a device index, or else a case
+// insensitive substring of the device name.
+static bool vtk_device_matches_selector(char const *selector, uint32_t index, char const *device_name) {
+  char *end;
+  unsigned long selected_index = strtoul(selector, &end, 10);
+  if (end != selector && *end == '\0') {
+    return selected_index == index;
+  }
+  size_t selector_length = strlen(selector);
+  for (char const *start = device_name; *start != '\0'; start++) {
+    if (strncasecmp(start, selector, selector_length) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Log the usable devices from the highest score to the lowest, the order in which they would be chosen.
+static void vtk_log_device_ranking(struct VtkDeviceCandidate const *candidates, uint32_t count) {
+  uint32_t *ranking = VTK_ARRAY_ALLOC(uint32_t, count);
+  uint32_t ranked = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    if (candidates[i].score < 0) {
+      continue;
+    }
+    // Insertion sort, keeping devices of equal score in enumeration order like the selection does.
+    uint32_t j = ranked++;
+    while (j > 0 && candidates[ranking[j - 1]].score < candidates[i].score) {
+      ranking[j] = ranking[j - 1];
+      j--;
+    }
+    ranking[j] = i;
+  }
+  for (uint32_t rank = 0; rank < ranked; rank++) {
+    struct VtkDeviceCandidate const *candidate = &candidates[ranking[rank]];
+    LOGI("gpu ranking %u: gpu %u: %s - score %lld", rank + 1, ranking[rank], candidate->properties.deviceName,
+         (long long)candidate->score);
+  }
+  free(ranking);
+}
+
+void vtk_select_physical_device(struct VtkDeviceNative *vtk_device, char const *selector) {
+  uint32_t gpu_count = 0;
+  CALL_VK(vkEnumeratePhysicalDevices(vtk_device->vk_instance, &gpu_count, NULL));
+  LOGI("Number of gpus: %d", gpu_count);
+  assert(gpu_count > 0);
+  VkPhysicalDevice *gpus = VTK_ARRAY_ALLOC(VkPhysicalDevice, gpu_count);
+  CALL_VK(vkEnumeratePhysicalDevices(vtk_device->vk_instance, &gpu_count, gpus));
+
+  char const *selector_source = "the application";
+  if (selector == NULL || selector[0] == '\0') {
+    selector = getenv("VTK_DEVICE");
+    selector_source = "VTK_DEVICE";
+  }
+  if (selector != NULL && selector[0] == '\0') {
+    selector = NULL;
+  }
+
+  struct VtkDeviceCandidate *candidates = VTK_ARRAY_ALLOC(struct VtkDeviceCandidate, gpu_count);
+  int64_t best_idx = -1;
+  int64_t selected_idx = -1;
+  for (uint32_t i = 0; i < gpu_count; i++) {
+    struct VtkDeviceCandidate *candidate = &candidates[i];
+    candidate->vk_physical_device = gpus[i];
+    vkGetPhysicalDeviceProperties(gpus[i], &candidate->properties);
+    vtk_score_device(vtk_device->vtk_context, candidate);
+    LOGI("gpu %d: %s - score %lld: %s", i, candidate->properties.deviceName, (long long)candidate->score,
+         candidate->reason);
+
+    if (candidate->score >= 0 && (best_idx < 0 || candidate->score > candidates[best_idx].score)) {
+      best_idx = i;
+    }
+    if (selector != NULL && selected_idx < 0 &&
+        vtk_device_matches_selector(selector, i, candidate->properties.deviceName)) {
+      if (candidate->score >= 0) {
+        selected_idx = i;
+      } else {
+        LOGW("gpu %d selected by %s is not usable: %s", i, selector_source, candidate->reason);
+      }
+    }
+  }
+  free(gpus);
+  vtk_log_device_ranking(candidates, gpu_count);
+
+  if (selector != NULL && selected_idx < 0) {
+    LOGW("No usable gpu matches '%s' from %s - selecting by score", selector, selector_source);
+  }
+  if (best_idx < 0) {
+    LOGE("No usable gpu found");
+    assert(false);
+    exit(1);
+  }
+
+  struct VtkDeviceCandidate *chosen = &candidates[selected_idx >= 0 ? selected_idx : best_idx];
+  if (selected_idx >= 0) {
+    LOGI("Selected gpu %lld: %s, as requested by %s ('%s')", (long long)selected_idx, chosen->properties.deviceName,
+         selector_source, selector);
+  } else {
+    LOGI("Selected gpu %lld: %s, with the highest score %lld: %s", (long long)best_idx,
+         chosen->properties.deviceName, (long long)chosen->score, chosen->reason);
+  }
+
+  vtk_device->vk_physical_device = chosen->vk_physical_device;
+  vtk_device->graphics_queue_family_idx = chosen->graphics_queue_family_idx;
+  snprintf(vtk_device->physical_device_name, sizeof(vtk_device->physical_device_name), "%s",
+           chosen->properties.deviceName);
+  free(candidates);
+}
@@ -0,0 +1,288 @@
+// The event loop of a context on Linux, run by vtk_context_run(). A single epoll instance waits on the Wayland
+// display, on an eventfd other threads signal to have tasks run on the loop thread, and on a timerfd per scheduled
+// task - so input, timers and coordination with rendering threads share one loop, and it sleeps until one is ready.
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <wayland-client.h>
+
+#include "vtk_cffi.h"
+#include "vtk_internal.h"
+#include "vtk_log.h"
+
+// Tags of the epoll events which are not timers. Timers are tagged with their id, counting up from
+// VTK_EVENT_LOOP_FIRST_TIMER_ID.
+#define VTK_EVENT_LOOP_DISPLAY 0
+#define VTK_EVENT_LOOP_WAKE 1
+#define VTK_EVENT_LOOP_FIRST_TIMER_ID 2
+#define VTK_EVENT_LOOP_MAX_EVENTS 16
+
+struct VtkEventLoopTask {
+  void (*function)(void *user_data);
+  void *user_data;
+};
+
+struct VtkEventLoopTimer {
+  uint64_t id;
+  int timer_fd;
+  _Bool repeating;
+  void (*function)(void *user_data);
+  void (*destroy)(void *user_data);
+  void *user_data;
+};
+
+struct VtkEventLoopNative {
+  int epoll_fd;
+  int wake_fd;
+  // Tasks are posted and timers scheduled and cancelled from any thread.
+  pthread_mutex_t mutex;
+  struct VtkEventLoopTask *tasks;
+  uint32_t task_count;
+  uint32_t task_capacity;
+  struct VtkEventLoopTimer *timers;
+  uint32_t timer_count;
+  uint32_t timer_capacity;
+  uint64_t next_timer_id;
+  _Bool quit;
+};
+
+static void vtk_event_loop_add_fd(struct VtkEventLoopNative *loop, int fd, uint32_t events, uint64_t tag) {
+  struct epoll_event event = {.events = events, .data = {.u64 = tag}};
+  if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+    LOGE("epoll_ctl() failed: %s", strerror(errno));
+    abort();
+  }
+}
+
+void vtk_event_loop_init(struct VtkContextNative *vtk_context) {
+  struct VtkEventLoopNative *loop = (struct VtkEventLoopNative *)calloc(1, sizeof(struct VtkEventLoopNative));
+  loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  loop->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (loop->epoll_fd < 0 || loop->wake_fd < 0) {
+    LOGE("Could not create the event loop: %s", strerror(errno));
+    abort();
+  }
+  pthread_mutex_init(&loop->mutex, NULL);
+  loop->next_timer_id = VTK_EVENT_LOOP_FIRST_TIMER_ID;
+  vtk_event_loop_add_fd(loop, loop->wake_fd, EPOLLIN, VTK_EVENT_LOOP_WAKE);
+  if (!vtk_context->headless) {
+    vtk_event_loop_add_fd(loop, wl_display_get_fd(vtk_context->wayland_display), EPOLLIN, VTK_EVENT_LOOP_DISPLAY);
+  }
+  vtk_context->event_loop = loop;
+}
+
+static void vtk_event_loop_wake(struct VtkEventLoopNative *loop) {
+  uint64_t one = 1;
+  // Only fails if the counter is about to overflow, in which case the loop wakes anyway.
+  ssize_t written = write(loop->wake_fd, &one, sizeof(one));
+  (void)written;
+}
+
+// Queue a task to run on the loop thread. Must be called with the mutex held.
+static void vtk_event_loop_push_task(struct VtkEventLoopNative *loop, void (*function)(void *), void *user_data) {
+  if (loop->task_count == loop->task_capacity) {
+    loop->task_capacity = loop->task_capacity == 0 ? 16 : 2 * loop->task_capacity;
+    loop->tasks =
+        (struct VtkEventLoopTask *)realloc(loop->tasks, loop->task_capacity * sizeof(struct VtkEventLoopTask));
+  }
+  loop->tasks[loop->task_count++] = (struct VtkEventLoopTask){.function = function, .user_data = user_data};
+}
+
+void vtk_context_post_task(struct VtkContextNative *vtk_context, void (*task)(void *user_data), void *user_data) {
+  struct VtkEventLoopNative *loop = vtk_context->event_loop;
+  pthread_mutex_lock(&loop->mutex);
+  vtk_event_loop_push_task(loop, task, user_data);
+  pthread_mutex_unlock(&loop->mutex);
+  vtk_event_loop_wake(loop);
+}
+
+static struct timespec vtk_event_loop_timespec(uint64_t ns) {
+  return (struct timespec){.tv_sec = (time_t)(ns / 1000000000), .tv_nsec = (long)(ns % 1000000000)};
+}
+
+uint64_t vtk_context_schedule_task(struct VtkContextNative *vtk_context, uint64_t delay_ns, uint64_t interval_ns,
+                                   void (*task)(void *user_data), void (*destroy)(void *user_data),
+                                   void *user_data) {
+  struct VtkEventLoopNative *loop = vtk_context->event_loop;
+  int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+  if (timer_fd < 0) {
+    LOGE("timerfd_create() failed: %s", strerror(errno));
+    abort();
+  }
+  // A zero expiration would disarm the timer.
+  struct itimerspec timer_spec = {
+      .it_interval = vtk_event_loop_timespec(interval_ns),
+      .it_value = vtk_event_loop_timespec(delay_ns > 0 ? delay_ns : 1),
+  };
+  timerfd_settime(timer_fd, 0, &timer_spec, NULL);
+
+  pthread_mutex_lock(&loop->mutex);
+  if (loop->timer_count == loop->timer_capacity) {
+    loop->timer_capacity = loop->timer_capacity == 0 ? 16 : 2 * loop->timer_capacity;
+    loop->timers =
+        (struct VtkEventLoopTimer *)realloc(loop->timers, loop->timer_capacity * sizeof(struct VtkEventLoopTimer));
+  }
+  uint64_t id = loop->next_timer_id++;
+  loop->timers[loop->timer_count++] = (struct VtkEventLoopTimer){
+      .id = id,
+      .timer_fd = timer_fd,
+      .repeating = interval_ns > 0,
+      .function = task,
+      .destroy = destroy,
+      .user_data = user_data,
+  };
+  vtk_event_loop_add_fd(loop, timer_fd, EPOLLIN, id);
+  pthread_mutex_unlock(&loop->mutex);
+  return id;
+}
+
+// Remove a timer from the loop, queueing its destruction to run on the loop thread - which may be running the timer
+// right now. Must be called with the mutex held.
+static void vtk_event_loop_remove_timer(struct VtkEventLoopNative *loop, uint32_t idx) {
+  struct VtkEventLoopTimer *timer = &loop->timers[idx];
+  epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, timer->timer_fd, NULL);
+  close(timer->timer_fd);
+  if (timer->destroy != NULL) {
+    vtk_event_loop_push_task(loop, timer->destroy, timer->user_data);
+  }
+  loop->timers[idx] = loop->timers[--loop->timer_count];
+}
+
+void vtk_context_cancel_task(struct VtkContextNative *vtk_context, uint64_t timer_id) {
+  struct VtkEventLoopNative *loop = vtk_context->event_loop;
+  pthread_mutex_lock(&loop->mutex);
+  for (uint32_t i = 0; i < loop->timer_count; i++) {
+    if (loop->timers[i].id == timer_id) {
+      vtk_event_loop_remove_timer(loop, i);
+      break;
+    }
+  }
+  pthread_mutex_unlock(&loop->mutex);
+  vtk_event_loop_wake(loop);
+}
+
+void vtk_context_quit(struct VtkContextNative *vtk_context) {
+  struct VtkEventLoopNative *loop = vtk_context->event_loop;
+  __atomic_store_n(&loop->quit, true, __ATOMIC_RELEASE);
+  vtk_event_loop_wake(loop);
+}
+
+static void vtk_event_loop_run_tasks(struct VtkEventLoopNative *loop) {
+  uint64_t count;
+  ssize_t bytes_read = read(loop->wake_fd, &count, sizeof(count));
+  (void)bytes_read;
+
+  // Tasks may post more tasks, which run on the next wake up.
+  pthread_mutex_lock(&loop->mutex);
+  uint32_t task_count = loop->task_count;
+  struct VtkEventLoopTask *tasks = loop->tasks;
+  loop->tasks = NULL;
+  loop->task_count = 0;
+  loop->task_capacity = 0;
+  pthread_mutex_unlock(&loop->mutex);
+
+  for (uint32_t i = 0; i < task_count; i++) {
+    tasks[i].function(tasks[i].user_data);
+  }
+  free(tasks);
+}
+
+static void vtk_event_loop_run_timer(struct VtkEventLoopNative *loop, uint64_t timer_id) {
+  pthread_mutex_lock(&loop->mutex);
+  uint32_t idx = 0;
+  while (idx < loop->timer_count && loop->timers[idx].id != timer_id) {
+    idx++;
+  }
+  uint64_t expirations;
+  if (idx == loop->timer_count || read(loop->timers[idx].timer_fd, &expirations, sizeof(expirations)) < 0) {
+    // Cancelled since epoll_wait() returned, or already handled.
+    pthread_mutex_unlock(&loop->mutex);
+    return;
+  }
+  struct VtkEventLoopTimer timer = loop->timers[idx];
+  if (!timer.repeating) {
+    // Destroyed through the task queue, after running.
+    vtk_event_loop_remove_timer(loop, idx);
+    vtk_event_loop_wake(loop);
+  }
+  pthread_mutex_unlock(&loop->mutex);
+
+  // Missed expirations of repeating timers are coalesced into one run.
+  timer.function(timer.user_data);
+}
+
+void vtk_event_loop_run(struct VtkContextNative *vtk_context) {
+  struct VtkEventLoopNative *loop = vtk_context->event_loop;
+  struct wl_display *display = vtk_context->headless ? NULL : vtk_context->wayland_display;
+  uint32_t display_events = EPOLLIN;
+
+  while (!__atomic_load_n(&loop->quit, __ATOMIC_ACQUIRE)) {
+    if (display != NULL) {
+      // Other threads - such as the Vulkan driver presenting on the rendering thread - read from the display too, so
+      // reading goes through the prepare/read protocol rather than wl_display_dispatch().
+      while (wl_display_prepare_read(display) != 0) {
+        wl_display_dispatch_pending(display);
+      }
+      // Requests which do not fit into the socket buffer are flushed once it is writable.
+      uint32_t wanted_display_events = EPOLLIN;
+      if (wl_display_flush(display) < 0 && errno == EAGAIN) {
+        wanted_display_events |= EPOLLOUT;
+      }
+      if (wanted_display_events != display_events) {
+        struct epoll_event event = {.events = wanted_display_events, .data = {.u64 = VTK_EVENT_LOOP_DISPLAY}};
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, wl_display_get_fd(display), &event);
+        display_events = wanted_display_events;
+      }
+    }
+
+    struct epoll_event events[VTK_EVENT_LOOP_MAX_EVENTS];
+    int event_count = epoll_wait(loop->epoll_fd, events, VTK_EVENT_LOOP_MAX_EVENTS, -1);
+    if (event_count < 0) {
+      if (display != NULL) {
+        wl_display_cancel_read(display);
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      LOGE("epoll_wait() failed: %s", strerror(errno));
+      break;
+    }
+
+    if (display != NULL) {
+      _Bool display_readable = false;
+      for (int i = 0; i < event_count; i++) {
+        if (events[i].data.u64 == VTK_EVENT_LOOP_DISPLAY && (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+          display_readable = true;
+        }
+      }
+      if (display_readable) {
+        if (wl_display_read_events(display) < 0) {
+          LOGE("Lost the Wayland connection: %s", strerror(errno));
+          break;
+        }
+      } else {
+        wl_display_cancel_read(display);
+      }
+      if (wl_display_dispatch_pending(display) < 0) {
+        LOGE("Lost the Wayland connection: %s", strerror(errno));
+        break;
+      }
+    }
+
+    for (int i = 0; i < event_count; i++) {
+      uint64_t tag = events[i].data.u64;
+      if (tag == VTK_EVENT_LOOP_WAKE) {
+        vtk_event_loop_run_tasks(loop);
+      } else if (tag >= VTK_EVENT_LOOP_FIRST_TIMER_ID) {
+        vtk_event_loop_run_timer(loop, tag);
+      }
+    }
+  }
+  // The loop may be run again.
+  __atomic_store_n(&loop->quit, false, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,109 @@
+// Per-frame dynamic data - vertices, indices and uniforms written by the CPU every frame - bump-allocated from a
+// persistently mapped, host coherent ring buffer owned by the window. Everything allocated before a frame is submitted
+// belongs to that frame, and is reclaimed once the fence of the frame has signalled.
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "vtk_cffi.h"
+#include "vtk_internal.h"
+#include "vtk_log.h"
+#include "vulkan_wrapper.h"
+
+// Size of the ring buffer of each window, which must be a power of two.
+#define VTK_FRAME_DATA_SIZE (8 * 1024 * 1024)
+// Minimum alignment of allocations, also satisfying the 4 byte alignment of index buffer offsets.
+#define VTK_FRAME_DATA_MIN_ALIGNMENT 16
+
+void vtk_frame_data_init(struct VtkWindowNative *vtk_window) {
+  struct VtkDeviceNative *vtk_device = vtk_window->vtk_device;
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(vtk_device->vk_physical_device, &properties);
+  // Any allocation may be bound as a uniform or storage buffer, so align to whatever either requires.
+  uint64_t alignment = VTK_FRAME_DATA_MIN_ALIGNMENT;
+  if (properties.limits.minUniformBufferOffsetAlignment > alignment) {
+    alignment = properties.limits.minUniformBufferOffsetAlignment;
+  }
+  if (properties.limits.minStorageBufferOffsetAlignment > alignment) {
+    alignment = properties.limits.minStorageBufferOffsetAlignment;
+  }
+  vtk_window->frame_data_alignment = alignment;
+
+  vtk_window->vk_frame_data_buffer = vtk_device_create_buffer(
+      vtk_device, VTK_FRAME_DATA_SIZE,
+      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
+          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+      true, &vtk_window->frame_data_allocation);
+  vtk_window->frame_data_ptr = (uint8_t *)vtk_window->frame_data_allocation.mapped;
+  vtk_window->frame_data_size = VTK_FRAME_DATA_SIZE;
+  vtk_window->frame_data_head = 0;
+  vtk_window->frame_data_tail = 0;
+}
+
+void vtk_frame_data_destroy(struct VtkWindowNative *vtk_window) {
+  vtk_device_destroy_buffer(vtk_window->vtk_device, vtk_window->vk_frame_data_buffer,
+                            &vtk_window->frame_data_allocation);
+  vtk_window->vk_frame_data_buffer = VK_NULL_HANDLE;
+  vtk_window->frame_data_ptr = NULL;
+}
+
+// Wait for the oldest submitted frame still holding ring space to finish, and reclaim its space. Returns false if no
+// submitted frame holds any, so all space in use belongs to the frame being prepared.
+static bool vtk_frame_data_reclaim_oldest(struct VtkWindowNative *vtk_window) {
+  // Starting at the frame to be rendered next visits frames in submission order, oldest first.
+  for (uint32_t i = 0; i < vtk_window->frames_in_flight; i++) {
+    struct VtkFrameNative *frame =
+        &vtk_window->frames[(vtk_window->current_frame_idx + i) % vtk_window->frames_in_flight];
+    if (frame->frame_data_end > vtk_window->frame_data_tail) {
+      CALL_VK(vkWaitForFences(vtk_window->vtk_device->vk_device, 1, &frame->vk_fence, VK_TRUE, UINT64_MAX))
+      vtk_window->frame_data_tail = frame->frame_data_end;
+      return true;
+    }
+  }
+  return false;
+}
+
+void vtk_frame_data_frame_finished(struct VtkWindowNative *vtk_window, struct VtkFrameNative *frame) {
+  if (frame->frame_data_end > vtk_window->frame_data_tail) {
+    vtk_window->frame_data_tail = frame->frame_data_end;
+  }
+}
+
+void vtk_frame_data_frame_submitted(struct VtkWindowNative *vtk_window, struct VtkFrameNative *frame) {
+  frame->frame_data_end = vtk_window->frame_data_head;
+}
+
+void vtk_frame_data_reset(struct VtkWindowNative *vtk_window) {
+  vtk_window->frame_data_tail = vtk_window->frame_data_head;
+}
+
+void *vtk_window_allocate_frame_data(struct VtkWindowNative *vtk_window, uint64_t size, uint64_t alignment,
+                                     uint64_t *offset) {
+  uint64_t const ring_size = vtk_window->frame_data_size;
+  if (alignment < vtk_window->frame_data_alignment) {
+    alignment = vtk_window->frame_data_alignment;
+  }
+  if (size > ring_size || alignment > ring_size || (alignment & (alignment - 1)) != 0) {
+    LOGE("Cannot allocate %llu bytes of frame data with alignment %llu", (unsigned long long)size,
+         (unsigned long long)alignment);
+    return NULL;
+  }
+
+  uint64_t start = (vtk_window->frame_data_head + alignment - 1) & ~(alignment - 1);
+  // Allocations are contiguous, so skip the end of the buffer if the allocation does not fit before it.
+  if ((start % ring_size) + size > ring_size) {
+    start += ring_size - (start % ring_size);
+  }
+  while (start + size - vtk_window->frame_data_tail > ring_size) {
+    if (!vtk_frame_data_reclaim_oldest(vtk_window)) {
+      LOGE("Out of frame data space: %llu bytes allocated for the current frame, %llu more requested",
+           (unsigned long long)(vtk_window->frame_data_head - vtk_window->frame_data_tail),
+           (unsigned long long)size);
+      return NULL;
+    }
+  }
+
+  vtk_window->frame_data_head = start + size;
+  *offset = start % ring_size;
+  return vtk_window->frame_data_ptr + *offset;
+}
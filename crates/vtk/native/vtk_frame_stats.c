@@ -0,0 +1,36 @@
+// CPU timings of the phases of rendering frames, kept in a ring of recent frames per window. The ring has a single
+// writer, the thread rendering the window, and is read without locks, see vtk_history.c.
+#include <stdint.h>
+#include <time.h>
+
+#include "vtk_cffi.h"
+#include "vtk_internal.h"
+
+uint64_t vtk_frame_stats_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+void vtk_frame_stats_lap(struct VtkFrameTimingNative *timing, enum VtkFramePhaseNative phase,
+                         uint64_t *lap_start) {
+  uint64_t now = vtk_frame_stats_now();
+  timing->phase_ns[phase] += now - *lap_start;
+  *lap_start = now;
+}
+
+void vtk_frame_stats_record(struct VtkWindowNative *vtk_window, struct VtkFrameTimingNative *timing) {
+  // Laps follow each other, so the phases add up to the whole frame.
+  timing->total_ns = 0;
+  for (uint32_t i = 0; i < VTK_FRAME_PHASE_COUNT; i++) {
+    timing->total_ns += timing->phase_ns[i];
+  }
+  vtk_history_write(&vtk_window->frame_timing_history, vtk_window->frame_timings, sizeof(struct VtkFrameTimingNative),
+                    VTK_FRAME_TIMING_HISTORY, timing);
+}
+
+uint32_t vtk_window_copy_frame_timings(struct VtkWindowNative *vtk_window, struct VtkFrameTimingNative *timings,
+                                       uint32_t max_count) {
+  return vtk_history_copy(&vtk_window->frame_timing_history, vtk_window->frame_timings,
+                          sizeof(struct VtkFrameTimingNative), VTK_FRAME_TIMING_HISTORY, timings, max_count);
+}
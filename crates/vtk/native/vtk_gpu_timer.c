@@ -0,0 +1,198 @@
+// GPU timing of named scopes of the commands of a frame, using timestamp queries. Each frame in flight has its own
+// range of queries, read back without waiting once the fence of the frame has signalled - frames_in_flight frames
+// after it was submitted.
+//
+// Scopes are handed out while the frame is being recorded, from any thread recording a command list of the frame. The
+// frame itself and its surface render pass take the first two, and enclose the scopes of the command lists.
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "vtk_array.h"
+#include "vtk_cffi.h"
+#include "vtk_internal.h"
+#include "vtk_log.h"
+#include "vulkan_wrapper.h"
+
+// Each scope takes a query for its start and one for its end.
+#define VTK_GPU_TIMER_QUERIES_PER_FRAME (2 * VTK_MAX_GPU_TIMER_SCOPES)
+
+struct VtkGpuTimerFrame {
+  // The number of the frame whose scopes were recorded, 0 if the queries hold no unread results.
+  uint64_t frame_number;
+  // Incremented atomically, and may exceed VTK_MAX_GPU_TIMER_SCOPES with the scopes beyond not timed.
+  uint32_t scope_count;
+  char const *names[VTK_MAX_GPU_TIMER_SCOPES];
+  uint32_t depths[VTK_MAX_GPU_TIMER_SCOPES];
+};
+
+struct VtkGpuTimerNative {
+  VkQueryPool vk_query_pool;
+  // Nanoseconds per timestamp tick.
+  double timestamp_period;
+  // Timestamps only have timestampValidBits significant bits, and wrap around.
+  uint64_t timestamp_mask;
+  // The frame being recorded.
+  struct VtkGpuTimerFrame *recording;
+  uint32_t recording_query_base;
+  struct VtkGpuTimerFrame frames[VTK_MAX_FRAMES_IN_FLIGHT];
+};
+
+void vtk_gpu_timer_init(struct VtkWindowNative *vtk_window) {
+  struct VtkDeviceNative *vtk_device = vtk_window->vtk_device;
+  vtk_window->gpu_timer = NULL;
+  vtk_window->gpu_frame_timings.frame_number = 0;
+  vtk_window->gpu_frame_timings.scope_count = 0;
+
+  uint32_t queue_family_count = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(vtk_device->vk_physical_device, &queue_family_count, NULL);
+  VkQueueFamilyProperties *queue_families = VTK_ARRAY_ALLOC(VkQueueFamilyProperties, queue_family_count);
+  vkGetPhysicalDeviceQueueFamilyProperties(vtk_device->vk_physical_device, &queue_family_count, queue_families);
+  uint32_t valid_bits = queue_families[vtk_device->graphics_queue_family_idx].timestampValidBits;
+  free(queue_families);
+  if (valid_bits == 0) {
+    LOGW("The graphics queue does not support timestamps - GPU frame timings are not available");
+    return;
+  }
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(vtk_device->vk_physical_device, &properties);
+
+  struct VtkGpuTimerNative *timer = (struct VtkGpuTimerNative *)calloc(1, sizeof(struct VtkGpuTimerNative));
+  timer->timestamp_period = properties.limits.timestampPeriod;
+  timer->timestamp_mask = valid_bits >= 64 ? UINT64_MAX : (((uint64_t)1 << valid_bits) - 1);
+
+  VkQueryPoolCreateInfo vk_query_pool_create_info = {
+      .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+      .pNext = NULL,
+      .flags = 0,
+      .queryType = VK_QUERY_TYPE_TIMESTAMP,
+      .queryCount = VTK_MAX_FRAMES_IN_FLIGHT * VTK_GPU_TIMER_QUERIES_PER_FRAME,
+      .pipelineStatistics = 0,
+  };
+  CALL_VK(vkCreateQueryPool(vtk_device->vk_device, &vk_query_pool_create_info, NULL, &timer->vk_query_pool))
+  vtk_window->gpu_timer = timer;
+}
+
+void vtk_gpu_timer_destroy(struct VtkWindowNative *vtk_window) {
+  struct VtkGpuTimerNative *timer = vtk_window->gpu_timer;
+  if (timer == NULL) {
+    return;
+  }
+  vkDestroyQueryPool(vtk_window->vtk_device->vk_device, timer->vk_query_pool, NULL);
+  free(timer);
+  vtk_window->gpu_timer = NULL;
+}
+
+void vtk_gpu_timer_begin_frame(struct VtkWindowNative *vtk_window, uint32_t frame_idx, uint64_t frame_number) {
+  struct VtkGpuTimerNative *timer = vtk_window->gpu_timer;
+  if (timer == NULL) {
+    return;
+  }
+  timer->recording = &timer->frames[frame_idx];
+  timer->recording->frame_number = frame_number;
+  timer->recording_query_base = frame_idx * VTK_GPU_TIMER_QUERIES_PER_FRAME;
+  timer->recording->names[VTK_GPU_TIMER_FRAME_SCOPE] = "frame";
+  timer->recording->depths[VTK_GPU_TIMER_FRAME_SCOPE] = 0;
+  timer->recording->names[VTK_GPU_TIMER_RENDER_PASS_SCOPE] = "surface render pass";
+  timer->recording->depths[VTK_GPU_TIMER_RENDER_PASS_SCOPE] = 1;
+  timer->recording->scope_count = 2;
+}
+
+void vtk_gpu_timer_discard_frame(struct VtkWindowNative *vtk_window) {
+  struct VtkGpuTimerNative *timer = vtk_window->gpu_timer;
+  if (timer != NULL) {
+    timer->recording->frame_number = 0;
+  }
+}
+
+void vtk_gpu_timer_reset_queries(struct VtkWindowNative *vtk_window, VkCommandBuffer vk_command_buffer) {
+  struct VtkGpuTimerNative *timer = vtk_window->gpu_timer;
+  if (timer == NULL) {
+    return;
+  }
+  // Must be recorded outside of a render pass, so reset the whole range up front.
+  vkCmdResetQueryPool(vk_command_buffer, timer->vk_query_pool, timer->recording_query_base,
+                      VTK_GPU_TIMER_QUERIES_PER_FRAME);
+}
+
+void vtk_gpu_timer_write_start(struct VtkWindowNative *vtk_window, VkCommandBuffer vk_command_buffer,
+                               uint32_t scope) {
+  struct VtkGpuTimerNative *timer = vtk_window->gpu_timer;
+  if (timer == NULL || scope == UINT32_MAX) {
+    return;
+  }
+  vkCmdWriteTimestamp(vk_command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timer->vk_query_pool,
+                      timer->recording_query_base + 2 * scope);
+}
+
+void vtk_gpu_timer_write_end(struct VtkWindowNative *vtk_window, VkCommandBuffer vk_command_buffer, uint32_t scope) {
+  struct VtkGpuTimerNative *timer = vtk_window->gpu_timer;
+  if (timer == NULL || scope == UINT32_MAX) {
+    return;
+  }
+  vkCmdWriteTimestamp(vk_command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timer->vk_query_pool,
+                      timer->recording_query_base + 2 * scope + 1);
+}
+
+uint32_t vtk_command_begin_gpu_scope(struct VtkWindowNative *vtk_window, VkCommandBuffer vk_command_buffer,
+                                     char const *name, uint32_t depth) {
+  struct VtkGpuTimerNative *timer = vtk_window->gpu_timer;
+  if (timer == NULL) {
+    return UINT32_MAX;
+  }
+  struct VtkGpuTimerFrame *frame = timer->recording;
+  uint32_t scope = __atomic_fetch_add(&frame->scope_count, 1, __ATOMIC_RELAXED);
+  if (scope >= VTK_MAX_GPU_TIMER_SCOPES) {
+    if (scope == VTK_MAX_GPU_TIMER_SCOPES) {
+      LOGW("Too many GPU timer scopes in a frame - not timing '%s' and those after it", name);
+    }
+    return UINT32_MAX;
+  }
+  // Command lists execute within the frame and its surface render pass.
+  frame->names[scope] = name;
+  frame->depths[scope] = 2 + depth;
+  vtk_gpu_timer_write_start(vtk_window, vk_command_buffer, scope);
+  return scope;
+}
+
+void vtk_command_end_gpu_scope(struct VtkWindowNative *vtk_window, VkCommandBuffer vk_command_buffer, uint32_t scope) {
+  vtk_gpu_timer_write_end(vtk_window, vk_command_buffer, scope);
+}
+
+void vtk_gpu_timer_frame_finished(struct VtkWindowNative *vtk_window, uint32_t frame_idx) {
+  struct VtkGpuTimerNative *timer = vtk_window->gpu_timer;
+  if (timer == NULL) {
+    return;
+  }
+  struct VtkGpuTimerFrame *frame = &timer->frames[frame_idx];
+  if (frame->frame_number == 0) {
+    return;
+  }
+
+  uint32_t scope_count = frame->scope_count < VTK_MAX_GPU_TIMER_SCOPES ? frame->scope_count : VTK_MAX_GPU_TIMER_SCOPES;
+  uint64_t timestamps[VTK_GPU_TIMER_QUERIES_PER_FRAME];
+  uint32_t query_count = 2 * scope_count;
+  // The fence of the frame has signalled, so the results are available - but never wait for them regardless.
+  VkResult result = vkGetQueryPoolResults(vtk_window->vtk_device->vk_device, timer->vk_query_pool,
+                                          frame_idx * VTK_GPU_TIMER_QUERIES_PER_FRAME, query_count,
+                                          query_count * sizeof(uint64_t), timestamps, sizeof(uint64_t),
+                                          VK_QUERY_RESULT_64_BIT);
+  if (result == VK_NOT_READY) {
+    return;
+  }
+  CALL_VK(result)
+
+  struct VtkGpuFrameTimingsNative *timings = &vtk_window->gpu_frame_timings;
+  timings->frame_number = frame->frame_number;
+  timings->scope_count = scope_count;
+  uint64_t const frame_start = timestamps[2 * VTK_GPU_TIMER_FRAME_SCOPE];
+  for (uint32_t i = 0; i < scope_count; i++) {
+    struct VtkGpuScopeTimingNative *scope = &timings->scopes[i];
+    scope->name = frame->names[i];
+    scope->depth = frame->depths[i];
+    scope->start_ns = (double)((timestamps[2 * i] - frame_start) & timer->timestamp_mask) * timer->timestamp_period;
+    scope->duration_ns =
+        (double)((timestamps[2 * i + 1] - timestamps[2 * i]) & timer->timestamp_mask) * timer->timestamp_period;
+  }
+  frame->frame_number = 0;
+}
@@ -0,0 +1,291 @@
+// Graphics pipelines rendering to the surface of a window, and the draw commands recorded with them into the secondary
+// command buffers of vtk_recorder.c.
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "vtk_array.h"
+#include "vtk_cffi.h"
+#include "vtk_internal.h"
+#include "vtk_log.h"
+#include "vulkan_wrapper.h"
+
+struct VtkGraphicsPipelineNative {
+  VkPipelineLayout vk_pipeline_layout;
+  VkPipeline vk_pipeline;
+  uint32_t push_constant_size;
+};
+
+// Push constants are visible to both shader stages, so the ranges of the layout and the pushes must match.
+#define VTK_GRAPHICS_PUSH_CONSTANT_STAGES (VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT)
+
+struct VtkGraphicsPipelineNative *vtk_window_create_graphics_pipeline(
+    struct VtkWindowNative *vtk_window, VkShaderModule vertex_shader, VkShaderModule fragment_shader,
+    uint32_t vertex_stride, uint32_t vertex_attribute_count, struct VtkVertexAttributeNative const *vertex_attributes,
+    uint32_t push_constant_size) {
+  assert(vertex_attribute_count <= VTK_MAX_VERTEX_ATTRIBUTES);
+  assert(push_constant_size <= VTK_MAX_GRAPHICS_PUSH_CONSTANT_SIZE && push_constant_size % 4 == 0);
+  struct VtkDeviceNative *vtk_device = vtk_window->vtk_device;
+  struct VtkGraphicsPipelineNative *pipeline =
+      (struct VtkGraphicsPipelineNative *)malloc(sizeof(struct VtkGraphicsPipelineNative));
+  pipeline->push_constant_size = push_constant_size;
+
+  VkPushConstantRange vk_push_constant_range = {
+      .stageFlags = VTK_GRAPHICS_PUSH_CONSTANT_STAGES,
+      .offset = 0,
+      .size = push_constant_size,
+  };
+  VkPipelineLayoutCreateInfo vk_pipeline_layout_create_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+      .pNext = NULL,
+      .flags = 0,
+      .setLayoutCount = 0,
+      .pSetLayouts = NULL,
+      .pushConstantRangeCount = push_constant_size > 0 ? 1 : 0,
+      .pPushConstantRanges = &vk_push_constant_range,
+  };
+  CALL_VK(vkCreatePipelineLayout(vtk_device->vk_device, &vk_pipeline_layout_create_info, NULL,
+                                 &pipeline->vk_pipeline_layout))
+
+  VkPipelineShaderStageCreateInfo vk_shader_stages[] = {
+      {
+          .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+          .pNext = NULL,
+          .flags = 0,
+          .stage = VK_SHADER_STAGE_VERTEX_BIT,
+          .module = vertex_shader,
+          .pName = "main",
+          .pSpecializationInfo = NULL,
+      },
+      {
+          .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+          .pNext = NULL,
+          .flags = 0,
+          .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+          .module = fragment_shader,
+          .pName = "main",
+          .pSpecializationInfo = NULL,
+      },
+  };
+
+  // All attributes come interleaved from the buffer at binding 0.
+  VkVertexInputBindingDescription vk_vertex_binding = {
+      .binding = 0,
+      .stride = vertex_stride,
+      .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+  };
+  VkVertexInputAttributeDescription vk_vertex_attributes[VTK_MAX_VERTEX_ATTRIBUTES];
+  for (uint32_t i = 0; i < vertex_attribute_count; i++) {
+    vk_vertex_attributes[i] = (VkVertexInputAttributeDescription){
+        .location = i,
+        .binding = 0,
+        .format = vertex_attributes[i].format,
+        .offset = vertex_attributes[i].offset,
+    };
+  }
+  VkPipelineVertexInputStateCreateInfo vk_vertex_input_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+      .pNext = NULL,
+      .flags = 0,
+      .vertexBindingDescriptionCount = vertex_attribute_count > 0 ? 1 : 0,
+      .pVertexBindingDescriptions = &vk_vertex_binding,
+      .vertexAttributeDescriptionCount = vertex_attribute_count,
+      .pVertexAttributeDescriptions = vk_vertex_attributes,
+  };
+
+  VkPipelineInputAssemblyStateCreateInfo vk_input_assembly_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+      .pNext = NULL,
+      .flags = 0,
+      .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+      .primitiveRestartEnable = VK_FALSE,
+  };
+
+  // Viewport and scissor are dynamic, so that pipelines survive resizing the window and may be shared between windows.
+  VkPipelineViewportStateCreateInfo vk_viewport_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+      .pNext = NULL,
+      .flags = 0,
+      .viewportCount = 1,
+      .pViewports = NULL,
+      .scissorCount = 1,
+      .pScissors = NULL,
+  };
+  // If possible so are cull mode, front face and topology, sparing pipelines differing only in those. The static state
+  // below matches the defaults set by vtk_recording_begin_secondary(), and the dynamic topology must stay in the same
+  // class as the static one: triangles.
+  VkDynamicState vk_dynamic_states[] = {
+      VK_DYNAMIC_STATE_VIEWPORT,
+      VK_DYNAMIC_STATE_SCISSOR,
+      // Extended dynamic state.
+      VK_DYNAMIC_STATE_CULL_MODE,
+      VK_DYNAMIC_STATE_FRONT_FACE,
+      VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY,
+  };
+  VkPipelineDynamicStateCreateInfo vk_dynamic_state_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+      .pNext = NULL,
+      .flags = 0,
+      .dynamicStateCount = vtk_device->extended_dynamic_state ? VTK_ARRAY_SIZE(vk_dynamic_states) : 2,
+      .pDynamicStates = vk_dynamic_states,
+  };
+
+  VkPipelineRasterizationStateCreateInfo vk_raster_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+      .pNext = NULL,
+      .flags = 0,
+      .depthClampEnable = VK_FALSE,
+      .rasterizerDiscardEnable = VK_FALSE,
+      .polygonMode = VK_POLYGON_MODE_FILL,
+      .cullMode = VK_CULL_MODE_NONE,
+      .frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
+      .depthBiasEnable = VK_FALSE,
+      .depthBiasConstantFactor = 0,
+      .depthBiasClamp = 0,
+      .depthBiasSlopeFactor = 0,
+      .lineWidth = 1,
+  };
+
+  VkPipelineMultisampleStateCreateInfo vk_multisample_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+      .pNext = NULL,
+      .flags = 0,
+      .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+      .sampleShadingEnable = VK_FALSE,
+      .minSampleShading = 0,
+      .pSampleMask = NULL,
+      .alphaToCoverageEnable = VK_FALSE,
+      .alphaToOneEnable = VK_FALSE,
+  };
+
+  VkPipelineColorBlendAttachmentState vk_blend_attachment = {
+      .blendEnable = VK_FALSE,
+      .colorWriteMask =
+          VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+  };
+  VkPipelineColorBlendStateCreateInfo vk_color_blend_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+      .pNext = NULL,
+      .flags = 0,
+      .logicOpEnable = VK_FALSE,
+      .logicOp = VK_LOGIC_OP_COPY,
+      .attachmentCount = 1,
+      .pAttachments = &vk_blend_attachment,
+  };
+
+  // With dynamic rendering the pipeline only depends on the formats of the attachments, not on a render pass.
+  VkPipelineRenderingCreateInfo vk_rendering_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+      .pNext = NULL,
+      .viewMask = 0,
+      .colorAttachmentCount = 1,
+      .pColorAttachmentFormats = &vtk_window->vk_surface_format,
+      .depthAttachmentFormat = VK_FORMAT_UNDEFINED,
+      .stencilAttachmentFormat = VK_FORMAT_UNDEFINED,
+  };
+  VkGraphicsPipelineCreateInfo vk_pipeline_create_info = {
+      .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+      .pNext = vtk_device->dynamic_rendering ? &vk_rendering_info : NULL,
+      .flags = 0,
+      .stageCount = VTK_ARRAY_SIZE(vk_shader_stages),
+      .pStages = vk_shader_stages,
+      .pVertexInputState = &vk_vertex_input_info,
+      .pInputAssemblyState = &vk_input_assembly_info,
+      .pTessellationState = NULL,
+      .pViewportState = &vk_viewport_info,
+      .pRasterizationState = &vk_raster_info,
+      .pMultisampleState = &vk_multisample_info,
+      .pDepthStencilState = NULL,
+      .pColorBlendState = &vk_color_blend_info,
+      .pDynamicState = &vk_dynamic_state_info,
+      .layout = pipeline->vk_pipeline_layout,
+      .renderPass = vtk_window->vk_surface_render_pass,
+      .subpass = 0,
+      .basePipelineHandle = VK_NULL_HANDLE,
+      .basePipelineIndex = -1,
+  };
+  vtk_pipeline_cache_create_graphics_pipeline(vtk_device, &vk_pipeline_create_info, &pipeline->vk_pipeline);
+  return pipeline;
+}
+
+void vtk_window_destroy_graphics_pipeline(struct VtkWindowNative *vtk_window,
+                                          struct VtkGraphicsPipelineNative *pipeline) {
+  VkDevice vk_device = vtk_window->vtk_device->vk_device;
+  vkDestroyPipeline(vk_device, pipeline->vk_pipeline, NULL);
+  vkDestroyPipelineLayout(vk_device, pipeline->vk_pipeline_layout, NULL);
+  free(pipeline);
+}
+
+void vtk_command_bind_graphics_pipeline(VkCommandBuffer vk_command_buffer,
+                                        struct VtkGraphicsPipelineNative const *pipeline) {
+  vkCmdBindPipeline(vk_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->vk_pipeline);
+}
+
+void vtk_command_bind_vertex_buffer(VkCommandBuffer vk_command_buffer, VkBuffer buffer, uint64_t offset) {
+  VkDeviceSize vk_offset = offset;
+  vkCmdBindVertexBuffers(vk_command_buffer, 0, 1, &buffer, &vk_offset);
+}
+
+void vtk_command_bind_index_buffer(VkCommandBuffer vk_command_buffer, VkBuffer buffer, uint64_t offset) {
+  vkCmdBindIndexBuffer(vk_command_buffer, buffer, offset, VK_INDEX_TYPE_UINT32);
+}
+
+void vtk_command_push_constants(VkCommandBuffer vk_command_buffer, struct VtkGraphicsPipelineNative const *pipeline,
+                                uint8_t const *data, uint32_t size) {
+  assert(size <= pipeline->push_constant_size && size % 4 == 0);
+  vkCmdPushConstants(vk_command_buffer, pipeline->vk_pipeline_layout, VTK_GRAPHICS_PUSH_CONSTANT_STAGES, 0, size,
+                     data);
+}
+
+void vtk_command_set_viewport(VkCommandBuffer vk_command_buffer, float x, float y, float width, float height) {
+  VkViewport vk_viewport = {
+      .x = x,
+      .y = y,
+      .width = width,
+      .height = height,
+      .minDepth = 0.0f,
+      .maxDepth = 1.0f,
+  };
+  vkCmdSetViewport(vk_command_buffer, 0, 1, &vk_viewport);
+}
+
+void vtk_command_set_scissor(VkCommandBuffer vk_command_buffer, int32_t x, int32_t y, uint32_t width, uint32_t height) {
+  VkRect2D vk_scissor = {
+      .offset = {.x = x, .y = y},
+      .extent = {.width = width, .height = height},
+  };
+  vkCmdSetScissor(vk_command_buffer, 0, 1, &vk_scissor);
+}
+
+void vtk_command_set_cull_mode(VkCommandBuffer vk_command_buffer, enum VtkCullModeNative cull_mode,
+                               _Bool front_clockwise) {
+  VkCullModeFlags vk_cull_mode = VK_CULL_MODE_NONE;
+  switch (cull_mode) {
+  case VTK_CULL_MODE_NONE:
+    vk_cull_mode = VK_CULL_MODE_NONE;
+    break;
+  case VTK_CULL_MODE_FRONT:
+    vk_cull_mode = VK_CULL_MODE_FRONT_BIT;
+    break;
+  case VTK_CULL_MODE_BACK:
+    vk_cull_mode = VK_CULL_MODE_BACK_BIT;
+    break;
+  }
+  vkCmdSetCullMode(vk_command_buffer, vk_cull_mode);
+  vkCmdSetFrontFace(vk_command_buffer, front_clockwise ? VK_FRONT_FACE_CLOCKWISE : VK_FRONT_FACE_COUNTER_CLOCKWISE);
+}
+
+void vtk_command_set_primitive_topology(VkCommandBuffer vk_command_buffer, enum VtkPrimitiveTopologyNative topology) {
+  vkCmdSetPrimitiveTopology(vk_command_buffer, topology == VTK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP
+                                                   ? VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP
+                                                   : VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+}
+
+void vtk_command_draw(VkCommandBuffer vk_command_buffer, uint32_t vertex_count, uint32_t instance_count,
+                      uint32_t first_vertex, uint32_t first_instance) {
+  vkCmdDraw(vk_command_buffer, vertex_count, instance_count, first_vertex, first_instance);
+}
+
+void vtk_command_draw_indexed(VkCommandBuffer vk_command_buffer, uint32_t index_count, uint32_t instance_count,
+                              uint32_t first_index, int32_t vertex_offset, uint32_t first_instance) {
+  vkCmdDrawIndexed(vk_command_buffer, index_count, instance_count, first_index, vertex_offset, first_instance);
+}
@@ -0,0 +1,58 @@
+// Rendering without a display server, for render servers, benchmarks and CI machines. Windows render to surfaces of
+// VK_EXT_headless_surface, which take part in presentation like any other surface but are never displayed - so windows
+// use the same swap chain path through vtk_setup_window_rendering() as on Wayland. Mesa drivers including lavapipe
+// support the extension, so this works on any Linux box.
+#include <stdlib.h>
+#include <string.h>
+
+#include "vtk_cffi.h"
+#include "vtk_internal.h"
+#include "vtk_log.h"
+#include "vulkan_wrapper.h"
+
+// The size of headless windows.
+#define VTK_HEADLESS_WINDOW_WIDTH 800
+#define VTK_HEADLESS_WINDOW_HEIGHT 800
+
+bool vtk_headless_requested(void) {
+  char const *headless = getenv("VTK_HEADLESS");
+  return headless != NULL && headless[0] != '\0' && strcmp(headless, "0") != 0;
+}
+
+struct VtkContextNative *vtk_context_init_headless(void) {
+  vtk_load_vulkan_symbols();
+
+  struct VtkContextNative *result = (struct VtkContextNative *)calloc(1, sizeof(struct VtkContextNative));
+  result->headless = true;
+  vtk_event_loop_init(result);
+  LOGI("Rendering headless");
+  return result;
+}
+
+void vtk_window_init_headless(struct VtkWindowNative *vtk_window) {
+  struct VtkDeviceNative *vtk_device = vtk_window->vtk_device;
+
+  vtk_window->wayland_surface = NULL;
+  vtk_window->wayland_shell_surface = NULL;
+  vtk_window->wayland_toplevel_listener = NULL;
+  vtk_window->wayland_frame_pacing = NULL;
+  vtk_window->wayland_locked_pointer = NULL;
+  vtk_window->wayland_presentation_feedback = NULL;
+  vtk_window->wayland_viewport = NULL;
+  vtk_window->wayland_fractional_scale = NULL;
+  vtk_window->wayland_scale_120 = 120;
+  vtk_window->render_scale = 1;
+  // Headless surfaces let the swap chain decide their size, and are never resized.
+  vtk_window->vk_extent_2d.width = vtk_window->wayland_size_requested_by_compositor.width = VTK_HEADLESS_WINDOW_WIDTH;
+  vtk_window->vk_extent_2d.height = vtk_window->wayland_size_requested_by_compositor.height =
+      VTK_HEADLESS_WINDOW_HEIGHT;
+
+  VkHeadlessSurfaceCreateInfoEXT surface_create_info = {
+      .sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT,
+      .pNext = NULL,
+      .flags = 0,
+  };
+  CALL_VK(vkCreateHeadlessSurfaceEXT(vtk_device->vk_instance, &surface_create_info, NULL, &vtk_window->vk_surface))
+
+  vtk_setup_window_rendering(vtk_window);
+}
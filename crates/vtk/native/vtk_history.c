@@ -0,0 +1,48 @@
+// Rings of recent records, such as the frame timings of a window, with a single writer and read without locks.
+//
+// The writer claims an index before writing its entry and publishes it once written, like a sequence lock: readers
+// copy the published entries and then check how far the writer has claimed, dropping entries it may have overwritten
+// while they were being copied.
+#include <stdint.h>
+#include <string.h>
+
+#include "vtk_cffi.h"
+#include "vtk_internal.h"
+
+void vtk_history_write(struct VtkHistoryNative *history, void *entries, size_t entry_size, uint32_t capacity,
+                       void const *entry) {
+  uint64_t count = history->claimed_count;
+  __atomic_store_n(&history->claimed_count, count + 1, __ATOMIC_RELAXED);
+  // Readers seeing any part of the entry being overwritten see the claim as well.
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy((uint8_t *)entries + (count % capacity) * entry_size, entry, entry_size);
+  // Publish the entry only once it has been written completely.
+  __atomic_store_n(&history->published_count, count + 1, __ATOMIC_RELEASE);
+}
+
+uint32_t vtk_history_copy(struct VtkHistoryNative *history, void const *entries, size_t entry_size,
+                          uint32_t capacity, void *copies, uint32_t max_count) {
+  if (max_count > capacity) {
+    max_count = capacity;
+  }
+  uint64_t end = __atomic_load_n(&history->published_count, __ATOMIC_ACQUIRE);
+  uint64_t start = end > max_count ? end - max_count : 0;
+  for (uint64_t i = start; i < end; i++) {
+    memcpy((uint8_t *)copies + (i - start) * entry_size, (uint8_t const *)entries + (i % capacity) * entry_size,
+           entry_size);
+  }
+
+  // The writer may have moved on meanwhile. Having claimed up to claimed_count, it may be overwriting the entry at
+  // claimed_count - 1 - capacity, so only entries after that one are intact.
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  uint64_t claimed_count = __atomic_load_n(&history->claimed_count, __ATOMIC_RELAXED);
+  uint64_t first_intact = claimed_count > capacity ? claimed_count - capacity : 0;
+  if (first_intact <= start) {
+    return (uint32_t)(end - start);
+  }
+  if (first_intact >= end) {
+    return 0;
+  }
+  memmove(copies, (uint8_t *)copies + (first_intact - start) * entry_size, (end - first_intact) * entry_size);
+  return (uint32_t)(end - first_intact);
+}
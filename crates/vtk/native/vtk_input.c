@@ -0,0 +1,75 @@
+// Input events of a context, passed from the thread running the event loop - which receives them from the compositor -
+// to the thread rendering in a bounded ring. The ring has a single producer and a single consumer, which only
+// synchronize through the atomic counts of events written and read: neither ever waits for the other or allocates. If
+// the ring is full the newest events are dropped, but the held keys and buttons are published separately and stay
+// accurate.
+#include <stdint.h>
+
+#include "vtk_cffi.h"
+#include "vtk_internal.h"
+
+void vtk_input_push(struct VtkContextNative *vtk_context, struct VtkInputEventNative const *event) {
+  // Only this thread writes the held keys and buttons, so it may read them without synchronization.
+  uint64_t held_keys = vtk_context->input_held_keys;
+  uint32_t held_buttons = vtk_context->input_held_buttons;
+  switch (event->kind) {
+  case VTK_INPUT_EVENT_KEY_PRESSED:
+    held_keys |= event->keys;
+    break;
+  case VTK_INPUT_EVENT_KEY_RELEASED:
+    held_keys &= ~event->keys;
+    break;
+  case VTK_INPUT_EVENT_KEY_REPEATED:
+    break;
+  case VTK_INPUT_EVENT_KEYBOARD_ENTERED:
+    held_keys = event->keys;
+    break;
+  case VTK_INPUT_EVENT_KEYBOARD_LEFT:
+    held_keys = 0;
+    break;
+  case VTK_INPUT_EVENT_POINTER_ENTERED:
+  case VTK_INPUT_EVENT_POINTER_LEFT:
+    held_buttons = 0;
+    break;
+  case VTK_INPUT_EVENT_POINTER:
+    held_buttons = (held_buttons | event->buttons_pressed) & ~event->buttons_released;
+    break;
+  }
+  __atomic_store_n(&vtk_context->input_held_keys, held_keys, __ATOMIC_RELEASE);
+  __atomic_store_n(&vtk_context->input_held_buttons, held_buttons, __ATOMIC_RELEASE);
+
+  uint64_t write_count = vtk_context->input_write_count;
+  uint64_t read_count = __atomic_load_n(&vtk_context->input_read_count, __ATOMIC_ACQUIRE);
+  if (write_count - read_count == VTK_INPUT_QUEUE_CAPACITY) {
+    __atomic_add_fetch(&vtk_context->input_dropped_count, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  vtk_context->input_events[write_count % VTK_INPUT_QUEUE_CAPACITY] = *event;
+  // Publish the event only once it has been written completely.
+  __atomic_store_n(&vtk_context->input_write_count, write_count + 1, __ATOMIC_RELEASE);
+}
+
+uint32_t vtk_context_drain_input(struct VtkContextNative *vtk_context, struct VtkInputEventNative *events,
+                                 uint32_t max_count) {
+  uint64_t read_count = vtk_context->input_read_count;
+  uint64_t write_count = __atomic_load_n(&vtk_context->input_write_count, __ATOMIC_ACQUIRE);
+  uint32_t count = write_count - read_count < max_count ? (uint32_t)(write_count - read_count) : max_count;
+  for (uint32_t i = 0; i < count; i++) {
+    events[i] = vtk_context->input_events[(read_count + i) % VTK_INPUT_QUEUE_CAPACITY];
+  }
+  // Hand the slots back to the producer only once they have been copied.
+  __atomic_store_n(&vtk_context->input_read_count, read_count + count, __ATOMIC_RELEASE);
+  return count;
+}
+
+uint64_t vtk_context_held_keys(struct VtkContextNative *vtk_context) {
+  return __atomic_load_n(&vtk_context->input_held_keys, __ATOMIC_ACQUIRE);
+}
+
+uint32_t vtk_context_held_buttons(struct VtkContextNative *vtk_context) {
+  return __atomic_load_n(&vtk_context->input_held_buttons, __ATOMIC_ACQUIRE);
+}
+
+uint64_t vtk_context_dropped_input_events(struct VtkContextNative *vtk_context) {
+  return __atomic_load_n(&vtk_context->input_dropped_count, __ATOMIC_RELAXED);
+}
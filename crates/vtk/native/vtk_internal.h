@@ -1,10 +1,231 @@
 #ifndef VTK_INTERNAL_H_INCLUDED
 #define VTK_INTERNAL_H_INCLUDED
 
+#include <pthread.h>
+
+// A device queue. Queues must be externally synchronized, and one queue may serve several purposes (graphics and
+// transfers, say) when the device lacks dedicated queue families - so all submissions go through vtk_queue_submit().
+struct VtkQueueNative {
+  VkQueue vk_queue;
+  uint32_t family_idx;
+  pthread_mutex_t submit_mutex;
+  // Signalled by submissions through vtk_queue_submit_timeline(), with increasing values handed out as tickets that
+  // other queues and the CPU can wait on.
+  VkSemaphore vk_timeline_semaphore;
+  // The value signalled by the latest such submission.
+  uint64_t timeline_value;
+};
+
+void vtk_queue_submit(struct VtkQueueNative *queue, uint32_t submit_count, VkSubmitInfo const *submits, VkFence fence);
+
+// Submit a batch which signals the timeline semaphore of the queue, with the signal value at *signal_value. The next
+// timeline value is written to *signal_value while the queue is locked, so that values are signalled in increasing
+// order, and returned.
+uint64_t vtk_queue_submit_timeline(struct VtkQueueNative *queue, VkSubmitInfo const *submit, uint64_t *signal_value,
+                                   VkFence fence);
+
+// Whether the timeline semaphore of the queue has reached the ticket.
+_Bool vtk_queue_ticket_complete(struct VtkDeviceNative *vtk_device, struct VtkQueueNative *queue, uint64_t ticket);
+
+// Block until the timeline semaphore of the queue has reached the ticket.
+void vtk_queue_wait_for_ticket(struct VtkDeviceNative *vtk_device, struct VtkQueueNative *queue, uint64_t ticket);
+
+VkResult vtk_queue_present(struct VtkQueueNative *queue, VkPresentInfoKHR const *present_info);
+
+// Create the device memory allocator, see vtk_memory.c.
+void vtk_memory_init(struct VtkDeviceNative *vtk_device);
+
+// The first memory type among type_bits with all the property flags of requirements_mask, using memory properties
+// cached at device creation.
+uint32_t vtk_find_memory_idx(struct VtkDeviceNative *vtk_device, uint32_t type_bits, VkFlags requirements_mask,
+                             _Bool *found);
+
+// Allocate memory for a buffer and bind it, from a memory type with the required property flags, and preferably the
+// preferred ones too. Host visible memory is mapped.
+void vtk_memory_bind_buffer(struct VtkDeviceNative *vtk_device, VkBuffer buffer, VkFlags required, VkFlags preferred,
+                            struct VtkMemoryAllocationNative *allocation);
+
+// Allocate memory for an image and bind it, as vtk_memory_bind_buffer().
+void vtk_memory_bind_image(struct VtkDeviceNative *vtk_device, VkImage image, _Bool linear_tiling, VkFlags required,
+                           VkFlags preferred, struct VtkMemoryAllocationNative *allocation);
+
+void vtk_memory_free(struct VtkDeviceNative *vtk_device, struct VtkMemoryAllocationNative *allocation);
+
+// Sub-allocations are at least 2^VTK_MEMORY_MIN_ORDER bytes.
+#define VTK_MEMORY_MIN_ORDER 8
+
+// The blocks of one memory type holding either linear or non-linear resources, see vtk_memory.c.
+struct VtkMemoryPool;
+
+// Create the allocator of a device with these memory types and heaps, without allocating any memory yet.
+struct VtkMemoryAllocatorNative *vtk_memory_create_allocator(VkPhysicalDeviceMemoryProperties const *memory_properties,
+                                                             uint32_t max_memory_allocation_count);
+
+// The pool of a memory type for linear resources - buffers and linear images - or for optimally tiled images. The two
+// never share a block, and so never a bufferImageGranularity page.
+struct VtkMemoryPool *vtk_memory_pool(struct VtkMemoryAllocatorNative *allocator, uint32_t memory_type_idx,
+                                      _Bool linear);
+
+// Set order to that of the chunk, relative to VTK_MEMORY_MIN_ORDER, for a resource of this size and alignment. Returns
+// false if the resource is too large to be sub-allocated from the blocks of the pool and needs memory of its own.
+_Bool vtk_memory_chunk_order(struct VtkMemoryPool const *pool, uint64_t size, uint64_t alignment, uint32_t *order);
+
+// The number of nodes of the buddy tree of a block of 2^(block_levels + VTK_MEMORY_MIN_ORDER) bytes.
+#define VTK_BUDDY_TREE_SIZE(block_levels) ((2u << (block_levels)) - 1)
+
+// Initialize the buddy tree of a block with the whole block free.
+void vtk_buddy_init(uint8_t *tree, uint32_t block_levels);
+
+// Allocate a chunk of the given order, relative to VTK_MEMORY_MIN_ORDER, returning false if the block has no free
+// chunk that large. The chunk is naturally aligned to its size.
+_Bool vtk_buddy_allocate(uint8_t *tree, uint32_t block_levels, uint32_t order, uint64_t *offset);
+
+// Free a chunk allocated with vtk_buddy_allocate(), merging it with its free buddies.
+void vtk_buddy_free(uint8_t *tree, uint32_t block_levels, uint64_t offset, uint32_t order);
+
+// Create the staging buffer, command pool and timeline semaphore used for uploads on the transfer queue.
+void vtk_uploader_init(struct VtkDeviceNative *vtk_device);
+
+// The timeline semaphore reaching upload tickets as uploads complete.
+VkSemaphore vtk_uploader_semaphore(struct VtkDeviceNative *vtk_device);
+
+// Create the command pool and descriptor pools used for dispatches on the compute queue.
+void vtk_compute_init(struct VtkDeviceNative *vtk_device);
+
+// Create and destroy the frame data ring buffer of a window, see vtk_frame_data.c.
+void vtk_frame_data_init(struct VtkWindowNative *vtk_window);
+void vtk_frame_data_destroy(struct VtkWindowNative *vtk_window);
+
+// Assign the frame data allocated so far to a frame being submitted.
+void vtk_frame_data_frame_submitted(struct VtkWindowNative *vtk_window, struct VtkFrameNative *frame);
+
+// Reclaim the frame data of a frame whose fence has signalled.
+void vtk_frame_data_frame_finished(struct VtkWindowNative *vtk_window, struct VtkFrameNative *frame);
+
+// Reclaim all frame data once the device is idle, before the frames are recreated.
+void vtk_frame_data_reset(struct VtkWindowNative *vtk_window);
+
+// Create and destroy the timestamp query pool of a window, see vtk_gpu_timer.c.
+void vtk_gpu_timer_init(struct VtkWindowNative *vtk_window);
+void vtk_gpu_timer_destroy(struct VtkWindowNative *vtk_window);
+
+// The scopes of the GPU timings of every frame, enclosing those of command lists.
+#define VTK_GPU_TIMER_FRAME_SCOPE 0
+#define VTK_GPU_TIMER_RENDER_PASS_SCOPE 1
+
+// Start timing the scopes of the frame about to be recorded with the resources at frame_idx.
+void vtk_gpu_timer_begin_frame(struct VtkWindowNative *vtk_window, uint32_t frame_idx, uint64_t frame_number);
+
+// Forget the scopes of a frame which could not be rendered.
+void vtk_gpu_timer_discard_frame(struct VtkWindowNative *vtk_window);
+
+// Reset the queries of the frame, at the beginning of its primary command buffer, outside any render pass.
+void vtk_gpu_timer_reset_queries(struct VtkWindowNative *vtk_window, VkCommandBuffer vk_command_buffer);
+
+// Write the start and end timestamps of a scope of the frame. Scopes of UINT32_MAX are not timed.
+void vtk_gpu_timer_write_start(struct VtkWindowNative *vtk_window, VkCommandBuffer vk_command_buffer, uint32_t scope);
+void vtk_gpu_timer_write_end(struct VtkWindowNative *vtk_window, VkCommandBuffer vk_command_buffer, uint32_t scope);
+
+// Create and destroy the queue of command buffers recorded for the next frame of a window, see vtk_recorder.c.
+void vtk_recording_init(struct VtkWindowNative *vtk_window);
+void vtk_recording_destroy(struct VtkWindowNative *vtk_window);
+
+// Free the recorders destroyed since, whose command buffers were recorded for frames up to finished_frame_number.
+void vtk_recording_frame_finished(struct VtkWindowNative *vtk_window, uint64_t finished_frame_number);
+
+// Begin a secondary command buffer continuing the surface rendering, with viewport and scissor covering the window and
+// the default cull mode and topology of pipelines.
+void vtk_recording_begin_secondary(struct VtkWindowNative *vtk_window, VkCommandBuffer vk_command_buffer);
+
+// Inside the surface rendering, execute the draws of the frame itself and then the command buffers recorded for the
+// frame in order, and empty the queue.
+void vtk_recording_execute(struct VtkWindowNative *vtk_window, VkCommandBuffer vk_command_buffer,
+                           VkCommandBuffer vk_frame_command_buffer);
+
+// Drop the command buffers recorded for a frame which could not be rendered.
+void vtk_recording_discard(struct VtkWindowNative *vtk_window);
+
+// Append an entry to a ring of capacity entries of entry_size bytes, see vtk_history.c. Must only be called by the
+// single writer of the ring.
+void vtk_history_write(struct VtkHistoryNative *history, void *entries, size_t entry_size, uint32_t capacity,
+                       void const *entry);
+
+// Copy up to max_count of the latest entries of a ring into copies, oldest first, from any thread. Returns the number
+// of entries copied, leaving out those the writer may have overwritten while they were being copied.
+uint32_t vtk_history_copy(struct VtkHistoryNative *history, void const *entries, size_t entry_size,
+                          uint32_t capacity, void *copies, uint32_t max_count);
+
+// The current CLOCK_MONOTONIC time in nanoseconds.
+uint64_t vtk_frame_stats_now(void);
+
+// Add the time since *lap_start to the phase, and restart the lap.
+void vtk_frame_stats_lap(struct VtkFrameTimingNative *timing, enum VtkFramePhaseNative phase,
+                         uint64_t *lap_start);
+
+// Total the timings of a frame and append them to the ring of the window. Must only be called from the thread
+// rendering the window.
+void vtk_frame_stats_record(struct VtkWindowNative *vtk_window, struct VtkFrameTimingNative *timing);
+
+// Read back the timings of the frame last rendered with the resources at frame_idx, once its fence has signalled.
+void vtk_gpu_timer_frame_finished(struct VtkWindowNative *vtk_window, uint32_t frame_idx);
+
 _Bool vtk_window_init_platform(struct VtkWindowNative *vtk_window);
 
+#if defined __linux__ && !defined __ANDROID__
+// Whether headless rendering is asked for with the VTK_HEADLESS environment variable.
+_Bool vtk_headless_requested(void);
+
+// Create the headless surface of a window of a headless context, and set up rendering to it.
+void vtk_window_init_headless(struct VtkWindowNative *vtk_window);
+
+// Create the event loop of a context, once its Wayland connection - if any - is set up.
+void vtk_event_loop_init(struct VtkContextNative *vtk_context);
+
+// Run the event loop until vtk_context_quit() is called or the Wayland connection is lost.
+void vtk_event_loop_run(struct VtkContextNative *vtk_context);
+
+// Ask the compositor for a frame callback with the next commit of the surface, made when presenting. Called from the
+// thread rendering the window.
+void vtk_wayland_request_frame(struct VtkWindowNative *vtk_window);
+
+// The size of the swap chain images of the window for its logical size, output scale and render scale, setting the
+// viewport to scale them to the logical size. Called from the thread rendering the window before rendering at a new
+// size, which the viewport applies to along with the first frame presented at it.
+VkExtent2D vtk_wayland_update_surface_size(struct VtkWindowNative *vtk_window);
+
+// Create the presentation feedback state of a window, if the compositor supports wp_presentation.
+void vtk_wayland_presentation_init(struct VtkWindowNative *vtk_window);
+
+// Ask for presentation feedback on the next commit of the surface, made when presenting the frame just submitted.
+// Called from the thread rendering the window.
+void vtk_wayland_request_presentation_feedback(struct VtkWindowNative *vtk_window);
+
+// Append an input event to the ring of the context and update the held keys and buttons. Must only be called from the
+// thread running the event loop.
+void vtk_input_push(struct VtkContextNative *vtk_context, struct VtkInputEventNative const *event);
+#endif
+
 void vtk_setup_window_rendering(struct VtkWindowNative *vtk_window);
 
 void vtk_tear_down_window_rendering(struct VtkWindowNative *vtk_window);
 
+// Choose the physical device and graphics queue family of the device, see vtk_device_init_with_selector().
+void vtk_select_physical_device(struct VtkDeviceNative *vtk_device, char const *selector);
+
+// Whether the extension is among those enumerated.
+_Bool vtk_has_extension(VkExtensionProperties const *extensions, uint32_t extension_count, char const *name);
+
+// Create the pipeline cache of the device, with the content of the cache file if it is valid for the device.
+void vtk_pipeline_cache_init(struct VtkDeviceNative *vtk_device);
+
+// Create a graphics pipeline using the pipeline cache of the device, recording statistics.
+void vtk_pipeline_cache_create_graphics_pipeline(struct VtkDeviceNative *vtk_device,
+                                                 VkGraphicsPipelineCreateInfo *vk_pipeline_create_info,
+                                                 VkPipeline *vk_pipeline);
+
+// Create a compute pipeline using the pipeline cache of the device, recording statistics.
+void vtk_pipeline_cache_create_compute_pipeline(struct VtkDeviceNative *vtk_device,
+                                                VkComputePipelineCreateInfo *vk_pipeline_create_info,
+                                                VkPipeline *vk_pipeline);
+
 #endif
\ No newline at end of file
@@ -27,6 +27,11 @@ void vtk_context_run(struct VtkContextNative *vtk_context) {
   [ns_application run];
 }
 
+// Windows on macOS are paced by presentation alone, as their present mode allows, so there is nothing to wait for.
+_Bool vtk_window_wait_for_frame(struct VtkWindowNative *vtk_window, uint64_t timeout_ns) {
+  return 1;
+}
+
 _Bool vtk_window_init_platform(struct VtkWindowNative *vtk_window) {
   NSRect frame = NSMakeRect(0, 0, 600, 600);
   VtkViewController *vtk_view_controller = [[VtkViewController alloc] init];
@@ -0,0 +1,428 @@
+// Device memory allocation. Resources are sub-allocated from large device memory blocks using a buddy allocator, so
+// that creating many buffers neither hits maxMemoryAllocationCount nor pays the latency of vkAllocateMemory() each
+// time. Large resources, and those the driver wants on their own, get dedicated allocations.
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vtk_cffi.h"
+#include "vtk_internal.h"
+#include "vtk_log.h"
+#include "vulkan_wrapper.h"
+
+// Blocks are 2^VTK_MEMORY_BLOCK_ORDER bytes, or smaller on small heaps.
+#define VTK_MEMORY_BLOCK_ORDER 26
+
+struct VtkMemoryBlockNative {
+  VkDeviceMemory vk_memory;
+  // The mapped block if its memory type is host visible, else null.
+  uint8_t *mapped;
+  struct VtkMemoryPool *pool;
+  struct VtkMemoryBlockNative *next;
+  uint32_t allocation_count;
+  // The buddy tree, a complete binary tree in breadth first order where the root covers the whole block and the
+  // leaves cover 2^VTK_MEMORY_MIN_ORDER bytes each. For every node it holds one more than the order, relative to
+  // VTK_MEMORY_MIN_ORDER, of the largest free chunk within it - or 0 if it is fully allocated.
+  uint8_t *tree;
+};
+
+// The blocks of one memory type holding either linear or non-linear resources.
+struct VtkMemoryPool {
+  uint32_t memory_type_idx;
+  // The size of the blocks as an order relative to VTK_MEMORY_MIN_ORDER.
+  uint32_t block_levels;
+  struct VtkMemoryBlockNative *blocks;
+};
+
+struct VtkMemoryAllocatorNative {
+  // Memory may be allocated from any thread.
+  pthread_mutex_t mutex;
+  VkPhysicalDeviceMemoryProperties vk_memory_properties;
+  uint32_t max_memory_allocation_count;
+  // Linear resources (buffers and linear images) and non-linear ones (optimally tiled images) are kept in separate
+  // pools, so that they never share a bufferImageGranularity page.
+  struct VtkMemoryPool pools[VK_MAX_MEMORY_TYPES][2];
+};
+
+static uint32_t vtk_ceil_log2(uint64_t value) {
+  uint32_t order = 0;
+  while (((uint64_t)1 << order) < value) {
+    order++;
+  }
+  return order;
+}
+
+struct VtkMemoryAllocatorNative *vtk_memory_create_allocator(VkPhysicalDeviceMemoryProperties const *memory_properties,
+                                                             uint32_t max_memory_allocation_count) {
+  struct VtkMemoryAllocatorNative *allocator =
+      (struct VtkMemoryAllocatorNative *)calloc(1, sizeof(struct VtkMemoryAllocatorNative));
+  pthread_mutex_init(&allocator->mutex, NULL);
+  allocator->vk_memory_properties = *memory_properties;
+  allocator->max_memory_allocation_count = max_memory_allocation_count;
+
+  for (uint32_t i = 0; i < memory_properties->memoryTypeCount; i++) {
+    // Use at most an eighth of the heap for a block, so that small heaps are not exhausted by a few blocks.
+    VkDeviceSize heap_size = memory_properties->memoryHeaps[memory_properties->memoryTypes[i].heapIndex].size;
+    uint32_t block_order = VTK_MEMORY_BLOCK_ORDER;
+    while (block_order > VTK_MEMORY_MIN_ORDER + 4 && ((VkDeviceSize)1 << block_order) > heap_size / 8) {
+      block_order--;
+    }
+    for (uint32_t linear = 0; linear < 2; linear++) {
+      allocator->pools[i][linear].memory_type_idx = i;
+      allocator->pools[i][linear].block_levels = block_order - VTK_MEMORY_MIN_ORDER;
+    }
+  }
+  return allocator;
+}
+
+void vtk_memory_init(struct VtkDeviceNative *vtk_device) {
+  VkPhysicalDeviceMemoryProperties memory_properties;
+  vkGetPhysicalDeviceMemoryProperties(vtk_device->vk_physical_device, &memory_properties);
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(vtk_device->vk_physical_device, &properties);
+
+  memset(&vtk_device->memory_stats, 0, sizeof(vtk_device->memory_stats));
+  vtk_device->memory_allocator =
+      vtk_memory_create_allocator(&memory_properties, properties.limits.maxMemoryAllocationCount);
+}
+
+struct VtkMemoryPool *vtk_memory_pool(struct VtkMemoryAllocatorNative *allocator, uint32_t memory_type_idx,
+                                      _Bool linear) {
+  return &allocator->pools[memory_type_idx][linear ? 1 : 0];
+}
+
+_Bool vtk_memory_chunk_order(struct VtkMemoryPool const *pool, uint64_t size, uint64_t alignment, uint32_t *order) {
+  // Chunks are naturally aligned to their size, so a chunk as large as the alignment is aligned too.
+  uint32_t chunk_order = vtk_ceil_log2(size > alignment ? size : alignment);
+  *order = chunk_order > VTK_MEMORY_MIN_ORDER ? chunk_order - VTK_MEMORY_MIN_ORDER : 0;
+  // Resources of half a block or more would waste most of a block, so get dedicated allocations.
+  return *order + 1 < pool->block_levels;
+}
+
+uint32_t vtk_find_memory_idx(struct VtkDeviceNative *vtk_device, uint32_t type_bits, VkFlags requirements_mask,
+                             bool *found) {
+  VkPhysicalDeviceMemoryProperties const *memory_properties = &vtk_device->memory_allocator->vk_memory_properties;
+  for (uint32_t memory_index = 0; memory_index < memory_properties->memoryTypeCount; memory_index++) {
+    if (type_bits & (1u << memory_index)) {
+      if ((memory_properties->memoryTypes[memory_index].propertyFlags & requirements_mask) == requirements_mask) {
+        *found = true;
+        return memory_index;
+      }
+    }
+  }
+  *found = false;
+  return 0;
+}
+
+// Allocate device memory from the driver, mapping it if it is host visible.
+static VkDeviceMemory vtk_memory_allocate_device_memory(struct VtkDeviceNative *vtk_device, uint32_t memory_type_idx,
+                                                        VkDeviceSize size, void const *next, uint8_t **mapped) {
+  struct VtkMemoryAllocatorNative *allocator = vtk_device->memory_allocator;
+  struct VtkMemoryStatsNative *stats = &vtk_device->memory_stats;
+  if (stats->block_count + stats->dedicated_allocation_count >= allocator->max_memory_allocation_count) {
+    LOGW("Exceeding maxMemoryAllocationCount of %u device memory allocations",
+         allocator->max_memory_allocation_count);
+  }
+
+  VkMemoryAllocateInfo vk_memory_allocate_info = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+      .pNext = next,
+      .allocationSize = size,
+      .memoryTypeIndex = memory_type_idx,
+  };
+  VkDeviceMemory vk_memory;
+  CALL_VK(vkAllocateMemory(vtk_device->vk_device, &vk_memory_allocate_info, NULL, &vk_memory))
+  stats->allocated_bytes += size;
+
+  *mapped = NULL;
+  if (allocator->vk_memory_properties.memoryTypes[memory_type_idx].propertyFlags &
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+    CALL_VK(vkMapMemory(vtk_device->vk_device, vk_memory, 0, VK_WHOLE_SIZE, 0, (void **)mapped))
+  }
+  return vk_memory;
+}
+
+static struct VtkMemoryBlockNative *vtk_memory_create_block(struct VtkDeviceNative *vtk_device,
+                                                            struct VtkMemoryPool *pool) {
+  struct VtkMemoryBlockNative *block = (struct VtkMemoryBlockNative *)malloc(sizeof(struct VtkMemoryBlockNative));
+  VkDeviceSize block_size = (VkDeviceSize)1 << (pool->block_levels + VTK_MEMORY_MIN_ORDER);
+  block->vk_memory = vtk_memory_allocate_device_memory(vtk_device, pool->memory_type_idx, block_size, NULL,
+                                                       &block->mapped);
+  block->pool = pool;
+  block->allocation_count = 0;
+
+  block->tree = (uint8_t *)malloc(VTK_BUDDY_TREE_SIZE(pool->block_levels));
+  vtk_buddy_init(block->tree, pool->block_levels);
+
+  block->next = pool->blocks;
+  pool->blocks = block;
+  vtk_device->memory_stats.block_count++;
+  LOGI("Allocated %llu MiB device memory block of memory type %u", (unsigned long long)(block_size >> 20),
+       pool->memory_type_idx);
+  return block;
+}
+
+static void vtk_memory_destroy_block(struct VtkDeviceNative *vtk_device, struct VtkMemoryBlockNative *block) {
+  struct VtkMemoryBlockNative **link = &block->pool->blocks;
+  while (*link != block) {
+    link = &(*link)->next;
+  }
+  *link = block->next;
+
+  vkFreeMemory(vtk_device->vk_device, block->vk_memory, NULL);
+  vtk_device->memory_stats.block_count--;
+  vtk_device->memory_stats.allocated_bytes -= (VkDeviceSize)1
+                                              << (block->pool->block_levels + VTK_MEMORY_MIN_ORDER);
+  free(block->tree);
+  free(block);
+}
+
+void vtk_buddy_init(uint8_t *tree, uint32_t block_levels) {
+  // Every node starts out as one free chunk of its own size.
+  for (uint32_t depth = 0, node = 0; depth <= block_levels; depth++) {
+    memset(tree + node, (int)(block_levels - depth + 1), (size_t)1 << depth);
+    node += 1u << depth;
+  }
+}
+
+// Recompute the ancestors of a node whose free chunk size has changed, merging buddies which are both free.
+static void vtk_buddy_update_parents(uint8_t *tree, uint32_t node, uint32_t order) {
+  while (node > 0) {
+    node = (node - 1) / 2;
+    order++;
+    uint8_t left = tree[2 * node + 1];
+    uint8_t right = tree[2 * node + 2];
+    if (left == order && right == order) {
+      tree[node] = (uint8_t)(order + 1);
+    } else {
+      tree[node] = left > right ? left : right;
+    }
+  }
+}
+
+_Bool vtk_buddy_allocate(uint8_t *tree, uint32_t block_levels, uint32_t order, uint64_t *offset) {
+  if (tree[0] < order + 1) {
+    return false;
+  }
+
+  uint32_t node = 0;
+  uint32_t node_order = block_levels;
+  while (node_order > order) {
+    // Descend into the child with the smallest large enough free chunk, keeping larger chunks intact.
+    uint32_t left = 2 * node + 1;
+    uint32_t right = left + 1;
+    if (tree[left] < order + 1) {
+      node = right;
+    } else if (tree[right] < order + 1) {
+      node = left;
+    } else {
+      node = tree[right] < tree[left] ? right : left;
+    }
+    node_order--;
+  }
+  tree[node] = 0;
+  vtk_buddy_update_parents(tree, node, order);
+
+  uint32_t first_node_of_level = (1u << (block_levels - order)) - 1;
+  *offset = (uint64_t)(node - first_node_of_level) << (order + VTK_MEMORY_MIN_ORDER);
+  return true;
+}
+
+void vtk_buddy_free(uint8_t *tree, uint32_t block_levels, uint64_t offset, uint32_t order) {
+  uint32_t first_node_of_level = (1u << (block_levels - order)) - 1;
+  uint32_t node = first_node_of_level + (uint32_t)(offset >> (order + VTK_MEMORY_MIN_ORDER));
+  tree[node] = (uint8_t)(order + 1);
+  vtk_buddy_update_parents(tree, node, order);
+}
+
+// Choose the memory type, preferring one with the preferred property flags in addition to the required ones.
+static uint32_t vtk_memory_choose_type(struct VtkDeviceNative *vtk_device, uint32_t type_bits, VkFlags required,
+                                       VkFlags preferred) {
+  bool found;
+  uint32_t memory_type_idx = vtk_find_memory_idx(vtk_device, type_bits, required | preferred, &found);
+  if (!found) {
+    memory_type_idx = vtk_find_memory_idx(vtk_device, type_bits, required, &found);
+  }
+  if (!found) {
+    LOGE("No memory type with property flags 0x%x among types 0x%x", required, type_bits);
+    assert(false);
+  }
+  return memory_type_idx;
+}
+
+static void vtk_memory_allocate(struct VtkDeviceNative *vtk_device, VkMemoryRequirements const *requirements,
+                                bool linear, bool dedicated, VkMemoryDedicatedAllocateInfo const *dedicated_info,
+                                VkFlags required, VkFlags preferred, struct VtkMemoryAllocationNative *allocation) {
+  struct VtkMemoryAllocatorNative *allocator = vtk_device->memory_allocator;
+  uint32_t memory_type_idx = vtk_memory_choose_type(vtk_device, requirements->memoryTypeBits, required, preferred);
+  struct VtkMemoryPool *pool = vtk_memory_pool(allocator, memory_type_idx, linear);
+  uint32_t order;
+  if (!vtk_memory_chunk_order(pool, requirements->size, requirements->alignment, &order)) {
+    dedicated = true;
+  }
+
+  pthread_mutex_lock(&allocator->mutex);
+  struct VtkMemoryStatsNative *stats = &vtk_device->memory_stats;
+  if (dedicated) {
+    uint8_t *mapped;
+    allocation->vk_memory =
+        vtk_memory_allocate_device_memory(vtk_device, memory_type_idx, requirements->size, dedicated_info, &mapped);
+    allocation->offset = 0;
+    allocation->size = requirements->size;
+    allocation->mapped = mapped;
+    allocation->block = NULL;
+    allocation->order = 0;
+    stats->dedicated_allocation_count++;
+  } else {
+    struct VtkMemoryBlockNative *block = pool->blocks;
+    VkDeviceSize offset = 0;
+    while (block != NULL && !vtk_buddy_allocate(block->tree, pool->block_levels, order, &offset)) {
+      block = block->next;
+    }
+    if (block == NULL) {
+      block = vtk_memory_create_block(vtk_device, pool);
+      bool allocated = vtk_buddy_allocate(block->tree, pool->block_levels, order, &offset);
+      assert(allocated);
+    }
+    block->allocation_count++;
+    allocation->vk_memory = block->vk_memory;
+    allocation->offset = offset;
+    allocation->size = (VkDeviceSize)1 << (order + VTK_MEMORY_MIN_ORDER);
+    allocation->mapped = block->mapped ? block->mapped + offset : NULL;
+    allocation->block = block;
+    allocation->order = order;
+  }
+  stats->allocation_count++;
+  stats->used_bytes += allocation->size;
+  pthread_mutex_unlock(&allocator->mutex);
+}
+
+void vtk_memory_bind_buffer(struct VtkDeviceNative *vtk_device, VkBuffer buffer, VkFlags required, VkFlags preferred,
+                            struct VtkMemoryAllocationNative *allocation) {
+  VkMemoryDedicatedRequirements vk_dedicated_requirements = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS,
+      .pNext = NULL,
+  };
+  VkMemoryRequirements2 vk_memory_requirements = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
+      .pNext = &vk_dedicated_requirements,
+  };
+  VkBufferMemoryRequirementsInfo2 vk_requirements_info = {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2,
+      .pNext = NULL,
+      .buffer = buffer,
+  };
+  vkGetBufferMemoryRequirements2(vtk_device->vk_device, &vk_requirements_info, &vk_memory_requirements);
+
+  VkMemoryDedicatedAllocateInfo vk_dedicated_allocate_info = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO,
+      .pNext = NULL,
+      .image = VK_NULL_HANDLE,
+      .buffer = buffer,
+  };
+  bool dedicated =
+      vk_dedicated_requirements.prefersDedicatedAllocation || vk_dedicated_requirements.requiresDedicatedAllocation;
+  vtk_memory_allocate(vtk_device, &vk_memory_requirements.memoryRequirements, true, dedicated,
+                      &vk_dedicated_allocate_info, required, preferred, allocation);
+  CALL_VK(vkBindBufferMemory(vtk_device->vk_device, buffer, allocation->vk_memory, allocation->offset))
+}
+
+void vtk_memory_bind_image(struct VtkDeviceNative *vtk_device, VkImage image, bool linear_tiling, VkFlags required,
+                           VkFlags preferred, struct VtkMemoryAllocationNative *allocation) {
+  VkMemoryDedicatedRequirements vk_dedicated_requirements = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS,
+      .pNext = NULL,
+  };
+  VkMemoryRequirements2 vk_memory_requirements = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
+      .pNext = &vk_dedicated_requirements,
+  };
+  VkImageMemoryRequirementsInfo2 vk_requirements_info = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2,
+      .pNext = NULL,
+      .image = image,
+  };
+  vkGetImageMemoryRequirements2(vtk_device->vk_device, &vk_requirements_info, &vk_memory_requirements);
+
+  VkMemoryDedicatedAllocateInfo vk_dedicated_allocate_info = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO,
+      .pNext = NULL,
+      .image = image,
+      .buffer = VK_NULL_HANDLE,
+  };
+  bool dedicated =
+      vk_dedicated_requirements.prefersDedicatedAllocation || vk_dedicated_requirements.requiresDedicatedAllocation;
+  vtk_memory_allocate(vtk_device, &vk_memory_requirements.memoryRequirements, linear_tiling, dedicated,
+                      &vk_dedicated_allocate_info, required, preferred, allocation);
+  CALL_VK(vkBindImageMemory(vtk_device->vk_device, image, allocation->vk_memory, allocation->offset))
+}
+
+void vtk_memory_free(struct VtkDeviceNative *vtk_device, struct VtkMemoryAllocationNative *allocation) {
+  struct VtkMemoryAllocatorNative *allocator = vtk_device->memory_allocator;
+  pthread_mutex_lock(&allocator->mutex);
+  struct VtkMemoryStatsNative *stats = &vtk_device->memory_stats;
+  stats->allocation_count--;
+  stats->used_bytes -= allocation->size;
+
+  struct VtkMemoryBlockNative *block = allocation->block;
+  if (block == NULL) {
+    vkFreeMemory(vtk_device->vk_device, allocation->vk_memory, NULL);
+    stats->dedicated_allocation_count--;
+    stats->allocated_bytes -= allocation->size;
+  } else {
+    vtk_buddy_free(block->tree, block->pool->block_levels, allocation->offset, allocation->order);
+    // Release empty blocks, but keep the last one of the pool around to avoid allocating it again right away.
+    if (--block->allocation_count == 0 && (block->pool->blocks != block || block->next != NULL)) {
+      vtk_memory_destroy_block(vtk_device, block);
+    }
+  }
+  pthread_mutex_unlock(&allocator->mutex);
+  memset(allocation, 0, sizeof(*allocation));
+}
+
+struct VtkMemoryStatsNative vtk_device_memory_stats(struct VtkDeviceNative *vtk_device) {
+  struct VtkMemoryAllocatorNative *allocator = vtk_device->memory_allocator;
+  pthread_mutex_lock(&allocator->mutex);
+  struct VtkMemoryStatsNative stats = vtk_device->memory_stats;
+  pthread_mutex_unlock(&allocator->mutex);
+  return stats;
+}
+
+VkBuffer vtk_device_create_buffer(struct VtkDeviceNative *vtk_device, uint64_t size, uint32_t usage,
+                                  _Bool host_visible, struct VtkMemoryAllocationNative *allocation) {
+  uint32_t queue_family_indices[3] = {vtk_device->graphics_queue_family_idx};
+  uint32_t queue_family_count = 1;
+  if (vtk_device->transfer_queue_family_idx != vtk_device->graphics_queue_family_idx) {
+    queue_family_indices[queue_family_count++] = vtk_device->transfer_queue_family_idx;
+  }
+  if (vtk_device->compute_queue_family_idx != vtk_device->graphics_queue_family_idx) {
+    queue_family_indices[queue_family_count++] = vtk_device->compute_queue_family_idx;
+  }
+  bool shared = queue_family_count > 1;
+  VkBufferCreateInfo vk_buffer_create_info = {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+      .pNext = NULL,
+      .flags = 0,
+      .size = size,
+      .usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      .sharingMode = shared ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+      .queueFamilyIndexCount = queue_family_count,
+      .pQueueFamilyIndices = queue_family_indices,
+  };
+  VkBuffer buffer;
+  CALL_VK(vkCreateBuffer(vtk_device->vk_device, &vk_buffer_create_info, NULL, &buffer))
+
+  if (host_visible) {
+    vtk_memory_bind_buffer(vtk_device, buffer,
+                           VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0, allocation);
+  } else {
+    vtk_memory_bind_buffer(vtk_device, buffer, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, allocation);
+  }
+  return buffer;
+}
+
+void vtk_device_destroy_buffer(struct VtkDeviceNative *vtk_device, VkBuffer buffer,
+                               struct VtkMemoryAllocationNative *allocation) {
+  vkDestroyBuffer(vtk_device->vk_device, buffer, NULL);
+  vtk_memory_free(vtk_device, allocation);
+}
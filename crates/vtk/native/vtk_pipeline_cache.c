@@ -0,0 +1,371 @@
+// Device-level pipeline cache, persisted to a per-application file so that pipelines compiled by one run of the
+// application are reused by the next.
+//
+// Saving serializes the whole cache and writes it out with an fsync, which is too slow to do for every pipeline
+// compiled. Creating a pipeline missing from the cache only marks the cache dirty, and on Linux schedules a save on the
+// event loop of the context - which waits until no pipeline has been compiled for VTK_PIPELINE_CACHE_SAVE_DELAY_NS, so
+// a cold start compiling many pipelines saves once. Misses are told from hits by pipeline creation feedback, or on
+// devices without it by the cache data growing.
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "vtk_cffi.h"
+#include "vtk_internal.h"
+#include "vtk_log.h"
+#include "vtk_platform.h"
+#include "vulkan_wrapper.h"
+
+#define VTK_PIPELINE_CACHE_SAVE_DELAY_NS 1000000000ull
+
+struct VtkPipelineCacheNative {
+  // Guards the statistics and the dirty state, as pipelines are created from any thread.
+  pthread_mutex_t mutex;
+  struct VtkPipelineCacheStatsNative stats;
+  // Whether pipelines have been compiled since the cache was last saved, and when the latest was.
+  bool dirty;
+  uint64_t changed_ns;
+  // Whether a save is scheduled on the event loop.
+  bool save_scheduled;
+  // The size of the cache data as of the latest pipeline created, to tell misses without creation feedback.
+  size_t data_size;
+  // Held while saving, so that concurrent saves do not write the same temporary file.
+  pthread_mutex_t save_mutex;
+};
+
+static const char *vtk_program_name(void) {
+#ifdef VTK_PLATFORM_APPLE
+  return getprogname();
+#elif defined VTK_PLATFORM_WAYLAND
+  return program_invocation_short_name;
+#else
+  return NULL;
+#endif
+}
+
+// Create the directory, and its parent, if they do not exist. Returns false on failure.
+static bool vtk_create_directory(char *path) {
+  char *last_slash = strrchr(path, '/');
+  if (last_slash != NULL && last_slash != path) {
+    *last_slash = '\0';
+    bool created_parent = (mkdir(path, 0755) == 0 || errno == EEXIST);
+    *last_slash = '/';
+    if (!created_parent) {
+      return false;
+    }
+  }
+  return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+// The path to the cache file of this application, or NULL if the cache should not be persisted. The
+// VTK_PIPELINE_CACHE_PATH environment variable may be used to override the location, or set to an empty string to
+// disable persistence. Returns a malloc:ed string.
+static char *vtk_pipeline_cache_path(void) {
+  char const *override_path = getenv("VTK_PIPELINE_CACHE_PATH");
+  if (override_path != NULL) {
+    return override_path[0] == '\0' ? NULL : strdup(override_path);
+  }
+
+  char const *program_name = vtk_program_name();
+  if (program_name == NULL) {
+    return NULL;
+  }
+
+  char directory[4096];
+  char const *home = getenv("HOME");
+#ifdef VTK_PLATFORM_APPLE
+  if (home == NULL) {
+    return NULL;
+  }
+  snprintf(directory, sizeof(directory), "%s/Library/Caches/vtk", home);
+#else
+  char const *xdg_cache_home = getenv("XDG_CACHE_HOME");
+  if (xdg_cache_home != NULL && xdg_cache_home[0] == '/') {
+    snprintf(directory, sizeof(directory), "%s/vtk", xdg_cache_home);
+  } else if (home != NULL) {
+    snprintf(directory, sizeof(directory), "%s/.cache/vtk", home);
+  } else {
+    return NULL;
+  }
+#endif
+  if (!vtk_create_directory(directory)) {
+    LOGW("Unable to create pipeline cache directory %s: %s", directory, strerror(errno));
+    return NULL;
+  }
+
+  size_t path_size = strlen(directory) + strlen(program_name) + sizeof("/.pipeline-cache");
+  char *path = (char *)malloc(path_size);
+  snprintf(path, path_size, "%s/%s.pipeline-cache", directory, program_name);
+  return path;
+}
+
+// Check that cache data was created by the same driver and device, since some drivers do not cope well with data
+// from elsewhere.
+static bool vtk_pipeline_cache_data_valid(struct VtkDeviceNative *vtk_device, uint8_t const *data, size_t size) {
+  VkPipelineCacheHeaderVersionOne header;
+  if (size < sizeof(header)) {
+    return false;
+  }
+  memcpy(&header, data, sizeof(header));
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(vtk_device->vk_physical_device, &properties);
+
+  return header.headerSize >= sizeof(header) && header.headerSize <= size &&
+         header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE && header.vendorID == properties.vendorID &&
+         header.deviceID == properties.deviceID &&
+         memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+// Read the whole file, returning a malloc:ed buffer or NULL if the file could not be read.
+static uint8_t *vtk_read_file(char const *path, size_t *size) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return NULL;
+  }
+  uint8_t *data = NULL;
+  if (fseek(file, 0, SEEK_END) == 0) {
+    long file_size = ftell(file);
+    if (file_size > 0 && fseek(file, 0, SEEK_SET) == 0) {
+      data = (uint8_t *)malloc((size_t)file_size);
+      if (fread(data, 1, (size_t)file_size, file) == (size_t)file_size) {
+        *size = (size_t)file_size;
+      } else {
+        free(data);
+        data = NULL;
+      }
+    }
+  }
+  fclose(file);
+  return data;
+}
+
+void vtk_pipeline_cache_init(struct VtkDeviceNative *vtk_device) {
+  struct VtkPipelineCacheNative *pipeline_cache =
+      (struct VtkPipelineCacheNative *)calloc(1, sizeof(struct VtkPipelineCacheNative));
+  pthread_mutex_init(&pipeline_cache->mutex, NULL);
+  pthread_mutex_init(&pipeline_cache->save_mutex, NULL);
+  vtk_device->pipeline_cache = pipeline_cache;
+  vtk_device->pipeline_cache_path = vtk_pipeline_cache_path();
+
+  size_t initial_data_size = 0;
+  uint8_t *initial_data = NULL;
+  if (vtk_device->pipeline_cache_path != NULL) {
+    initial_data = vtk_read_file(vtk_device->pipeline_cache_path, &initial_data_size);
+    if (initial_data != NULL && !vtk_pipeline_cache_data_valid(vtk_device, initial_data, initial_data_size)) {
+      LOGW("Ignoring pipeline cache %s created by another device or driver", vtk_device->pipeline_cache_path);
+      free(initial_data);
+      initial_data = NULL;
+      initial_data_size = 0;
+    }
+  }
+
+  VkPipelineCacheCreateInfo vk_pipeline_cache_create_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+      .pNext = NULL,
+      .flags = 0,
+      .initialDataSize = initial_data_size,
+      .pInitialData = initial_data,
+  };
+  CALL_VK(vkCreatePipelineCache(vtk_device->vk_device, &vk_pipeline_cache_create_info, NULL,
+                                &vtk_device->vk_pipeline_cache))
+  free(initial_data);
+
+  pipeline_cache->stats.loaded_bytes = initial_data_size;
+  pipeline_cache->stats.creation_feedback = vtk_device->pipeline_creation_feedback;
+  CALL_VK(vkGetPipelineCacheData(vtk_device->vk_device, vtk_device->vk_pipeline_cache, &pipeline_cache->data_size,
+                                 NULL))
+  LOGI("Created pipeline cache with %zu bytes from %s", initial_data_size,
+       vtk_device->pipeline_cache_path ? vtk_device->pipeline_cache_path : "(not persisted)");
+}
+
+void vtk_device_save_pipeline_cache(struct VtkDeviceNative *vtk_device) {
+  if (vtk_device->pipeline_cache_path == NULL) {
+    return;
+  }
+  struct VtkPipelineCacheNative *pipeline_cache = vtk_device->pipeline_cache;
+  pthread_mutex_lock(&pipeline_cache->save_mutex);
+  // Pipelines compiled from here on may be missing from the data, so they mark the cache dirty again.
+  pthread_mutex_lock(&pipeline_cache->mutex);
+  pipeline_cache->dirty = false;
+  pthread_mutex_unlock(&pipeline_cache->mutex);
+
+  size_t data_size = 0;
+  CALL_VK(vkGetPipelineCacheData(vtk_device->vk_device, vtk_device->vk_pipeline_cache, &data_size, NULL))
+  uint8_t *data = (uint8_t *)malloc(data_size);
+  CALL_VK(vkGetPipelineCacheData(vtk_device->vk_device, vtk_device->vk_pipeline_cache, &data_size, data))
+
+  // Write to a temporary file which is renamed over the cache file, so that an interrupted write or a concurrently
+  // running instance of the application never leaves a partially written cache behind.
+  size_t temp_path_size = strlen(vtk_device->pipeline_cache_path) + 32;
+  char *temp_path = (char *)malloc(temp_path_size);
+  snprintf(temp_path, temp_path_size, "%s.%ld.tmp", vtk_device->pipeline_cache_path, (long)getpid());
+
+  FILE *file = fopen(temp_path, "wb");
+  bool written = file != NULL && fwrite(data, 1, data_size, file) == data_size && fflush(file) == 0 &&
+                 fsync(fileno(file)) == 0;
+  if (file != NULL && fclose(file) != 0) {
+    written = false;
+  }
+  if (written && rename(temp_path, vtk_device->pipeline_cache_path) == 0) {
+    LOGI("Saved %zu bytes of pipeline cache to %s", data_size, vtk_device->pipeline_cache_path);
+  } else {
+    LOGW("Unable to save pipeline cache to %s: %s", vtk_device->pipeline_cache_path, strerror(errno));
+    unlink(temp_path);
+  }
+
+  free(temp_path);
+  free(data);
+  pthread_mutex_unlock(&pipeline_cache->save_mutex);
+}
+
+struct VtkPipelineCacheStatsNative vtk_device_pipeline_cache_stats(struct VtkDeviceNative *vtk_device) {
+  struct VtkPipelineCacheNative *pipeline_cache = vtk_device->pipeline_cache;
+  pthread_mutex_lock(&pipeline_cache->mutex);
+  struct VtkPipelineCacheStatsNative stats = pipeline_cache->stats;
+  pthread_mutex_unlock(&pipeline_cache->mutex);
+  return stats;
+}
+
+#ifdef VTK_PLATFORM_WAYLAND
+// Save the cache once no pipeline has been compiled for VTK_PIPELINE_CACHE_SAVE_DELAY_NS, run on the event loop.
+static void vtk_pipeline_cache_save_task(void *user_data) {
+  struct VtkDeviceNative *vtk_device = (struct VtkDeviceNative *)user_data;
+  struct VtkPipelineCacheNative *pipeline_cache = vtk_device->pipeline_cache;
+  uint64_t now = vtk_frame_stats_now();
+  pthread_mutex_lock(&pipeline_cache->mutex);
+  uint64_t save_at = pipeline_cache->changed_ns + VTK_PIPELINE_CACHE_SAVE_DELAY_NS;
+  bool save = pipeline_cache->dirty && now >= save_at;
+  bool wait = pipeline_cache->dirty && now < save_at;
+  pipeline_cache->save_scheduled = wait;
+  pthread_mutex_unlock(&pipeline_cache->mutex);
+
+  if (wait) {
+    vtk_context_schedule_task(vtk_device->vtk_context, save_at - now, 0, vtk_pipeline_cache_save_task, NULL,
+                              vtk_device);
+  } else if (save) {
+    vtk_device_save_pipeline_cache(vtk_device);
+  }
+}
+#endif
+
+// Mark the cache as having changed since it was last saved, and have it saved once pipeline creation settles.
+static void vtk_pipeline_cache_mark_dirty(struct VtkDeviceNative *vtk_device) {
+  if (vtk_device->pipeline_cache_path == NULL) {
+    return;
+  }
+  struct VtkPipelineCacheNative *pipeline_cache = vtk_device->pipeline_cache;
+  pthread_mutex_lock(&pipeline_cache->mutex);
+  pipeline_cache->dirty = true;
+  pipeline_cache->changed_ns = vtk_frame_stats_now();
+  bool schedule = !pipeline_cache->save_scheduled;
+  pipeline_cache->save_scheduled = true;
+  pthread_mutex_unlock(&pipeline_cache->mutex);
+#ifdef VTK_PLATFORM_WAYLAND
+  if (schedule) {
+    vtk_context_schedule_task(vtk_device->vtk_context, VTK_PIPELINE_CACHE_SAVE_DELAY_NS, 0,
+                              vtk_pipeline_cache_save_task, NULL, vtk_device);
+  }
+#else
+  (void)schedule;
+#endif
+}
+
+// Creation feedback asking the driver whether a pipeline was found in the cache, chained in front of next if the
+// device has creation feedback. Returns the chain to create the pipeline with.
+static void const *vtk_pipeline_feedback_chain(struct VtkDeviceNative *vtk_device,
+                                               VkPipelineCreationFeedbackCreateInfo *vk_feedback_create_info,
+                                               VkPipelineCreationFeedback *vk_feedback, void const *next) {
+  vk_feedback->flags = 0;
+  vk_feedback->duration = 0;
+  if (!vtk_device->pipeline_creation_feedback) {
+    return next;
+  }
+  *vk_feedback_create_info = (VkPipelineCreationFeedbackCreateInfo){
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO,
+      .pNext = next,
+      .pPipelineCreationFeedback = vk_feedback,
+      .pipelineStageCreationFeedbackCount = 0,
+      .pPipelineStageCreationFeedbacks = NULL,
+  };
+  return vk_feedback_create_info;
+}
+
+static void vtk_pipeline_cache_record(struct VtkDeviceNative *vtk_device, VkPipelineCreationFeedback const *vk_feedback,
+                                      struct timespec const *start_time, struct timespec const *end_time) {
+  struct VtkPipelineCacheNative *pipeline_cache = vtk_device->pipeline_cache;
+  bool valid = vk_feedback->flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT;
+  bool hit = valid && (vk_feedback->flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT);
+  // Without feedback, a pipeline compiled and added to the cache grows its data.
+  size_t data_size = 0;
+  if (!valid) {
+    CALL_VK(vkGetPipelineCacheData(vtk_device->vk_device, vtk_device->vk_pipeline_cache, &data_size, NULL))
+  }
+  pthread_mutex_lock(&pipeline_cache->mutex);
+  struct VtkPipelineCacheStatsNative *stats = &pipeline_cache->stats;
+  stats->pipelines_created++;
+  stats->creation_nanoseconds += (uint64_t)(end_time->tv_sec - start_time->tv_sec) * 1000000000ull +
+                                 (uint64_t)end_time->tv_nsec - (uint64_t)start_time->tv_nsec;
+  bool changed = valid && !hit;
+  if (hit) {
+    stats->cache_hits++;
+  } else if (valid) {
+    stats->cache_misses++;
+  } else if (data_size > pipeline_cache->data_size) {
+    pipeline_cache->data_size = data_size;
+    changed = true;
+  }
+  pthread_mutex_unlock(&pipeline_cache->mutex);
+
+  if (changed) {
+    vtk_pipeline_cache_mark_dirty(vtk_device);
+  }
+}
+
+void vtk_pipeline_cache_create_graphics_pipeline(struct VtkDeviceNative *vtk_device,
+                                                 VkGraphicsPipelineCreateInfo *vk_pipeline_create_info,
+                                                 VkPipeline *vk_pipeline) {
+  VkPipelineCreationFeedback vk_feedback;
+  VkPipelineCreationFeedbackCreateInfo vk_feedback_create_info;
+  void const *original_next = vk_pipeline_create_info->pNext;
+  vk_pipeline_create_info->pNext =
+      vtk_pipeline_feedback_chain(vtk_device, &vk_feedback_create_info, &vk_feedback, original_next);
+
+  struct timespec start_time, end_time;
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  CALL_VK(vkCreateGraphicsPipelines(vtk_device->vk_device, vtk_device->vk_pipeline_cache, 1, vk_pipeline_create_info,
+                                    NULL, vk_pipeline))
+  clock_gettime(CLOCK_MONOTONIC, &end_time);
+  vk_pipeline_create_info->pNext = original_next;
+
+  vtk_pipeline_cache_record(vtk_device, &vk_feedback, &start_time, &end_time);
+}
+
+void vtk_pipeline_cache_create_compute_pipeline(struct VtkDeviceNative *vtk_device,
+                                                VkComputePipelineCreateInfo *vk_pipeline_create_info,
+                                                VkPipeline *vk_pipeline) {
+  VkPipelineCreationFeedback vk_feedback;
+  VkPipelineCreationFeedbackCreateInfo vk_feedback_create_info;
+  void const *original_next = vk_pipeline_create_info->pNext;
+  vk_pipeline_create_info->pNext =
+      vtk_pipeline_feedback_chain(vtk_device, &vk_feedback_create_info, &vk_feedback, original_next);
+
+  struct timespec start_time, end_time;
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  CALL_VK(vkCreateComputePipelines(vtk_device->vk_device, vtk_device->vk_pipeline_cache, 1, vk_pipeline_create_info,
+                                   NULL, vk_pipeline))
+  clock_gettime(CLOCK_MONOTONIC, &end_time);
+  vk_pipeline_create_info->pNext = original_next;
+
+  vtk_pipeline_cache_record(vtk_device, &vk_feedback, &start_time, &end_time);
+}
@@ -0,0 +1,272 @@
+// Parallel recording of the draws of a frame. Each recording thread has a recorder, whose command pools - one per frame
+// in flight, as command pools must be externally synchronized - hand out secondary command buffers continuing the
+// surface rendering. Finished command buffers are queued on the window, and executed in order by the primary command
+// buffer of the next frame rendered, after the draws recorded between vtk_window_begin_frame() and
+// vtk_window_end_frame().
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "vtk_cffi.h"
+#include "vtk_internal.h"
+#include "vtk_log.h"
+#include "vulkan_wrapper.h"
+
+#define VTK_RECORDER_INITIAL_COMMAND_BUFFERS 4
+#define VTK_RECORDING_INITIAL_CAPACITY 16
+
+struct VtkRecorderFrame {
+  VkCommandPool vk_command_pool;
+  // The frame number the command buffers of the pool are recorded for, 0 if none have been yet.
+  uint64_t frame_number;
+  // Secondary command buffers allocated from the pool, the first used_count of which hold commands of the frame.
+  VkCommandBuffer *vk_command_buffers;
+  uint32_t used_count;
+  uint32_t allocated_count;
+};
+
+struct VtkRecorderNative {
+  struct VtkWindowNative *vtk_window;
+  struct VtkRecorderFrame frames[VTK_MAX_FRAMES_IN_FLIGHT];
+  // The next recorder destroyed while frames in flight could still execute its command buffers.
+  struct VtkRecorderNative *next_retired;
+};
+
+struct VtkRecordedCommands {
+  VkCommandBuffer vk_command_buffer;
+  uint32_t order;
+  // Keeps command buffers of equal order in the order they were finished.
+  uint32_t sequence;
+};
+
+struct VtkRecordingNative {
+  // Recorders finish command buffers from any thread.
+  pthread_mutex_t mutex;
+  struct VtkRecordedCommands *entries;
+  uint32_t count;
+  uint32_t capacity;
+  // Destroyed recorders, freed once the last frame they recorded for has finished.
+  struct VtkRecorderNative *retired_recorders;
+};
+
+void vtk_recording_init(struct VtkWindowNative *vtk_window) {
+  struct VtkRecordingNative *recording = (struct VtkRecordingNative *)calloc(1, sizeof(struct VtkRecordingNative));
+  pthread_mutex_init(&recording->mutex, NULL);
+  recording->capacity = VTK_RECORDING_INITIAL_CAPACITY;
+  recording->entries =
+      (struct VtkRecordedCommands *)malloc(recording->capacity * sizeof(struct VtkRecordedCommands));
+  vtk_window->recording = recording;
+}
+
+void vtk_recording_destroy(struct VtkWindowNative *vtk_window) {
+  struct VtkRecordingNative *recording = vtk_window->recording;
+  // The frames have been deleted, which idles the device.
+  vtk_recording_frame_finished(vtk_window, UINT64_MAX);
+  pthread_mutex_destroy(&recording->mutex);
+  free(recording->entries);
+  free(recording);
+  vtk_window->recording = NULL;
+}
+
+static int vtk_recorded_commands_compare(void const *a, void const *b) {
+  struct VtkRecordedCommands const *lhs = (struct VtkRecordedCommands const *)a;
+  struct VtkRecordedCommands const *rhs = (struct VtkRecordedCommands const *)b;
+  if (lhs->order != rhs->order) {
+    return lhs->order < rhs->order ? -1 : 1;
+  }
+  return lhs->sequence < rhs->sequence ? -1 : (lhs->sequence > rhs->sequence ? 1 : 0);
+}
+
+void vtk_recording_execute(struct VtkWindowNative *vtk_window, VkCommandBuffer vk_command_buffer,
+                           VkCommandBuffer vk_frame_command_buffer) {
+  struct VtkRecordingNative *recording = vtk_window->recording;
+  pthread_mutex_lock(&recording->mutex);
+  qsort(recording->entries, recording->count, sizeof(struct VtkRecordedCommands), vtk_recorded_commands_compare);
+  uint32_t count = recording->count + 1;
+  VkCommandBuffer *vk_command_buffers = (VkCommandBuffer *)malloc(count * sizeof(VkCommandBuffer));
+  vk_command_buffers[0] = vk_frame_command_buffer;
+  for (uint32_t i = 0; i < recording->count; i++) {
+    vk_command_buffers[i + 1] = recording->entries[i].vk_command_buffer;
+  }
+  recording->count = 0;
+  pthread_mutex_unlock(&recording->mutex);
+
+  vkCmdExecuteCommands(vk_command_buffer, count, vk_command_buffers);
+  free(vk_command_buffers);
+}
+
+void vtk_recording_discard(struct VtkWindowNative *vtk_window) {
+  struct VtkRecordingNative *recording = vtk_window->recording;
+  pthread_mutex_lock(&recording->mutex);
+  recording->count = 0;
+  pthread_mutex_unlock(&recording->mutex);
+}
+
+void vtk_recording_begin_secondary(struct VtkWindowNative *vtk_window, VkCommandBuffer vk_command_buffer) {
+  // With dynamic rendering there is no render pass to inherit, only the formats of the attachments rendered to.
+  VkCommandBufferInheritanceRenderingInfo vk_inheritance_rendering_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO,
+      .pNext = NULL,
+      .flags = 0,
+      .viewMask = 0,
+      .colorAttachmentCount = 1,
+      .pColorAttachmentFormats = &vtk_window->vk_surface_format,
+      .depthAttachmentFormat = VK_FORMAT_UNDEFINED,
+      .stencilAttachmentFormat = VK_FORMAT_UNDEFINED,
+      .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+  };
+  // Secondary command buffers executed inside the surface render pass. The framebuffer depends on the swap chain image
+  // acquired when the frame is rendered, so it is left unspecified.
+  VkCommandBufferInheritanceInfo vk_inheritance_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+      .pNext = vtk_window->vtk_device->dynamic_rendering ? &vk_inheritance_rendering_info : NULL,
+      .renderPass = vtk_window->vk_surface_render_pass,
+      .subpass = 0,
+      .framebuffer = VK_NULL_HANDLE,
+      .occlusionQueryEnable = VK_FALSE,
+      .queryFlags = 0,
+      .pipelineStatistics = 0,
+  };
+  VkCommandBufferBeginInfo vk_command_buffer_begin_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+      .pNext = NULL,
+      .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+      .pInheritanceInfo = &vk_inheritance_info,
+  };
+  CALL_VK(vkBeginCommandBuffer(vk_command_buffer, &vk_command_buffer_begin_info))
+
+  // Dynamic state is not inherited from the primary command buffer.
+  VkExtent2D vk_extent = vtk_window->vk_extent_2d;
+  vtk_command_set_viewport(vk_command_buffer, 0, 0, (float)vk_extent.width, (float)vk_extent.height);
+  vtk_command_set_scissor(vk_command_buffer, 0, 0, vk_extent.width, vk_extent.height);
+  if (vtk_window->vtk_device->extended_dynamic_state) {
+    vtk_command_set_cull_mode(vk_command_buffer, VTK_CULL_MODE_NONE, false);
+    vtk_command_set_primitive_topology(vk_command_buffer, VTK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+  }
+}
+
+struct VtkRecorderNative *vtk_window_create_recorder(struct VtkWindowNative *vtk_window) {
+  struct VtkDeviceNative *vtk_device = vtk_window->vtk_device;
+  struct VtkRecorderNative *recorder = (struct VtkRecorderNative *)calloc(1, sizeof(struct VtkRecorderNative));
+  recorder->vtk_window = vtk_window;
+
+  // Command buffers are only ever reset all at once, along with their pool.
+  VkCommandPoolCreateInfo vk_command_pool_create_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+      .pNext = NULL,
+      .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+      .queueFamilyIndex = vtk_device->graphics_queue_family_idx,
+  };
+  for (uint32_t i = 0; i < VTK_MAX_FRAMES_IN_FLIGHT; i++) {
+    CALL_VK(vkCreateCommandPool(vtk_device->vk_device, &vk_command_pool_create_info, NULL,
+                                &recorder->frames[i].vk_command_pool))
+  }
+  return recorder;
+}
+
+// The last frame number which any command buffer of the recorder was recorded for.
+static uint64_t vtk_recorder_last_frame_number(struct VtkRecorderNative const *recorder) {
+  uint64_t last_frame_number = 0;
+  for (uint32_t i = 0; i < VTK_MAX_FRAMES_IN_FLIGHT; i++) {
+    if (recorder->frames[i].frame_number > last_frame_number) {
+      last_frame_number = recorder->frames[i].frame_number;
+    }
+  }
+  return last_frame_number;
+}
+
+static void vtk_recorder_free(struct VtkRecorderNative *recorder) {
+  VkDevice vk_device = recorder->vtk_window->vtk_device->vk_device;
+  for (uint32_t i = 0; i < VTK_MAX_FRAMES_IN_FLIGHT; i++) {
+    // Destroying the pool frees its command buffers.
+    vkDestroyCommandPool(vk_device, recorder->frames[i].vk_command_pool, NULL);
+    free(recorder->frames[i].vk_command_buffers);
+  }
+  free(recorder);
+}
+
+void vtk_window_destroy_recorder(struct VtkWindowNative *vtk_window, struct VtkRecorderNative *recorder) {
+  // Frames in flight, or the next frame, may still execute command buffers of the recorder. Rather than waiting for
+  // them here - possibly on another thread than the one rendering - the window frees the recorder once they are done.
+  struct VtkRecordingNative *recording = vtk_window->recording;
+  pthread_mutex_lock(&recording->mutex);
+  recorder->next_retired = recording->retired_recorders;
+  recording->retired_recorders = recorder;
+  pthread_mutex_unlock(&recording->mutex);
+}
+
+void vtk_recording_frame_finished(struct VtkWindowNative *vtk_window, uint64_t finished_frame_number) {
+  struct VtkRecordingNative *recording = vtk_window->recording;
+  pthread_mutex_lock(&recording->mutex);
+  struct VtkRecorderNative **link = &recording->retired_recorders;
+  while (*link != NULL) {
+    struct VtkRecorderNative *recorder = *link;
+    // A frame dropped because the swap chain was out of date leaves its number to the next frame submitted, which
+    // finishing covers the dropped command buffers as well.
+    if (vtk_recorder_last_frame_number(recorder) <= finished_frame_number) {
+      *link = recorder->next_retired;
+      vtk_recorder_free(recorder);
+    } else {
+      link = &recorder->next_retired;
+    }
+  }
+  pthread_mutex_unlock(&recording->mutex);
+}
+
+// Allocate more secondary command buffers from the pool of a frame, doubling their number.
+static void vtk_recorder_grow(struct VtkDeviceNative *vtk_device, struct VtkRecorderFrame *frame) {
+  uint32_t new_count = frame->allocated_count == 0 ? VTK_RECORDER_INITIAL_COMMAND_BUFFERS : 2 * frame->allocated_count;
+  frame->vk_command_buffers =
+      (VkCommandBuffer *)realloc(frame->vk_command_buffers, new_count * sizeof(VkCommandBuffer));
+  VkCommandBufferAllocateInfo vk_command_buffers_allocate_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+      .pNext = NULL,
+      .commandPool = frame->vk_command_pool,
+      .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+      .commandBufferCount = new_count - frame->allocated_count,
+  };
+  CALL_VK(vkAllocateCommandBuffers(vtk_device->vk_device, &vk_command_buffers_allocate_info,
+                                   frame->vk_command_buffers + frame->allocated_count))
+  frame->allocated_count = new_count;
+}
+
+VkCommandBuffer vtk_recorder_begin(struct VtkRecorderNative *recorder) {
+  struct VtkWindowNative *vtk_window = recorder->vtk_window;
+  struct VtkDeviceNative *vtk_device = vtk_window->vtk_device;
+  uint32_t frame_idx = vtk_window->current_frame_idx;
+  struct VtkRecorderFrame *frame = &recorder->frames[frame_idx];
+
+  uint64_t frame_number = vtk_window->frame_number + 1;
+  if (frame->frame_number != frame_number) {
+    // The pool holds commands of the frame that last used these frame resources, which must finish before the pool is
+    // reset. vtk_window_begin_frame() waits for the same fence before rendering the frame, so this rarely blocks.
+    CALL_VK(vkWaitForFences(vtk_device->vk_device, 1, &vtk_window->frames[frame_idx].vk_fence, VK_TRUE, UINT64_MAX))
+    CALL_VK(vkResetCommandPool(vtk_device->vk_device, frame->vk_command_pool, 0))
+    frame->frame_number = frame_number;
+    frame->used_count = 0;
+  }
+  if (frame->used_count == frame->allocated_count) {
+    vtk_recorder_grow(vtk_device, frame);
+  }
+  VkCommandBuffer vk_command_buffer = frame->vk_command_buffers[frame->used_count++];
+  vtk_recording_begin_secondary(vtk_window, vk_command_buffer);
+  return vk_command_buffer;
+}
+
+void vtk_recorder_end(struct VtkRecorderNative *recorder, VkCommandBuffer vk_command_buffer, uint32_t order) {
+  CALL_VK(vkEndCommandBuffer(vk_command_buffer))
+
+  struct VtkRecordingNative *recording = recorder->vtk_window->recording;
+  pthread_mutex_lock(&recording->mutex);
+  if (recording->count == recording->capacity) {
+    recording->capacity *= 2;
+    recording->entries = (struct VtkRecordedCommands *)realloc(
+        recording->entries, recording->capacity * sizeof(struct VtkRecordedCommands));
+  }
+  recording->entries[recording->count] = (struct VtkRecordedCommands){
+      .vk_command_buffer = vk_command_buffer,
+      .order = order,
+      .sequence = recording->count,
+  };
+  recording->count++;
+  pthread_mutex_unlock(&recording->mutex);
+}
@@ -0,0 +1,375 @@
+// Uploads of data to device local buffers and images, copied from a host visible staging ring buffer on the transfer
+// queue. Completion is tracked with a timeline semaphore, whose values are handed out as upload tickets that the
+// graphics queue can wait on.
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vtk_array.h"
+#include "vtk_cffi.h"
+#include "vtk_internal.h"
+#include "vtk_log.h"
+#include "vulkan_wrapper.h"
+
+// Size of the staging ring buffer. Larger uploads are split into chunks of at most this size.
+#define VTK_STAGING_BUFFER_SIZE (16 * 1024 * 1024)
+// Maximum number of upload submissions in flight.
+#define VTK_MAX_PENDING_UPLOADS 32
+
+struct VtkPendingUpload {
+  VkCommandBuffer vk_command_buffer;
+  // The timeline value signalled when the upload has completed.
+  uint64_t ticket;
+  // The staging position after the data of the upload, freed up when it completes.
+  uint64_t staging_end;
+};
+
+struct VtkUploaderNative {
+  // Uploads may be started from any thread.
+  pthread_mutex_t mutex;
+  VkCommandPool vk_command_pool;
+  VkSemaphore vk_timeline_semaphore;
+  // The ticket of the latest submitted upload.
+  uint64_t last_ticket;
+
+  VkBuffer vk_staging_buffer;
+  struct VtkMemoryAllocationNative staging_allocation;
+  uint8_t *staging_ptr;
+  // The optimalBufferCopyOffsetAlignment of the device, which staging allocations are aligned to.
+  uint64_t staging_alignment;
+  // Ever increasing positions, the offset in the staging buffer being the position modulo its size. The range
+  // between tail and head is in use by pending uploads.
+  uint64_t staging_head;
+  uint64_t staging_tail;
+
+  // Ring of pending uploads in submission order.
+  struct VtkPendingUpload pending[VTK_MAX_PENDING_UPLOADS];
+  uint32_t pending_start;
+  uint32_t pending_count;
+};
+
+void vtk_uploader_init(struct VtkDeviceNative *vtk_device) {
+  VkDevice vk_device = vtk_device->vk_device;
+  struct VtkUploaderNative *uploader = (struct VtkUploaderNative *)calloc(1, sizeof(struct VtkUploaderNative));
+  pthread_mutex_init(&uploader->mutex, NULL);
+
+  VkCommandPoolCreateInfo vk_command_pool_create_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+      .pNext = NULL,
+      .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+      .queueFamilyIndex = vtk_device->transfer_queue_family_idx,
+  };
+  CALL_VK(vkCreateCommandPool(vk_device, &vk_command_pool_create_info, NULL, &uploader->vk_command_pool))
+
+  VkCommandBuffer vk_command_buffers[VTK_MAX_PENDING_UPLOADS];
+  VkCommandBufferAllocateInfo vk_command_buffers_allocate_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+      .pNext = NULL,
+      .commandPool = uploader->vk_command_pool,
+      .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+      .commandBufferCount = VTK_MAX_PENDING_UPLOADS,
+  };
+  CALL_VK(vkAllocateCommandBuffers(vk_device, &vk_command_buffers_allocate_info, vk_command_buffers))
+  for (uint32_t i = 0; i < VTK_MAX_PENDING_UPLOADS; i++) {
+    uploader->pending[i].vk_command_buffer = vk_command_buffers[i];
+  }
+
+  VkSemaphoreTypeCreateInfo vk_semaphore_type_create_info = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+      .pNext = NULL,
+      .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+      .initialValue = 0,
+  };
+  VkSemaphoreCreateInfo vk_semaphore_create_info = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+      .pNext = &vk_semaphore_type_create_info,
+      .flags = 0,
+  };
+  CALL_VK(vkCreateSemaphore(vk_device, &vk_semaphore_create_info, NULL, &uploader->vk_timeline_semaphore))
+
+  VkBufferCreateInfo vk_buffer_create_info = {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+      .pNext = NULL,
+      .flags = 0,
+      .size = VTK_STAGING_BUFFER_SIZE,
+      .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+      .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+      .queueFamilyIndexCount = 1,
+      .pQueueFamilyIndices = &vtk_device->transfer_queue_family_idx,
+  };
+  CALL_VK(vkCreateBuffer(vk_device, &vk_buffer_create_info, NULL, &uploader->vk_staging_buffer))
+
+  vtk_memory_bind_buffer(vtk_device, uploader->vk_staging_buffer,
+                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0,
+                         &uploader->staging_allocation);
+  uploader->staging_ptr = (uint8_t *)uploader->staging_allocation.mapped;
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(vtk_device->vk_physical_device, &properties);
+  uploader->staging_alignment = properties.limits.optimalBufferCopyOffsetAlignment;
+  if (uploader->staging_alignment == 0) {
+    uploader->staging_alignment = 1;
+  }
+
+  vtk_device->uploader = uploader;
+}
+
+// Retire completed uploads, freeing their staging memory. If wait is true and no upload has completed, block until
+// the oldest one has.
+static void vtk_uploader_retire(struct VtkDeviceNative *vtk_device, bool wait) {
+  struct VtkUploaderNative *uploader = vtk_device->uploader;
+  if (uploader->pending_count == 0) {
+    return;
+  }
+
+  uint64_t completed_ticket;
+  CALL_VK(vkGetSemaphoreCounterValue(vtk_device->vk_device, uploader->vk_timeline_semaphore, &completed_ticket))
+  uint64_t oldest_ticket = uploader->pending[uploader->pending_start].ticket;
+  if (wait && completed_ticket < oldest_ticket) {
+    VkSemaphoreWaitInfo vk_semaphore_wait_info = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .semaphoreCount = 1,
+        .pSemaphores = &uploader->vk_timeline_semaphore,
+        .pValues = &oldest_ticket,
+    };
+    CALL_VK(vkWaitSemaphores(vtk_device->vk_device, &vk_semaphore_wait_info, UINT64_MAX))
+    completed_ticket = oldest_ticket;
+  }
+
+  while (uploader->pending_count > 0 && uploader->pending[uploader->pending_start].ticket <= completed_ticket) {
+    uploader->staging_tail = uploader->pending[uploader->pending_start].staging_end;
+    uploader->pending_start = (uploader->pending_start + 1) % VTK_MAX_PENDING_UPLOADS;
+    uploader->pending_count--;
+  }
+  if (uploader->pending_count == 0) {
+    uploader->staging_tail = uploader->staging_head;
+  }
+}
+
+static uint64_t vtk_gcd(uint64_t a, uint64_t b) {
+  while (b != 0) {
+    uint64_t remainder = a % b;
+    a = b;
+    b = remainder;
+  }
+  return a;
+}
+
+// Reserve size bytes of the staging buffer, returning the offset of the reservation, which is a multiple of
+// alignment. The alignment need not be a power of two.
+static uint64_t vtk_uploader_reserve_staging(struct VtkDeviceNative *vtk_device, uint64_t size, uint64_t alignment) {
+  struct VtkUploaderNative *uploader = vtk_device->uploader;
+  assert(size <= VTK_STAGING_BUFFER_SIZE);
+
+  // Align the offset in the buffer rather than the position, as the buffer size is not a multiple of every alignment.
+  uint64_t offset = uploader->staging_head % VTK_STAGING_BUFFER_SIZE;
+  uint64_t aligned_offset = (offset + alignment - 1) / alignment * alignment;
+  uint64_t start = uploader->staging_head - offset + aligned_offset;
+  // Never let a reservation wrap around the end of the buffer - the start of the buffer is aligned to anything.
+  if (aligned_offset + size > VTK_STAGING_BUFFER_SIZE) {
+    start = uploader->staging_head - offset + VTK_STAGING_BUFFER_SIZE;
+  }
+  while (start + size - uploader->staging_tail > VTK_STAGING_BUFFER_SIZE) {
+    if (uploader->pending_count == 0) {
+      // Nothing is in use, so the whole buffer is available.
+      uploader->staging_tail = start;
+      break;
+    }
+    vtk_uploader_retire(vtk_device, true);
+  }
+  uploader->staging_head = start + size;
+  return start % VTK_STAGING_BUFFER_SIZE;
+}
+
+// Get a command buffer to record an upload in, in the recording state.
+static struct VtkPendingUpload *vtk_uploader_begin(struct VtkDeviceNative *vtk_device) {
+  struct VtkUploaderNative *uploader = vtk_device->uploader;
+  vtk_uploader_retire(vtk_device, uploader->pending_count == VTK_MAX_PENDING_UPLOADS);
+
+  struct VtkPendingUpload *upload =
+      &uploader->pending[(uploader->pending_start + uploader->pending_count) % VTK_MAX_PENDING_UPLOADS];
+  CALL_VK(vkResetCommandBuffer(upload->vk_command_buffer, 0))
+  VkCommandBufferBeginInfo vk_command_buffer_begin_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+      .pNext = NULL,
+      .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+      .pInheritanceInfo = NULL,
+  };
+  CALL_VK(vkBeginCommandBuffer(upload->vk_command_buffer, &vk_command_buffer_begin_info))
+  return upload;
+}
+
+// Submit a recorded upload, returning its ticket.
+static uint64_t vtk_uploader_submit(struct VtkDeviceNative *vtk_device, struct VtkPendingUpload *upload) {
+  struct VtkUploaderNative *uploader = vtk_device->uploader;
+  CALL_VK(vkEndCommandBuffer(upload->vk_command_buffer))
+
+  upload->ticket = ++uploader->last_ticket;
+  upload->staging_end = uploader->staging_head;
+  uploader->pending_count++;
+
+  VkTimelineSemaphoreSubmitInfo vk_timeline_submit_info = {
+      .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+      .pNext = NULL,
+      .waitSemaphoreValueCount = 0,
+      .pWaitSemaphoreValues = NULL,
+      .signalSemaphoreValueCount = 1,
+      .pSignalSemaphoreValues = &upload->ticket,
+  };
+  VkSubmitInfo submit_info = {
+      .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+      .pNext = &vk_timeline_submit_info,
+      .waitSemaphoreCount = 0,
+      .pWaitSemaphores = NULL,
+      .pWaitDstStageMask = NULL,
+      .commandBufferCount = 1,
+      .pCommandBuffers = &upload->vk_command_buffer,
+      .signalSemaphoreCount = 1,
+      .pSignalSemaphores = &uploader->vk_timeline_semaphore,
+  };
+  vtk_queue_submit(vtk_device->transfer_queue, 1, &submit_info, VK_NULL_HANDLE);
+  return upload->ticket;
+}
+
+uint64_t vtk_device_upload_buffer(struct VtkDeviceNative *vtk_device, VkBuffer buffer, uint64_t offset,
+                                  uint8_t const *data, size_t size) {
+  struct VtkUploaderNative *uploader = vtk_device->uploader;
+  pthread_mutex_lock(&uploader->mutex);
+
+  uint64_t ticket = uploader->last_ticket;
+  size_t copied = 0;
+  while (copied < size) {
+    size_t chunk_size = size - copied;
+    if (chunk_size > VTK_STAGING_BUFFER_SIZE) {
+      chunk_size = VTK_STAGING_BUFFER_SIZE;
+    }
+    uint64_t staging_offset = vtk_uploader_reserve_staging(vtk_device, chunk_size, uploader->staging_alignment);
+    memcpy(uploader->staging_ptr + staging_offset, data + copied, chunk_size);
+
+    struct VtkPendingUpload *upload = vtk_uploader_begin(vtk_device);
+    VkBufferCopy vk_buffer_copy = {
+        .srcOffset = staging_offset,
+        .dstOffset = offset + copied,
+        .size = chunk_size,
+    };
+    vkCmdCopyBuffer(upload->vk_command_buffer, uploader->vk_staging_buffer, buffer, 1, &vk_buffer_copy);
+    ticket = vtk_uploader_submit(vtk_device, upload);
+    copied += chunk_size;
+  }
+
+  pthread_mutex_unlock(&uploader->mutex);
+  return ticket;
+}
+
+static void vtk_upload_image_barrier(VkCommandBuffer vk_command_buffer, VkImage image, VkImageLayout old_layout,
+                                     VkImageLayout new_layout, VkAccessFlags src_access, VkAccessFlags dst_access,
+                                     VkPipelineStageFlags src_stages, VkPipelineStageFlags dst_stages) {
+  VkImageMemoryBarrier vk_image_memory_barrier = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+      .pNext = NULL,
+      .srcAccessMask = src_access,
+      .dstAccessMask = dst_access,
+      .oldLayout = old_layout,
+      .newLayout = new_layout,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .image = image,
+      .subresourceRange =
+          {
+              .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+              .baseMipLevel = 0,
+              .levelCount = 1,
+              .baseArrayLayer = 0,
+              .layerCount = 1,
+          },
+  };
+  vkCmdPipelineBarrier(vk_command_buffer, src_stages, dst_stages, 0, 0, NULL, 0, NULL, 1, &vk_image_memory_barrier);
+}
+
+uint64_t vtk_device_upload_image(struct VtkDeviceNative *vtk_device, VkImage image, uint32_t width, uint32_t height,
+                                 uint32_t texel_size, uint8_t const *data) {
+  struct VtkUploaderNative *uploader = vtk_device->uploader;
+  size_t row_size = (size_t)width * texel_size;
+  assert(row_size > 0 && row_size <= VTK_STAGING_BUFFER_SIZE);
+  // Chunks consist of whole rows.
+  uint32_t rows_per_chunk = (uint32_t)(VTK_STAGING_BUFFER_SIZE / row_size);
+  // The buffer offset of a copy to an image must be a multiple of both the texel size and 4, which for 3, 6 and 12
+  // byte texels the optimal alignment is not.
+  uint64_t texel_alignment = texel_size / vtk_gcd(texel_size, 4) * 4;
+  uint64_t alignment = uploader->staging_alignment / vtk_gcd(uploader->staging_alignment, texel_alignment) *
+                       texel_alignment;
+
+  pthread_mutex_lock(&uploader->mutex);
+
+  uint64_t ticket = uploader->last_ticket;
+  for (uint32_t row = 0; row < height; row += rows_per_chunk) {
+    uint32_t chunk_rows = height - row < rows_per_chunk ? height - row : rows_per_chunk;
+    size_t chunk_size = row_size * chunk_rows;
+    uint64_t staging_offset = vtk_uploader_reserve_staging(vtk_device, chunk_size, alignment);
+    memcpy(uploader->staging_ptr + staging_offset, data + row_size * row, chunk_size);
+
+    struct VtkPendingUpload *upload = vtk_uploader_begin(vtk_device);
+    if (row == 0) {
+      vtk_upload_image_barrier(upload->vk_command_buffer, image, VK_IMAGE_LAYOUT_UNDEFINED,
+                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT,
+                               VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+    }
+    VkBufferImageCopy vk_buffer_image_copy = {
+        .bufferOffset = staging_offset,
+        .bufferRowLength = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource =
+            {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .mipLevel = 0,
+                .baseArrayLayer = 0,
+                .layerCount = 1,
+            },
+        .imageOffset = {.x = 0, .y = (int32_t)row, .z = 0},
+        .imageExtent = {.width = width, .height = chunk_rows, .depth = 1},
+    };
+    vkCmdCopyBufferToImage(upload->vk_command_buffer, uploader->vk_staging_buffer, image,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &vk_buffer_image_copy);
+    if (row + chunk_rows == height) {
+      // The graphics queue makes the writes visible to its shaders by waiting on the timeline semaphore, so only
+      // the layout transition is needed here.
+      vtk_upload_image_barrier(upload->vk_command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                               VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, 0,
+                               VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+    }
+    ticket = vtk_uploader_submit(vtk_device, upload);
+  }
+
+  pthread_mutex_unlock(&uploader->mutex);
+  return ticket;
+}
+
+_Bool vtk_device_upload_complete(struct VtkDeviceNative *vtk_device, uint64_t ticket) {
+  uint64_t completed_ticket;
+  CALL_VK(vkGetSemaphoreCounterValue(vtk_device->vk_device, vtk_device->uploader->vk_timeline_semaphore,
+                                     &completed_ticket))
+  return completed_ticket >= ticket;
+}
+
+void vtk_device_wait_for_upload(struct VtkDeviceNative *vtk_device, uint64_t ticket) {
+  VkSemaphoreWaitInfo vk_semaphore_wait_info = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+      .pNext = NULL,
+      .flags = 0,
+      .semaphoreCount = 1,
+      .pSemaphores = &vtk_device->uploader->vk_timeline_semaphore,
+      .pValues = &ticket,
+  };
+  CALL_VK(vkWaitSemaphores(vtk_device->vk_device, &vk_semaphore_wait_info, UINT64_MAX))
+}
+
+void vtk_window_wait_for_upload(struct VtkWindowNative *vtk_window, uint64_t ticket) {
+  if (ticket > vtk_window->upload_wait_ticket) {
+    vtk_window->upload_wait_ticket = ticket;
+  }
+}
+
+VkSemaphore vtk_uploader_semaphore(struct VtkDeviceNative *vtk_device) {
+  return vtk_device->uploader->vk_timeline_semaphore;
+}
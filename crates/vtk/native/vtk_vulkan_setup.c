@@ -39,29 +39,92 @@ void vtk_setup_surface_format(struct VtkWindowNative *vtk_window) {
   free(formats);
 }
 
-void vtk_create_swap_chain(struct VtkWindowNative *vtk_window) {
-  struct VtkDeviceNative *vtk_device = vtk_window->vtk_device;
+// Return the requested present mode if supported by the surface, otherwise the closest supported one. FIFO is
+// always supported, so it is the last resort.
+VkPresentModeKHR vtk_choose_present_mode(struct VtkWindowNative *vtk_window) {
+  VkPresentModeKHR requested = vtk_window->requested_present_mode;
+  VkPresentModeKHR fallbacks[3];
+  int num_fallbacks = 0;
+  fallbacks[num_fallbacks++] = requested;
+  switch (requested) {
+  case VK_PRESENT_MODE_IMMEDIATE_KHR:
+    // Lowest latency without tearing is the next best thing.
+    fallbacks[num_fallbacks++] = VK_PRESENT_MODE_MAILBOX_KHR;
+    break;
+  case VK_PRESENT_MODE_MAILBOX_KHR:
+  case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+  case VK_PRESENT_MODE_FIFO_KHR:
+    break;
+  default:
+    LOGW("Unsupported present mode requested: %d", requested);
+    break;
+  }
+  fallbacks[num_fallbacks++] = VK_PRESENT_MODE_FIFO_KHR;
+
+  uint32_t mode_count = 0;
+  CALL_VK(vkGetPhysicalDeviceSurfacePresentModesKHR(vtk_window->vtk_device->vk_physical_device, vtk_window->vk_surface,
+                                                    &mode_count, NULL))
+  VkPresentModeKHR *modes = VTK_ARRAY_ALLOC(VkPresentModeKHR, mode_count);
+  CALL_VK(vkGetPhysicalDeviceSurfacePresentModesKHR(vtk_window->vtk_device->vk_physical_device, vtk_window->vk_surface,
+                                                    &mode_count, modes))
+
+  VkPresentModeKHR chosen = VK_PRESENT_MODE_FIFO_KHR;
+  for (int i = 0; i < num_fallbacks; i++) {
+    bool supported = false;
+    for (uint32_t j = 0; j < mode_count; j++) {
+      if (modes[j] == fallbacks[i]) {
+        supported = true;
+        break;
+      }
+    }
+    if (supported) {
+      chosen = fallbacks[i];
+      break;
+    }
+  }
+  free(modes);
 
-  memset(&vtk_window->vk_swapchain, 0, sizeof(vtk_window->vk_swapchain));
+  if (chosen != requested) {
+    LOGW("Present mode %d not supported by surface - falling back to %d", requested, chosen);
+  }
+  return chosen;
+}
+
+// Create the swap chain and its image views and framebuffers. If vk_old_swapchain is not VK_NULL_HANDLE it is the
+// swap chain being replaced, which lets the presentation engine hand over resources without a visible glitch.
+void vtk_create_swap_chain(struct VtkWindowNative *vtk_window, VkSwapchainKHR vk_old_swapchain) {
+  struct VtkDeviceNative *vtk_device = vtk_window->vtk_device;
 
   VkSurfaceCapabilitiesKHR vk_surface_capabilities;
   CALL_VK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(vtk_device->vk_physical_device, vtk_window->vk_surface,
                                                     &vk_surface_capabilities))
-#ifndef VTK_PLATFORM_WAYLAND
-  // On Wayland we need to set the surface width here when creating the swap chain.
-  vtk_window->vk_extent_2d = vk_surface_capabilities.currentExtent;
-#endif
+  // A current extent of 0xFFFFFFFF means the swap chain determines the surface size, as on Wayland and for headless
+  // surfaces - the extent of the window is used then.
+  if (vk_surface_capabilities.currentExtent.width != UINT32_MAX) {
+    vtk_window->vk_extent_2d = vk_surface_capabilities.currentExtent;
+  }
 
   // VkSurfaceCapabilitiesKHR surfaceCap;
   // CALL_VK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(vtk_device->vk_physical_device, vtk_window->vk_surface,
   // &surfaceCap)) assert(surfaceCap.supportedCompositeAlpha | VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR);
 
-  LOGI("vk_surface_capabilities.minImageCount = %d", vk_surface_capabilities.minImageCount);
+  uint32_t image_count = vk_surface_capabilities.minImageCount;
+  if (vtk_window->requested_swap_chain_images > image_count) {
+    image_count = vtk_window->requested_swap_chain_images;
+  }
+  // A maxImageCount of 0 means that there is no limit.
+  if (vk_surface_capabilities.maxImageCount != 0 && image_count > vk_surface_capabilities.maxImageCount) {
+    image_count = vk_surface_capabilities.maxImageCount;
+  }
+  vtk_window->vk_present_mode = vtk_choose_present_mode(vtk_window);
+
+  LOGI("vk_surface_capabilities.minImageCount = %d, requesting %d images with present mode %d",
+       vk_surface_capabilities.minImageCount, image_count, vtk_window->vk_present_mode);
   VkSwapchainCreateInfoKHR swapchainCreateInfo = {
       .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
       .pNext = NULL,
       .surface = vtk_window->vk_surface,
-      .minImageCount = vk_surface_capabilities.minImageCount,
+      .minImageCount = image_count,
       .imageFormat = vtk_window->vk_surface_format,
       .imageColorSpace = vtk_window->vk_color_space,
       .imageExtent = vtk_window->vk_extent_2d,
@@ -74,12 +137,13 @@ void vtk_create_swap_chain(struct VtkWindowNative *vtk_window) {
       // https://developer.android.com/games/optimize/vulkan-prerotation
       .preTransform = vk_surface_capabilities.currentTransform,
       .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR, // VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR,
-      .presentMode = VK_PRESENT_MODE_FIFO_KHR,
+      .presentMode = vtk_window->vk_present_mode,
       .clipped = VK_TRUE,
-      .oldSwapchain = VK_NULL_HANDLE,
+      .oldSwapchain = vk_old_swapchain,
   };
 
   CALL_VK(vkCreateSwapchainKHR(vtk_device->vk_device, &swapchainCreateInfo, NULL, &vtk_window->vk_swapchain))
+  vtk_window->swap_chain_acquire_count = 0;
 
   uint32_t num_images;
   CALL_VK(vkGetSwapchainImagesKHR(vtk_device->vk_device, vtk_window->vk_swapchain, &num_images, NULL))
@@ -92,7 +156,15 @@ void vtk_create_swap_chain(struct VtkWindowNative *vtk_window) {
   VkImageView depth_view = VK_NULL_HANDLE;
 
   vtk_window->vk_swap_chain_images_views = VTK_ARRAY_ALLOC(VkImageView, num_images);
-  vtk_window->vk_swap_chain_framebuffers = VTK_ARRAY_ALLOC(VkFramebuffer, num_images);
+  // With dynamic rendering the image views are rendered to directly, see vtk_record_command_buffer().
+  _Bool dynamic_rendering = vtk_device->dynamic_rendering;
+  vtk_window->vk_swap_chain_framebuffers = dynamic_rendering ? NULL : VTK_ARRAY_ALLOC(VkFramebuffer, num_images);
+  vtk_window->vk_render_finished_semaphores = VTK_ARRAY_ALLOC(VkSemaphore, num_images);
+  VkSemaphoreCreateInfo vk_semaphore_create_info = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+      .pNext = NULL,
+      .flags = 0,
+  };
 
   for (uint32_t i = 0; i < num_images; i++) {
     VkImageViewCreateInfo vk_image_view_create_info = {
@@ -120,6 +192,11 @@ void vtk_create_swap_chain(struct VtkWindowNative *vtk_window) {
     };
     CALL_VK(vkCreateImageView(vtk_device->vk_device, &vk_image_view_create_info, NULL,
                               &vtk_window->vk_swap_chain_images_views[i]))
+    CALL_VK(vkCreateSemaphore(vtk_device->vk_device, &vk_semaphore_create_info, NULL,
+                              &vtk_window->vk_render_finished_semaphores[i]))
+    if (dynamic_rendering) {
+      continue;
+    }
 
     VkImageView attachments[2] = {
         vtk_window->vk_swap_chain_images_views[i],
@@ -140,26 +217,85 @@ void vtk_create_swap_chain(struct VtkWindowNative *vtk_window) {
   }
 }
 
-void vtk_delete_swap_chain(struct VtkWindowNative *vtk_window) {
-  struct VtkDeviceNative *vtk_device = vtk_window->vtk_device;
+// Whether the presentation engine is done with the presents to a retired swap chain, none of which may be pending
+// for its semaphores and images to be destroyed. No frame fence covers presents.
+static bool vtk_retired_presents_done(struct VtkWindowNative *vtk_window, struct VtkRetiredSwapChainNative *retired) {
+  if (vtk_window->vtk_device->swapchain_maintenance1) {
+    // Each frame waits for its previous present to be done before presenting again, so only the latest present of
+    // each frame may be pending.
+    for (uint32_t i = 0; i < vtk_window->frames_in_flight; i++) {
+      struct VtkFrameNative *frame = &vtk_window->frames[i];
+      if (frame->frame_number <= retired->last_frame_number &&
+          vkGetFenceStatus(vtk_window->vtk_device->vk_device, frame->vk_present_fence) == VK_NOT_READY) {
+        return false;
+      }
+    }
+    return true;
+  }
+  // Without present fences, acquiring an image of the current swap chain which has been presented before shows that
+  // its present is done - and with it every present queued before, including those to retired swap chains. Acquiring
+  // more images than the swap chain has means one of them has been acquired twice.
+  return vtk_window->swap_chain_acquire_count > vtk_window->num_swap_chain_images;
+}
 
-  for (uint32_t i = 0; i < vtk_window->num_swap_chain_images; i++) {
-    vkDestroyFramebuffer(vtk_device->vk_device, vtk_window->vk_swap_chain_framebuffers[i], NULL);
-    vkDestroyImageView(vtk_device->vk_device, vtk_window->vk_swap_chain_images_views[i], NULL);
-    // https://github.com/KhronosGroup/Vulkan-ValidationLayers/issues/2718
-    // TODO: Delete not presentable image here?
-    // vkDestroyImage(device.vk_device, swapchain.vk_images[i], NULL);
+// Destroy the retired swap chains which are no longer used by any frame or present, given that all frames up to and
+// including completed_frame_number have finished. UINT64_MAX destroys all of them, for when the device is idle.
+void vtk_destroy_retired_swap_chains(struct VtkWindowNative *vtk_window, uint64_t completed_frame_number) {
+  VkDevice vk_device = vtk_window->vtk_device->vk_device;
+
+  uint32_t num_kept = 0;
+  for (uint32_t i = 0; i < vtk_window->num_retired_swap_chains; i++) {
+    struct VtkRetiredSwapChainNative *retired = &vtk_window->retired_swap_chains[i];
+    if (completed_frame_number != UINT64_MAX &&
+        (retired->last_frame_number > completed_frame_number || !vtk_retired_presents_done(vtk_window, retired))) {
+      vtk_window->retired_swap_chains[num_kept++] = *retired;
+      continue;
+    }
+    for (uint32_t j = 0; j < retired->num_images; j++) {
+      if (retired->vk_framebuffers != NULL) {
+        vkDestroyFramebuffer(vk_device, retired->vk_framebuffers[j], NULL);
+      }
+      vkDestroyImageView(vk_device, retired->vk_image_views[j], NULL);
+      vkDestroySemaphore(vk_device, retired->vk_render_finished_semaphores[j], NULL);
+      // https://github.com/KhronosGroup/Vulkan-ValidationLayers/issues/2718
+      // The swap chain images themselves are owned by the swap chain.
+    }
+    vkDestroySwapchainKHR(vk_device, retired->vk_swapchain, NULL);
+
+    free(retired->vk_framebuffers);
+    free(retired->vk_render_finished_semaphores);
+    free(retired->vk_image_views);
+    free(retired->vk_images);
   }
-  vkDestroySwapchainKHR(vtk_device->vk_device, vtk_window->vk_swapchain, NULL);
+  vtk_window->num_retired_swap_chains = num_kept;
+}
 
-  free(vtk_window->vk_swap_chain_framebuffers);
-  free(vtk_window->vk_swap_chain_images_views);
-  free(vtk_window->vk_swap_chain_images);
+// Move the current swap chain to the list of retired ones, to be destroyed once the frames using it have finished.
+// The current swap chain handle is left in place, so that it can be passed as oldSwapchain to its replacement.
+struct VtkRetiredSwapChainNative *vtk_retire_swap_chain(struct VtkWindowNative *vtk_window) {
+  if (vtk_window->num_retired_swap_chains == VTK_MAX_RETIRED_SWAP_CHAINS) {
+    // Resizing faster than frames and presents finish. Waiting for the frame fences would not cover pending presents,
+    // so wait for the whole device, which retires every swap chain.
+    LOGW("Too many retired swap chains - waiting for the device to idle");
+    CALL_VK(vkDeviceWaitIdle(vtk_window->vtk_device->vk_device))
+    vtk_destroy_retired_swap_chains(vtk_window, UINT64_MAX);
+  }
 
-  // vtk_window->vk_swapchain.vk_framebuffers = NULL;
-  // vtk_window->vk_swapchain.vk_image_views = NULL;
-  // vtk_window->vk_swapchain.vk_images = NULL;
-  //  Note that vk_swapchain is just a handle, not a pointer.
+  struct VtkRetiredSwapChainNative *retired = &vtk_window->retired_swap_chains[vtk_window->num_retired_swap_chains++];
+  retired->vk_swapchain = vtk_window->vk_swapchain;
+  retired->num_images = vtk_window->num_swap_chain_images;
+  retired->vk_images = vtk_window->vk_swap_chain_images;
+  retired->vk_image_views = vtk_window->vk_swap_chain_images_views;
+  retired->vk_framebuffers = vtk_window->vk_swap_chain_framebuffers;
+  retired->vk_render_finished_semaphores = vtk_window->vk_render_finished_semaphores;
+  retired->last_frame_number = vtk_window->frame_number;
+  return retired;
+}
+
+void vtk_delete_swap_chain(struct VtkWindowNative *vtk_window) {
+  vtk_retire_swap_chain(vtk_window);
+  vtk_destroy_retired_swap_chains(vtk_window, UINT64_MAX);
+  vtk_window->vk_swapchain = VK_NULL_HANDLE;
 }
 
 void vtk_create_surface_render_pass(struct VtkWindowNative *vtk_window) {
@@ -215,300 +351,165 @@ void vtk_create_surface_render_pass(struct VtkWindowNative *vtk_window) {
                              &vtk_window->vk_surface_render_pass))
 }
 
-void vtk_create_graphics_pipeline(struct VtkWindowNative *vtk_window, uint32_t push_constant_size) {
-  VkPushConstantRange vk_push_constant_range = {
-      .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
-      .offset = 0,
-      .size = push_constant_size,
-  };
-
-  VkPipelineLayoutCreateInfo vk_pipeline_layout_create_info = {
-      .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-      .pNext = NULL,
-      .setLayoutCount = 0,
-      .pSetLayouts = NULL,
-      .pushConstantRangeCount = (uint32_t)((push_constant_size == 0) ? 0 : 1),
-      .pPushConstantRanges = &vk_push_constant_range,
-  };
-  CALL_VK(vkCreatePipelineLayout(vtk_window->vtk_device->vk_device, &vk_pipeline_layout_create_info, NULL,
-                                 &vtk_window->vk_pipeline_layout));
-
-  VkShaderModule vertexShader, fragmentShader;
-  // load_shader_from_file("out/shaders/triangle.vert.spv", &vertexShader);
-  // load_shader_from_file("out/shaders/triangle.frag.spv", &fragmentShader);
-
-  // Specify vertex and fragment shader stages
-  /*
-  VkPipelineShaderStageCreateInfo shader_stages[] = {
-          {
-                  .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-                  .pNext = NULL,
-                  .flags = 0,
-                  .stage = VK_SHADER_STAGE_VERTEX_BIT,
-                  .module = vertexShader,
-                  .pName = "main",
-                  .pSpecializationInfo = NULL,
-          },
-          {
-                  .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-                  .pNext = NULL,
-                  .flags = 0,
-                  .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
-                  .module = fragmentShader,
-                  .pName = "main",
-                  .pSpecializationInfo = NULL,
-          }};
-          */
-
-  VkViewport viewports = {
-      .x = 0,
-      .y = 0,
-      .width = (float)vtk_window->vk_extent_2d.width,
-      .height = (float)vtk_window->vk_extent_2d.height,
-      .minDepth = 0.0f,
-      .maxDepth = 1.0f,
-  };
-
-  VkRect2D scissor = {
-      .offset = {.x = 0, .y = 0},
-      .extent = vtk_window->vk_extent_2d,
-  };
-
-  VkPipelineViewportStateCreateInfo viewportInfo = {
-      .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
-      .pNext = NULL,
-      .viewportCount = 1,
-      .pViewports = &viewports,
-      .scissorCount = 1,
-      .pScissors = &scissor,
-  };
-
-  VkSampleMask sampleMask = ~0u;
-  VkPipelineMultisampleStateCreateInfo multisampleInfo = {
-      .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
-      .pNext = NULL,
-      .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
-      .sampleShadingEnable = VK_FALSE,
-      .minSampleShading = 0,
-      .pSampleMask = &sampleMask,
-      .alphaToCoverageEnable = VK_FALSE,
-      .alphaToOneEnable = VK_FALSE,
-  };
-
-  // Specify color blend state
-  VkPipelineColorBlendAttachmentState attachmentStates = {
-      .blendEnable = VK_FALSE,
-      .colorWriteMask =
-          VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
-  };
-  VkPipelineColorBlendStateCreateInfo colorBlendInfo = {
-      .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
-      .pNext = NULL,
-      .flags = 0,
-      .logicOpEnable = VK_FALSE,
-      .logicOp = VK_LOGIC_OP_COPY,
-      .attachmentCount = 1,
-      .pAttachments = &attachmentStates,
-  };
-
-  VkPipelineRasterizationStateCreateInfo rasterInfo = {
-      .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
-      .pNext = NULL,
-      .depthClampEnable = VK_FALSE,
-      .rasterizerDiscardEnable = VK_FALSE,
-      .polygonMode = VK_POLYGON_MODE_FILL,
-      .cullMode = VK_CULL_MODE_NONE,
-      .frontFace = VK_FRONT_FACE_CLOCKWISE,
-      .depthBiasEnable = VK_FALSE,
-      .lineWidth = 1,
-  };
+void vtk_create_frames(struct VtkWindowNative *vtk_window) {
+  VkDevice vk_device = vtk_window->vtk_device->vk_device;
+  assert(vtk_window->frames_in_flight >= 1 && vtk_window->frames_in_flight <= VTK_MAX_FRAMES_IN_FLIGHT);
 
-  VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo = {
-      .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+  // Each frame gets its own command pool, so that it can be recorded while earlier frames are executing. Frames are
+  // recorded anew every time, so the pool is transient and its command buffers are reset all at once with the pool
+  // rather than individually.
+  VkCommandPoolCreateInfo vk_command_pool_create_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
       .pNext = NULL,
-      .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-      .primitiveRestartEnable = VK_FALSE,
+      .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+      .queueFamilyIndex = vtk_window->vtk_device->graphics_queue_family_idx,
   };
 
-  VkVertexInputBindingDescription vk_vertex_input_binding_descriptions[] = {
-      {
-          .binding = 0,
-          .stride = 3 * sizeof(float),
-          .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
-      },
-      {
-          .binding = 1,
-          .stride = 3 * sizeof(float),
-          .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
-      }};
-
-  VkVertexInputAttributeDescription vk_vertex_input_attribute_descriptions[] = {
-      {
-          .location = 0,
-          .binding = 0,
-          .format = VK_FORMAT_R32G32B32_SFLOAT,
-          .offset = 0,
-      },
-      {
-          .location = 1,
-          .binding = 1,
-          .format = VK_FORMAT_R32G32B32_SFLOAT,
-          .offset = 0,
-      },
-  };
-
-  VkPipelineVertexInputStateCreateInfo vk_pipeline_vertex_input_state_create_info = {
-      .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+  // The fences are created signalled, so that waiting on a frame which has not yet been used returns immediately.
+  VkFenceCreateInfo vk_fence_create_info = {
+      .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
       .pNext = NULL,
-      .vertexBindingDescriptionCount = VTK_ARRAY_SIZE(vk_vertex_input_binding_descriptions),
-      .pVertexBindingDescriptions = vk_vertex_input_binding_descriptions,
-      .vertexAttributeDescriptionCount = VTK_ARRAY_SIZE(vk_vertex_input_attribute_descriptions),
-      .pVertexAttributeDescriptions = vk_vertex_input_attribute_descriptions,
+      .flags = VK_FENCE_CREATE_SIGNALED_BIT,
   };
-
-  VkGraphicsPipelineCreateInfo pipelineCreateInfo = {
-      .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+  VkSemaphoreCreateInfo vk_semaphore_create_info = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
       .pNext = NULL,
       .flags = 0,
-      .stageCount = 0,
-      .pStages = NULL, // shader_stages,
-      .pVertexInputState = &vk_pipeline_vertex_input_state_create_info,
-      .pInputAssemblyState = &inputAssemblyInfo,
-      .pTessellationState = NULL,
-      .pViewportState = &viewportInfo,
-      .pRasterizationState = &rasterInfo,
-      .pMultisampleState = &multisampleInfo,
-      .pDepthStencilState = NULL,
-      .pColorBlendState = &colorBlendInfo,
-      .pDynamicState = NULL,
-      .layout = vtk_window->vk_pipeline_layout,
-      .renderPass = vtk_window->vk_surface_render_pass,
-      .subpass = 0,
-      .basePipelineHandle = VK_NULL_HANDLE,
-      .basePipelineIndex = 0,
-  };
-
-  // VkPipelineCacheCreateInfo pipelineCacheInfo = { .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO, .pNext =
-  // NULL, .flags = 0,  // reserved, must be 0 .initialDataSize = 0, .pInitialData = NULL, };
-  // CALL_VK(vkCreatePipelineCache(device.vk_device, &pipelineCacheInfo, NULL, &gfxPipeline.vk_pipeline_cache));
-  CALL_VK(vkCreateGraphicsPipelines(vtk_window->vtk_device->vk_device, NULL /*gfxPipeline.vk_pipeline_cache*/, 1,
-                                    &pipelineCreateInfo, NULL, &vtk_window->vk_pipeline))
-
-  // We don't need the shaders anymore, we can release their memory
-  // vkDestroyShaderModule(vtk_window->vtk_device->vk_device, vertexShader, NULL);
-  // vkDestroyShaderModule(vtk_window->vtk_device->vk_device, fragmentShader, NULL);
-}
-
-void vtk_create_command_buffers(struct VtkWindowNative *vtk_window) {
-  // In our case we create one command buffer per swap chain image.
-  vtk_window->command_buffer_len = vtk_window->num_swap_chain_images;
-  vtk_window->vk_command_buffers = VTK_ARRAY_ALLOC(VkCommandBuffer, vtk_window->num_swap_chain_images);
-  VkCommandBufferAllocateInfo vk_command_buffers_allocate_info = {
-      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-      .pNext = NULL,
-      .commandPool = vtk_window->vtk_device->vk_command_pool,
-      .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-      .commandBufferCount = vtk_window->command_buffer_len,
   };
-  CALL_VK(vkAllocateCommandBuffers(vtk_window->vtk_device->vk_device, &vk_command_buffers_allocate_info,
-                                   vtk_window->vk_command_buffers));
-}
 
-void vtk_record_command_buffers(struct VtkWindowNative *vtk_window) {
-  for (uint32_t bufferIndex = 0; bufferIndex < vtk_window->num_swap_chain_images; bufferIndex++) {
-    // We start by creating and declare the "beginning" our command buffer
-    VkCommandBufferBeginInfo vk_command_buffers_begin_info = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+  for (uint32_t i = 0; i < vtk_window->frames_in_flight; i++) {
+    struct VtkFrameNative *frame = &vtk_window->frames[i];
+    CALL_VK(vkCreateCommandPool(vk_device, &vk_command_pool_create_info, NULL, &frame->vk_command_pool))
+    VkCommandBufferAllocateInfo vk_command_buffers_allocate_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
         .pNext = NULL,
-        .flags = 0,
-        .pInheritanceInfo = NULL,
+        .commandPool = frame->vk_command_pool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1,
     };
-    CALL_VK(vkBeginCommandBuffer(vtk_window->vk_command_buffers[bufferIndex], &vk_command_buffers_begin_info));
-    // transition the display image to color attachment layout
-    set_image_layout(vtk_window->vk_command_buffers[bufferIndex], vtk_window->vk_swap_chain_images[bufferIndex],
-                     VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-                     VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
-
-    // Now we start a renderpass. Any draw command has to be recorded in a renderpass.
-    VkClearValue vk_clear_value = {.color = {.float32 = {1.0f, 0.0f, 1.0f, 1.0f}}};
-    VkRenderPassBeginInfo vk_render_pass_begin_info = {.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-                                                       .pNext = NULL,
-                                                       .renderPass = vtk_window->vk_surface_render_pass,
-                                                       .framebuffer =
-                                                           vtk_window->vk_swap_chain_framebuffers[bufferIndex],
-                                                       .renderArea = {.offset =
-                                                                          {
-                                                                              .x = 0,
-                                                                              .y = 0,
-                                                                          },
-                                                                      .extent = vtk_window->vk_extent_2d},
-                                                       .clearValueCount = 1,
-                                                       .pClearValues = &vk_clear_value};
-
-    vkCmdBeginRenderPass(vtk_window->vk_command_buffers[bufferIndex], &vk_render_pass_begin_info,
-                         VK_SUBPASS_CONTENTS_INLINE);
-    /*
-    {
-        vkCmdBindPipeline(vtk_window->vk_command_buffers[bufferIndex], VK_PIPELINE_BIND_POINT_GRAPHICS,
-    gfxPipeline.vk_pipeline);
-
-        //vkCmdPushConstants(cmd, _meshPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshPushConstants),
-    &constants);
-
-        uint32_t first_binding = 0;
-        VkBuffer new_buffers[2] = {buffers.vk_vertex_position_buffer, buffers.vk_vertex_color_buffer};
-        uint32_t binding_count = 2;
-        VkDeviceSize buffer_offsets[2] = {0, 0};
-        vkCmdBindVertexBuffers(vtk_window->vk_command_buffers[bufferIndex], first_binding, binding_count, new_buffers,
-    buffer_offsets);
-
-        uint32_t vertex_count = 3;
-        uint32_t instance_count = 1;
-        uint32_t first_vertex = 0;
-        uint32_t first_instance = 0;
-        vkCmdDraw(vtk_window->vk_command_buffers[bufferIndex], vertex_count, instance_count, first_vertex,
-    first_instance);
+    CALL_VK(vkAllocateCommandBuffers(vk_device, &vk_command_buffers_allocate_info, &frame->vk_command_buffer))
+    vk_command_buffers_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    CALL_VK(vkAllocateCommandBuffers(vk_device, &vk_command_buffers_allocate_info, &frame->vk_draw_command_buffer))
+    CALL_VK(vkCreateFence(vk_device, &vk_fence_create_info, NULL, &frame->vk_fence));
+    CALL_VK(vkCreateSemaphore(vk_device, &vk_semaphore_create_info, NULL, &frame->vk_image_available_semaphore));
+    frame->vk_present_fence = VK_NULL_HANDLE;
+    if (vtk_window->vtk_device->swapchain_maintenance1) {
+      CALL_VK(vkCreateFence(vk_device, &vk_fence_create_info, NULL, &frame->vk_present_fence))
     }
-    */
-    vkCmdEndRenderPass(vtk_window->vk_command_buffers[bufferIndex]);
-    CALL_VK(vkEndCommandBuffer(vtk_window->vk_command_buffers[bufferIndex]));
+    frame->frame_number = 0;
+    frame->frame_data_end = 0;
   }
+  vtk_window->current_frame_idx = 0;
 }
 
-void vtk_create_sync(struct VtkWindowNative *vtk_window) {
-  // We need to create a fence to be able, in the main loop, to wait for our
-  // draw command(s) to finish before swapping the framebuffers
-  VkFenceCreateInfo vk_fence_create_info = {
-      .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-      .pNext = NULL,
-      .flags = VK_FENCE_CREATE_SIGNALED_BIT,
-  };
-  CALL_VK(vkCreateFence(vtk_window->vtk_device->vk_device, &vk_fence_create_info, NULL, &vtk_window->vk_fence));
+void vtk_delete_frames(struct VtkWindowNative *vtk_window) {
+  VkDevice vk_device = vtk_window->vtk_device->vk_device;
+
+  // Semaphores may still be waited on by a pending present, which no fence covers - so wait for the whole device.
+  CALL_VK(vkDeviceWaitIdle(vk_device))
+  // With the device idle every retired swap chain can go, which also keeps them from waiting on frame numbers that
+  // the recreated frames will not report.
+  vtk_destroy_retired_swap_chains(vtk_window, UINT64_MAX);
+  vtk_recording_frame_finished(vtk_window, UINT64_MAX);
+  vtk_frame_data_reset(vtk_window);
+
+  for (uint32_t i = 0; i < vtk_window->frames_in_flight; i++) {
+    struct VtkFrameNative *frame = &vtk_window->frames[i];
+    // Destroying the pool frees the command buffers of the frame.
+    vkDestroyCommandPool(vk_device, frame->vk_command_pool, NULL);
+    vkDestroyFence(vk_device, frame->vk_fence, NULL);
+    vkDestroySemaphore(vk_device, frame->vk_image_available_semaphore, NULL);
+    if (frame->vk_present_fence != VK_NULL_HANDLE) {
+      vkDestroyFence(vk_device, frame->vk_present_fence, NULL);
+    }
+  }
+}
 
-  // We need to create a semaphore to be able to wait, in the main loop, for our
-  // framebuffer to be available for us before drawing.
-  VkSemaphoreCreateInfo vk_semaphore_create_info = {
-      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+void vtk_record_command_buffer(struct VtkWindowNative *vtk_window, VkCommandBuffer vk_command_buffer,
+                               VkCommandBuffer vk_draw_command_buffer, uint32_t image_idx) {
+  // We start by creating and declare the "beginning" our command buffer
+  VkCommandBufferBeginInfo vk_command_buffers_begin_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
       .pNext = NULL,
-      .flags = 0,
+      .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+      .pInheritanceInfo = NULL,
   };
-  CALL_VK(
-      vkCreateSemaphore(vtk_window->vtk_device->vk_device, &vk_semaphore_create_info, NULL, &vtk_window->vk_semaphore));
-}
-
-void vtk_setup_window_rendering_repeat(struct VtkWindowNative *vtk_window) {
-  vtk_create_swap_chain(vtk_window);
-  vtk_record_command_buffers(vtk_window);
+  CALL_VK(vkBeginCommandBuffer(vk_command_buffer, &vk_command_buffers_begin_info));
+  vtk_gpu_timer_reset_queries(vtk_window, vk_command_buffer);
+  vtk_gpu_timer_write_start(vtk_window, vk_command_buffer, VTK_GPU_TIMER_FRAME_SCOPE);
+  // transition the display image to color attachment layout
+  set_image_layout(vk_command_buffer, vtk_window->vk_swap_chain_images[image_idx], VK_IMAGE_LAYOUT_UNDEFINED,
+                   VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                   VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+
+  VkClearValue vk_clear_value = {.color = {.float32 = {1.0f, 0.0f, 1.0f, 1.0f}}};
+  VkRect2D vk_render_area = {.offset = {.x = 0, .y = 0}, .extent = vtk_window->vk_extent_2d};
+
+  vtk_gpu_timer_write_start(vtk_window, vk_command_buffer, VTK_GPU_TIMER_RENDER_PASS_SCOPE);
+  // The draws of the frame were recorded into secondary command buffers, possibly on several threads.
+  if (vtk_window->vtk_device->dynamic_rendering) {
+    VkRenderingAttachmentInfo vk_color_attachment = {
+        .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+        .pNext = NULL,
+        .imageView = vtk_window->vk_swap_chain_images_views[image_idx],
+        .imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        .resolveMode = VK_RESOLVE_MODE_NONE,
+        .resolveImageView = VK_NULL_HANDLE,
+        .resolveImageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+        .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+        .clearValue = vk_clear_value,
+    };
+    VkRenderingInfo vk_rendering_info = {
+        .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+        .pNext = NULL,
+        .flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT,
+        .renderArea = vk_render_area,
+        .layerCount = 1,
+        .viewMask = 0,
+        .colorAttachmentCount = 1,
+        .pColorAttachments = &vk_color_attachment,
+        .pDepthAttachment = NULL,
+        .pStencilAttachment = NULL,
+    };
+    vkCmdBeginRendering(vk_command_buffer, &vk_rendering_info);
+    vtk_recording_execute(vtk_window, vk_command_buffer, vk_draw_command_buffer);
+    vkCmdEndRendering(vk_command_buffer);
+    // The final layout transition of the render pass, done by hand.
+    set_image_layout(vk_command_buffer, vtk_window->vk_swap_chain_images[image_idx],
+                     VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                     VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+  } else {
+    VkRenderPassBeginInfo vk_render_pass_begin_info = {
+        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+        .pNext = NULL,
+        .renderPass = vtk_window->vk_surface_render_pass,
+        .framebuffer = vtk_window->vk_swap_chain_framebuffers[image_idx],
+        .renderArea = vk_render_area,
+        .clearValueCount = 1,
+        .pClearValues = &vk_clear_value,
+    };
+    vkCmdBeginRenderPass(vk_command_buffer, &vk_render_pass_begin_info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+    vtk_recording_execute(vtk_window, vk_command_buffer, vk_draw_command_buffer);
+    vkCmdEndRenderPass(vk_command_buffer);
+  }
+  vtk_gpu_timer_write_end(vtk_window, vk_command_buffer, VTK_GPU_TIMER_RENDER_PASS_SCOPE);
+  vtk_gpu_timer_write_end(vtk_window, vk_command_buffer, VTK_GPU_TIMER_FRAME_SCOPE);
+  CALL_VK(vkEndCommandBuffer(vk_command_buffer));
 }
 
 void vtk_setup_window_rendering(struct VtkWindowNative *vtk_window) {
-  vtk_create_sync(vtk_window);
+  vtk_create_frames(vtk_window);
+  vtk_frame_data_init(vtk_window);
+  vtk_gpu_timer_init(vtk_window);
+  vtk_recording_init(vtk_window);
   vtk_setup_surface_format(vtk_window);
-  vtk_create_surface_render_pass(vtk_window);
+  vtk_window->vk_surface_render_pass = VK_NULL_HANDLE;
+  if (!vtk_window->vtk_device->dynamic_rendering) {
+    vtk_create_surface_render_pass(vtk_window);
+  }
 
-  vtk_create_swap_chain(vtk_window);
-  vtk_create_command_buffers(vtk_window);
-  vtk_record_command_buffers(vtk_window);
+  vtk_create_swap_chain(vtk_window, VK_NULL_HANDLE);
 }
 
 // set_image_layout():
@@ -576,9 +577,10 @@ void set_image_layout(VkCommandBuffer cmdBuffer, VkImage image, VkImageLayout ol
 }
 
 void vtk_terminate_window(struct VtkWindowNative *vtk_window) {
-  vkFreeCommandBuffers(vtk_window->vtk_device->vk_device, vtk_window->vtk_device->vk_command_pool,
-                       vtk_window->command_buffer_len, vtk_window->vk_command_buffers);
-  free(vtk_window->vk_command_buffers);
+  vtk_delete_frames(vtk_window);
+  vtk_frame_data_destroy(vtk_window);
+  vtk_gpu_timer_destroy(vtk_window);
+  vtk_recording_destroy(vtk_window);
 
   vkDestroyRenderPass(vtk_window->vtk_device->vk_device, vtk_window->vk_surface_render_pass, NULL);
 
@@ -591,37 +593,93 @@ void vtk_terminate_window(struct VtkWindowNative *vtk_window) {
   // device.initialized_ = false;
 }
 
+// Replace the swap chain without waiting for the device to idle. Frames in flight may still render to the old
+// swap chain, so it is retired and its resources destroyed once those frames have finished.
 void vtk_recreate_swap_chain(struct VtkWindowNative *vtk_window) {
-  CALL_VK(vkDeviceWaitIdle(vtk_window->vtk_device->vk_device))
+  struct VtkRetiredSwapChainNative *retired = vtk_retire_swap_chain(vtk_window);
+  vtk_create_swap_chain(vtk_window, retired->vk_swapchain);
+}
 
-  vtk_delete_swap_chain(vtk_window);
-  vtk_setup_window_rendering_repeat(vtk_window);
-  // delete_graphics_pipeline();
-  // delete_command_buffers();
+void vtk_window_set_frames_in_flight(struct VtkWindowNative *vtk_window, uint32_t frames_in_flight) {
+  assert(frames_in_flight >= 1 && frames_in_flight <= VTK_MAX_FRAMES_IN_FLIGHT);
+  if (frames_in_flight == vtk_window->frames_in_flight) {
+    return;
+  }
+  vtk_delete_frames(vtk_window);
+  vtk_window->frames_in_flight = frames_in_flight;
+  vtk_create_frames(vtk_window);
+}
 
-  // vtk_create_swap_chain();
-  // vtk_create_graphics_pipeline();
-  // vtk_create_command_buffers();
+void vtk_window_configure_swap_chain(struct VtkWindowNative *vtk_window, VkPresentModeKHR present_mode,
+                                     uint32_t image_count) {
+  vtk_window->requested_present_mode = present_mode;
+  vtk_window->requested_swap_chain_images = image_count;
+  vtk_recreate_swap_chain(vtk_window);
 }
 
-void vtk_render_frame(struct VtkWindowNative *vtk_window) {
-  CALL_VK(vkWaitForFences(vtk_window->vtk_device->vk_device, 1, &vtk_window->vk_fence, VK_TRUE, UINT64_MAX))
+VkCommandBuffer vtk_window_begin_frame(struct VtkWindowNative *vtk_window) {
+  assert(!vtk_window->frame_begun);
+  VkDevice vk_device = vtk_window->vtk_device->vk_device;
+  struct VtkFrameNative *frame = &vtk_window->frames[vtk_window->current_frame_idx];
+  struct VtkFrameTimingNative *timing = &vtk_window->frame_timing;
+  memset(timing, 0, sizeof(struct VtkFrameTimingNative));
+  uint64_t *lap_start = &vtk_window->frame_lap_start;
+  *lap_start = vtk_frame_stats_now();
+
+  // Only wait for the frame which last used these resources, frames_in_flight frames ago, to finish.
+  CALL_VK(vkWaitForFences(vk_device, 1, &frame->vk_fence, VK_TRUE, UINT64_MAX))
+  // Frames finish in submission order, so every frame up to this one is done.
+  if (vtk_window->num_retired_swap_chains > 0) {
+    vtk_destroy_retired_swap_chains(vtk_window, frame->frame_number);
+  }
+  vtk_frame_data_frame_finished(vtk_window, frame);
+  vtk_recording_frame_finished(vtk_window, frame->frame_number);
+  vtk_gpu_timer_frame_finished(vtk_window, vtk_window->current_frame_idx);
+  vtk_gpu_timer_begin_frame(vtk_window, vtk_window->current_frame_idx, vtk_window->frame_number + 1);
+  vtk_frame_stats_lap(timing, VTK_FRAME_PHASE_FENCE_WAIT, lap_start);
+
+  // Reset every command buffer of the frame at once, which is cheaper than resetting them one by one.
+  CALL_VK(vkResetCommandPool(vk_device, frame->vk_command_pool, 0))
+  vtk_recording_begin_secondary(vtk_window, frame->vk_draw_command_buffer);
+  vtk_frame_stats_lap(timing, VTK_FRAME_PHASE_RESET, lap_start);
+  vtk_window->frame_begun = true;
+  return frame->vk_draw_command_buffer;
+}
+
+void vtk_window_end_frame(struct VtkWindowNative *vtk_window) {
+  assert(vtk_window->frame_begun);
+  vtk_window->frame_begun = false;
+  VkDevice vk_device = vtk_window->vtk_device->vk_device;
+  struct VtkFrameNative *frame = &vtk_window->frames[vtk_window->current_frame_idx];
+  struct VtkFrameTimingNative *timing = &vtk_window->frame_timing;
+  uint64_t *lap_start = &vtk_window->frame_lap_start;
+
+  CALL_VK(vkEndCommandBuffer(frame->vk_draw_command_buffer))
+  vtk_frame_stats_lap(timing, VTK_FRAME_PHASE_RECORD, lap_start);
 
   uint32_t acquired_image_idx;
-  VkResult acquire_result =
-      vkAcquireNextImageKHR(vtk_window->vtk_device->vk_device, vtk_window->vk_swapchain, UINT64_MAX,
-                            vtk_window->vk_semaphore, VK_NULL_HANDLE, &acquired_image_idx);
+  VkResult acquire_result = vkAcquireNextImageKHR(vk_device, vtk_window->vk_swapchain, UINT64_MAX,
+                                                  frame->vk_image_available_semaphore, VK_NULL_HANDLE,
+                                                  &acquired_image_idx);
+  vtk_frame_stats_lap(timing, VTK_FRAME_PHASE_ACQUIRE, lap_start);
   switch (acquire_result) {
   case VK_SUCCESS:
+    vtk_window->swap_chain_acquire_count++;
     break;
   case VK_ERROR_OUT_OF_DATE_KHR:
     LOGI("vkAcquireNextImageKHR() returned VK_ERROR_OUT_OF_DATE_KHR - recreating... %d", 1);
-    // We cannot present it - recreate and return.
+    // We cannot present it - recreate and drop the frame. The fence has not been reset, so the frame resources can be
+    // reused directly.
+    vtk_recording_discard(vtk_window);
+    vtk_gpu_timer_discard_frame(vtk_window);
     vtk_recreate_swap_chain(vtk_window);
-    break;
+    vtk_frame_stats_lap(timing, VTK_FRAME_PHASE_RECREATE, lap_start);
+    vtk_frame_stats_record(vtk_window, timing);
+    return;
   case VK_SUBOPTIMAL_KHR:
     // Ok to go ahead and present image - recreate after present.
     LOGI("vkAcquireNextImageKHR() returned VK_SUBOPTIMAL_KHR, %d", 1);
+    vtk_window->swap_chain_acquire_count++;
     break;
   default:
     LOGE("vkAcquireNextImageKHR failed");
@@ -629,32 +687,89 @@ void vtk_render_frame(struct VtkWindowNative *vtk_window) {
     break;
   }
 
-  CALL_VK(vkResetFences(vtk_window->vtk_device->vk_device, 1, &vtk_window->vk_fence))
+  CALL_VK(vkResetFences(vk_device, 1, &frame->vk_fence))
+  vtk_frame_stats_lap(timing, VTK_FRAME_PHASE_RESET, lap_start);
+  vtk_record_command_buffer(vtk_window, frame->vk_command_buffer, frame->vk_draw_command_buffer, acquired_image_idx);
+  vtk_frame_stats_lap(timing, VTK_FRAME_PHASE_RECORD, lap_start);
 
-  VkPipelineStageFlags vk_pipeline_stage_flags = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  // Besides the acquired image, wait for uploads and compute dispatches the frame depends on - the value of the
+  // binary semaphore is ignored.
+  struct VtkDeviceNative *vtk_device = vtk_window->vtk_device;
+  VkPipelineStageFlags const data_stages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+                                           VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                                           VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+  VkSemaphore vk_wait_semaphores[3] = {frame->vk_image_available_semaphore};
+  uint64_t wait_semaphore_values[3] = {0};
+  VkPipelineStageFlags vk_pipeline_stage_flags[3] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+  uint32_t wait_semaphore_count = 1;
+  if (vtk_window->upload_wait_ticket > 0) {
+    vk_wait_semaphores[wait_semaphore_count] = vtk_uploader_semaphore(vtk_device);
+    wait_semaphore_values[wait_semaphore_count] = vtk_window->upload_wait_ticket;
+    vk_pipeline_stage_flags[wait_semaphore_count++] = data_stages;
+  }
+  if (vtk_window->compute_wait_ticket > 0) {
+    vk_wait_semaphores[wait_semaphore_count] = vtk_device->compute_queue->vk_timeline_semaphore;
+    wait_semaphore_values[wait_semaphore_count] = vtk_window->compute_wait_ticket;
+    vk_pipeline_stage_flags[wait_semaphore_count++] = data_stages;
+  }
+  // Signal the timeline of the graphics queue as well, so that compute dispatches can wait for the frame.
+  VkSemaphore vk_signal_semaphores[] = {vtk_window->vk_render_finished_semaphores[acquired_image_idx],
+                                        vtk_device->graphics_queue->vk_timeline_semaphore};
+  uint64_t signal_semaphore_values[] = {0, 0};
+  VkTimelineSemaphoreSubmitInfo vk_timeline_submit_info = {
+      .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+      .pNext = NULL,
+      .waitSemaphoreValueCount = wait_semaphore_count,
+      .pWaitSemaphoreValues = wait_semaphore_values,
+      .signalSemaphoreValueCount = VTK_ARRAY_SIZE(signal_semaphore_values),
+      .pSignalSemaphoreValues = signal_semaphore_values,
+  };
   VkSubmitInfo submit_info = {.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-                              .pNext = NULL,
-                              .waitSemaphoreCount = 1,
-                              .pWaitSemaphores = &vtk_window->vk_semaphore,
-                              .pWaitDstStageMask = &vk_pipeline_stage_flags,
+                              .pNext = &vk_timeline_submit_info,
+                              .waitSemaphoreCount = wait_semaphore_count,
+                              .pWaitSemaphores = vk_wait_semaphores,
+                              .pWaitDstStageMask = vk_pipeline_stage_flags,
                               .commandBufferCount = 1,
-                              .pCommandBuffers = &vtk_window->vk_command_buffers[acquired_image_idx],
-                              .signalSemaphoreCount = 0,
-                              .pSignalSemaphores = NULL};
-  CALL_VK(vkQueueSubmit(vtk_window->vtk_device->vk_queue, 1, &submit_info, vtk_window->vk_fence))
-
+                              .pCommandBuffers = &frame->vk_command_buffer,
+                              .signalSemaphoreCount = VTK_ARRAY_SIZE(vk_signal_semaphores),
+                              .pSignalSemaphores = vk_signal_semaphores};
+  vtk_window->frame_ticket =
+      vtk_queue_submit_timeline(vtk_device->graphics_queue, &submit_info, &signal_semaphore_values[1], frame->vk_fence);
+  frame->frame_number = ++vtk_window->frame_number;
+  vtk_frame_data_frame_submitted(vtk_window, frame);
+  timing->frame_number = frame->frame_number;
+  vtk_frame_stats_lap(timing, VTK_FRAME_PHASE_SUBMIT, lap_start);
+
+  // With swapchain_maintenance1 the present signals a fence once done, telling when a retired swap chain can go. The
+  // previous present of the frame was frames_in_flight frames ago, so it is done by now.
+  VkSwapchainPresentFenceInfoEXT vk_present_fence_info = {
+      .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_FENCE_INFO_EXT,
+      .pNext = NULL,
+      .swapchainCount = 1,
+      .pFences = &frame->vk_present_fence,
+  };
+  if (vtk_device->swapchain_maintenance1) {
+    CALL_VK(vkWaitForFences(vk_device, 1, &frame->vk_present_fence, VK_TRUE, UINT64_MAX))
+    CALL_VK(vkResetFences(vk_device, 1, &frame->vk_present_fence))
+  }
   VkResult result;
   VkPresentInfoKHR presentInfo = {
       .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
-      .pNext = NULL,
-      .waitSemaphoreCount = 0,
-      .pWaitSemaphores = NULL,
+      .pNext = vtk_device->swapchain_maintenance1 ? &vk_present_fence_info : NULL,
+      .waitSemaphoreCount = 1,
+      .pWaitSemaphores = &vtk_window->vk_render_finished_semaphores[acquired_image_idx],
       .swapchainCount = 1,
       .pSwapchains = &vtk_window->vk_swapchain,
       .pImageIndices = &acquired_image_idx,
       .pResults = &result,
   };
-  VkResult present_result = vkQueuePresentKHR(vtk_window->vtk_device->vk_queue, &presentInfo);
+  vtk_window->current_frame_idx = (vtk_window->current_frame_idx + 1) % vtk_window->frames_in_flight;
+#ifdef VTK_PLATFORM_WAYLAND
+  vtk_wayland_request_frame(vtk_window);
+  vtk_wayland_request_presentation_feedback(vtk_window);
+#endif
+  VkResult present_result = vtk_queue_present(vtk_window->vtk_device->graphics_queue, &presentInfo);
+  vtk_frame_stats_lap(timing, VTK_FRAME_PHASE_PRESENT, lap_start);
   switch (present_result) {
   case VK_SUCCESS:
     break;
@@ -672,65 +787,19 @@ void vtk_render_frame(struct VtkWindowNative *vtk_window) {
     break;
   }
 #ifdef VTK_PLATFORM_WAYLAND
-  if (vtk_window->wayland_size_requested_by_compositor.width != vtk_window->vk_extent_2d.width ||
-      vtk_window->wayland_size_requested_by_compositor.height != vtk_window->vk_extent_2d.height) {
-    vtk_window->vk_extent_2d = vtk_window->wayland_size_requested_by_compositor;
+  VkExtent2D vk_extent_2d = vtk_wayland_update_surface_size(vtk_window);
+  if (vk_extent_2d.width != vtk_window->vk_extent_2d.width || vk_extent_2d.height != vtk_window->vk_extent_2d.height) {
+    vtk_window->vk_extent_2d = vk_extent_2d;
     vtk_recreate_swap_chain(vtk_window);
   }
 #endif
+  vtk_frame_stats_lap(timing, VTK_FRAME_PHASE_RECREATE, lap_start);
+  vtk_frame_stats_record(vtk_window, timing);
 }
 
-uint32_t vtk_find_memory_idx(VkPhysicalDevice vk_device, uint32_t typeBits, VkFlags requirements_mask, bool *found) {
-  VkPhysicalDeviceMemoryProperties memoryProperties;
-  vkGetPhysicalDeviceMemoryProperties(vk_device, &memoryProperties);
-  for (uint32_t memory_index = 0; memory_index < memoryProperties.memoryTypeCount; memory_index++) {
-    if ((typeBits & (1 << memory_index)) == 1) {
-      if ((memoryProperties.memoryTypes[memory_index].propertyFlags & requirements_mask) == requirements_mask) {
-        *found = true;
-        return memory_index;
-      }
-    }
-  }
-  *found = false;
-  return 0;
-}
-
-void vtk_create_vertex_buffer(struct VtkDeviceNative *vtk_device, uint64_t buffer_size) {
-  VkDevice vk_device = vtk_device->vk_device;
-  VkBuffer *vk_vertex_buffer = &vtk_device->vk_vertex_buffer;
-  VkDeviceMemory *vk_device_memory = &vtk_device->vk_vertex_buffer_device_memory;
-
-  VkBufferCreateInfo createBufferInfo = {
-      .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-      .pNext = NULL,
-      .flags = 0,
-      .size = buffer_size,
-      .usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-      .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-      .queueFamilyIndexCount = 1,
-      .pQueueFamilyIndices = &vtk_device->graphics_queue_family_idx,
-  };
-  CALL_VK(vkCreateBuffer(vk_device, &createBufferInfo, NULL, vk_vertex_buffer))
-
-  VkMemoryRequirements vk_memory_requirements;
-  vkGetBufferMemoryRequirements(vk_device, *vk_vertex_buffer, &vk_memory_requirements);
-  bool found_memory_type;
-  VkFlags memory_type_bits = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-  uint32_t memory_type_idx = vtk_find_memory_idx(vtk_device->vk_physical_device, vk_memory_requirements.memoryTypeBits,
-                                                 memory_type_bits, &found_memory_type);
-  assert(found_memory_type);
-  VkMemoryAllocateInfo vk_memory_allocation_info = {
-      .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-      .pNext = NULL,
-      .allocationSize = buffer_size,
-      .memoryTypeIndex = memory_type_idx,
-  };
-
-  CALL_VK(vkAllocateMemory(vk_device, &vk_memory_allocation_info, NULL, vk_device_memory))
-  CALL_VK(vkMapMemory(vk_device, *vk_device_memory, 0, vk_memory_allocation_info.allocationSize, 0,
-                      &vtk_device->vertex_buffer_ptr))
-  CALL_VK(vkBindBufferMemory(vk_device, *vk_vertex_buffer, *vk_device_memory, 0))
-  vtk_device->vertex_buffer_size = buffer_size;
+void vtk_render_frame(struct VtkWindowNative *vtk_window) {
+  vtk_window_begin_frame(vtk_window);
+  vtk_window_end_frame(vtk_window);
 }
 
 /*
@@ -1,16 +1,29 @@
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <wayland-client.h>
 #include <xkbcommon/xkbcommon.h>
 
 #include "vtk_cffi.h"
 #include "vtk_internal.h"
+#include "fractional-scale-v1-client-protocol.h"
+#include "pointer-constraints-unstable-v1-client-protocol.h"
+#include "presentation-time-client-protocol.h"
+#include "relative-pointer-unstable-v1-client-protocol.h"
 #include "vtk_log.h"
 #include "vtk_wayland_keyboard.h"
+#include "viewporter-client-protocol.h"
+#include "vtk_wayland_pointer.h"
 #include "vulkan_wrapper.h"
 #include "xdg-shell-client-protocol.h"
 
+// The logical size of windows whose size the compositor leaves to the client.
+#define VTK_WAYLAND_DEFAULT_WIDTH 800
+#define VTK_WAYLAND_DEFAULT_HEIGHT 800
+
 #define VTK_CHECK_WL_RESULT(_expr)                                                                                     \
   if (!(_expr)) {                                                                                                      \
     fprintf(stderr, "[vtk] Error executing %s.", #_expr);                                                              \
@@ -20,7 +33,21 @@
 static void handleRegistry(void *data, struct wl_registry *registry, uint32_t name, const char *interface,
                            uint32_t version);
 
-static const struct wl_registry_listener vtk_wl_registry_listener = {.global = handleRegistry};
+static void vtk_wayland_registry_remove(void *data, struct wl_registry *registry, uint32_t name);
+
+static const struct wl_registry_listener vtk_wl_registry_listener = {
+    .global = handleRegistry,
+    .global_remove = vtk_wayland_registry_remove,
+};
+
+// An output, bound for its integer scale - which compositors without wl_surface.preferred_buffer_scale leave clients
+// to derive from the outputs their surfaces are on.
+struct VtkWaylandOutputNative {
+  struct wl_output *wl_output;
+  uint32_t name;
+  int32_t scale;
+  struct VtkWaylandOutputNative *next;
+};
 
 static void handleShellPing(void *data, struct xdg_wm_base *shell, uint32_t serial) { xdg_wm_base_pong(shell, serial); }
 
@@ -40,20 +67,16 @@ static void wl_seat_capabilities(void *data, struct wl_seat *wl_seat, uint32_t c
 
   bool have_pointer = capabilities & WL_SEAT_CAPABILITY_POINTER;
   if (have_pointer && vtk_context->wayland_pointer == NULL) {
-    vtk_context->wayland_pointer = wl_seat_get_pointer(vtk_context->wayland_seat);
-    // TODO: https://wayland-book.com/seat/example.html
-    // wl_pointer_add_listener(vtk_context->wayland_pointer, &wl_pointer_listener, state);
+    vtk_wayland_add_pointer_listener(vtk_context);
   } else if (!have_pointer && vtk_context->wayland_pointer != NULL) {
-    wl_pointer_release(vtk_context->wayland_pointer);
-    vtk_context->wayland_pointer = NULL;
+    vtk_wayland_release_pointer(vtk_context);
   }
 
   bool have_keyboard = capabilities & WL_SEAT_CAPABILITY_KEYBOARD;
   if (have_keyboard && vtk_context->wayland_keyboard == NULL) {
     vtk_wayland_add_keyboard_listener(vtk_context);
   } else if (!have_keyboard && vtk_context->wayland_keyboard != NULL) {
-    wl_keyboard_release(vtk_context->wayland_keyboard);
-    vtk_context->wayland_keyboard = NULL;
+    vtk_wayland_release_keyboard(vtk_context);
   }
 }
 
@@ -89,12 +112,206 @@ static const struct xdg_toplevel_listener toplevelListener = {
     .close = vtk_wayland_callback_top_level_close,
 };
 
+// Compositor-paced rendering. Each presented frame asks for a frame callback, whose done event the compositor sends
+// when it is a good time to draw the next frame - never while the surface is hidden. The event is dispatched by the
+// thread running the event loop, and waited for by the thread rendering the window.
+struct VtkFramePacingNative {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  // The callback asked for with the last presented frame, null once done.
+  struct wl_callback *callback;
+  // Whether a callback is done and no frame has been waited for since.
+  bool frame_wanted;
+};
+
+static void vtk_wayland_frame_pacing_init(struct VtkWindowNative *vtk_window) {
+  struct VtkFramePacingNative *pacing = (struct VtkFramePacingNative *)calloc(1, sizeof(struct VtkFramePacingNative));
+  pthread_mutex_init(&pacing->mutex, NULL);
+  // Deadlines of timed waits are on the monotonic clock, unaffected by changes to the wall clock.
+  pthread_condattr_t cond_attr;
+  pthread_condattr_init(&cond_attr);
+  pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&pacing->cond, &cond_attr);
+  pthread_condattr_destroy(&cond_attr);
+  // The first frame is wanted right away.
+  pacing->frame_wanted = true;
+  vtk_window->wayland_frame_pacing = pacing;
+}
+
+static void vtk_wayland_frame_done(void *data, struct wl_callback *callback, uint32_t time_ms) {
+  struct VtkFramePacingNative *pacing = (struct VtkFramePacingNative *)data;
+  pthread_mutex_lock(&pacing->mutex);
+  wl_callback_destroy(callback);
+  pacing->callback = NULL;
+  pacing->frame_wanted = true;
+  pthread_cond_broadcast(&pacing->cond);
+  pthread_mutex_unlock(&pacing->mutex);
+}
+
+static const struct wl_callback_listener vtk_wayland_frame_listener = {.done = vtk_wayland_frame_done};
+
+void vtk_wayland_request_frame(struct VtkWindowNative *vtk_window) {
+  struct VtkFramePacingNative *pacing = vtk_window->wayland_frame_pacing;
+  if (pacing == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&pacing->mutex);
+  // Frames rendered without waiting need no callback of their own, a pending one paces them just as well. The done
+  // event cannot arrive before the commit of the frame, so the listener is in place in time.
+  if (pacing->callback == NULL) {
+    pacing->callback = wl_surface_frame(vtk_window->wayland_surface);
+    wl_callback_add_listener(pacing->callback, &vtk_wayland_frame_listener, pacing);
+  }
+  pthread_mutex_unlock(&pacing->mutex);
+}
+
+bool vtk_window_wait_for_frame(struct VtkWindowNative *vtk_window, uint64_t timeout_ns) {
+  struct VtkFramePacingNative *pacing = vtk_window->wayland_frame_pacing;
+  if (pacing == NULL) {
+    return true;
+  }
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  uint64_t deadline_ns = (uint64_t)deadline.tv_sec * 1000000000 + (uint64_t)deadline.tv_nsec + timeout_ns;
+  deadline.tv_sec = (time_t)(deadline_ns / 1000000000);
+  deadline.tv_nsec = (long)(deadline_ns % 1000000000);
+
+  pthread_mutex_lock(&pacing->mutex);
+  // Without a pending callback, as when the last frame was dropped for an out of date swap chain, nothing would wake
+  // the wait - and nothing was shown which the next frame should follow.
+  bool timed_out = false;
+  while (!pacing->frame_wanted && pacing->callback != NULL && !timed_out) {
+    if (timeout_ns == UINT64_MAX) {
+      pthread_cond_wait(&pacing->cond, &pacing->mutex);
+    } else {
+      timed_out = pthread_cond_timedwait(&pacing->cond, &pacing->mutex, &deadline) == ETIMEDOUT;
+    }
+  }
+  bool wanted = pacing->frame_wanted || pacing->callback == NULL;
+  pacing->frame_wanted = false;
+  pthread_mutex_unlock(&pacing->mutex);
+  return wanted;
+}
+
+static void vtk_wayland_presentation_clock_id(void *data, struct wp_presentation *presentation, uint32_t clock_id) {
+  struct VtkContextNative *vtk_context = (struct VtkContextNative *)data;
+  vtk_context->wayland_presentation_clock = clock_id;
+  if (clock_id != CLOCK_MONOTONIC) {
+    LOGW("Presentation times are on clock %u rather than CLOCK_MONOTONIC", clock_id);
+  }
+}
+
+static const struct wp_presentation_listener vtk_wayland_presentation_listener = {
+    .clock_id = vtk_wayland_presentation_clock_id,
+};
+
+static void vtk_wayland_preferred_scale(void *data, struct wp_fractional_scale_v1 *fractional_scale,
+                                        uint32_t scale_120) {
+  struct VtkWindowNative *vtk_window = (struct VtkWindowNative *)data;
+  __atomic_store_n(&vtk_window->wayland_scale_120, scale_120, __ATOMIC_RELAXED);
+}
+
+static const struct wp_fractional_scale_v1_listener vtk_wayland_fractional_scale_listener = {
+    .preferred_scale = vtk_wayland_preferred_scale,
+};
+
+static void vtk_wayland_output_geometry(void *data, struct wl_output *wl_output, int32_t x, int32_t y,
+                                        int32_t physical_width, int32_t physical_height, int32_t subpixel,
+                                        const char *make, const char *model, int32_t transform) {}
+
+static void vtk_wayland_output_mode(void *data, struct wl_output *wl_output, uint32_t flags, int32_t width,
+                                    int32_t height, int32_t refresh) {}
+
+static void vtk_wayland_output_done(void *data, struct wl_output *wl_output) {}
+
+static void vtk_wayland_output_scale(void *data, struct wl_output *wl_output, int32_t factor) {
+  ((struct VtkWaylandOutputNative *)data)->scale = factor;
+}
+
+static const struct wl_output_listener vtk_wayland_output_listener = {
+    .geometry = vtk_wayland_output_geometry,
+    .mode = vtk_wayland_output_mode,
+    .done = vtk_wayland_output_done,
+    .scale = vtk_wayland_output_scale,
+};
+
+// Use an integer scale as the preferred scale, unless the compositor has fractional ones.
+static void vtk_wayland_set_integer_scale(struct VtkWindowNative *vtk_window, int32_t scale) {
+  if (vtk_window->wayland_fractional_scale == NULL && scale > 0) {
+    __atomic_store_n(&vtk_window->wayland_scale_120, (uint32_t)scale * 120, __ATOMIC_RELAXED);
+  }
+}
+
+static void vtk_wayland_surface_enter(void *data, struct wl_surface *wl_surface, struct wl_output *wl_output) {
+  // Since version 6 the compositor tells the scale to use, taking all outputs the surface is on into account.
+  // The output is null if it has been removed meanwhile.
+  if (wl_surface_get_version(wl_surface) >= WL_SURFACE_PREFERRED_BUFFER_SCALE_SINCE_VERSION || wl_output == NULL) {
+    return;
+  }
+  struct VtkWaylandOutputNative *output = (struct VtkWaylandOutputNative *)wl_output_get_user_data(wl_output);
+  if (output != NULL) {
+    vtk_wayland_set_integer_scale((struct VtkWindowNative *)data, output->scale);
+  }
+}
+
+static void vtk_wayland_surface_leave(void *data, struct wl_surface *wl_surface, struct wl_output *wl_output) {}
+
+static void vtk_wayland_surface_preferred_buffer_scale(void *data, struct wl_surface *wl_surface, int32_t factor) {
+  vtk_wayland_set_integer_scale((struct VtkWindowNative *)data, factor);
+}
+
+static void vtk_wayland_surface_preferred_buffer_transform(void *data, struct wl_surface *wl_surface,
+                                                           uint32_t transform) {}
+
+static const struct wl_surface_listener vtk_wayland_surface_listener = {
+    .enter = vtk_wayland_surface_enter,
+    .leave = vtk_wayland_surface_leave,
+    .preferred_buffer_scale = vtk_wayland_surface_preferred_buffer_scale,
+    .preferred_buffer_transform = vtk_wayland_surface_preferred_buffer_transform,
+};
+
+VkExtent2D vtk_wayland_update_surface_size(struct VtkWindowNative *vtk_window) {
+  VkExtent2D logical_size = vtk_window->wayland_size_requested_by_compositor;
+  if (vtk_window->wayland_viewport == NULL) {
+    // Headless windows, and surfaces the compositor cannot scale, which map buffer pixels to logical ones.
+    return logical_size;
+  }
+  if (logical_size.width != vtk_window->wayland_viewport_size.width ||
+      logical_size.height != vtk_window->wayland_viewport_size.height) {
+    wp_viewport_set_destination(vtk_window->wayland_viewport, (int32_t)logical_size.width,
+                                (int32_t)logical_size.height);
+    vtk_window->wayland_viewport_size = logical_size;
+  }
+  // The fractional scale protocol asks for rounding half away from zero.
+  uint32_t scale_120 = __atomic_load_n(&vtk_window->wayland_scale_120, __ATOMIC_RELAXED);
+  float scale = (float)scale_120 / 120 * vtk_window->render_scale;
+  VkExtent2D extent = {
+      .width = (uint32_t)((float)logical_size.width * scale + 0.5f),
+      .height = (uint32_t)((float)logical_size.height * scale + 0.5f),
+  };
+  extent.width = extent.width == 0 ? 1 : extent.width;
+  extent.height = extent.height == 0 ? 1 : extent.height;
+  return extent;
+}
+
+void vtk_window_set_render_scale(struct VtkWindowNative *vtk_window, float render_scale) {
+  if (vtk_window->wayland_surface != NULL && vtk_window->wayland_viewport == NULL) {
+    LOGW("The compositor cannot scale surfaces - rendering at the logical size");
+  }
+  vtk_window->render_scale = render_scale;
+}
+
+float vtk_window_surface_scale(struct VtkWindowNative *vtk_window) {
+  return (float)__atomic_load_n(&vtk_window->wayland_scale_120, __ATOMIC_RELAXED) / 120;
+}
+
 static void handleRegistry(void *data, struct wl_registry *registry, uint32_t name, const char *interface,
                            uint32_t version) {
   struct VtkContextNative *vtk_context_native = (struct VtkContextNative *)data;
   if (strcmp(interface, wl_compositor_interface.name) == 0) {
+    // Version 6 has surfaces report their preferred buffer scale.
     VTK_CHECK_WL_RESULT(vtk_context_native->wayland_compositor =
-                            wl_registry_bind(registry, name, &wl_compositor_interface, 1));
+                            wl_registry_bind(registry, name, &wl_compositor_interface, version < 6 ? version : 6));
   } else if (strcmp(interface, xdg_wm_base_interface.name) == 0) {
     VTK_CHECK_WL_RESULT(vtk_context_native->wayland_shell =
                             wl_registry_bind(registry, name, &xdg_wm_base_interface, 1));
@@ -102,20 +319,84 @@ static void handleRegistry(void *data, struct wl_registry *registry, uint32_t na
   } else if (strcmp(interface, wl_seat_interface.name) == 0) {
     VTK_CHECK_WL_RESULT(vtk_context_native->wayland_seat = wl_registry_bind(registry, name, &wl_seat_interface, 7));
     wl_seat_add_listener(vtk_context_native->wayland_seat, &wl_seat_listener, data);
+  } else if (strcmp(interface, zwp_relative_pointer_manager_v1_interface.name) == 0) {
+    vtk_context_native->wayland_relative_pointer_manager =
+        wl_registry_bind(registry, name, &zwp_relative_pointer_manager_v1_interface, 1);
+  } else if (strcmp(interface, zwp_pointer_constraints_v1_interface.name) == 0) {
+    vtk_context_native->wayland_pointer_constraints =
+        wl_registry_bind(registry, name, &zwp_pointer_constraints_v1_interface, 1);
+  } else if (strcmp(interface, wp_presentation_interface.name) == 0) {
+    vtk_context_native->wayland_presentation = wl_registry_bind(registry, name, &wp_presentation_interface, 1);
+    wp_presentation_add_listener(vtk_context_native->wayland_presentation, &vtk_wayland_presentation_listener, data);
+  } else if (strcmp(interface, wp_viewporter_interface.name) == 0) {
+    vtk_context_native->wayland_viewporter = wl_registry_bind(registry, name, &wp_viewporter_interface, 1);
+  } else if (strcmp(interface, wp_fractional_scale_manager_v1_interface.name) == 0) {
+    vtk_context_native->wayland_fractional_scale_manager =
+        wl_registry_bind(registry, name, &wp_fractional_scale_manager_v1_interface, 1);
+  } else if (strcmp(interface, wl_output_interface.name) == 0 && version >= 2) {
+    struct VtkWaylandOutputNative *output =
+        (struct VtkWaylandOutputNative *)calloc(1, sizeof(struct VtkWaylandOutputNative));
+    output->wl_output = wl_registry_bind(registry, name, &wl_output_interface, 2);
+    output->name = name;
+    output->scale = 1;
+    output->next = vtk_context_native->wayland_outputs;
+    vtk_context_native->wayland_outputs = output;
+    wl_output_add_listener(output->wl_output, &vtk_wayland_output_listener, output);
+  }
+}
+
+static void vtk_wayland_registry_remove(void *data, struct wl_registry *registry, uint32_t name) {
+  struct VtkContextNative *vtk_context = (struct VtkContextNative *)data;
+  for (struct VtkWaylandOutputNative **link = &vtk_context->wayland_outputs; *link != NULL; link = &(*link)->next) {
+    struct VtkWaylandOutputNative *output = *link;
+    if (output->name == name) {
+      *link = output->next;
+      wl_output_destroy(output->wl_output);
+      free(output);
+      return;
+    }
   }
 }
 
 struct VtkContextNative *vtk_context_init() {
+  if (vtk_headless_requested()) {
+    return vtk_context_init_headless();
+  }
+  struct wl_display *wayland_display = wl_display_connect(NULL);
+  if (wayland_display == NULL) {
+    LOGW("Could not connect to a Wayland compositor - falling back to headless rendering");
+    return vtk_context_init_headless();
+  }
+
   vtk_load_vulkan_symbols();
 
   struct VtkContextNative *result = malloc(sizeof(struct VtkContextNative));
-  VTK_CHECK_WL_RESULT(result->wayland_display = wl_display_connect(NULL));
+  result->headless = false;
+  result->wayland_display = wayland_display;
   VTK_CHECK_WL_RESULT(result->wayland_registry = wl_display_get_registry(result->wayland_display));
   result->wayland_compositor = NULL;
   result->wayland_shell = NULL;
+  result->wayland_seat = NULL;
+  result->wayland_keyboard = NULL;
+  result->wayland_pointer = NULL;
+  result->wayland_relative_pointer_manager = NULL;
+  result->wayland_pointer_constraints = NULL;
+  result->wayland_presentation = NULL;
+  result->wayland_presentation_clock = CLOCK_MONOTONIC;
+  result->wayland_viewporter = NULL;
+  result->wayland_fractional_scale_manager = NULL;
+  result->wayland_outputs = NULL;
+  result->wayland_pointer_state = NULL;
   result->wayland_xkb_context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
   result->wayland_xkb_keymap = NULL;
   result->wayland_xkb_state = NULL;
+  result->wayland_keyboard_state = NULL;
+  result->input_write_count = 0;
+  result->input_read_count = 0;
+  result->input_dropped_count = 0;
+  result->input_held_keys = 0;
+  result->input_held_buttons = 0;
+  result->input_queue_taken = false;
 
   // TODO: Avoid static listener. use inline or save in result struct.
   wl_registry_add_listener(result->wayland_registry, &vtk_wl_registry_listener, result);
@@ -126,18 +407,19 @@ struct VtkContextNative *vtk_context_init() {
   assert(result->wayland_shell != NULL);
   assert(result->wayland_seat != NULL);
 
+  vtk_event_loop_init(result);
   return result;
 }
 
-void vtk_context_run(struct VtkContextNative *vtk_context) {
-  while (wl_display_dispatch(vtk_context->wayland_display) != -1) {
-    /* This space deliberately left blank */
-  }
-}
+void vtk_context_run(struct VtkContextNative *vtk_context) { vtk_event_loop_run(vtk_context); }
 
 _Bool vtk_window_init_platform(struct VtkWindowNative *vtk_window) {
   struct VtkDeviceNative *vtk_device = vtk_window->vtk_device;
   struct VtkContextNative *vtk_context = vtk_device->vtk_context;
+  if (vtk_context->headless) {
+    vtk_window_init_headless(vtk_window);
+    return 1;
+  }
 
   VTK_CHECK_WL_RESULT(vtk_window->wayland_surface = wl_compositor_create_surface(vtk_context->wayland_compositor));
   VTK_CHECK_WL_RESULT(vtk_window->wayland_shell_surface =
@@ -153,13 +435,37 @@ _Bool vtk_window_init_platform(struct VtkWindowNative *vtk_window) {
   xdg_toplevel_set_title(toplevel, appName);
   xdg_toplevel_set_app_id(toplevel, appName);
 
+  // Until the compositor configures a size, or if it leaves the size to the window.
+  vtk_window->wayland_size_requested_by_compositor.width = VTK_WAYLAND_DEFAULT_WIDTH;
+  vtk_window->wayland_size_requested_by_compositor.height = VTK_WAYLAND_DEFAULT_HEIGHT;
+  vtk_window->wayland_scale_120 = 120;
+  vtk_window->render_scale = 1;
+  // Without a viewport, buffer pixels map to surface coordinates and fractional scales cannot be rendered at.
+  vtk_window->wayland_viewport = NULL;
+  vtk_window->wayland_fractional_scale = NULL;
+  vtk_window->wayland_viewport_size.width = vtk_window->wayland_viewport_size.height = 0;
+  if (vtk_context->wayland_viewporter != NULL) {
+    vtk_window->wayland_viewport =
+        wp_viewporter_get_viewport(vtk_context->wayland_viewporter, vtk_window->wayland_surface);
+    if (vtk_context->wayland_fractional_scale_manager != NULL) {
+      vtk_window->wayland_fractional_scale = wp_fractional_scale_manager_v1_get_fractional_scale(
+          vtk_context->wayland_fractional_scale_manager, vtk_window->wayland_surface);
+      wp_fractional_scale_v1_add_listener(vtk_window->wayland_fractional_scale,
+                                          &vtk_wayland_fractional_scale_listener, vtk_window);
+    }
+  }
+  // Without fractional scales, integer ones still give sharp rendering on scaled outputs.
+  wl_surface_add_listener(vtk_window->wayland_surface, &vtk_wayland_surface_listener, vtk_window);
+
   wl_surface_commit(vtk_window->wayland_surface);
   wl_display_roundtrip(vtk_context->wayland_display);
   wl_surface_commit(vtk_window->wayland_surface);
+  vtk_wayland_frame_pacing_init(vtk_window);
+  vtk_window->wayland_locked_pointer = NULL;
+  vtk_wayland_presentation_init(vtk_window);
 
-  // TODO: Handle initial window size
-  vtk_window->vk_extent_2d.width = vtk_window->wayland_size_requested_by_compositor.width = 800;
-  vtk_window->vk_extent_2d.height = vtk_window->wayland_size_requested_by_compositor.height = 800;
+  // The roundtrip has delivered the initial configure, with the size chosen by the compositor if any.
+  vtk_window->vk_extent_2d = vtk_wayland_update_surface_size(vtk_window);
 
   VkWaylandSurfaceCreateInfoKHR surface_create_info = {
       .sType = VK_STRUCTURE_TYPE_WAYLAND_SURFACE_CREATE_INFO_KHR,
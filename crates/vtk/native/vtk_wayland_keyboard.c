@@ -1,84 +1,351 @@
 // See https://wayland-book.com/seat.html and https://wayland-book.com/seat/example.html
+//
+// Compiling a keymap takes milliseconds, and the compositor sends the same keymap again whenever the seat gains its
+// keyboard back - so compiled keymaps are cached by a hash of their text. Looking up keys through xkb_state on every
+// key event is not free either, so for each layout and set of effective modifiers in use a table maps all keycodes of
+// the keymap to their keysym and Key, built when the modifiers change. Key events are then a table lookup, and are
+// passed on to the input ring of the context.
+//
+// Key repeat is up to clients on Wayland. A held key is repeated by a timer of the event loop at the rate and delay the
+// compositor configured, independent of rendering. Repeats are stamped with the times they were due rather than the
+// times the timer ran, so the loop running late delays them but does not distort their rhythm.
 
 #include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
 #include <sys/mman.h>
 #include <unistd.h>
 #include <wayland-client.h>
 #include <xkbcommon/xkbcommon.h>
 
+#include "rustffi.h"
 #include "vtk_cffi.h"
+#include "vtk_internal.h"
 #include "vtk_log.h"
 #include "vtk_wayland_keyboard.h"
 
+#define VTK_KEYMAP_CACHE_SIZE 4
+// Layouts times combinations of modifiers typically in use, beyond which the least recently built table is rebuilt.
+#define VTK_KEY_TABLES_PER_KEYMAP 8
+
+// The keysyms and Key bits of the keycodes of a keymap, for one layout and one set of effective modifiers.
+struct VtkKeyTable {
+  xkb_layout_index_t layout;
+  xkb_mod_mask_t mods;
+  // Indexed by keycode - min_keycode of the keymap.
+  xkb_keysym_t *keysyms;
+  uint64_t *keys;
+};
+
+struct VtkCachedKeymap {
+  // FNV-1a hash and size of the keymap text.
+  uint64_t hash;
+  uint32_t size;
+  struct xkb_keymap *xkb_keymap;
+  xkb_keycode_t min_keycode;
+  uint32_t keycode_count;
+  struct VtkKeyTable tables[VTK_KEY_TABLES_PER_KEYMAP];
+  uint32_t table_count;
+  // The table replaced when all are in use.
+  uint32_t next_replaced_table;
+  uint64_t last_used;
+};
+
+struct VtkKeyboardNative {
+  struct VtkCachedKeymap keymaps[VTK_KEYMAP_CACHE_SIZE];
+  uint32_t keymap_count;
+  uint64_t use_count;
+  // The keymap in use and its table for the current layout and modifiers, null until the first keymap arrives.
+  struct VtkCachedKeymap *keymap;
+  struct VtkKeyTable const *table;
+  // Repeats per second, 0 to not repeat keys, and the delay before the first repeat in milliseconds.
+  int32_t repeat_rate;
+  int32_t repeat_delay;
+  // The key being repeated and its Key bits, and the timer repeating it - 0 if none.
+  uint32_t repeat_key;
+  uint64_t repeat_key_bits;
+  uint64_t repeat_timer;
+  // The interval between repeats of the key, fixed when it started repeating.
+  uint64_t repeat_interval_ns;
+  // When the next repeat is due, from CLOCK_MONOTONIC.
+  uint64_t repeat_next_ns;
+};
+
+static uint64_t vtk_keymap_hash(uint8_t const *bytes, uint32_t size) {
+  uint64_t hash = 0xcbf29ce484222325;
+  for (uint32_t i = 0; i < size; i++) {
+    hash = (hash ^ bytes[i]) * 0x100000001b3;
+  }
+  return hash;
+}
+
+static uint64_t vtk_key_from_keysym(xkb_keysym_t keysym) {
+  switch (keysym) {
+  case XKB_KEY_Up:
+    return Key_ArrowUp.bits;
+  case XKB_KEY_Right:
+    return Key_ArrowRight.bits;
+  case XKB_KEY_Down:
+    return Key_ArrowDown.bits;
+  case XKB_KEY_Left:
+    return Key_ArrowLeft.bits;
+  case XKB_KEY_Shift_L:
+  case XKB_KEY_Shift_R:
+    return Key_Shift.bits;
+  case XKB_KEY_Caps_Lock:
+    return Key_CapsLock.bits;
+  case XKB_KEY_Super_L:
+  case XKB_KEY_Super_R:
+    return Key_Command.bits;
+  case XKB_KEY_Control_L:
+  case XKB_KEY_Control_R:
+    return Key_Control.bits;
+  case XKB_KEY_a:
+  case XKB_KEY_A:
+    return Key_A.bits;
+  case XKB_KEY_d:
+  case XKB_KEY_D:
+    return Key_D.bits;
+  case XKB_KEY_s:
+  case XKB_KEY_S:
+    return Key_S.bits;
+  case XKB_KEY_w:
+  case XKB_KEY_W:
+    return Key_W.bits;
+  default:
+    return 0;
+  }
+}
+
+// The table of the keymap in use for the layout and modifiers of the state, built if there is none yet.
+static struct VtkKeyTable const *vtk_keyboard_table(struct VtkKeyboardNative *keyboard, struct xkb_state *xkb_state) {
+  struct VtkCachedKeymap *keymap = keyboard->keymap;
+  xkb_layout_index_t layout = xkb_state_serialize_layout(xkb_state, XKB_STATE_LAYOUT_EFFECTIVE);
+  xkb_mod_mask_t mods = xkb_state_serialize_mods(xkb_state, XKB_STATE_MODS_EFFECTIVE);
+  for (uint32_t i = 0; i < keymap->table_count; i++) {
+    if (keymap->tables[i].layout == layout && keymap->tables[i].mods == mods) {
+      return &keymap->tables[i];
+    }
+  }
+
+  struct VtkKeyTable *table;
+  if (keymap->table_count < VTK_KEY_TABLES_PER_KEYMAP) {
+    table = &keymap->tables[keymap->table_count++];
+    table->keysyms = (xkb_keysym_t *)malloc(keymap->keycode_count * sizeof(xkb_keysym_t));
+    table->keys = (uint64_t *)malloc(keymap->keycode_count * sizeof(uint64_t));
+  } else {
+    table = &keymap->tables[keymap->next_replaced_table];
+    keymap->next_replaced_table = (keymap->next_replaced_table + 1) % VTK_KEY_TABLES_PER_KEYMAP;
+  }
+  table->layout = layout;
+  table->mods = mods;
+  for (uint32_t i = 0; i < keymap->keycode_count; i++) {
+    table->keysyms[i] = xkb_state_key_get_one_sym(xkb_state, keymap->min_keycode + i);
+    table->keys[i] = vtk_key_from_keysym(table->keysyms[i]);
+  }
+  return table;
+}
+
+static void vtk_cached_keymap_destroy(struct VtkCachedKeymap *keymap) {
+  xkb_keymap_unref(keymap->xkb_keymap);
+  for (uint32_t i = 0; i < keymap->table_count; i++) {
+    free(keymap->tables[i].keysyms);
+    free(keymap->tables[i].keys);
+  }
+}
+
+// The cached keymap compiled from the text, compiling it if it is not cached.
+static struct VtkCachedKeymap *vtk_keyboard_keymap(struct VtkContextNative *context, char const *text, uint32_t size) {
+  struct VtkKeyboardNative *keyboard = context->wayland_keyboard_state;
+  uint64_t hash = vtk_keymap_hash((uint8_t const *)text, size);
+  for (uint32_t i = 0; i < keyboard->keymap_count; i++) {
+    if (keyboard->keymaps[i].hash == hash && keyboard->keymaps[i].size == size) {
+      return &keyboard->keymaps[i];
+    }
+  }
+
+  // The text is null-terminated within size.
+  struct xkb_keymap *xkb_keymap = xkb_keymap_new_from_string(context->wayland_xkb_context, text,
+                                                             XKB_KEYMAP_FORMAT_TEXT_V1, XKB_KEYMAP_COMPILE_NO_FLAGS);
+  if (xkb_keymap == NULL) {
+    LOGE("Could not compile the keymap of the keyboard");
+    return NULL;
+  }
+
+  struct VtkCachedKeymap *keymap;
+  if (keyboard->keymap_count < VTK_KEYMAP_CACHE_SIZE) {
+    keymap = &keyboard->keymaps[keyboard->keymap_count++];
+  } else {
+    // Replace the least recently used keymap, which is not the one in use.
+    keymap = NULL;
+    for (uint32_t i = 0; i < VTK_KEYMAP_CACHE_SIZE; i++) {
+      struct VtkCachedKeymap *candidate = &keyboard->keymaps[i];
+      if (candidate != keyboard->keymap && (keymap == NULL || candidate->last_used < keymap->last_used)) {
+        keymap = candidate;
+      }
+    }
+    vtk_cached_keymap_destroy(keymap);
+  }
+  xkb_keycode_t min_keycode = xkb_keymap_min_keycode(xkb_keymap);
+  *keymap = (struct VtkCachedKeymap){
+      .hash = hash,
+      .size = size,
+      .xkb_keymap = xkb_keymap,
+      .min_keycode = min_keycode,
+      .keycode_count = xkb_keymap_max_keycode(xkb_keymap) - min_keycode + 1,
+      .table_count = 0,
+      .next_replaced_table = 0,
+  };
+  return keymap;
+}
+
 static void vtk_wl_keyboard_keymap(void *data, struct wl_keyboard *wl_keyboard, uint32_t format, int32_t fd,
                                    uint32_t size) {
-  LOGI("vtk_wl_keyboard called: size = %d, fd = %d", size, fd);
   struct VtkContextNative *context = (struct VtkContextNative *)data;
-  assert(format == WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1);
+  if (format != WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1) {
+    LOGW("Unsupported keymap format %u", format);
+    close(fd);
+    return;
+  }
+  struct VtkKeyboardNative *keyboard = context->wayland_keyboard_state;
 
-  void *keymap_mem = malloc(size);
-  assert(keymap_mem != NULL);
-  assert(read(fd, keymap_mem, size) == size);
+  // From version 7 of wl_seat the keymap must be mapped privately.
+  char *text = (char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
   close(fd);
-  // char *map_shm = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
-  // if (map_shm == MAP_FAILED) { perror("mmap"); }
-  // assert(map_shm != MAP_FAILED);
+  if (text == MAP_FAILED) {
+    LOGE("Could not map the keymap of the keyboard");
+    return;
+  }
+  struct VtkCachedKeymap *keymap = vtk_keyboard_keymap(context, text, size);
+  munmap(text, size);
+  if (keymap == NULL) {
+    return;
+  }
+  keymap->last_used = ++keyboard->use_count;
 
-  struct xkb_keymap *xkb_keymap = xkb_keymap_new_from_string(context->wayland_xkb_context, keymap_mem,
-                                                             XKB_KEYMAP_FORMAT_TEXT_V1, XKB_KEYMAP_COMPILE_NO_FLAGS);
-  free(keymap_mem);
+  xkb_keymap_unref(context->wayland_xkb_keymap);
+  context->wayland_xkb_keymap = xkb_keymap_ref(keymap->xkb_keymap);
+  xkb_state_unref(context->wayland_xkb_state);
+  context->wayland_xkb_state = xkb_state_new(keymap->xkb_keymap);
+  keyboard->keymap = keymap;
+  keyboard->table = vtk_keyboard_table(keyboard, context->wayland_xkb_state);
+}
 
-  struct xkb_state *xkb_state = xkb_state_new(xkb_keymap);
+static void vtk_keyboard_push(struct VtkContextNative *context, enum VtkInputEventKindNative kind, uint64_t keys,
+                              uint64_t time_ns) {
+  struct VtkInputEventNative event = {.kind = kind, .time_ns = time_ns, .keys = keys};
+  vtk_input_push(context, &event);
+}
 
-  xkb_keymap_unref(context->wayland_xkb_keymap);
-  context->wayland_xkb_keymap = xkb_keymap;
+static void vtk_keyboard_repeat(void *user_data) {
+  struct VtkContextNative *context = (struct VtkContextNative *)user_data;
+  struct VtkKeyboardNative *keyboard = context->wayland_keyboard_state;
+  if (keyboard->repeat_timer == 0) {
+    return;
+  }
+  // Missed expirations of the timer are run once, so catch up on all repeats due.
+  uint64_t now = vtk_frame_stats_now();
+  while (keyboard->repeat_next_ns <= now) {
+    vtk_keyboard_push(context, VTK_INPUT_EVENT_KEY_REPEATED, keyboard->repeat_key_bits, keyboard->repeat_next_ns);
+    keyboard->repeat_next_ns += keyboard->repeat_interval_ns;
+  }
+}
 
-  xkb_state_unref(context->wayland_xkb_state);
-  context->wayland_xkb_state = xkb_state;
+static void vtk_keyboard_stop_repeat(struct VtkContextNative *context) {
+  struct VtkKeyboardNative *keyboard = context->wayland_keyboard_state;
+  if (keyboard->repeat_timer != 0) {
+    vtk_context_cancel_task(context, keyboard->repeat_timer);
+    keyboard->repeat_timer = 0;
+  }
+}
+
+static void vtk_keyboard_start_repeat(struct VtkContextNative *context, uint32_t key, uint64_t key_bits,
+                                      uint64_t time_ns) {
+  struct VtkKeyboardNative *keyboard = context->wayland_keyboard_state;
+  vtk_keyboard_stop_repeat(context);
+  if (keyboard->repeat_rate <= 0 || !xkb_keymap_key_repeats(keyboard->keymap->xkb_keymap, key + 8)) {
+    return;
+  }
+  uint64_t delay_ns = (uint64_t)keyboard->repeat_delay * 1000000;
+  uint64_t interval_ns = 1000000000 / (uint64_t)keyboard->repeat_rate;
+  keyboard->repeat_key = key;
+  keyboard->repeat_key_bits = key_bits;
+  keyboard->repeat_interval_ns = interval_ns;
+  keyboard->repeat_next_ns = time_ns + delay_ns;
+  keyboard->repeat_timer =
+      vtk_context_schedule_task(context, delay_ns, interval_ns, vtk_keyboard_repeat, NULL, context);
+}
+
+// The Key bits of a key in the current table, 0 for keys outside the keymap.
+static uint64_t vtk_keyboard_key(struct VtkKeyboardNative const *keyboard, uint32_t key) {
+  uint32_t idx = key + 8 - keyboard->keymap->min_keycode;
+  return idx < keyboard->keymap->keycode_count ? keyboard->table->keys[idx] : 0;
 }
 
 static void vtk_wl_keyboard_enter(void *data, struct wl_keyboard *wl_keyboard, uint32_t serial,
                                   struct wl_surface *surface, struct wl_array *keys) {
   struct VtkContextNative *context = (struct VtkContextNative *)data;
-  fprintf(stderr, "keyboard enter; keys pressed are:\n");
-  uint32_t *key;
-  wl_array_for_each(key, keys) {
-    char buf[128];
-    xkb_keysym_t sym = xkb_state_key_get_one_sym(context->wayland_xkb_state, *key + 8);
-    xkb_keysym_get_name(sym, buf, sizeof(buf));
-    fprintf(stderr, "sym: %-12s (%d), ", buf, sym);
-    xkb_state_key_get_utf8(context->wayland_xkb_state, *key + 8, buf, sizeof(buf));
-    fprintf(stderr, "utf8: '%s'\n", buf);
+  struct VtkKeyboardNative *keyboard = context->wayland_keyboard_state;
+  if (keyboard == NULL || keyboard->keymap == NULL) {
+    return;
   }
+  uint64_t held_keys = 0;
+  uint32_t *key;
+  wl_array_for_each(key, keys) { held_keys |= vtk_keyboard_key(keyboard, *key); }
+  vtk_keyboard_push(context, VTK_INPUT_EVENT_KEYBOARD_ENTERED, held_keys, vtk_frame_stats_now());
 }
 
 static void vtk_wl_keyboard_key(void *data, struct wl_keyboard *wl_keyboard, uint32_t serial, uint32_t time,
                                 uint32_t key, uint32_t state) {
   struct VtkContextNative *context = (struct VtkContextNative *)data;
-  char buf[128];
-  uint32_t keycode = key + 8;
-  xkb_keysym_t sym = xkb_state_key_get_one_sym(context->wayland_xkb_state, keycode);
-  xkb_keysym_get_name(sym, buf, sizeof(buf));
-  const char *action = state == WL_KEYBOARD_KEY_STATE_PRESSED ? "press" : "release";
-  fprintf(stderr, "key %s: sym: %-12s (%d), ", action, buf, sym);
-  xkb_state_key_get_utf8(context->wayland_xkb_state, keycode, buf, sizeof(buf));
-  fprintf(stderr, "utf8: '%s'\n", buf);
+  struct VtkKeyboardNative *keyboard = context->wayland_keyboard_state;
+  if (keyboard == NULL || keyboard->keymap == NULL) {
+    return;
+  }
+  uint64_t key_bits = vtk_keyboard_key(keyboard, key);
+  if (key_bits == 0) {
+    return;
+  }
+  uint64_t now = vtk_frame_stats_now();
+  if (state == WL_KEYBOARD_KEY_STATE_PRESSED) {
+    vtk_keyboard_push(context, VTK_INPUT_EVENT_KEY_PRESSED, key_bits, now);
+    vtk_keyboard_start_repeat(context, key, key_bits, now);
+  } else {
+    vtk_keyboard_push(context, VTK_INPUT_EVENT_KEY_RELEASED, key_bits, now);
+    if (key == keyboard->repeat_key) {
+      vtk_keyboard_stop_repeat(context);
+    }
+  }
 }
 
 static void vtk_wl_keyboard_leave(void *data, struct wl_keyboard *wl_keyboard, uint32_t serial,
                                   struct wl_surface *surface) {
-  fprintf(stderr, "keyboard leave\n");
+  struct VtkContextNative *context = (struct VtkContextNative *)data;
+  vtk_keyboard_stop_repeat(context);
+  vtk_keyboard_push(context, VTK_INPUT_EVENT_KEYBOARD_LEFT, 0, vtk_frame_stats_now());
 }
 
 static void vtk_wl_keyboard_modifiers(void *data, struct wl_keyboard *wl_keyboard, uint32_t serial,
                                       uint32_t mods_depressed, uint32_t mods_latched, uint32_t mods_locked,
                                       uint32_t group) {
   struct VtkContextNative *context = (struct VtkContextNative *)data;
+  struct VtkKeyboardNative *keyboard = context->wayland_keyboard_state;
+  if (keyboard == NULL || keyboard->keymap == NULL) {
+    return;
+  }
   xkb_state_update_mask(context->wayland_xkb_state, mods_depressed, mods_latched, mods_locked, 0, 0, group);
+  keyboard->table = vtk_keyboard_table(keyboard, context->wayland_xkb_state);
 }
 
 static void vtk_wl_keyboard_repeat_info(void *data, struct wl_keyboard *wl_keyboard, int32_t rate, int32_t delay) {
-  /* Left as an exercise for the reader */
+  struct VtkContextNative *context = (struct VtkContextNative *)data;
+  struct VtkKeyboardNative *keyboard = context->wayland_keyboard_state;
+  // A key being repeated keeps its old rhythm until released, unless repeating is turned off.
+  keyboard->repeat_rate = rate;
+  keyboard->repeat_delay = delay;
+  if (rate <= 0) {
+    vtk_keyboard_stop_repeat(context);
+  }
 }
 
 static const struct wl_keyboard_listener vtk_wl_keyboard_listener = {
@@ -95,5 +362,19 @@ void vtk_wayland_add_keyboard_listener(struct VtkContextNative *vtk_context) {
   assert(vtk_context->wayland_seat != NULL);
   vtk_context->wayland_keyboard = wl_seat_get_keyboard(vtk_context->wayland_seat);
   assert(vtk_context->wayland_keyboard != NULL);
+  // Kept when the seat loses its keyboard, so the keymaps stay cached for when it comes back.
+  if (vtk_context->wayland_keyboard_state == NULL) {
+    struct VtkKeyboardNative *keyboard = (struct VtkKeyboardNative *)calloc(1, sizeof(struct VtkKeyboardNative));
+    // The defaults of X servers, until the compositor tells otherwise.
+    keyboard->repeat_rate = 25;
+    keyboard->repeat_delay = 600;
+    vtk_context->wayland_keyboard_state = keyboard;
+  }
   wl_keyboard_add_listener(vtk_context->wayland_keyboard, &vtk_wl_keyboard_listener, vtk_context);
 }
+
+void vtk_wayland_release_keyboard(struct VtkContextNative *vtk_context) {
+  vtk_keyboard_stop_repeat(vtk_context);
+  wl_keyboard_release(vtk_context->wayland_keyboard);
+  vtk_context->wayland_keyboard = NULL;
+}
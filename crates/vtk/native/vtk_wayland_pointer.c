@@ -0,0 +1,203 @@
+// See https://wayland-book.com/seat/pointer.html
+//
+// The compositor groups pointer events into frames ended by wl_pointer.frame - a high rate mouse sends one per motion
+// report. The events of a frame are accumulated here and passed on to the input ring of the context as a single event,
+// so the thread draining the ring sees one event per report rather than one per change, and can coalesce further.
+// Entering and leaving are passed on as events of their own right away, in order with the rest of the frame.
+// Relative motion from zwp_relative_pointer_v1 is part of the same frames, and keeps being reported while the pointer
+// is locked with zwp_pointer_constraints_v1.
+
+#include <assert.h>
+#include <linux/input-event-codes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <wayland-client.h>
+
+#include "pointer-constraints-unstable-v1-client-protocol.h"
+#include "relative-pointer-unstable-v1-client-protocol.h"
+#include "vtk_cffi.h"
+#include "vtk_internal.h"
+#include "vtk_log.h"
+#include "vtk_wayland_pointer.h"
+
+struct VtkPointerNative {
+  // Null if the compositor does not support relative pointer motion.
+  struct zwp_relative_pointer_v1 *relative_pointer;
+  // The VTK_INPUT_EVENT_POINTER event of the frame being received, pushed to the input ring when the frame ends. The
+  // position is kept between frames, the rest is reset.
+  struct VtkInputEventNative frame;
+  // Whether the frame being received has had any events.
+  bool frame_pending;
+};
+
+// Push the events of the frame received so far, if there were any.
+static void vtk_pointer_push_frame(struct VtkContextNative *context, struct VtkPointerNative *pointer) {
+  if (!pointer->frame_pending) {
+    return;
+  }
+  pointer->frame.time_ns = vtk_frame_stats_now();
+  vtk_input_push(context, &pointer->frame);
+
+  pointer->frame.dx = pointer->frame.dy = 0;
+  pointer->frame.scroll_x = pointer->frame.scroll_y = 0;
+  pointer->frame.buttons_pressed = pointer->frame.buttons_released = 0;
+  pointer->frame_pending = false;
+}
+
+static void vtk_wl_pointer_enter(void *data, struct wl_pointer *wl_pointer, uint32_t serial,
+                                 struct wl_surface *surface, wl_fixed_t x, wl_fixed_t y) {
+  struct VtkContextNative *context = (struct VtkContextNative *)data;
+  struct VtkPointerNative *pointer = context->wayland_pointer_state;
+  // Events before entering belong before it, even if the frame goes on.
+  vtk_pointer_push_frame(context, pointer);
+  pointer->frame.x = (float)wl_fixed_to_double(x);
+  pointer->frame.y = (float)wl_fixed_to_double(y);
+  struct VtkInputEventNative event = {
+      .kind = VTK_INPUT_EVENT_POINTER_ENTERED,
+      .time_ns = vtk_frame_stats_now(),
+      .x = pointer->frame.x,
+      .y = pointer->frame.y,
+  };
+  vtk_input_push(context, &event);
+}
+
+static void vtk_wl_pointer_leave(void *data, struct wl_pointer *wl_pointer, uint32_t serial,
+                                 struct wl_surface *surface) {
+  struct VtkContextNative *context = (struct VtkContextNative *)data;
+  struct VtkPointerNative *pointer = context->wayland_pointer_state;
+  vtk_pointer_push_frame(context, pointer);
+  struct VtkInputEventNative event = {
+      .kind = VTK_INPUT_EVENT_POINTER_LEFT,
+      .time_ns = vtk_frame_stats_now(),
+  };
+  vtk_input_push(context, &event);
+}
+
+static void vtk_wl_pointer_motion(void *data, struct wl_pointer *wl_pointer, uint32_t time, wl_fixed_t x,
+                                  wl_fixed_t y) {
+  struct VtkPointerNative *pointer = ((struct VtkContextNative *)data)->wayland_pointer_state;
+  pointer->frame.x = (float)wl_fixed_to_double(x);
+  pointer->frame.y = (float)wl_fixed_to_double(y);
+  pointer->frame_pending = true;
+}
+
+static void vtk_wl_pointer_button(void *data, struct wl_pointer *wl_pointer, uint32_t serial, uint32_t time,
+                                  uint32_t button, uint32_t state) {
+  struct VtkPointerNative *pointer = ((struct VtkContextNative *)data)->wayland_pointer_state;
+  if (button < BTN_LEFT || button >= BTN_LEFT + 32) {
+    return;
+  }
+  uint32_t button_bit = 1u << (button - BTN_LEFT);
+  if (state == WL_POINTER_BUTTON_STATE_PRESSED) {
+    pointer->frame.buttons_pressed |= button_bit;
+  } else {
+    pointer->frame.buttons_released |= button_bit;
+  }
+  pointer->frame_pending = true;
+}
+
+static void vtk_wl_pointer_axis(void *data, struct wl_pointer *wl_pointer, uint32_t time, uint32_t axis,
+                                wl_fixed_t value) {
+  struct VtkPointerNative *pointer = ((struct VtkContextNative *)data)->wayland_pointer_state;
+  if (axis == WL_POINTER_AXIS_VERTICAL_SCROLL) {
+    pointer->frame.scroll_y += (float)wl_fixed_to_double(value);
+  } else {
+    pointer->frame.scroll_x += (float)wl_fixed_to_double(value);
+  }
+  pointer->frame_pending = true;
+}
+
+static void vtk_wl_pointer_frame(void *data, struct wl_pointer *wl_pointer) {
+  struct VtkContextNative *context = (struct VtkContextNative *)data;
+  vtk_pointer_push_frame(context, context->wayland_pointer_state);
+}
+
+static void vtk_wl_pointer_axis_source(void *data, struct wl_pointer *wl_pointer, uint32_t axis_source) {}
+
+static void vtk_wl_pointer_axis_stop(void *data, struct wl_pointer *wl_pointer, uint32_t time, uint32_t axis) {}
+
+static void vtk_wl_pointer_axis_discrete(void *data, struct wl_pointer *wl_pointer, uint32_t axis, int32_t discrete) {}
+
+static const struct wl_pointer_listener vtk_wl_pointer_listener = {
+    .enter = vtk_wl_pointer_enter,
+    .leave = vtk_wl_pointer_leave,
+    .motion = vtk_wl_pointer_motion,
+    .button = vtk_wl_pointer_button,
+    .axis = vtk_wl_pointer_axis,
+    .frame = vtk_wl_pointer_frame,
+    .axis_source = vtk_wl_pointer_axis_source,
+    .axis_stop = vtk_wl_pointer_axis_stop,
+    .axis_discrete = vtk_wl_pointer_axis_discrete,
+};
+
+static void vtk_relative_pointer_motion(void *data, struct zwp_relative_pointer_v1 *relative_pointer,
+                                        uint32_t utime_hi, uint32_t utime_lo, wl_fixed_t dx, wl_fixed_t dy,
+                                        wl_fixed_t dx_unaccel, wl_fixed_t dy_unaccel) {
+  struct VtkPointerNative *pointer = ((struct VtkContextNative *)data)->wayland_pointer_state;
+  pointer->frame.dx += (float)wl_fixed_to_double(dx_unaccel);
+  pointer->frame.dy += (float)wl_fixed_to_double(dy_unaccel);
+  pointer->frame_pending = true;
+}
+
+static const struct zwp_relative_pointer_v1_listener vtk_relative_pointer_listener = {
+    .relative_motion = vtk_relative_pointer_motion,
+};
+
+void vtk_wayland_add_pointer_listener(struct VtkContextNative *vtk_context) {
+  assert(vtk_context->wayland_pointer == NULL);
+  assert(vtk_context->wayland_seat != NULL);
+  vtk_context->wayland_pointer = wl_seat_get_pointer(vtk_context->wayland_seat);
+  assert(vtk_context->wayland_pointer != NULL);
+
+  struct VtkPointerNative *pointer = (struct VtkPointerNative *)calloc(1, sizeof(struct VtkPointerNative));
+  pointer->frame.kind = VTK_INPUT_EVENT_POINTER;
+  vtk_context->wayland_pointer_state = pointer;
+  wl_pointer_add_listener(vtk_context->wayland_pointer, &vtk_wl_pointer_listener, vtk_context);
+
+  // Globals are bound before the seat reports its capabilities, so the manager is known by now if there is one.
+  if (vtk_context->wayland_relative_pointer_manager != NULL) {
+    pointer->relative_pointer = zwp_relative_pointer_manager_v1_get_relative_pointer(
+        vtk_context->wayland_relative_pointer_manager, vtk_context->wayland_pointer);
+    zwp_relative_pointer_v1_add_listener(pointer->relative_pointer, &vtk_relative_pointer_listener, vtk_context);
+  }
+}
+
+void vtk_wayland_release_pointer(struct VtkContextNative *vtk_context) {
+  struct VtkPointerNative *pointer = vtk_context->wayland_pointer_state;
+  if (pointer->relative_pointer != NULL) {
+    zwp_relative_pointer_v1_destroy(pointer->relative_pointer);
+  }
+  free(pointer);
+  vtk_context->wayland_pointer_state = NULL;
+  wl_pointer_release(vtk_context->wayland_pointer);
+  vtk_context->wayland_pointer = NULL;
+}
+
+static void vtk_wayland_lock_pointer(void *user_data) {
+  struct VtkWindowNative *vtk_window = (struct VtkWindowNative *)user_data;
+  struct VtkContextNative *vtk_context = vtk_window->vtk_device->vtk_context;
+  if (vtk_window->wayland_locked_pointer != NULL) {
+    return;
+  }
+  if (vtk_context->wayland_pointer_constraints == NULL || vtk_context->wayland_pointer == NULL) {
+    LOGW("Cannot lock the pointer, as the compositor does not support it");
+    return;
+  }
+  vtk_window->wayland_locked_pointer = zwp_pointer_constraints_v1_lock_pointer(
+      vtk_context->wayland_pointer_constraints, vtk_window->wayland_surface, vtk_context->wayland_pointer, NULL,
+      ZWP_POINTER_CONSTRAINTS_V1_LIFETIME_PERSISTENT);
+}
+
+static void vtk_wayland_unlock_pointer(void *user_data) {
+  struct VtkWindowNative *vtk_window = (struct VtkWindowNative *)user_data;
+  if (vtk_window->wayland_locked_pointer != NULL) {
+    zwp_locked_pointer_v1_destroy(vtk_window->wayland_locked_pointer);
+    vtk_window->wayland_locked_pointer = NULL;
+  }
+}
+
+void vtk_window_set_pointer_locked(struct VtkWindowNative *vtk_window, _Bool locked) {
+  // The pointer and its constraints belong to the thread dispatching their events.
+  vtk_context_post_task(vtk_window->vtk_device->vtk_context,
+                        locked ? vtk_wayland_lock_pointer : vtk_wayland_unlock_pointer, vtk_window);
+}
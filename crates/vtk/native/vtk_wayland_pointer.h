@@ -0,0 +1,10 @@
+#ifndef VTK_WAYLAND_POINTER_H
+#define VTK_WAYLAND_POINTER_H
+
+struct VtkContextNative;
+
+void vtk_wayland_add_pointer_listener(struct VtkContextNative *vtk_context);
+
+void vtk_wayland_release_pointer(struct VtkContextNative *vtk_context);
+
+#endif
@@ -0,0 +1,146 @@
+// Presentation feedback, see https://wayland.app/protocols/presentation-time. Each presented frame asks wp_presentation
+// for feedback on its commit, which the compositor sends once the frame has turned into light - with the time it did,
+// the refresh interval and vblank counter of the output - or once it was replaced before being shown.
+//
+// Feedback is asked for by the thread rendering the window and received by the thread running the event loop, in a
+// fixed set of slots. Records of presented frames are kept in a ring per window like the frame timings, with the event
+// loop thread as the single writer, and read without locks - see vtk_history.c.
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <wayland-client.h>
+
+#include "presentation-time-client-protocol.h"
+#include "vtk_cffi.h"
+#include "vtk_internal.h"
+#include "vtk_log.h"
+
+// Frames which may await feedback at once. Compositors answer within a few refresh cycles, frames rendered while all
+// slots are taken go without feedback.
+#define VTK_PRESENTATION_FEEDBACK_SLOTS 16
+
+struct VtkPresentationFeedbackSlot {
+  struct VtkPresentationFeedbackNative *presentation;
+  // Null while the slot is free, set by the rendering thread and cleared by the event loop thread.
+  struct wp_presentation_feedback *feedback;
+  uint64_t frame_number;
+};
+
+struct VtkPresentationFeedbackNative {
+  struct VtkPresentationFeedbackSlot slots[VTK_PRESENTATION_FEEDBACK_SLOTS];
+  uint32_t next_slot;
+  struct VtkPresentationNative records[VTK_PRESENTATION_HISTORY];
+  // The number of records written to the ring so far.
+  struct VtkHistoryNative record_history;
+  // The vblank counter at the previous presentation synchronized to vblank, if there was one.
+  uint64_t last_sequence;
+  bool has_last_sequence;
+  // Totals, updated atomically.
+  struct VtkPresentationStatsNative stats;
+};
+
+static void vtk_presentation_record(struct VtkPresentationFeedbackSlot *slot, struct VtkPresentationNative *record) {
+  struct VtkPresentationFeedbackNative *presentation = slot->presentation;
+  wp_presentation_feedback_destroy(slot->feedback);
+  __atomic_store_n(&slot->feedback, NULL, __ATOMIC_RELEASE);
+
+  vtk_history_write(&presentation->record_history, presentation->records, sizeof(struct VtkPresentationNative),
+                    VTK_PRESENTATION_HISTORY, record);
+}
+
+static void vtk_presentation_sync_output(void *data, struct wp_presentation_feedback *feedback,
+                                         struct wl_output *output) {}
+
+static void vtk_presentation_presented(void *data, struct wp_presentation_feedback *feedback, uint32_t tv_sec_hi,
+                                       uint32_t tv_sec_lo, uint32_t tv_nsec, uint32_t refresh, uint32_t seq_hi,
+                                       uint32_t seq_lo, uint32_t flags) {
+  struct VtkPresentationFeedbackSlot *slot = (struct VtkPresentationFeedbackSlot *)data;
+  struct VtkPresentationFeedbackNative *presentation = slot->presentation;
+  uint64_t sequence = ((uint64_t)seq_hi << 32) | seq_lo;
+  struct VtkPresentationNative record = {
+      .frame_number = slot->frame_number,
+      .presented_ns = ((((uint64_t)tv_sec_hi << 32) | tv_sec_lo) * 1000000000) + tv_nsec,
+      .refresh_ns = refresh,
+      .flags = flags,
+      .sequence = (flags & VTK_PRESENTATION_VSYNC) ? sequence : 0,
+      .missed_vblanks = 0,
+  };
+  if (flags & VTK_PRESENTATION_VSYNC) {
+    // Each vblank between two presented frames showed the previous frame again.
+    if (presentation->has_last_sequence && sequence > presentation->last_sequence + 1) {
+      record.missed_vblanks = (uint32_t)(sequence - presentation->last_sequence - 1);
+    }
+    presentation->last_sequence = sequence;
+    presentation->has_last_sequence = true;
+  }
+  __atomic_add_fetch(&presentation->stats.presented_count, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&presentation->stats.missed_vblanks, record.missed_vblanks, __ATOMIC_RELAXED);
+  vtk_presentation_record(slot, &record);
+}
+
+static void vtk_presentation_discarded(void *data, struct wp_presentation_feedback *feedback) {
+  struct VtkPresentationFeedbackSlot *slot = (struct VtkPresentationFeedbackSlot *)data;
+  struct VtkPresentationNative record = {.frame_number = slot->frame_number};
+  __atomic_add_fetch(&slot->presentation->stats.discarded_count, 1, __ATOMIC_RELAXED);
+  vtk_presentation_record(slot, &record);
+}
+
+static const struct wp_presentation_feedback_listener vtk_presentation_feedback_listener = {
+    .sync_output = vtk_presentation_sync_output,
+    .presented = vtk_presentation_presented,
+    .discarded = vtk_presentation_discarded,
+};
+
+void vtk_wayland_presentation_init(struct VtkWindowNative *vtk_window) {
+  struct VtkContextNative *vtk_context = vtk_window->vtk_device->vtk_context;
+  if (vtk_context->wayland_presentation == NULL) {
+    LOGI("The compositor does not report presentation times");
+    vtk_window->wayland_presentation_feedback = NULL;
+    return;
+  }
+  struct VtkPresentationFeedbackNative *presentation =
+      (struct VtkPresentationFeedbackNative *)calloc(1, sizeof(struct VtkPresentationFeedbackNative));
+  for (uint32_t i = 0; i < VTK_PRESENTATION_FEEDBACK_SLOTS; i++) {
+    presentation->slots[i].presentation = presentation;
+  }
+  vtk_window->wayland_presentation_feedback = presentation;
+}
+
+void vtk_wayland_request_presentation_feedback(struct VtkWindowNative *vtk_window) {
+  struct VtkPresentationFeedbackNative *presentation = vtk_window->wayland_presentation_feedback;
+  if (presentation == NULL) {
+    return;
+  }
+  struct VtkPresentationFeedbackSlot *slot = &presentation->slots[presentation->next_slot];
+  if (__atomic_load_n(&slot->feedback, __ATOMIC_ACQUIRE) != NULL) {
+    return;
+  }
+  presentation->next_slot = (presentation->next_slot + 1) % VTK_PRESENTATION_FEEDBACK_SLOTS;
+  slot->frame_number = vtk_window->frame_number;
+  // As with frame callbacks, no event can arrive before the commit of the frame, so the listener is in place in time.
+  struct wp_presentation_feedback *feedback =
+      wp_presentation_feedback(vtk_window->vtk_device->vtk_context->wayland_presentation, vtk_window->wayland_surface);
+  wp_presentation_feedback_add_listener(feedback, &vtk_presentation_feedback_listener, slot);
+  __atomic_store_n(&slot->feedback, feedback, __ATOMIC_RELEASE);
+}
+
+uint32_t vtk_window_copy_presentations(struct VtkWindowNative *vtk_window, struct VtkPresentationNative *presentations,
+                                       uint32_t max_count) {
+  struct VtkPresentationFeedbackNative *presentation = vtk_window->wayland_presentation_feedback;
+  if (presentation == NULL) {
+    return 0;
+  }
+  return vtk_history_copy(&presentation->record_history, presentation->records, sizeof(struct VtkPresentationNative),
+                          VTK_PRESENTATION_HISTORY, presentations, max_count);
+}
+
+struct VtkPresentationStatsNative vtk_window_presentation_stats(struct VtkWindowNative *vtk_window) {
+  struct VtkPresentationStatsNative stats = {0};
+  struct VtkPresentationFeedbackNative *presentation = vtk_window->wayland_presentation_feedback;
+  if (presentation != NULL) {
+    stats.presented_count = __atomic_load_n(&presentation->stats.presented_count, __ATOMIC_RELAXED);
+    stats.discarded_count = __atomic_load_n(&presentation->stats.discarded_count, __ATOMIC_RELAXED);
+    stats.missed_vblanks = __atomic_load_n(&presentation->stats.missed_vblanks, __ATOMIC_RELAXED);
+  }
+  return stats;
+}
@@ -187,6 +187,17 @@ bool vtk_load_vulkan_symbols() {
   vkCmdNextSubpass = (PFN_vkCmdNextSubpass)dlsym(libvulkan, "vkCmdNextSubpass");
   vkCmdEndRenderPass = (PFN_vkCmdEndRenderPass)dlsym(libvulkan, "vkCmdEndRenderPass");
   vkCmdExecuteCommands = (PFN_vkCmdExecuteCommands)dlsym(libvulkan, "vkCmdExecuteCommands");
+  vkCmdBeginRendering = (PFN_vkCmdBeginRendering)dlsym(libvulkan, "vkCmdBeginRendering");
+  vkCmdEndRendering = (PFN_vkCmdEndRendering)dlsym(libvulkan, "vkCmdEndRendering");
+  vkCmdSetCullMode = (PFN_vkCmdSetCullMode)dlsym(libvulkan, "vkCmdSetCullMode");
+  vkCmdSetFrontFace = (PFN_vkCmdSetFrontFace)dlsym(libvulkan, "vkCmdSetFrontFace");
+  vkCmdSetPrimitiveTopology = (PFN_vkCmdSetPrimitiveTopology)dlsym(libvulkan, "vkCmdSetPrimitiveTopology");
+  vkGetPhysicalDeviceFeatures2 = (PFN_vkGetPhysicalDeviceFeatures2)dlsym(libvulkan, "vkGetPhysicalDeviceFeatures2");
+  vkGetBufferMemoryRequirements2 =
+      (PFN_vkGetBufferMemoryRequirements2)dlsym(libvulkan, "vkGetBufferMemoryRequirements2");
+  vkGetImageMemoryRequirements2 = (PFN_vkGetImageMemoryRequirements2)dlsym(libvulkan, "vkGetImageMemoryRequirements2");
+  vkGetSemaphoreCounterValue = (PFN_vkGetSemaphoreCounterValue)dlsym(libvulkan, "vkGetSemaphoreCounterValue");
+  vkWaitSemaphores = (PFN_vkWaitSemaphores)dlsym(libvulkan, "vkWaitSemaphores");
   vkDestroySurfaceKHR = (PFN_vkDestroySurfaceKHR)dlsym(libvulkan, "vkDestroySurfaceKHR");
   vkGetPhysicalDeviceSurfaceSupportKHR =
       (PFN_vkGetPhysicalDeviceSurfaceSupportKHR)dlsym(libvulkan, "vkGetPhysicalDeviceSurfaceSupportKHR");
@@ -214,6 +225,7 @@ bool vtk_load_vulkan_symbols() {
   vkCreateDisplayPlaneSurfaceKHR =
       (PFN_vkCreateDisplayPlaneSurfaceKHR)dlsym(libvulkan, "vkCreateDisplayPlaneSurfaceKHR");
   vkCreateSharedSwapchainsKHR = (PFN_vkCreateSharedSwapchainsKHR)dlsym(libvulkan, "vkCreateSharedSwapchainsKHR");
+  vkCreateHeadlessSurfaceEXT = (PFN_vkCreateHeadlessSurfaceEXT)dlsym(libvulkan, "vkCreateHeadlessSurfaceEXT");
 
 #ifdef VK_USE_PLATFORM_XLIB_KHR
   vkCreateXlibSurfaceKHR = (PFN_vkCreateXlibSurfaceKHR)dlsym(libvulkan, "vkCreateXlibSurfaceKHR");
@@ -403,6 +415,16 @@ PFN_vkCmdBeginRenderPass vkCmdBeginRenderPass;
 PFN_vkCmdNextSubpass vkCmdNextSubpass;
 PFN_vkCmdEndRenderPass vkCmdEndRenderPass;
 PFN_vkCmdExecuteCommands vkCmdExecuteCommands;
+PFN_vkCmdBeginRendering vkCmdBeginRendering;
+PFN_vkCmdEndRendering vkCmdEndRendering;
+PFN_vkCmdSetCullMode vkCmdSetCullMode;
+PFN_vkCmdSetFrontFace vkCmdSetFrontFace;
+PFN_vkCmdSetPrimitiveTopology vkCmdSetPrimitiveTopology;
+PFN_vkGetPhysicalDeviceFeatures2 vkGetPhysicalDeviceFeatures2;
+PFN_vkGetBufferMemoryRequirements2 vkGetBufferMemoryRequirements2;
+PFN_vkGetImageMemoryRequirements2 vkGetImageMemoryRequirements2;
+PFN_vkGetSemaphoreCounterValue vkGetSemaphoreCounterValue;
+PFN_vkWaitSemaphores vkWaitSemaphores;
 PFN_vkDestroySurfaceKHR vkDestroySurfaceKHR;
 PFN_vkGetPhysicalDeviceSurfaceSupportKHR vkGetPhysicalDeviceSurfaceSupportKHR;
 PFN_vkGetPhysicalDeviceSurfaceCapabilitiesKHR vkGetPhysicalDeviceSurfaceCapabilitiesKHR;
@@ -421,6 +443,7 @@ PFN_vkCreateDisplayModeKHR vkCreateDisplayModeKHR;
 PFN_vkGetDisplayPlaneCapabilitiesKHR vkGetDisplayPlaneCapabilitiesKHR;
 PFN_vkCreateDisplayPlaneSurfaceKHR vkCreateDisplayPlaneSurfaceKHR;
 PFN_vkCreateSharedSwapchainsKHR vkCreateSharedSwapchainsKHR;
+PFN_vkCreateHeadlessSurfaceEXT vkCreateHeadlessSurfaceEXT;
 
 #ifdef VK_USE_PLATFORM_XLIB_KHR
 PFN_vkCreateXlibSurfaceKHR vkCreateXlibSurfaceKHR;
@@ -2,18 +2,70 @@
 #![allow(non_camel_case_types)]
 #![allow(non_snake_case)]
 
+use crate::Key;
+
 pub struct VtkContext {
     native_handle: *mut VtkContextNative,
 }
 
 impl VtkContext {
+    /// Connect to the display server.
+    ///
+    /// On Linux this falls back to `new_headless()` if the `VTK_HEADLESS` environment variable is
+    /// set, or if no Wayland compositor is available.
     pub fn new() -> Self {
         let native_handle = unsafe { vtk_context_init() };
         Self { native_handle }
     }
 
+    /// Create a context without a display server, for render servers, benchmarks and tests.
+    ///
+    /// Windows render to swap chains of `VK_EXT_headless_surface`, which are never displayed, and
+    /// `run()` only runs the tasks of `event_loop()`. Works with software rendering through
+    /// lavapipe.
+    #[cfg(all(target_os = "linux", not(target_os = "android")))]
+    pub fn new_headless() -> Self {
+        let native_handle = unsafe { vtk_context_init_headless() };
+        Self { native_handle }
+    }
+
+    /// Whether windows render to headless surfaces rather than being displayed.
+    pub fn is_headless(&self) -> bool {
+        #[cfg(all(target_os = "linux", not(target_os = "android")))]
+        {
+            unsafe { (*self.native_handle).headless }
+        }
+        #[cfg(not(all(target_os = "linux", not(target_os = "android"))))]
+        {
+            false
+        }
+    }
+
+    /// Create a device on the physical device selected by the `VTK_DEVICE` environment variable, or
+    /// else the highest scoring one.
     pub fn create_device(&mut self) -> VtkDevice {
-        let native_handle = unsafe { vtk_device_init(self.native_handle) };
+        self.create_device_with_selection(&VtkDeviceSelection::Automatic)
+    }
+
+    /// Create a device on a specific physical device, falling back to automatic selection if it is not
+    /// usable.
+    pub fn create_device_with_selection(&mut self, selection: &VtkDeviceSelection) -> VtkDevice {
+        let selector = match selection {
+            VtkDeviceSelection::Automatic => None,
+            VtkDeviceSelection::Index(index) => Some(index.to_string()),
+            VtkDeviceSelection::Name(name) => Some(name.clone()),
+        }
+        .map(|selector| {
+            std::ffi::CString::new(selector).expect("device selector contains a nul byte")
+        });
+        let native_handle = unsafe {
+            vtk_device_init_with_selector(
+                self.native_handle,
+                selector
+                    .as_ref()
+                    .map_or(std::ptr::null(), |selector| selector.as_ptr()),
+            )
+        };
         VtkDevice { native_handle }
     }
 
@@ -25,9 +77,299 @@ impl VtkContext {
         VtkWindow { native_handle }
     }
 
+    /// Run the event loop on the calling thread. On Linux it runs until `VtkEventLoop::quit()` is
+    /// called.
     pub fn run(&mut self) {
         unsafe { vtk_context_run(self.native_handle) };
     }
+
+    /// A handle to run tasks on the thread running `run()`, from any thread.
+    #[cfg(all(target_os = "linux", not(target_os = "android")))]
+    pub fn event_loop(&self) -> VtkEventLoop {
+        VtkEventLoop {
+            native_handle: self.native_handle,
+        }
+    }
+
+    /// The receiving end of the input events of the context, to drain once per frame on the thread
+    /// rendering. Panics if called more than once, as the queue has a single consumer.
+    #[cfg(all(target_os = "linux", not(target_os = "android")))]
+    pub fn input_queue(&mut self) -> VtkInputQueue {
+        let taken = unsafe { &mut (*self.native_handle).input_queue_taken };
+        assert!(
+            !*taken,
+            "the input queue of the context has already been taken"
+        );
+        *taken = true;
+        VtkInputQueue {
+            native_handle: self.native_handle,
+            native_events: vec![unsafe { std::mem::zeroed() }; VTK_INPUT_QUEUE_CAPACITY as usize],
+            events: Vec::with_capacity(VTK_INPUT_QUEUE_CAPACITY as usize),
+        }
+    }
+}
+
+/// Runs tasks on the thread running `VtkContext::run()`, which sleeps until the display, a posted
+/// task or a timer is ready. Obtained from `VtkContext::event_loop()`, and used from any thread.
+#[cfg(all(target_os = "linux", not(target_os = "android")))]
+#[derive(Copy, Clone)]
+pub struct VtkEventLoop {
+    native_handle: *mut VtkContextNative,
+}
+
+#[cfg(all(target_os = "linux", not(target_os = "android")))]
+unsafe impl Send for VtkEventLoop {}
+#[cfg(all(target_os = "linux", not(target_os = "android")))]
+unsafe impl Sync for VtkEventLoop {}
+
+/// A task scheduled with `VtkEventLoop::schedule()`.
+#[derive(Copy, Clone, Debug, PartialEq, Eq, Hash)]
+pub struct VtkTimerId(u64);
+
+#[cfg(all(target_os = "linux", not(target_os = "android")))]
+impl VtkEventLoop {
+    /// Run a task on the loop thread as soon as possible.
+    pub fn post(&self, task: impl FnOnce() + Send + 'static) {
+        unsafe extern "C" fn run(user_data: *mut std::ffi::c_void) {
+            let task = Box::from_raw(user_data as *mut Box<dyn FnOnce() + Send>);
+            task();
+        }
+        let task: Box<Box<dyn FnOnce() + Send>> = Box::new(Box::new(task));
+        unsafe {
+            vtk_context_post_task(self.native_handle, Some(run), Box::into_raw(task) as *mut _)
+        };
+    }
+
+    /// Run a task on the loop thread after `delay`, and then every `interval` until cancelled if
+    /// there is one.
+    pub fn schedule(
+        &self,
+        delay: std::time::Duration,
+        interval: Option<std::time::Duration>,
+        task: impl FnMut() + Send + 'static,
+    ) -> VtkTimerId {
+        unsafe extern "C" fn run(user_data: *mut std::ffi::c_void) {
+            let task = &mut *(user_data as *mut Box<dyn FnMut() + Send>);
+            task();
+        }
+        unsafe extern "C" fn destroy(user_data: *mut std::ffi::c_void) {
+            drop(Box::from_raw(user_data as *mut Box<dyn FnMut() + Send>));
+        }
+        let nanos =
+            |duration: std::time::Duration| u64::try_from(duration.as_nanos()).unwrap_or(u64::MAX);
+        let task: Box<Box<dyn FnMut() + Send>> = Box::new(Box::new(task));
+        VtkTimerId(unsafe {
+            vtk_context_schedule_task(
+                self.native_handle,
+                nanos(delay),
+                interval.map_or(0, nanos),
+                Some(run),
+                Some(destroy),
+                Box::into_raw(task) as *mut _,
+            )
+        })
+    }
+
+    /// Cancel a scheduled task. It may still be running on the loop thread when this returns.
+    pub fn cancel(&self, timer: VtkTimerId) {
+        unsafe { vtk_context_cancel_task(self.native_handle, timer.0) };
+    }
+
+    /// Make `VtkContext::run()` return once it has handled the current events.
+    pub fn quit(&self) {
+        unsafe { vtk_context_quit(self.native_handle) };
+    }
+}
+
+/// Input events received by the event loop, passed on to the thread rendering through a bounded
+/// ring without locks. Obtained from `VtkContext::input_queue()`.
+///
+/// Pointer events arrive as one event per report of the pointing device, and consecutive reports
+/// without button changes are coalesced when drained - so a 1000 Hz mouse yields a single motion
+/// event per frame.
+///
+/// If the ring fills up because it is not drained, new events are dropped - but the held keys of
+/// `KeyInput` and `held_buttons()` stay accurate.
+#[cfg(all(target_os = "linux", not(target_os = "android")))]
+pub struct VtkInputQueue {
+    native_handle: *mut VtkContextNative,
+    native_events: Vec<VtkInputEventNative>,
+    events: Vec<VtkInputEvent>,
+}
+
+#[cfg(all(target_os = "linux", not(target_os = "android")))]
+unsafe impl Send for VtkInputQueue {}
+
+#[cfg(all(target_os = "linux", not(target_os = "android")))]
+impl VtkInputQueue {
+    /// Take the events received since the last drain, oldest first, and update `input` with the
+    /// keys pressed and released since and the keys held now. Never blocks, so it may be called at
+    /// the start of every frame.
+    pub fn drain(&mut self, input: &mut crate::KeyInput) -> &[VtkInputEvent] {
+        let count = unsafe {
+            vtk_context_drain_input(
+                self.native_handle,
+                self.native_events.as_mut_ptr(),
+                VTK_INPUT_QUEUE_CAPACITY,
+            )
+        };
+        input.pressed = Key::empty();
+        input.released = Key::empty();
+        input.repeated = Key::empty();
+        self.events.clear();
+        for native in &self.native_events[..count as usize] {
+            let keys = Key::from_bits_truncate(native.keys);
+            let kind = match native.kind {
+                VtkInputEventKindNative_VTK_INPUT_EVENT_KEY_PRESSED => {
+                    input.pressed |= keys;
+                    VtkInputEventKind::KeyPressed(keys)
+                }
+                VtkInputEventKindNative_VTK_INPUT_EVENT_KEY_RELEASED => {
+                    input.released |= keys;
+                    VtkInputEventKind::KeyReleased(keys)
+                }
+                VtkInputEventKindNative_VTK_INPUT_EVENT_KEY_REPEATED => {
+                    input.repeated |= keys;
+                    VtkInputEventKind::KeyRepeated(keys)
+                }
+                VtkInputEventKindNative_VTK_INPUT_EVENT_KEYBOARD_ENTERED => {
+                    input.pressed |= keys;
+                    VtkInputEventKind::KeyboardEntered(keys)
+                }
+                VtkInputEventKindNative_VTK_INPUT_EVENT_KEYBOARD_LEFT => {
+                    VtkInputEventKind::KeyboardLeft
+                }
+                VtkInputEventKindNative_VTK_INPUT_EVENT_POINTER_ENTERED => {
+                    VtkInputEventKind::PointerEntered {
+                        x: native.x,
+                        y: native.y,
+                    }
+                }
+                VtkInputEventKindNative_VTK_INPUT_EVENT_POINTER_LEFT => {
+                    VtkInputEventKind::PointerLeft
+                }
+                _ => VtkInputEventKind::Pointer(VtkPointerFrame {
+                    x: native.x,
+                    y: native.y,
+                    dx: native.dx,
+                    dy: native.dy,
+                    scroll_x: native.scroll_x,
+                    scroll_y: native.scroll_y,
+                    pressed: VtkPointerButtons::from_bits_retain(native.buttons_pressed),
+                    released: VtkPointerButtons::from_bits_retain(native.buttons_released),
+                }),
+            };
+            let time = std::time::Duration::from_nanos(native.time_ns);
+            if let (
+                VtkInputEventKind::Pointer(frame),
+                Some(VtkInputEvent {
+                    time: last_time,
+                    kind: VtkInputEventKind::Pointer(last_frame),
+                }),
+            ) = (&kind, self.events.last_mut())
+            {
+                // Motion and scrolling add up, but button changes keep their position.
+                if frame.pressed.is_empty()
+                    && frame.released.is_empty()
+                    && last_frame.pressed.is_empty()
+                    && last_frame.released.is_empty()
+                {
+                    last_frame.x = frame.x;
+                    last_frame.y = frame.y;
+                    last_frame.dx += frame.dx;
+                    last_frame.dy += frame.dy;
+                    last_frame.scroll_x += frame.scroll_x;
+                    last_frame.scroll_y += frame.scroll_y;
+                    *last_time = time;
+                    continue;
+                }
+            }
+            self.events.push(VtkInputEvent { time, kind });
+        }
+        input.bits = Key::from_bits_truncate(unsafe { vtk_context_held_keys(self.native_handle) });
+        &self.events
+    }
+
+    /// The pointer buttons held now.
+    pub fn held_buttons(&self) -> VtkPointerButtons {
+        VtkPointerButtons::from_bits_retain(unsafe { vtk_context_held_buttons(self.native_handle) })
+    }
+
+    /// The number of events dropped so far because the queue was full.
+    pub fn dropped_events(&self) -> u64 {
+        unsafe { vtk_context_dropped_input_events(self.native_handle) }
+    }
+}
+
+/// An input event, see `VtkInputQueue::drain()`.
+#[derive(Copy, Clone, Debug, PartialEq)]
+pub struct VtkInputEvent {
+    /// When the event was received, on the `CLOCK_MONOTONIC` clock of the frame timings.
+    pub time: std::time::Duration,
+    pub kind: VtkInputEventKind,
+}
+
+#[derive(Copy, Clone, Debug, PartialEq)]
+pub enum VtkInputEventKind {
+    KeyPressed(Key),
+    KeyReleased(Key),
+    /// A held key repeated at the rate and delay configured by the compositor, timed by the event
+    /// loop rather than by rendering.
+    KeyRepeated(Key),
+    /// The keyboard focus entered a window of the context, with these keys already held.
+    KeyboardEntered(Key),
+    KeyboardLeft,
+    /// The pointer entered a window of the context at this position, in surface coordinates.
+    PointerEntered {
+        x: f32,
+        y: f32,
+    },
+    PointerLeft,
+    Pointer(VtkPointerFrame),
+}
+
+/// The pointer motion, scrolling and button changes of one or more reports of the pointing device.
+#[derive(Copy, Clone, Debug, Default, PartialEq)]
+pub struct VtkPointerFrame {
+    /// The position of the pointer at the end of the frame, in surface coordinates.
+    pub x: f32,
+    pub y: f32,
+    /// Unaccelerated relative motion, if the compositor supports it. Keeps being reported while
+    /// the pointer is locked with `VtkWindow::set_pointer_locked()`.
+    pub dx: f32,
+    pub dy: f32,
+    pub scroll_x: f32,
+    pub scroll_y: f32,
+    pub pressed: VtkPointerButtons,
+    pub released: VtkPointerButtons,
+}
+
+bitflags::bitflags! {
+    /// Pointer buttons, see `VtkPointerFrame`.
+    #[derive(Debug, Default, Clone, Copy, PartialEq, Eq, Hash)]
+    pub struct VtkPointerButtons: u32 {
+        const LEFT = VTK_POINTER_BUTTON_LEFT;
+        const RIGHT = VTK_POINTER_BUTTON_RIGHT;
+        const MIDDLE = VTK_POINTER_BUTTON_MIDDLE;
+        const SIDE = VTK_POINTER_BUTTON_SIDE;
+        const EXTRA = VTK_POINTER_BUTTON_EXTRA;
+    }
+}
+
+/// Which physical device to create a device on.
+///
+/// Automatic selection scores devices on type, supported features, queue families, memory size and
+/// presentation support, and is logged with the reason for the choice. It can be overridden with the
+/// `VTK_DEVICE` environment variable, holding a device index or part of a device name.
+#[derive(Clone, Debug, Default, PartialEq, Eq)]
+pub enum VtkDeviceSelection {
+    /// Use `VTK_DEVICE` if set, otherwise the highest scoring device.
+    #[default]
+    Automatic,
+    /// The device with this index in enumeration order.
+    Index(u32),
+    /// The first device whose name contains this string, ignoring case.
+    Name(String),
 }
 
 pub struct VtkDevice {
@@ -37,12 +379,312 @@ pub struct VtkDevice {
 unsafe impl Send for VtkDevice {}
 
 impl VtkDevice {
+    /// The name of the physical device in use.
+    pub fn name(&self) -> String {
+        let name = unsafe {
+            std::ffi::CStr::from_ptr((*self.native_handle).physical_device_name.as_ptr())
+        };
+        name.to_string_lossy().into_owned()
+    }
+
+    /// Whether windows render with dynamic rendering, which the device supports if it implements Vulkan 1.3, rather than
+    /// with a render pass and framebuffers.
+    pub fn dynamic_rendering(&self) -> bool {
+        unsafe { (*self.native_handle).dynamic_rendering }
+    }
+
+    /// Whether cull mode and primitive topology may be set per command list, with
+    /// `VtkCommandList::set_cull_mode()` and `VtkCommandList::set_primitive_topology()`. Requires
+    /// Vulkan 1.3.
+    pub fn extended_dynamic_state(&self) -> bool {
+        unsafe { (*self.native_handle).extended_dynamic_state }
+    }
+
     pub fn create_shader(&self, spirv_bytes: &[u8]) -> VtkShaderModule {
         let vulkan_handle = unsafe {
             vtk_device_create_shader(self.native_handle, spirv_bytes.as_ptr(), spirv_bytes.len())
         };
         VtkShaderModule { vulkan_handle }
     }
+
+    /// Destroy a shader module. Pipelines created from it are not affected.
+    pub fn destroy_shader(&self, shader: VtkShaderModule) {
+        unsafe { vtk_device_destroy_shader(self.native_handle, shader.vulkan_handle) };
+    }
+
+    /// Statistics on pipeline creation since the device was created.
+    pub fn pipeline_cache_stats(&self) -> VtkPipelineCacheStats {
+        let native = unsafe { vtk_device_pipeline_cache_stats(self.native_handle) };
+        VtkPipelineCacheStats {
+            loaded_bytes: native.loaded_bytes,
+            pipelines_created: native.pipelines_created,
+            cache_hits: native.creation_feedback.then_some(native.cache_hits),
+            cache_misses: native.creation_feedback.then_some(native.cache_misses),
+            creation_time: std::time::Duration::from_nanos(native.creation_nanoseconds),
+        }
+    }
+
+    /// Write the pipeline cache to disk.
+    ///
+    /// On Linux the event loop of the context does this once no pipeline missing from the cache has
+    /// been created for a second, if it is running. Elsewhere, or to persist the cache right away,
+    /// call this once the pipelines of the application have been created.
+    pub fn save_pipeline_cache(&self) {
+        unsafe { vtk_device_save_pipeline_cache(self.native_handle) };
+    }
+
+    /// Create a device local buffer, which may be filled using `upload_to_buffer()`.
+    pub fn create_buffer(&self, size: u64, usage: VtkBufferUsage) -> VtkBuffer {
+        self.buffer_allocator()
+            .create_buffer(size, usage, VtkMemoryLocation::DeviceLocal)
+    }
+
+    /// Destroy a buffer. It must no longer be used by any pending upload or frame.
+    pub fn destroy_buffer(&self, buffer: VtkBuffer) {
+        self.buffer_allocator().destroy_buffer(buffer);
+    }
+
+    /// The allocator of buffer memory of the device.
+    pub fn buffer_allocator(&self) -> VtkBufferAllocator {
+        VtkBufferAllocator {
+            device: self.native_handle,
+        }
+    }
+
+    /// Statistics on the device memory allocated by the device.
+    pub fn memory_stats(&self) -> VtkMemoryStats {
+        self.buffer_allocator().stats()
+    }
+
+    /// Copy data into a buffer at the given offset.
+    ///
+    /// The data is copied into a staging ring and transferred on the transfer queue, without
+    /// blocking rendering. The returned ticket can be waited on by a window before rendering with
+    /// the buffer, or by the CPU.
+    pub fn upload_to_buffer(
+        &self,
+        buffer: &VtkBuffer,
+        offset: u64,
+        data: &[u8],
+    ) -> VtkUploadTicket {
+        assert!(
+            offset
+                .checked_add(data.len() as u64)
+                .map_or(false, |end| end <= buffer.size),
+            "upload of {} bytes at offset {offset} outside of buffer of size {}",
+            data.len(),
+            buffer.size
+        );
+        let ticket = unsafe {
+            vtk_device_upload_buffer(
+                self.native_handle,
+                buffer.vk_buffer,
+                offset,
+                data.as_ptr(),
+                data.len(),
+            )
+        };
+        VtkUploadTicket(ticket)
+    }
+
+    /// Whether the transfer of an upload has completed on the GPU.
+    pub fn is_upload_complete(&self, ticket: VtkUploadTicket) -> bool {
+        unsafe { vtk_device_upload_complete(self.native_handle, ticket.0) }
+    }
+
+    /// Block until the transfer of an upload has completed on the GPU.
+    pub fn wait_for_upload(&self, ticket: VtkUploadTicket) {
+        unsafe { vtk_device_wait_for_upload(self.native_handle, ticket.0) };
+    }
+
+    /// Create a compute pipeline running the `main` function of a compute shader.
+    ///
+    /// The shader accesses `storage_buffer_count` storage buffers at bindings 0 and up of
+    /// descriptor set 0, and takes `push_constant_size` bytes of push constants.
+    pub fn create_compute_pipeline(
+        &self,
+        shader: &VtkShaderModule,
+        storage_buffer_count: u32,
+        push_constant_size: u32,
+    ) -> VtkComputePipeline {
+        assert!(
+            storage_buffer_count <= VTK_MAX_COMPUTE_STORAGE_BUFFERS,
+            "at most {VTK_MAX_COMPUTE_STORAGE_BUFFERS} storage buffers are supported"
+        );
+        assert!(
+            push_constant_size <= VTK_MAX_COMPUTE_PUSH_CONSTANT_SIZE && push_constant_size % 4 == 0,
+            "push constant size must be a multiple of 4 of at most {VTK_MAX_COMPUTE_PUSH_CONSTANT_SIZE}"
+        );
+        let native_handle = unsafe {
+            vtk_device_create_compute_pipeline(
+                self.native_handle,
+                shader.vulkan_handle,
+                storage_buffer_count,
+                push_constant_size,
+            )
+        };
+        VtkComputePipeline {
+            native_handle,
+            storage_buffer_count,
+            push_constant_size,
+        }
+    }
+
+    /// Destroy a compute pipeline. It must no longer be used by any pending dispatch.
+    pub fn destroy_compute_pipeline(&self, pipeline: VtkComputePipeline) {
+        unsafe { vtk_device_destroy_compute_pipeline(self.native_handle, pipeline.native_handle) };
+    }
+
+    /// Run a compute pipeline on the compute queue, overlapping with rendering.
+    ///
+    /// The dispatch starts once the frame and upload it waits for are done on the GPU, without
+    /// blocking the CPU. Windows can in turn make their frames wait for the returned ticket.
+    pub fn dispatch_compute(&self, dispatch: &VtkComputeDispatch) -> VtkComputeTicket {
+        let pipeline = dispatch.pipeline;
+        assert_eq!(
+            dispatch.buffers.len(),
+            pipeline.storage_buffer_count as usize,
+            "the number of buffers must match the storage buffers of the pipeline"
+        );
+        assert_eq!(
+            dispatch.push_constants.len(),
+            pipeline.push_constant_size as usize,
+            "the size of the push constants must match the pipeline"
+        );
+        let vk_buffers: Vec<VkBuffer> = dispatch
+            .buffers
+            .iter()
+            .map(|buffer| buffer.vk_buffer)
+            .collect();
+        let ticket = unsafe {
+            vtk_device_dispatch_compute(
+                self.native_handle,
+                pipeline.native_handle,
+                vk_buffers.as_ptr(),
+                dispatch.push_constants.as_ptr(),
+                dispatch.group_count[0],
+                dispatch.group_count[1],
+                dispatch.group_count[2],
+                dispatch.wait_for_frame.map_or(0, |ticket| ticket.0),
+                dispatch.wait_for_upload.map_or(0, |ticket| ticket.0),
+            )
+        };
+        VtkComputeTicket(ticket)
+    }
+
+    /// Whether a compute dispatch has completed on the GPU.
+    pub fn is_compute_complete(&self, ticket: VtkComputeTicket) -> bool {
+        unsafe { vtk_device_compute_complete(self.native_handle, ticket.0) }
+    }
+
+    /// Block until a compute dispatch has completed on the GPU.
+    pub fn wait_for_compute(&self, ticket: VtkComputeTicket) {
+        unsafe { vtk_device_wait_for_compute(self.native_handle, ticket.0) };
+    }
+}
+
+/// A compute pipeline created with `VtkDevice::create_compute_pipeline()`.
+pub struct VtkComputePipeline {
+    native_handle: *mut VtkComputePipelineNative,
+    storage_buffer_count: u32,
+    push_constant_size: u32,
+}
+
+unsafe impl Send for VtkComputePipeline {}
+
+/// A dispatch of a compute pipeline, see `VtkDevice::dispatch_compute()`.
+pub struct VtkComputeDispatch<'a> {
+    pub pipeline: &'a VtkComputePipeline,
+    /// Bound in order to the storage buffer bindings of the pipeline.
+    pub buffers: &'a [&'a VtkBuffer],
+    pub push_constants: &'a [u8],
+    /// The number of workgroups in each dimension.
+    pub group_count: [u32; 3],
+    /// A frame which must have finished rendering before the dispatch runs, if any.
+    pub wait_for_frame: Option<VtkFrameTicket>,
+    /// An upload which must have completed before the dispatch runs, if any.
+    pub wait_for_upload: Option<VtkUploadTicket>,
+}
+
+/// Identifies a compute dispatch. Tickets of later dispatches compare greater than earlier ones.
+#[derive(Copy, Clone, Debug, PartialEq, Eq, PartialOrd, Ord, Hash)]
+pub struct VtkComputeTicket(u64);
+
+/// Identifies a frame submitted for rendering, which compute dispatches can wait on.
+#[derive(Copy, Clone, Debug, PartialEq, Eq, PartialOrd, Ord, Hash)]
+pub struct VtkFrameTicket(u64);
+
+bitflags::bitflags! {
+    /// How a buffer created with `VtkDevice::create_buffer()` may be used.
+    #[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+    pub struct VtkBufferUsage: u32 {
+        const UNIFORM = 0x10;
+        const STORAGE = 0x20;
+        const INDEX = 0x40;
+        const VERTEX = 0x80;
+        const INDIRECT = 0x100;
+    }
+}
+
+/// A buffer, created by a `VtkBufferAllocator`.
+pub struct VtkBuffer {
+    vk_buffer: VkBuffer,
+    allocation: VtkMemoryAllocationNative,
+    size: u64,
+}
+
+unsafe impl Send for VtkBuffer {}
+
+impl VtkBuffer {
+    pub fn size(&self) -> u64 {
+        self.size
+    }
+
+    /// The buffer from `offset` on, for binding in command lists.
+    pub fn binding(&self, offset: u64) -> VtkBufferBinding {
+        VtkBufferBinding {
+            vk_buffer: self.vk_buffer,
+            offset,
+        }
+    }
+
+    /// The memory of the buffer, if it was created with `VtkMemoryLocation::HostVisible`.
+    ///
+    /// The memory is coherent, so writes are visible to the GPU without flushing - but the buffer
+    /// must not be written while in use by a frame or dispatch.
+    pub fn mapped_mut(&mut self) -> Option<&mut [u8]> {
+        let mapped = self.allocation.mapped.cast::<u8>();
+        if mapped.is_null() {
+            None
+        } else {
+            Some(unsafe { std::slice::from_raw_parts_mut(mapped, self.size as usize) })
+        }
+    }
+}
+
+/// Identifies an upload to the GPU. Tickets of later uploads compare greater than earlier ones,
+/// and completion of an upload implies completion of all earlier ones.
+#[derive(Copy, Clone, Debug, PartialEq, Eq, PartialOrd, Ord, Hash)]
+pub struct VtkUploadTicket(u64);
+
+/// Pipeline creation statistics, to compare cold starts with warm starts from a persisted cache.
+///
+/// The cache is stored per application under `$XDG_CACHE_HOME/vtk/` (`~/Library/Caches/vtk/` on
+/// macOS). The `VTK_PIPELINE_CACHE_PATH` environment variable overrides the location, and setting it
+/// to an empty string disables persistence.
+#[derive(Copy, Clone, Debug, Default, PartialEq, Eq)]
+pub struct VtkPipelineCacheStats {
+    /// Bytes of cache data loaded from disk, 0 on a cold start.
+    pub loaded_bytes: usize,
+    pub pipelines_created: u32,
+    /// Pipelines found in the cache, as reported by the driver. None if the device lacks pipeline
+    /// creation feedback (Vulkan 1.3 or `VK_EXT_pipeline_creation_feedback`).
+    pub cache_hits: Option<u32>,
+    /// Pipelines which had to be compiled, as reported by the driver. None if the device lacks
+    /// pipeline creation feedback.
+    pub cache_misses: Option<u32>,
+    /// Total time spent creating pipelines.
+    pub creation_time: std::time::Duration,
 }
 
 pub struct VtkWindow {
@@ -52,22 +694,1622 @@ pub struct VtkWindow {
 unsafe impl Send for VtkWindow {}
 
 impl VtkWindow {
+    /// Block until the compositor wants the next frame of the window, or until `timeout` has
+    /// passed, returning whether it does. Rendering each frame after waiting paces rendering to the
+    /// compositor, which wants no frames at all while the window is hidden - so the CPU and GPU
+    /// idle. Returns immediately for headless windows, and on macOS, where rendering is paced by
+    /// presentation alone.
+    pub fn wait_for_frame(&self, timeout: Option<std::time::Duration>) -> bool {
+        let timeout_ns = timeout.map_or(u64::MAX, |timeout| {
+            u64::try_from(timeout.as_nanos()).unwrap_or(u64::MAX)
+        });
+        unsafe { vtk_window_wait_for_frame(self.native_handle, timeout_ns) }
+    }
+
+    /// Lock the pointer in place while it is over the window, for camera controls driven by the
+    /// relative motion of `VtkPointerFrame`, or release it. Does nothing if the compositor does not
+    /// support locking the pointer.
+    #[cfg(all(target_os = "linux", not(target_os = "android")))]
+    pub fn set_pointer_locked(&self, locked: bool) {
+        unsafe { vtk_window_set_pointer_locked(self.native_handle, locked) };
+    }
+
+    /// Render a frame without draws of its own, the same as beginning and ending a frame.
     pub fn render(&mut self) {
         unsafe {
             vtk_render_frame(self.native_handle);
         }
     }
+
+    /// Begin recording the next frame, which is rendered and presented when the returned `VtkFrame`
+    /// is dropped.
+    ///
+    /// This waits for the frame which last used the frame resources to finish on the GPU, and
+    /// resets all its command buffers at once - so recording every frame anew is cheap.
+    pub fn begin_frame(&mut self) -> VtkFrame<'_> {
+        let vk_command_buffer = unsafe { vtk_window_begin_frame(self.native_handle) };
+        let extended_dynamic_state = self.extended_dynamic_state();
+        VtkFrame {
+            commands: VtkCommandList {
+                vk_command_buffer,
+                window_handle: self.native_handle,
+                extended_dynamic_state,
+                open_scopes: Default::default(),
+                recorder: None,
+            },
+            window: self,
+        }
+    }
+
+    /// The number of frames the CPU may record ahead of the GPU.
+    pub fn frames_in_flight(&self) -> u32 {
+        unsafe { (*self.native_handle).frames_in_flight }
+    }
+
+    /// Set the number of frames the CPU may record ahead of the GPU.
+    ///
+    /// More frames in flight increase throughput, at the cost of input latency. Panics if
+    /// `frames_in_flight` is not between 1 and `VTK_MAX_FRAMES_IN_FLIGHT`.
+    pub fn set_frames_in_flight(&mut self, frames_in_flight: u32) {
+        assert!(
+            (1..=VTK_MAX_FRAMES_IN_FLIGHT).contains(&frames_in_flight),
+            "frames_in_flight must be between 1 and {VTK_MAX_FRAMES_IN_FLIGHT}"
+        );
+        unsafe { vtk_window_set_frames_in_flight(self.native_handle, frames_in_flight) };
+    }
+
+    /// The scale from the logical size of the window to physical pixels preferred by the compositor,
+    /// like 1.5 on an output scaled to 150%. 1 for headless windows, and without fractional scale
+    /// support in the compositor.
+    #[cfg(all(target_os = "linux", not(target_os = "android")))]
+    pub fn surface_scale(&self) -> f32 {
+        unsafe { vtk_window_surface_scale(self.native_handle) }
+    }
+
+    /// The size of the swap chain images relative to the physical pixel size of the window.
+    #[cfg(all(target_os = "linux", not(target_os = "android")))]
+    pub fn render_scale(&self) -> f32 {
+        unsafe { (*self.native_handle).render_scale }
+    }
+
+    /// Render at `render_scale` times the physical pixel size of the window from the next frame
+    /// on, letting the compositor scale frames to the window. Below 1 trades sharpness for fill
+    /// rate, as on 4K outputs - and the default of 1 renders at exactly the physical pixel size on
+    /// outputs with fractional scales. Has no effect if the compositor cannot scale surfaces.
+    ///
+    /// Panics if `render_scale` is not above 0 and at most 4.
+    #[cfg(all(target_os = "linux", not(target_os = "android")))]
+    pub fn set_render_scale(&mut self, render_scale: f32) {
+        assert!(
+            render_scale > 0.0 && render_scale <= 4.0,
+            "render_scale must be above 0 and at most 4"
+        );
+        unsafe { vtk_window_set_render_scale(self.native_handle, render_scale) };
+    }
+
+    /// Request a present mode and number of swap chain images, recreating the swap chain.
+    ///
+    /// An `image_count` of 0 uses the minimum supported by the surface. Unsupported present modes
+    /// fall back to a supported one, and the image count is clamped to the surface limits - the
+    /// configuration actually chosen is returned.
+    pub fn configure_swap_chain(
+        &mut self,
+        present_mode: VtkPresentMode,
+        image_count: u32,
+    ) -> VtkSwapChainConfig {
+        unsafe {
+            vtk_window_configure_swap_chain(
+                self.native_handle,
+                present_mode.to_native(),
+                image_count,
+            )
+        };
+        self.swap_chain_config()
+    }
+
+    /// The configuration of the current swap chain.
+    pub fn swap_chain_config(&self) -> VtkSwapChainConfig {
+        let native = unsafe { &*self.native_handle };
+        VtkSwapChainConfig {
+            present_mode: VtkPresentMode::from_native(native.vk_present_mode),
+            image_count: u32::from(native.num_swap_chain_images),
+        }
+    }
+
+    /// Make rendered frames wait on the GPU for an upload to complete before using its data.
+    ///
+    /// Only vertex input and shader stages wait, so rendering not depending on the upload is not
+    /// delayed by it.
+    pub fn wait_for_upload(&mut self, ticket: VtkUploadTicket) {
+        unsafe { vtk_window_wait_for_upload(self.native_handle, ticket.0) };
+    }
+
+    /// Make rendered frames wait on the GPU for a compute dispatch to complete before using its
+    /// results, in the same way as `wait_for_upload()`.
+    pub fn wait_for_compute(&mut self, ticket: VtkComputeTicket) {
+        unsafe { vtk_window_wait_for_compute(self.native_handle, ticket.0) };
+    }
+
+    /// The ticket of the latest frame submitted for rendering, or `None` before the first frame.
+    pub fn last_frame_ticket(&self) -> Option<VtkFrameTicket> {
+        match unsafe { (*self.native_handle).frame_ticket } {
+            0 => None,
+            ticket => Some(VtkFrameTicket(ticket)),
+        }
+    }
+
+    /// Allocate `size` bytes of dynamic data for the next frame - vertices, indices, uniforms -
+    /// directly in a persistently mapped ring buffer, so no memory allocation or copy is needed.
+    ///
+    /// The data may be written until the frame is rendered - by `render()`, or when the `VtkFrame`
+    /// being recorded is dropped - and its space is reused once the GPU has finished that frame. The offset is suitably aligned for any buffer binding. Blocks while the
+    /// ring is full of data of frames in flight, and panics if the data of the frame alone does not
+    /// fit.
+    pub fn allocate_frame_data(&self, size: usize) -> VtkFrameData<'_, u8> {
+        let (offset, ptr) = self.allocate_frame_data_raw(size, 1);
+        VtkFrameData {
+            vk_buffer: unsafe { (*self.native_handle).vk_frame_data_buffer },
+            offset,
+            data: unsafe { std::slice::from_raw_parts_mut(ptr.cast::<u8>(), size) },
+        }
+    }
+
+    /// Allocate dynamic data for `len` values of `T` for the next frame, as `allocate_frame_data()`.
+    pub fn allocate_frame_slice<T: Copy>(
+        &self,
+        len: usize,
+    ) -> VtkFrameData<'_, std::mem::MaybeUninit<T>> {
+        let size = len
+            .checked_mul(std::mem::size_of::<T>())
+            .expect("frame data size overflow");
+        let (offset, ptr) = self.allocate_frame_data_raw(size, std::mem::align_of::<T>());
+        VtkFrameData {
+            vk_buffer: unsafe { (*self.native_handle).vk_frame_data_buffer },
+            offset,
+            data: unsafe { std::slice::from_raw_parts_mut(ptr.cast(), len) },
+        }
+    }
+
+    /// GPU timings of the latest frame to have finished rendering, or `None` if none has yet or
+    /// the device does not support timestamps.
+    ///
+    /// Timings are read back without waiting, `frames_in_flight()` frames after the frame was
+    /// submitted. The first scope, `"frame"`, covers all commands of the frame - compare it with the
+    /// CPU time per frame to tell whether rendering is GPU bound. The scopes of command lists, from
+    /// `VtkCommandList::begin_scope()`, follow those of the frame.
+    pub fn gpu_frame_timings(&self) -> Option<VtkGpuFrameTimings> {
+        let native = unsafe { &(*self.native_handle).gpu_frame_timings };
+        if native.frame_number == 0 {
+            return None;
+        }
+        let scopes = native.scopes[..native.scope_count as usize]
+            .iter()
+            .map(|scope| VtkGpuScopeTiming {
+                name: unsafe { std::ffi::CStr::from_ptr(scope.name) }
+                    .to_str()
+                    .unwrap_or("?"),
+                depth: scope.depth,
+                start: std::time::Duration::from_nanos(scope.start_ns as u64),
+                duration: std::time::Duration::from_nanos(scope.duration_ns as u64),
+            })
+            .collect();
+        Some(VtkGpuFrameTimings {
+            frame_number: native.frame_number,
+            scopes,
+        })
+    }
+
+    /// When the most recent frames were shown on screen, oldest first, as reported by the
+    /// compositor some time after they were presented. Empty if the compositor does not support
+    /// `wp_presentation`, and for headless windows.
+    #[cfg(all(target_os = "linux", not(target_os = "android")))]
+    pub fn presentations(&self) -> Vec<VtkPresentation> {
+        let mut records: Vec<VtkPresentationNative> =
+            vec![unsafe { std::mem::zeroed() }; VTK_PRESENTATION_HISTORY as usize];
+        let count = unsafe {
+            vtk_window_copy_presentations(
+                self.native_handle,
+                records.as_mut_ptr(),
+                VTK_PRESENTATION_HISTORY,
+            )
+        };
+        records.truncate(count as usize);
+        records
+            .iter()
+            .map(|record| VtkPresentation {
+                frame_number: record.frame_number,
+                presented_at: (record.presented_ns != 0)
+                    .then(|| std::time::Duration::from_nanos(record.presented_ns)),
+                refresh_interval: (record.refresh_ns != 0)
+                    .then(|| std::time::Duration::from_nanos(u64::from(record.refresh_ns))),
+                flags: VtkPresentationFlags::from_bits_retain(record.flags),
+                sequence: record.sequence,
+                missed_vblanks: record.missed_vblanks,
+            })
+            .collect()
+    }
+
+    /// Totals of the frames of the window reported by the compositor so far, see
+    /// `presentations()`.
+    #[cfg(all(target_os = "linux", not(target_os = "android")))]
+    pub fn presentation_stats(&self) -> VtkPresentationStats {
+        let stats = unsafe { vtk_window_presentation_stats(self.native_handle) };
+        VtkPresentationStats {
+            presented_frames: stats.presented_count,
+            discarded_frames: stats.discarded_count,
+            missed_vblanks: stats.missed_vblanks,
+        }
+    }
+
+    /// CPU time statistics of the phases of rendering frames, over the most recent frames.
+    ///
+    /// Shows whether rendering is blocked on the GPU (`FenceWait`), on vertical blank (`Acquire`)
+    /// or on the driver (`Submit` and `Present`).
+    pub fn frame_stats(&self) -> VtkFrameStats {
+        let mut timings: Vec<VtkFrameTimingNative> =
+            vec![unsafe { std::mem::zeroed() }; VTK_FRAME_TIMING_HISTORY as usize];
+        let count = unsafe {
+            vtk_window_copy_frame_timings(
+                self.native_handle,
+                timings.as_mut_ptr(),
+                VTK_FRAME_TIMING_HISTORY,
+            )
+        };
+        timings.truncate(count as usize);
+
+        let mut samples: Vec<u64> = timings.iter().map(|timing| timing.total_ns).collect();
+        let total = VtkDurationStats::from_nanos(&mut samples);
+        let phases = VtkFramePhase::ALL.map(|phase| {
+            samples.clear();
+            samples.extend(
+                timings
+                    .iter()
+                    .map(|timing| timing.phase_ns[phase.to_native() as usize]),
+            );
+            VtkDurationStats::from_nanos(&mut samples)
+        });
+        VtkFrameStats {
+            frame_count: timings.len(),
+            total,
+            phases,
+        }
+    }
+
+    /// Create a graphics pipeline drawing triangles to the surface of the window. Viewport and
+    /// scissor, and cull mode and topology with `VtkDevice::extended_dynamic_state()`, are set
+    /// per command list rather than baked into the pipeline, so it survives resizes and may draw in
+    /// any window with the same surface format.
+    pub fn create_graphics_pipeline(&self, desc: &VtkGraphicsPipelineDesc) -> VtkGraphicsPipeline {
+        assert!(
+            desc.vertex_attributes.len() <= VTK_MAX_VERTEX_ATTRIBUTES as usize,
+            "at most {VTK_MAX_VERTEX_ATTRIBUTES} vertex attributes are supported"
+        );
+        assert!(
+            desc.push_constant_size <= VTK_MAX_GRAPHICS_PUSH_CONSTANT_SIZE
+                && desc.push_constant_size % 4 == 0,
+            "push constant size must be a multiple of 4 of at most {VTK_MAX_GRAPHICS_PUSH_CONSTANT_SIZE}"
+        );
+        let vertex_attributes: Vec<VtkVertexAttributeNative> = desc
+            .vertex_attributes
+            .iter()
+            .map(|attribute| VtkVertexAttributeNative {
+                format: attribute.format.to_native(),
+                offset: attribute.offset,
+            })
+            .collect();
+        let native_handle = unsafe {
+            vtk_window_create_graphics_pipeline(
+                self.native_handle,
+                desc.vertex_shader.vulkan_handle,
+                desc.fragment_shader.vulkan_handle,
+                desc.vertex_stride,
+                vertex_attributes.len() as u32,
+                vertex_attributes.as_ptr(),
+                desc.push_constant_size,
+            )
+        };
+        VtkGraphicsPipeline {
+            native_handle,
+            push_constant_size: desc.push_constant_size,
+        }
+    }
+
+    /// Destroy a graphics pipeline. It must no longer be used by any frame in flight.
+    pub fn destroy_graphics_pipeline(&self, pipeline: VtkGraphicsPipeline) {
+        unsafe { vtk_window_destroy_graphics_pipeline(self.native_handle, pipeline.native_handle) };
+    }
+
+    /// Create a recorder of draw commands for the window, to be used by one thread at a time.
+    /// Dropping the recorder destroys it once the frames in flight are done with its commands.
+    pub fn create_recorder(&self) -> VtkRecorder {
+        VtkRecorder {
+            native_handle: unsafe { vtk_window_create_recorder(self.native_handle) },
+            window_handle: self.native_handle,
+            extended_dynamic_state: self.extended_dynamic_state(),
+        }
+    }
+
+    fn extended_dynamic_state(&self) -> bool {
+        unsafe { (*(*self.native_handle).vtk_device).extended_dynamic_state }
+    }
+
+    // Allocations never overlap each other or the data of frames in flight, so handing out mutable
+    // slices borrowing the window immutably is sound - rendering needs a mutable borrow.
+    fn allocate_frame_data_raw(&self, size: usize, alignment: usize) -> (u64, *mut u8) {
+        let mut offset = 0;
+        let ptr = unsafe {
+            vtk_window_allocate_frame_data(
+                self.native_handle,
+                size as u64,
+                alignment as u64,
+                &mut offset,
+            )
+        };
+        assert!(
+            !ptr.is_null(),
+            "out of frame data space allocating {size} bytes"
+        );
+        (offset, ptr.cast())
+    }
+}
+
+/// GPU timings of a rendered frame, from `VtkWindow::gpu_frame_timings()`.
+#[derive(Clone, Debug, PartialEq)]
+pub struct VtkGpuFrameTimings {
+    /// The number of the frame, counting from 1 for the first frame rendered by the window.
+    pub frame_number: u64,
+    /// The timed scopes: the frame, its surface render pass, and then those of its command lists in
+    /// the order they were begun.
+    pub scopes: Vec<VtkGpuScopeTiming>,
+}
+
+impl VtkGpuFrameTimings {
+    /// The GPU time taken by the frame as a whole.
+    pub fn gpu_time(&self) -> std::time::Duration {
+        self.scopes
+            .iter()
+            .filter(|scope| scope.depth == 0)
+            .map(|scope| scope.start + scope.duration)
+            .max()
+            .unwrap_or_default()
+    }
+}
+
+/// The GPU time taken by a named scope of the commands of a frame.
+#[derive(Clone, Debug, PartialEq)]
+pub struct VtkGpuScopeTiming {
+    pub name: &'static str,
+    /// The number of scopes enclosing this one.
+    pub depth: u32,
+    /// Time from the start of the frame to the start of the scope.
+    pub start: std::time::Duration,
+    pub duration: std::time::Duration,
+}
+
+/// A phase of rendering a frame, timed on the CPU.
+#[derive(Copy, Clone, Debug, PartialEq, Eq, Hash)]
+pub enum VtkFramePhase {
+    /// Waiting for the GPU to finish the frame which last used the frame resources.
+    FenceWait,
+    /// Acquiring a swap chain image, which blocks on vertical blank with `VtkPresentMode::Fifo`.
+    Acquire,
+    /// Resetting the fence and command pool of the frame.
+    Reset,
+    /// Recording the frame, including the draws recorded between `VtkWindow::begin_frame()` and
+    /// dropping the `VtkFrame`.
+    Record,
+    Submit,
+    Present,
+    /// Recreating the swap chain when it is out of date or the window has been resized.
+    Recreate,
+}
+
+impl VtkFramePhase {
+    pub const ALL: [VtkFramePhase; 7] = [
+        VtkFramePhase::FenceWait,
+        VtkFramePhase::Acquire,
+        VtkFramePhase::Reset,
+        VtkFramePhase::Record,
+        VtkFramePhase::Submit,
+        VtkFramePhase::Present,
+        VtkFramePhase::Recreate,
+    ];
+
+    fn to_native(self) -> VtkFramePhaseNative {
+        match self {
+            VtkFramePhase::FenceWait => VtkFramePhaseNative_VTK_FRAME_PHASE_FENCE_WAIT,
+            VtkFramePhase::Acquire => VtkFramePhaseNative_VTK_FRAME_PHASE_ACQUIRE,
+            VtkFramePhase::Reset => VtkFramePhaseNative_VTK_FRAME_PHASE_RESET,
+            VtkFramePhase::Record => VtkFramePhaseNative_VTK_FRAME_PHASE_RECORD,
+            VtkFramePhase::Submit => VtkFramePhaseNative_VTK_FRAME_PHASE_SUBMIT,
+            VtkFramePhase::Present => VtkFramePhaseNative_VTK_FRAME_PHASE_PRESENT,
+            VtkFramePhase::Recreate => VtkFramePhaseNative_VTK_FRAME_PHASE_RECREATE,
+        }
+    }
+}
+
+/// Statistics of a duration measured over a number of frames.
+#[derive(Copy, Clone, Debug, Default, PartialEq, Eq)]
+pub struct VtkDurationStats {
+    pub min: std::time::Duration,
+    pub avg: std::time::Duration,
+    pub p50: std::time::Duration,
+    pub p99: std::time::Duration,
+    pub max: std::time::Duration,
+}
+
+impl VtkDurationStats {
+    fn from_nanos(samples: &mut [u64]) -> Self {
+        if samples.is_empty() {
+            return Self::default();
+        }
+        samples.sort_unstable();
+        // Nearest rank percentiles.
+        let percentile = |p: usize| {
+            let rank = (samples.len() * p).div_ceil(100).max(1);
+            std::time::Duration::from_nanos(samples[rank - 1])
+        };
+        let sum: u128 = samples.iter().map(|&sample| u128::from(sample)).sum();
+        Self {
+            min: std::time::Duration::from_nanos(samples[0]),
+            avg: std::time::Duration::from_nanos((sum / samples.len() as u128) as u64),
+            p50: percentile(50),
+            p99: percentile(99),
+            max: std::time::Duration::from_nanos(samples[samples.len() - 1]),
+        }
+    }
+}
+
+/// When a frame was shown on screen, from `VtkWindow::presentations()`.
+#[cfg(all(target_os = "linux", not(target_os = "android")))]
+#[derive(Copy, Clone, Debug, PartialEq, Eq)]
+pub struct VtkPresentation {
+    /// The number of the frame, counting frames submitted by the window.
+    pub frame_number: u64,
+    /// When the frame turned into light, on the `CLOCK_MONOTONIC` clock of the frame timings -
+    /// `None` if the compositor discarded the frame without showing it.
+    pub presented_at: Option<std::time::Duration>,
+    /// The refresh interval of the output, `None` if it is variable or unknown.
+    pub refresh_interval: Option<std::time::Duration>,
+    pub flags: VtkPresentationFlags,
+    /// The vblank counter of the output, with `VtkPresentationFlags::VSYNC`.
+    pub sequence: u64,
+    /// The vblanks since the previously presented frame which showed no new frame. For a window
+    /// rendering every frame the compositor wants, anything but 0 is a visible stutter.
+    pub missed_vblanks: u32,
+}
+
+#[cfg(all(target_os = "linux", not(target_os = "android")))]
+bitflags::bitflags! {
+    /// How a frame was presented, see `VtkPresentation`.
+    #[derive(Debug, Default, Clone, Copy, PartialEq, Eq, Hash)]
+    pub struct VtkPresentationFlags: u32 {
+        /// Synchronized to the vertical blank of the output, so the sequence counts vblanks.
+        const VSYNC = VTK_PRESENTATION_VSYNC;
+        /// The timestamp comes from the display hardware.
+        const HW_CLOCK = VTK_PRESENTATION_HW_CLOCK;
+        const HW_COMPLETION = VTK_PRESENTATION_HW_COMPLETION;
+        /// The frame was scanned out directly, without composition.
+        const ZERO_COPY = VTK_PRESENTATION_ZERO_COPY;
+    }
+}
+
+/// Totals of presented frames, from `VtkWindow::presentation_stats()`.
+#[cfg(all(target_os = "linux", not(target_os = "android")))]
+#[derive(Copy, Clone, Debug, Default, PartialEq, Eq)]
+pub struct VtkPresentationStats {
+    pub presented_frames: u64,
+    pub discarded_frames: u64,
+    /// Vblanks which showed no new frame, summed over presented frames.
+    pub missed_vblanks: u64,
+}
+
+/// CPU time statistics of rendering recent frames, from `VtkWindow::frame_stats()`.
+#[derive(Clone, Debug, Default, PartialEq, Eq)]
+pub struct VtkFrameStats {
+    /// The number of frames the statistics cover, at most `VTK_FRAME_TIMING_HISTORY`.
+    pub frame_count: usize,
+    /// Time spent rendering the frame as a whole, from beginning the frame to presenting it.
+    pub total: VtkDurationStats,
+    phases: [VtkDurationStats; 7],
+}
+
+impl VtkFrameStats {
+    pub fn phase(&self, phase: VtkFramePhase) -> VtkDurationStats {
+        self.phases[phase.to_native() as usize]
+    }
+}
+
+/// Dynamic data of the next frame, from `VtkWindow::allocate_frame_data()`.
+pub struct VtkFrameData<'a, T> {
+    /// The buffer containing the data, usable as vertex, index, uniform, storage or indirect
+    /// buffer.
+    pub vk_buffer: VkBuffer,
+    /// The offset of the data in `vk_buffer`.
+    pub offset: u64,
+    /// The mapped memory of the data.
+    pub data: &'a mut [T],
+}
+
+impl<T> VtkFrameData<'_, T> {
+    /// The data, for binding in command lists.
+    pub fn binding(&self) -> VtkBufferBinding {
+        VtkBufferBinding {
+            vk_buffer: self.vk_buffer,
+            offset: self.offset,
+        }
+    }
+}
+
+/// The format of a vertex attribute.
+#[derive(Copy, Clone, Debug, PartialEq, Eq)]
+pub enum VtkVertexFormat {
+    Float,
+    Float2,
+    Float3,
+    Float4,
+    /// Four bytes normalized to [0, 1], typically a color.
+    UNorm8x4,
+}
+
+impl VtkVertexFormat {
+    fn to_native(self) -> VkFormat {
+        match self {
+            Self::Float => VkFormat_VK_FORMAT_R32_SFLOAT,
+            Self::Float2 => VkFormat_VK_FORMAT_R32G32_SFLOAT,
+            Self::Float3 => VkFormat_VK_FORMAT_R32G32B32_SFLOAT,
+            Self::Float4 => VkFormat_VK_FORMAT_R32G32B32A32_SFLOAT,
+            Self::UNorm8x4 => VkFormat_VK_FORMAT_R8G8B8A8_UNORM,
+        }
+    }
+}
+
+/// The faces culled by graphics pipelines, see `VtkCommandList::set_cull_mode()`.
+#[derive(Copy, Clone, Debug, PartialEq, Eq)]
+pub enum VtkCullMode {
+    None,
+    Front,
+    Back,
+}
+
+impl VtkCullMode {
+    fn to_native(self) -> VtkCullModeNative {
+        match self {
+            Self::None => VtkCullModeNative_VTK_CULL_MODE_NONE,
+            Self::Front => VtkCullModeNative_VTK_CULL_MODE_FRONT,
+            Self::Back => VtkCullModeNative_VTK_CULL_MODE_BACK,
+        }
+    }
+}
+
+/// The primitives drawn by graphics pipelines, see `VtkCommandList::set_primitive_topology()`.
+#[derive(Copy, Clone, Debug, PartialEq, Eq)]
+pub enum VtkPrimitiveTopology {
+    TriangleList,
+    TriangleStrip,
+}
+
+impl VtkPrimitiveTopology {
+    fn to_native(self) -> VtkPrimitiveTopologyNative {
+        match self {
+            Self::TriangleList => VtkPrimitiveTopologyNative_VTK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+            Self::TriangleStrip => VtkPrimitiveTopologyNative_VTK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP,
+        }
+    }
+}
+
+/// A vertex attribute of a graphics pipeline, at the location of its index in
+/// `VtkGraphicsPipelineDesc::vertex_attributes`.
+#[derive(Copy, Clone, Debug, PartialEq, Eq)]
+pub struct VtkVertexAttribute {
+    pub format: VtkVertexFormat,
+    /// Byte offset of the attribute within a vertex.
+    pub offset: u32,
+}
+
+/// The description of a graphics pipeline, see `VtkWindow::create_graphics_pipeline()`.
+pub struct VtkGraphicsPipelineDesc<'a> {
+    pub vertex_shader: &'a VtkShaderModule,
+    pub fragment_shader: &'a VtkShaderModule,
+    /// Bytes per vertex of the interleaved vertices of the vertex buffer.
+    pub vertex_stride: u32,
+    pub vertex_attributes: &'a [VtkVertexAttribute],
+    /// Bytes of push constants, visible to both shaders.
+    pub push_constant_size: u32,
+}
+
+/// A graphics pipeline created with `VtkWindow::create_graphics_pipeline()`.
+pub struct VtkGraphicsPipeline {
+    native_handle: *mut VtkGraphicsPipelineNative,
+    push_constant_size: u32,
+}
+
+unsafe impl Send for VtkGraphicsPipeline {}
+unsafe impl Sync for VtkGraphicsPipeline {}
+
+/// Records draw commands for the frames of a window, with command pools of its own so that
+/// recorders on different threads do not contend. Created with `VtkWindow::create_recorder()`, and
+/// destroyed when dropped - its command pools are freed by the window once the frames in flight
+/// are done with them, so dropping never blocks.
+pub struct VtkRecorder {
+    native_handle: *mut VtkRecorderNative,
+    // Windows are never destroyed, so the recorder may outlive any borrow of its window.
+    window_handle: *mut VtkWindowNative,
+    extended_dynamic_state: bool,
+}
+
+unsafe impl Send for VtkRecorder {}
+
+impl VtkRecorder {
+    /// Begin a command list drawing in `frame`, with viewport and scissor covering the window, no
+    /// culling and triangle lists. The command lists of a frame execute sorted by `order`, and
+    /// those of equal order in the order they were finished. Use `VtkFrame::record_parallel()` to
+    /// record on several threads.
+    ///
+    /// # Panics
+    /// If `frame` is not a frame of the window the recorder was created for.
+    pub fn begin<'f>(&'f mut self, frame: &'f VtkFrame<'_>, order: u32) -> VtkCommandList<'f> {
+        frame.check_recorder(self);
+        self.begin_in_frame(order)
+    }
+
+    // The caller borrows the frame of the window for as long as the command list lives, so the
+    // window does not render concurrently.
+    fn begin_in_frame(&mut self, order: u32) -> VtkCommandList<'_> {
+        VtkCommandList {
+            vk_command_buffer: unsafe { vtk_recorder_begin(self.native_handle) },
+            window_handle: self.window_handle,
+            extended_dynamic_state: self.extended_dynamic_state,
+            open_scopes: Default::default(),
+            recorder: Some((self, order)),
+        }
+    }
+}
+
+impl Drop for VtkRecorder {
+    fn drop(&mut self) {
+        unsafe { vtk_window_destroy_recorder(self.window_handle, self.native_handle) };
+    }
+}
+
+/// Draw commands for a frame, from `VtkRecorder::begin()` or `VtkFrame::commands()`.
+/// Command lists of recorders are finished when dropped.
+pub struct VtkCommandList<'a> {
+    vk_command_buffer: VkCommandBuffer,
+    window_handle: *mut VtkWindowNative,
+    extended_dynamic_state: bool,
+    /// The GPU timer scopes begun and not yet ended, innermost last.
+    open_scopes: std::cell::RefCell<Vec<u32>>,
+    /// The recorder of the list and its order, none for the draws of the frame itself.
+    recorder: Option<(&'a mut VtkRecorder, u32)>,
+}
+
+impl VtkCommandList<'_> {
+    /// Begin timing a named scope of the following commands on the GPU, reported by
+    /// `VtkWindow::gpu_frame_timings()` within the `"surface render pass"` scope. Scopes nest, and
+    /// are ended with `end_scope()` - or when the command list is finished.
+    ///
+    /// A frame times at most `VTK_MAX_GPU_TIMER_SCOPES` scopes, two of which are its own. Scopes
+    /// beyond that, and all scopes on devices without timestamps, are not timed.
+    pub fn begin_scope(&self, name: &'static std::ffi::CStr) {
+        let depth = self.open_scopes.borrow().len() as u32;
+        let scope = unsafe {
+            vtk_command_begin_gpu_scope(
+                self.window_handle,
+                self.vk_command_buffer,
+                name.as_ptr(),
+                depth,
+            )
+        };
+        self.open_scopes.borrow_mut().push(scope);
+    }
+
+    /// End the innermost scope begun with `begin_scope()`.
+    ///
+    /// # Panics
+    /// If no scope is open.
+    pub fn end_scope(&self) {
+        let scope = self
+            .open_scopes
+            .borrow_mut()
+            .pop()
+            .expect("no GPU timer scope to end");
+        unsafe { vtk_command_end_gpu_scope(self.window_handle, self.vk_command_buffer, scope) };
+    }
+
+    fn end_open_scopes(&self) {
+        while !self.open_scopes.borrow().is_empty() {
+            self.end_scope();
+        }
+    }
+
+    pub fn bind_pipeline(&self, pipeline: &VtkGraphicsPipeline) {
+        unsafe {
+            vtk_command_bind_graphics_pipeline(self.vk_command_buffer, pipeline.native_handle)
+        };
+    }
+
+    /// Bind the buffer the vertex attributes are read from.
+    pub fn bind_vertex_buffer(&self, binding: VtkBufferBinding) {
+        unsafe {
+            vtk_command_bind_vertex_buffer(
+                self.vk_command_buffer,
+                binding.vk_buffer,
+                binding.offset,
+            )
+        };
+    }
+
+    /// Bind a buffer of `u32` indices.
+    pub fn bind_index_buffer(&self, binding: VtkBufferBinding) {
+        unsafe {
+            vtk_command_bind_index_buffer(self.vk_command_buffer, binding.vk_buffer, binding.offset)
+        };
+    }
+
+    /// Set the first `data.len()` bytes of the push constants of the pipeline.
+    pub fn push_constants(&self, pipeline: &VtkGraphicsPipeline, data: &[u8]) {
+        assert!(
+            data.len() <= pipeline.push_constant_size as usize && data.len() % 4 == 0,
+            "push constants must be a multiple of 4 bytes, within the push constants of the pipeline"
+        );
+        unsafe {
+            vtk_command_push_constants(
+                self.vk_command_buffer,
+                pipeline.native_handle,
+                data.as_ptr(),
+                data.len() as u32,
+            )
+        };
+    }
+
+    /// Set the viewport, in pixels from the top left corner of the window.
+    pub fn set_viewport(&self, x: f32, y: f32, width: f32, height: f32) {
+        unsafe { vtk_command_set_viewport(self.vk_command_buffer, x, y, width, height) };
+    }
+
+    /// Set the scissor rectangle, in pixels from the top left corner of the window.
+    pub fn set_scissor(&self, x: i32, y: i32, width: u32, height: u32) {
+        unsafe { vtk_command_set_scissor(self.vk_command_buffer, x, y, width, height) };
+    }
+
+    /// Set the faces culled by the following draws, front faces winding clockwise if
+    /// `front_clockwise`.
+    ///
+    /// # Panics
+    /// If the device lacks `VtkDevice::extended_dynamic_state()`.
+    pub fn set_cull_mode(&self, cull_mode: VtkCullMode, front_clockwise: bool) {
+        assert!(
+            self.extended_dynamic_state,
+            "the device lacks extended dynamic state"
+        );
+        unsafe {
+            vtk_command_set_cull_mode(
+                self.vk_command_buffer,
+                cull_mode.to_native(),
+                front_clockwise,
+            )
+        };
+    }
+
+    /// Set the primitives drawn by the following draws.
+    ///
+    /// # Panics
+    /// If the device lacks `VtkDevice::extended_dynamic_state()`.
+    pub fn set_primitive_topology(&self, topology: VtkPrimitiveTopology) {
+        assert!(
+            self.extended_dynamic_state,
+            "the device lacks extended dynamic state"
+        );
+        unsafe { vtk_command_set_primitive_topology(self.vk_command_buffer, topology.to_native()) };
+    }
+
+    pub fn draw(&self, vertices: std::ops::Range<u32>, instances: std::ops::Range<u32>) {
+        unsafe {
+            vtk_command_draw(
+                self.vk_command_buffer,
+                vertices.end - vertices.start,
+                instances.end - instances.start,
+                vertices.start,
+                instances.start,
+            )
+        };
+    }
+
+    pub fn draw_indexed(
+        &self,
+        indices: std::ops::Range<u32>,
+        vertex_offset: i32,
+        instances: std::ops::Range<u32>,
+    ) {
+        unsafe {
+            vtk_command_draw_indexed(
+                self.vk_command_buffer,
+                indices.end - indices.start,
+                instances.end - instances.start,
+                indices.start,
+                vertex_offset,
+                instances.start,
+            )
+        };
+    }
+}
+
+impl Drop for VtkCommandList<'_> {
+    fn drop(&mut self) {
+        if let Some((recorder, order)) = &self.recorder {
+            self.end_open_scopes();
+            unsafe { vtk_recorder_end(recorder.native_handle, self.vk_command_buffer, *order) };
+        }
+    }
+}
+
+/// A frame being recorded, from `VtkWindow::begin_frame()`. Rendered and presented when dropped.
+///
+/// Dereferences to the window, so that frame data can be allocated and draws recorded in parallel
+/// while the frame is being recorded. If the swap chain turns out to be out of date when the frame
+/// is rendered, the frame is dropped along with the command lists recorded for it.
+pub struct VtkFrame<'a> {
+    window: &'a mut VtkWindow,
+    commands: VtkCommandList<'a>,
+}
+
+impl<'a> VtkFrame<'a> {
+    /// The draws of the frame itself, executed before the command lists of recorders.
+    pub fn commands(&self) -> &VtkCommandList<'a> {
+        &self.commands
+    }
+
+    /// Record draws for the frame in parallel, on a scoped thread per recorder.
+    ///
+    /// `items` is split into contiguous chunks, one per recorder, and `record` is called with a
+    /// command list and the chunk on each thread. The command lists execute in the order of their
+    /// chunks, so draws execute in the order of `items` as if recorded serially.
+    pub fn record_parallel<T: Sync>(
+        &self,
+        recorders: &mut [VtkRecorder],
+        items: &[T],
+        record: impl Fn(&VtkCommandList, &[T]) + Sync,
+    ) {
+        if recorders.is_empty() || items.is_empty() {
+            return;
+        }
+        for recorder in recorders.iter() {
+            self.check_recorder(recorder);
+        }
+        let chunk_size = items.len().div_ceil(recorders.len());
+        let record = &record;
+        std::thread::scope(|scope| {
+            for (order, (recorder, chunk)) in recorders
+                .iter_mut()
+                .zip(items.chunks(chunk_size))
+                .enumerate()
+            {
+                // The frame stays borrowed until every thread has finished its command list.
+                scope.spawn(move || record(&recorder.begin_in_frame(order as u32), chunk));
+            }
+        });
+    }
+
+    fn check_recorder(&self, recorder: &VtkRecorder) {
+        assert!(
+            recorder.window_handle == self.window.native_handle,
+            "the recorder belongs to another window"
+        );
+    }
+
+    /// Render and present the frame, the same as dropping it.
+    pub fn end(self) {}
+}
+
+impl std::ops::Deref for VtkFrame<'_> {
+    type Target = VtkWindow;
+
+    fn deref(&self) -> &VtkWindow {
+        self.window
+    }
+}
+
+impl Drop for VtkFrame<'_> {
+    fn drop(&mut self) {
+        self.commands.end_open_scopes();
+        unsafe { vtk_window_end_frame(self.window.native_handle) };
+    }
+}
+
+/// A buffer from an offset on, bound by `VtkCommandList`. Unlike a raw `VkBuffer` it may be shared
+/// with recording threads.
+#[derive(Copy, Clone, Debug, PartialEq, Eq)]
+pub struct VtkBufferBinding {
+    vk_buffer: VkBuffer,
+    offset: u64,
+}
+
+unsafe impl Send for VtkBufferBinding {}
+unsafe impl Sync for VtkBufferBinding {}
+
+/// How presented images are queued for display, trading latency against throughput and tearing.
+#[derive(Copy, Clone, Debug, PartialEq, Eq)]
+pub enum VtkPresentMode {
+    /// Wait for vertical blank, queueing presented images. Always supported.
+    Fifo,
+    /// Like `Fifo`, but present immediately (possibly tearing) if a vertical blank was missed.
+    FifoRelaxed,
+    /// Wait for vertical blank, replacing the queued image with the newest one. Low latency without tearing.
+    Mailbox,
+    /// Present immediately, possibly tearing. Lowest latency.
+    Immediate,
+}
+
+impl VtkPresentMode {
+    fn to_native(self) -> VkPresentModeKHR {
+        match self {
+            Self::Fifo => VkPresentModeKHR_VK_PRESENT_MODE_FIFO_KHR,
+            Self::FifoRelaxed => VkPresentModeKHR_VK_PRESENT_MODE_FIFO_RELAXED_KHR,
+            Self::Mailbox => VkPresentModeKHR_VK_PRESENT_MODE_MAILBOX_KHR,
+            Self::Immediate => VkPresentModeKHR_VK_PRESENT_MODE_IMMEDIATE_KHR,
+        }
+    }
+
+    fn from_native(present_mode: VkPresentModeKHR) -> Self {
+        match present_mode {
+            VkPresentModeKHR_VK_PRESENT_MODE_FIFO_RELAXED_KHR => Self::FifoRelaxed,
+            VkPresentModeKHR_VK_PRESENT_MODE_MAILBOX_KHR => Self::Mailbox,
+            VkPresentModeKHR_VK_PRESENT_MODE_IMMEDIATE_KHR => Self::Immediate,
+            _ => Self::Fifo,
+        }
+    }
+}
+
+/// The swap chain configuration chosen for a window.
+#[derive(Copy, Clone, Debug, PartialEq, Eq)]
+pub struct VtkSwapChainConfig {
+    pub present_mode: VtkPresentMode,
+    pub image_count: u32,
 }
 
 pub struct VtkShaderModule {
     vulkan_handle: VkShaderModule,
 }
 
+/// Allocates buffers, sub-allocating their memory from large device memory blocks.
+///
+/// This keeps the number of device memory allocations low, so that thousands of buffers neither
+/// hit the `maxMemoryAllocationCount` limit of the driver nor pay for a driver allocation each.
+/// Large buffers, and buffers the driver prefers on their own, get dedicated allocations.
 pub struct VtkBufferAllocator {
-    pointer: *mut std::ffi::c_void,
-    size: u64,
-    buffer: VkBuffer,
-    memory: VkDeviceMemory,
+    device: *mut VtkDeviceNative,
+}
+
+unsafe impl Send for VtkBufferAllocator {}
+
+impl VtkBufferAllocator {
+    pub fn create_buffer(
+        &self,
+        size: u64,
+        usage: VtkBufferUsage,
+        location: VtkMemoryLocation,
+    ) -> VtkBuffer {
+        let mut allocation = std::mem::MaybeUninit::uninit();
+        let vk_buffer = unsafe {
+            vtk_device_create_buffer(
+                self.device,
+                size,
+                usage.bits(),
+                location == VtkMemoryLocation::HostVisible,
+                allocation.as_mut_ptr(),
+            )
+        };
+        VtkBuffer {
+            vk_buffer,
+            allocation: unsafe { allocation.assume_init() },
+            size,
+        }
+    }
+
+    /// Destroy a buffer, returning its memory to the allocator. It must no longer be used by any
+    /// pending upload, dispatch or frame.
+    pub fn destroy_buffer(&self, mut buffer: VtkBuffer) {
+        unsafe { vtk_device_destroy_buffer(self.device, buffer.vk_buffer, &mut buffer.allocation) };
+    }
+
+    pub fn stats(&self) -> VtkMemoryStats {
+        let native = unsafe { vtk_device_memory_stats(self.device) };
+        VtkMemoryStats {
+            block_count: native.block_count,
+            dedicated_allocation_count: native.dedicated_allocation_count,
+            allocated_bytes: native.allocated_bytes,
+            allocation_count: native.allocation_count,
+            used_bytes: native.used_bytes,
+        }
+    }
+}
+
+/// Where the memory of a buffer lives.
+#[derive(Copy, Clone, Debug, Default, PartialEq, Eq)]
+pub enum VtkMemoryLocation {
+    /// Fast GPU memory, written through uploads.
+    #[default]
+    DeviceLocal,
+    /// Memory mapped into the address space of the process, written directly by the CPU.
+    HostVisible,
+}
+
+/// Device memory statistics of a device.
+#[derive(Copy, Clone, Debug, Default, PartialEq, Eq)]
+pub struct VtkMemoryStats {
+    /// Device memory blocks sub-allocated from.
+    pub block_count: u32,
+    /// Buffers with memory of their own.
+    pub dedicated_allocation_count: u32,
+    /// Bytes allocated from the driver, for blocks and dedicated allocations.
+    pub allocated_bytes: u64,
+    /// Live allocations, sub-allocated or dedicated.
+    pub allocation_count: u32,
+    /// Bytes used by live allocations, including rounding up to the allocation granularity.
+    pub used_bytes: u64,
 }
 
 include!(concat!(env!("OUT_DIR"), "/cffi_bindings.rs"));
+
+#[cfg(all(test, target_os = "linux", not(target_os = "android")))]
+mod input_tests {
+    use super::*;
+
+    extern "C" {
+        // Called by the event loop, see vtk_internal.h.
+        fn vtk_input_push(vtk_context: *mut VtkContextNative, event: *const VtkInputEventNative);
+    }
+
+    /// The input ring of a context, without the display and event loop around it.
+    struct TestInput {
+        queue: VtkInputQueue,
+        context: Box<VtkContextNative>,
+        input: crate::KeyInput,
+    }
+
+    impl TestInput {
+        fn new() -> Self {
+            let mut context: Box<VtkContextNative> = Box::new(unsafe { std::mem::zeroed() });
+            let queue = VtkInputQueue {
+                native_handle: &mut *context,
+                native_events: vec![
+                    unsafe { std::mem::zeroed() };
+                    VTK_INPUT_QUEUE_CAPACITY as usize
+                ],
+                events: Vec::new(),
+            };
+            Self {
+                queue,
+                context,
+                input: crate::KeyInput::default(),
+            }
+        }
+
+        fn push(&mut self, kind: VtkInputEventKindNative, time_ns: u64, keys: Key) {
+            self.push_native(VtkInputEventNative {
+                kind,
+                time_ns,
+                keys: keys.bits(),
+                ..unsafe { std::mem::zeroed() }
+            });
+        }
+
+        fn push_pointer(&mut self, time_ns: u64, frame: VtkPointerFrame) {
+            self.push_native(VtkInputEventNative {
+                kind: VtkInputEventKindNative_VTK_INPUT_EVENT_POINTER,
+                time_ns,
+                x: frame.x,
+                y: frame.y,
+                dx: frame.dx,
+                dy: frame.dy,
+                scroll_x: frame.scroll_x,
+                scroll_y: frame.scroll_y,
+                buttons_pressed: frame.pressed.bits(),
+                buttons_released: frame.released.bits(),
+                ..unsafe { std::mem::zeroed() }
+            });
+        }
+
+        fn push_native(&mut self, event: VtkInputEventNative) {
+            unsafe { vtk_input_push(&mut *self.context, &event) };
+        }
+
+        fn drain(&mut self) -> Vec<VtkInputEvent> {
+            self.queue.drain(&mut self.input).to_vec()
+        }
+    }
+
+    fn event(time_ns: u64, kind: VtkInputEventKind) -> VtkInputEvent {
+        VtkInputEvent {
+            time: std::time::Duration::from_nanos(time_ns),
+            kind,
+        }
+    }
+
+    #[test]
+    fn drain_reports_key_events_in_order() {
+        let mut test = TestInput::new();
+        test.push(
+            VtkInputEventKindNative_VTK_INPUT_EVENT_KEY_PRESSED,
+            1,
+            Key::W,
+        );
+        test.push(
+            VtkInputEventKindNative_VTK_INPUT_EVENT_KEY_REPEATED,
+            2,
+            Key::W,
+        );
+        test.push(
+            VtkInputEventKindNative_VTK_INPUT_EVENT_KEY_PRESSED,
+            3,
+            Key::Shift,
+        );
+        assert_eq!(
+            test.drain(),
+            [
+                event(1, VtkInputEventKind::KeyPressed(Key::W)),
+                event(2, VtkInputEventKind::KeyRepeated(Key::W)),
+                event(3, VtkInputEventKind::KeyPressed(Key::Shift)),
+            ]
+        );
+        assert!(test.input.is_held(Key::W) && test.input.is_held(Key::Shift));
+        assert!(test.input.was_pressed(Key::W) && test.input.was_pressed(Key::Shift));
+        assert!(test.input.was_repeated(Key::W) && !test.input.was_repeated(Key::Shift));
+        assert!(!test.input.was_released(Key::W));
+        assert_eq!(test.drain(), []);
+    }
+
+    #[test]
+    fn drain_resets_key_changes_but_keeps_held_keys() {
+        let mut test = TestInput::new();
+        test.push(
+            VtkInputEventKindNative_VTK_INPUT_EVENT_KEY_PRESSED,
+            1,
+            Key::A,
+        );
+        test.drain();
+        test.push(
+            VtkInputEventKindNative_VTK_INPUT_EVENT_KEY_PRESSED,
+            2,
+            Key::D,
+        );
+        test.drain();
+        assert!(test.input.is_held(Key::A) && !test.input.was_pressed(Key::A));
+        assert!(test.input.is_held(Key::D) && test.input.was_pressed(Key::D));
+
+        test.push(
+            VtkInputEventKindNative_VTK_INPUT_EVENT_KEY_RELEASED,
+            3,
+            Key::A,
+        );
+        test.drain();
+        assert!(!test.input.is_held(Key::A) && test.input.was_released(Key::A));
+        assert!(test.input.is_held(Key::D) && !test.input.was_pressed(Key::D));
+        assert_eq!(test.input.all_pressed().collect::<Vec<_>>(), [Key::D]);
+    }
+
+    #[test]
+    fn drain_reports_keys_pressed_and_released_between_drains() {
+        let mut test = TestInput::new();
+        test.push(
+            VtkInputEventKindNative_VTK_INPUT_EVENT_KEY_PRESSED,
+            1,
+            Key::S,
+        );
+        test.push(
+            VtkInputEventKindNative_VTK_INPUT_EVENT_KEY_RELEASED,
+            2,
+            Key::S,
+        );
+        assert_eq!(test.drain().len(), 2);
+        assert!(test.input.was_pressed(Key::S) && test.input.was_released(Key::S));
+        assert!(!test.input.is_held(Key::S));
+    }
+
+    #[test]
+    fn keyboard_focus_replaces_held_keys() {
+        let mut test = TestInput::new();
+        test.push(
+            VtkInputEventKindNative_VTK_INPUT_EVENT_KEY_PRESSED,
+            1,
+            Key::A,
+        );
+        test.push(
+            VtkInputEventKindNative_VTK_INPUT_EVENT_KEYBOARD_LEFT,
+            2,
+            Key::empty(),
+        );
+        test.drain();
+        assert!(!test.input.is_held(Key::A));
+
+        test.push(
+            VtkInputEventKindNative_VTK_INPUT_EVENT_KEYBOARD_ENTERED,
+            3,
+            Key::Control | Key::W,
+        );
+        assert_eq!(
+            test.drain(),
+            [event(
+                3,
+                VtkInputEventKind::KeyboardEntered(Key::Control | Key::W)
+            )]
+        );
+        assert!(test.input.is_held(Key::Control) && test.input.is_held(Key::W));
+        assert!(test.input.was_pressed(Key::Control) && test.input.was_pressed(Key::W));
+    }
+
+    #[test]
+    fn drain_coalesces_pointer_motion() {
+        let mut test = TestInput::new();
+        for i in 1..=4 {
+            let motion = VtkPointerFrame {
+                x: i as f32,
+                y: 10.0,
+                dx: 1.0,
+                dy: -0.5,
+                scroll_y: 2.0,
+                ..Default::default()
+            };
+            test.push_pointer(i, motion);
+        }
+        assert_eq!(
+            test.drain(),
+            [event(
+                4,
+                VtkInputEventKind::Pointer(VtkPointerFrame {
+                    x: 4.0,
+                    y: 10.0,
+                    dx: 4.0,
+                    dy: -2.0,
+                    scroll_y: 8.0,
+                    ..Default::default()
+                })
+            )]
+        );
+    }
+
+    #[test]
+    fn drain_keeps_pointer_button_changes_apart() {
+        let mut test = TestInput::new();
+        let motion = |x| VtkPointerFrame {
+            x,
+            dx: 1.0,
+            ..Default::default()
+        };
+        let pressed = VtkPointerFrame {
+            x: 2.0,
+            pressed: VtkPointerButtons::LEFT,
+            ..Default::default()
+        };
+        let released = VtkPointerFrame {
+            x: 4.0,
+            released: VtkPointerButtons::LEFT,
+            ..Default::default()
+        };
+        test.push_pointer(1, motion(1.0));
+        test.push_pointer(2, pressed);
+        test.push_pointer(3, motion(3.0));
+        assert_eq!(test.queue.held_buttons(), VtkPointerButtons::LEFT);
+        test.push_pointer(4, released);
+        test.push_pointer(5, motion(5.0));
+        test.push_pointer(6, motion(6.0));
+        assert_eq!(
+            test.drain(),
+            [
+                event(1, VtkInputEventKind::Pointer(motion(1.0))),
+                event(2, VtkInputEventKind::Pointer(pressed)),
+                event(3, VtkInputEventKind::Pointer(motion(3.0))),
+                event(4, VtkInputEventKind::Pointer(released)),
+                event(
+                    6,
+                    VtkInputEventKind::Pointer(VtkPointerFrame {
+                        x: 6.0,
+                        dx: 2.0,
+                        ..Default::default()
+                    })
+                ),
+            ]
+        );
+        assert_eq!(test.queue.held_buttons(), VtkPointerButtons::empty());
+    }
+
+    #[test]
+    fn pointer_leaving_releases_buttons() {
+        let mut test = TestInput::new();
+        test.push_pointer(
+            1,
+            VtkPointerFrame {
+                pressed: VtkPointerButtons::RIGHT,
+                ..Default::default()
+            },
+        );
+        test.push(
+            VtkInputEventKindNative_VTK_INPUT_EVENT_POINTER_LEFT,
+            2,
+            Key::empty(),
+        );
+        assert_eq!(test.queue.held_buttons(), VtkPointerButtons::empty());
+        assert_eq!(test.drain()[1], event(2, VtkInputEventKind::PointerLeft));
+    }
+
+    #[test]
+    fn full_ring_drops_new_events_but_tracks_held_keys() {
+        let mut test = TestInput::new();
+        for i in 0..VTK_INPUT_QUEUE_CAPACITY as u64 {
+            test.push(
+                VtkInputEventKindNative_VTK_INPUT_EVENT_KEY_REPEATED,
+                i,
+                Key::A,
+            );
+        }
+        test.push(
+            VtkInputEventKindNative_VTK_INPUT_EVENT_KEY_PRESSED,
+            1000,
+            Key::D,
+        );
+        test.push(
+            VtkInputEventKindNative_VTK_INPUT_EVENT_KEY_PRESSED,
+            1001,
+            Key::W,
+        );
+        test.push(
+            VtkInputEventKindNative_VTK_INPUT_EVENT_KEY_RELEASED,
+            1002,
+            Key::W,
+        );
+        assert_eq!(test.queue.dropped_events(), 3);
+
+        let events = test.drain();
+        assert_eq!(events.len(), VTK_INPUT_QUEUE_CAPACITY as usize);
+        assert_eq!(
+            events.last(),
+            Some(&event(
+                VTK_INPUT_QUEUE_CAPACITY as u64 - 1,
+                VtkInputEventKind::KeyRepeated(Key::A)
+            ))
+        );
+        assert!(test.input.is_held(Key::D) && !test.input.is_held(Key::W));
+        assert!(!test.input.was_pressed(Key::D));
+
+        // Draining makes room again.
+        test.push(
+            VtkInputEventKindNative_VTK_INPUT_EVENT_KEY_RELEASED,
+            1003,
+            Key::D,
+        );
+        assert_eq!(
+            test.drain(),
+            [event(1003, VtkInputEventKind::KeyReleased(Key::D))]
+        );
+        assert_eq!(test.queue.dropped_events(), 3);
+    }
+}
+
+#[cfg(test)]
+mod memory_tests {
+    use super::*;
+
+    /// The pools of an allocator, opaque outside of vtk_memory.c.
+    #[repr(C)]
+    struct VtkMemoryPool {
+        _unused: [u8; 0],
+    }
+
+    // The arithmetic of the device memory allocator, see vtk_internal.h.
+    extern "C" {
+        fn vtk_memory_create_allocator(
+            memory_properties: *const VkPhysicalDeviceMemoryProperties,
+            max_memory_allocation_count: u32,
+        ) -> *mut VtkMemoryAllocatorNative;
+        fn vtk_memory_pool(
+            allocator: *mut VtkMemoryAllocatorNative,
+            memory_type_idx: u32,
+            linear: bool,
+        ) -> *mut VtkMemoryPool;
+        fn vtk_memory_chunk_order(
+            pool: *const VtkMemoryPool,
+            size: u64,
+            alignment: u64,
+            order: *mut u32,
+        ) -> bool;
+        fn vtk_buddy_init(tree: *mut u8, block_levels: u32);
+        fn vtk_buddy_allocate(
+            tree: *mut u8,
+            block_levels: u32,
+            order: u32,
+            offset: *mut u64,
+        ) -> bool;
+        fn vtk_buddy_free(tree: *mut u8, block_levels: u32, offset: u64, order: u32);
+    }
+
+    const MIN_CHUNK_SIZE: u64 = 256;
+    const KIB: u64 = 1 << 10;
+    const MIB: u64 = 1 << 20;
+    const GIB: u64 = 1 << 30;
+
+    /// The buddy tree of a block of `MIN_CHUNK_SIZE << levels` bytes.
+    struct Buddy {
+        tree: Vec<u8>,
+        levels: u32,
+    }
+
+    impl Buddy {
+        fn new(levels: u32) -> Self {
+            let mut tree = vec![0; (2 << levels) - 1];
+            unsafe { vtk_buddy_init(tree.as_mut_ptr(), levels) };
+            Self { tree, levels }
+        }
+
+        fn allocate(&mut self, order: u32) -> Option<u64> {
+            let mut offset = 0;
+            unsafe { vtk_buddy_allocate(self.tree.as_mut_ptr(), self.levels, order, &mut offset) }
+                .then_some(offset)
+        }
+
+        fn free(&mut self, offset: u64, order: u32) {
+            unsafe { vtk_buddy_free(self.tree.as_mut_ptr(), self.levels, offset, order) };
+        }
+    }
+
+    /// Memory type `i` of the allocator lives in a heap of `heap_sizes[i]` bytes.
+    fn create_allocator(heap_sizes: &[u64]) -> *mut VtkMemoryAllocatorNative {
+        let mut properties: VkPhysicalDeviceMemoryProperties = unsafe { std::mem::zeroed() };
+        properties.memoryTypeCount = heap_sizes.len() as u32;
+        properties.memoryHeapCount = heap_sizes.len() as u32;
+        for (i, &heap_size) in heap_sizes.iter().enumerate() {
+            properties.memoryTypes[i].heapIndex = i as u32;
+            properties.memoryHeaps[i].size = heap_size;
+        }
+        // Leaked, as allocators live as long as their device.
+        unsafe { vtk_memory_create_allocator(&properties, 4096) }
+    }
+
+    /// The chunk order of a resource in memory type 0, or `None` if it gets dedicated memory.
+    fn chunk_order(
+        allocator: *mut VtkMemoryAllocatorNative,
+        size: u64,
+        alignment: u64,
+    ) -> Option<u32> {
+        let mut order = 0;
+        unsafe {
+            let pool = vtk_memory_pool(allocator, 0, true);
+            vtk_memory_chunk_order(pool, size, alignment, &mut order)
+        }
+        .then_some(order)
+    }
+
+    #[test]
+    fn buddy_splits_the_smallest_fitting_chunk() {
+        let mut buddy = Buddy::new(4);
+        assert_eq!(buddy.allocate(0), Some(0));
+        // Splitting the block left the halves, quarters and eighths after the first chunk free.
+        assert_eq!(buddy.allocate(1), Some(2 * MIN_CHUNK_SIZE));
+        assert_eq!(buddy.allocate(0), Some(MIN_CHUNK_SIZE));
+        assert_eq!(buddy.allocate(3), Some(8 * MIN_CHUNK_SIZE));
+        assert_eq!(buddy.allocate(2), Some(4 * MIN_CHUNK_SIZE));
+        assert_eq!(buddy.allocate(0), None);
+    }
+
+    #[test]
+    fn buddy_rejects_chunks_larger_than_the_largest_free_one() {
+        let mut buddy = Buddy::new(4);
+        assert_eq!(buddy.allocate(4), Some(0));
+        assert_eq!(buddy.allocate(0), None);
+        buddy.free(0, 4);
+
+        assert_eq!(buddy.allocate(0), Some(0));
+        assert_eq!(buddy.allocate(4), None);
+        assert_eq!(buddy.allocate(3), Some(8 * MIN_CHUNK_SIZE));
+        assert_eq!(buddy.allocate(3), None);
+    }
+
+    #[test]
+    fn buddy_merges_free_buddies() {
+        let mut buddy = Buddy::new(4);
+        let offsets: Vec<u64> = (0..16).map(|_| buddy.allocate(0).unwrap()).collect();
+        assert_eq!(
+            offsets,
+            (0..16).map(|i| i * MIN_CHUNK_SIZE).collect::<Vec<_>>()
+        );
+
+        // Chunks merge only with their own buddies: freeing the second and third chunk leaves no
+        // free pair.
+        buddy.free(MIN_CHUNK_SIZE, 0);
+        buddy.free(2 * MIN_CHUNK_SIZE, 0);
+        assert_eq!(buddy.allocate(1), None);
+        buddy.free(0, 0);
+        assert_eq!(buddy.allocate(1), Some(0));
+        buddy.free(0, 1);
+
+        for &offset in offsets.iter().skip(3).rev() {
+            buddy.free(offset, 0);
+        }
+        assert_eq!(buddy.allocate(4), Some(0));
+    }
+
+    #[test]
+    fn buddy_chunks_are_aligned_and_disjoint() {
+        let mut buddy = Buddy::new(10);
+        let mut chunks = Vec::new();
+        let mut random = 12345u32;
+        for _ in 0..2000 {
+            random = random.wrapping_mul(1103515245).wrapping_add(12345);
+            let order = (random >> 16) % 6;
+            if random >> 31 == 1 && !chunks.is_empty() {
+                let (offset, order) = chunks.swap_remove((random >> 8) as usize % chunks.len());
+                buddy.free(offset, order);
+            } else if let Some(offset) = buddy.allocate(order) {
+                assert_eq!(offset % (MIN_CHUNK_SIZE << order), 0);
+                assert!(offset + (MIN_CHUNK_SIZE << order) <= MIN_CHUNK_SIZE << buddy.levels);
+                chunks.push((offset, order));
+            }
+        }
+        chunks.sort();
+        for pair in chunks.windows(2) {
+            let ((offset, order), (next_offset, _)) = (pair[0], pair[1]);
+            assert!(offset + (MIN_CHUNK_SIZE << order) <= next_offset);
+        }
+
+        for (offset, order) in chunks {
+            buddy.free(offset, order);
+        }
+        assert_eq!(buddy.allocate(10), Some(0));
+    }
+
+    #[test]
+    fn chunks_cover_size_and_alignment() {
+        let allocator = create_allocator(&[8 * GIB]);
+        assert_eq!(chunk_order(allocator, 1, 1), Some(0));
+        assert_eq!(chunk_order(allocator, MIN_CHUNK_SIZE, 16), Some(0));
+        assert_eq!(chunk_order(allocator, MIN_CHUNK_SIZE + 1, 16), Some(1));
+        assert_eq!(chunk_order(allocator, 3 * KIB, 256), Some(4));
+        // Chunks are naturally aligned, so a chunk as large as the alignment satisfies it.
+        assert_eq!(chunk_order(allocator, 100, 4 * KIB), Some(4));
+        assert_eq!(chunk_order(allocator, 64 * KIB, 64 * KIB), Some(8));
+    }
+
+    #[test]
+    fn resources_of_half_a_block_get_dedicated_memory() {
+        // 64 MiB blocks.
+        let allocator = create_allocator(&[8 * GIB]);
+        assert_eq!(chunk_order(allocator, 16 * MIB, 256), Some(16));
+        assert_eq!(chunk_order(allocator, 16 * MIB + 1, 256), None);
+        assert_eq!(chunk_order(allocator, 32 * MIB, 256), None);
+        assert_eq!(chunk_order(allocator, 256, 32 * MIB), None);
+
+        // Blocks take at most an eighth of a small heap, here 32 MiB.
+        let allocator = create_allocator(&[256 * MIB]);
+        assert_eq!(chunk_order(allocator, 8 * MIB, 256), Some(15));
+        assert_eq!(chunk_order(allocator, 8 * MIB + 1, 256), None);
+
+        // But are at least 4 KiB.
+        let allocator = create_allocator(&[KIB]);
+        assert_eq!(chunk_order(allocator, KIB, 256), Some(2));
+        assert_eq!(chunk_order(allocator, KIB + 1, 256), None);
+    }
+
+    #[test]
+    fn linear_and_optimal_resources_never_share_pools() {
+        let allocator = create_allocator(&[8 * GIB, 256 * MIB]);
+        let pools: Vec<*mut VtkMemoryPool> = [(0, true), (0, false), (1, true), (1, false)]
+            .iter()
+            .map(|&(memory_type_idx, linear)| unsafe {
+                vtk_memory_pool(allocator, memory_type_idx, linear)
+            })
+            .collect();
+        for (i, pool) in pools.iter().enumerate() {
+            assert!(!pools[..i].contains(pool));
+        }
+        // The pools of a memory type share its block size.
+        for memory_type_idx in 0..2 {
+            for linear in [true, false] {
+                let mut order = 0;
+                let pool = unsafe { vtk_memory_pool(allocator, memory_type_idx, linear) };
+                let sub_allocated =
+                    unsafe { vtk_memory_chunk_order(pool, 16 * MIB, 256, &mut order) };
+                assert_eq!(sub_allocated, memory_type_idx == 0);
+            }
+        }
+    }
+}
@@ -2,20 +2,43 @@ mod cffi;
 mod rustffi;
 
 pub use cffi::*;
-use rustffi::Key;
+pub use rustffi::Key;
 
-struct KeyInput {
+/// The state of the keyboard for a frame, updated by `VtkInputQueue::drain()`.
+#[derive(Debug, Default, Clone, Copy, PartialEq, Eq)]
+pub struct KeyInput {
     bits: Key,
+    pressed: Key,
+    released: Key,
+    repeated: Key,
 }
 
 impl KeyInput {
-    fn is_held(self, key: Key) -> bool {
+    /// Whether the key is held down now.
+    pub fn is_held(self, key: Key) -> bool {
         self.bits.contains(key)
     }
 
-    fn all_pressed(self) -> bitflags::iter::Iter<Key> {
+    /// The keys held down now.
+    pub fn all_pressed(self) -> bitflags::iter::Iter<Key> {
         self.bits.iter()
     }
+
+    /// Whether the key went down since the previous drain, even if it has been released again.
+    pub fn was_pressed(self, key: Key) -> bool {
+        self.pressed.contains(key)
+    }
+
+    /// Whether the key went up since the previous drain.
+    pub fn was_released(self, key: Key) -> bool {
+        self.released.contains(key)
+    }
+
+    /// Whether the key, held down, repeated since the previous drain - as for moving a cursor in
+    /// steps.
+    pub fn was_repeated(self, key: Key) -> bool {
+        self.repeated.contains(key)
+    }
 }
 
 #[derive(Copy, Clone)]
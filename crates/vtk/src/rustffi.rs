@@ -5,7 +5,7 @@ use std::ffi::c_char;
 
 bitflags! {
     /// Represents a set of flags.
-    #[derive(Debug, Clone, Copy, PartialEq, Eq, PartialOrd, Ord, Hash)]
+    #[derive(Debug, Default, Clone, Copy, PartialEq, Eq, PartialOrd, Ord, Hash)]
     #[repr(C)]
     pub struct Key: u64 {
         const ArrowUp = 1;
@@ -35,18 +35,7 @@ pub extern "C" fn get_triangle_fragment_shader() -> *const c_char {
     "hello, world".as_ptr() as *const c_char
 }
 
+/// Called by the macOS view controller with keys pressed. Only Linux passes input events on to
+/// `VtkInputQueue` so far, so they are dropped here.
 #[no_mangle]
-pub extern "C" fn add_held_keys(held_keys: Key) {
-    for key in held_keys.iter() {
-        println!("KEY HELD: {:?}", key);
-        match key {
-            Key::ArrowUp => {
-                println!("ArrowUp from rust");
-            }
-            Key::ArrowRight => {
-                println!("ArrowRight from rust");
-            }
-            _ => {}
-        }
-    }
-}
+pub extern "C" fn add_held_keys(_held_keys: Key) {}